@@ -22,6 +22,7 @@
 #include "refactor/Tweak.h"
 #include "support/Cancellation.h"
 #include "support/Context.h"
+#include "support/MemoryRelease.h"
 #include "support/MemoryTree.h"
 #include "support/Trace.h"
 #include "clang/Tooling/Core/Replacement.h"
@@ -472,6 +473,8 @@ void ClangdLSPServer::onInitialize(const InitializeParams &Params,
     Opts.CodeComplete.BundleOverloads = Params.capabilities.HasSignatureHelp;
   Opts.CodeComplete.DocumentationFormat =
       Params.capabilities.CompletionDocumentationFormat;
+  Opts.CodeComplete.DeferDocumentation =
+      Params.capabilities.CompletionResolve;
   Opts.SignatureHelpDocumentationFormat =
       Params.capabilities.SignatureHelpDocumentationFormat;
   DiagOpts.EmbedFixesInDiagnostics = Params.capabilities.DiagnosticFixes;
@@ -505,7 +508,8 @@ void ClangdLSPServer::onInitialize(const InitializeParams &Params,
   }
   auto Mangler = CommandMangler::detect();
   Mangler.SystemIncludeExtractor =
-      getSystemIncludeExtractor(llvm::ArrayRef(Opts.QueryDriverGlobs));
+      getSystemIncludeExtractor(llvm::ArrayRef(Opts.QueryDriverGlobs),
+                                Opts.QueryDriverCacheDir);
   if (Opts.ResourceDir)
     Mangler.ResourceDir = *Opts.ResourceDir;
   CDB.emplace(BaseCDB.get(), Params.initializationOptions.fallbackFlags,
@@ -538,12 +542,13 @@ void ClangdLSPServer::onInitialize(const InitializeParams &Params,
        }},
       {"completionProvider",
        llvm::json::Object{
+           // Items only need resolving if their documentation was deferred.
+           {"resolveProvider", Params.capabilities.CompletionResolve},
            // We don't set `(` etc as allCommitCharacters as they interact
            // poorly with snippet results.
            // See https://github.com/clangd/vscode-clangd/issues/357
            // Hopefully we can use them one day without this side-effect:
            //     https://github.com/microsoft/vscode/issues/42544
-           {"resolveProvider", false},
            // We do extra checks, e.g. that > is part of ->.
            {"triggerCharacters", {".", "<", ">", ":", "\"", "/", "*"}},
        }},
@@ -580,6 +585,7 @@ void ClangdLSPServer::onInitialize(const InitializeParams &Params,
       // extension we really have support for the standardized one as well.
       {"standardTypeHierarchyProvider", true}, // clangd extension
       {"memoryUsageProvider", true},           // clangd extension
+      {"timeTraceProvider", true},             // clangd extension
       {"compilationDatabase",                  // clangd extension
        llvm::json::Object{{"automaticReload", true}}},
       {"callHierarchyProvider", true},
@@ -1065,6 +1071,27 @@ void ClangdLSPServer::onCompletion(const CompletionParams &Params,
                        });
 }
 
+void ClangdLSPServer::onCompletionItemResolve(
+    const ResolveCompletionItemParams &Params,
+    Callback<llvm::json::Value> Reply) {
+  DeferredDocumentation Deferred;
+  const llvm::json::Value *Data = Params.item.get("data");
+  llvm::json::Path::Root Root;
+  // Items without deferred documentation are complete already.
+  if (!Data || !fromJSON(*Data, Deferred, Root))
+    return Reply(llvm::json::Object(Params.item));
+  Server->resolveCompletionDocumentation(
+      Deferred, Opts.CodeComplete.DocumentationFormat,
+      [Item = Params.item, Reply = std::move(Reply)](
+          llvm::Expected<std::optional<MarkupContent>> Documentation) mutable {
+        if (!Documentation)
+          return Reply(Documentation.takeError());
+        if (*Documentation)
+          Item["documentation"] = std::move(**Documentation);
+        Reply(std::move(Item));
+      });
+}
+
 void ClangdLSPServer::onSignatureHelp(const TextDocumentPositionParams &Params,
                                       Callback<SignatureHelp> Reply) {
   Server->signatureHelp(Params.textDocument.uri.file(), Params.position,
@@ -1362,6 +1389,7 @@ void ClangdLSPServer::maybeExportMemoryProfile() {
   MemoryTree MT;
   profile(MT);
   record(MT, "clangd_lsp_server", MemoryUsage);
+  recordRetainedMemory();
 }
 
 void ClangdLSPServer::maybeCleanupMemory() {
@@ -1547,6 +1575,26 @@ void ClangdLSPServer::onMemoryUsage(const NoParams &,
   Reply(std::move(MT));
 }
 
+void ClangdLSPServer::onTimeTrace(const TimeTraceParams &Params,
+                                  Callback<std::vector<BuildTimeTrace>> Reply) {
+  PathRef File = Params.textDocument.uri.file();
+  if (Params.record)
+    Server->recordTimeTraces(File, *Params.record);
+  Reply(Server->timeTraces(File));
+}
+
+void ClangdLSPServer::onTimeTraceHotspots(
+    const TimeTraceHotspotsParams &Params,
+    Callback<std::vector<TimeTraceHotspot>> Reply) {
+  int Limit = Params.limit.value_or(50);
+  // The summary has no way to say "unlimited".
+  if (Limit <= 0)
+    return Reply(llvm::make_error<LSPError>(
+        llvm::formatv("Hotspot limit must be positive, got {0}.", Limit).str(),
+        ErrorCode::InvalidParams));
+  Reply(Server->timeTraceHotspots(Limit));
+}
+
 void ClangdLSPServer::onAST(const ASTParams &Params,
                             Callback<std::optional<ASTNode>> CB) {
   Server->getAST(Params.textDocument.uri.file(), Params.range, std::move(CB));
@@ -1583,6 +1631,8 @@ void ClangdLSPServer::bindMethods(LSPBinder &Bind,
   Bind.method("textDocument/formatting", this, &ClangdLSPServer::onDocumentFormatting);
   Bind.method("textDocument/codeAction", this, &ClangdLSPServer::onCodeAction);
   Bind.method("textDocument/completion", this, &ClangdLSPServer::onCompletion);
+  Bind.method("completionItem/resolve", this,
+              &ClangdLSPServer::onCompletionItemResolve);
   Bind.method("textDocument/signatureHelp", this, &ClangdLSPServer::onSignatureHelp);
   Bind.method("textDocument/definition", this, &ClangdLSPServer::onGoToDefinition);
   Bind.method("textDocument/declaration", this, &ClangdLSPServer::onGoToDeclaration);
@@ -1619,6 +1669,9 @@ void ClangdLSPServer::bindMethods(LSPBinder &Bind,
   Bind.method("clangd/inlayHints", this, &ClangdLSPServer::onClangdInlayHints);
   Bind.method("textDocument/inlayHint", this, &ClangdLSPServer::onInlayHint);
   Bind.method("$/memoryUsage", this, &ClangdLSPServer::onMemoryUsage);
+  Bind.method("textDocument/timeTrace", this, &ClangdLSPServer::onTimeTrace);
+  Bind.method("$/timeTraceHotspots", this,
+              &ClangdLSPServer::onTimeTraceHotspots);
   Bind.method("textDocument/foldingRange", this, &ClangdLSPServer::onFoldingRange);
   Bind.command(ApplyFixCommand, this, &ClangdLSPServer::onCommandApplyEdit);
   Bind.command(ApplyTweakCommand, this, &ClangdLSPServer::onCommandApplyTweak);
@@ -110,6 +110,8 @@ private:
                       Callback<std::vector<FoldingRange>>);
   void onCodeAction(const CodeActionParams &, Callback<llvm::json::Value>);
   void onCompletion(const CompletionParams &, Callback<CompletionList>);
+  void onCompletionItemResolve(const ResolveCompletionItemParams &,
+                               Callback<llvm::json::Value>);
   void onSignatureHelp(const TextDocumentPositionParams &,
                        Callback<SignatureHelp>);
   void onGoToDeclaration(const TextDocumentPositionParams &,
@@ -167,6 +169,14 @@ private:
   /// This is a clangd extension. Provides a json tree representing memory usage
   /// hierarchy.
   void onMemoryUsage(const NoParams &, Callback<MemoryTree>);
+  /// This is a clangd extension. Controls and returns time-trace profiles of
+  /// preamble and AST builds of a document.
+  void onTimeTrace(const TimeTraceParams &,
+                   Callback<std::vector<BuildTimeTrace>>);
+  /// This is a clangd extension. Aggregates recorded time traces to find the
+  /// most expensive headers and templates.
+  void onTimeTraceHotspots(const TimeTraceHotspotsParams &,
+                           Callback<std::vector<TimeTraceHotspot>>);
   void onCommand(const ExecuteCommandParams &, Callback<llvm::json::Value>);
 
   /// Implement commands.
@@ -23,6 +23,7 @@
 #include "SourceCode.h"
 #include "TUScheduler.h"
 #include "XRefs.h"
+#include "index/Cache.h"
 #include "index/CanonicalIncludes.h"
 #include "index/FileIndex.h"
 #include "index/Merge.h"
@@ -61,9 +62,11 @@ namespace {
 struct UpdateIndexCallbacks : public ParsingCallbacks {
   UpdateIndexCallbacks(FileIndex *FIndex,
                        ClangdServer::Callbacks *ServerCallbacks,
-                       const ThreadsafeFS &TFS, AsyncTaskRunner *Tasks)
+                       const ThreadsafeFS &TFS, AsyncTaskRunner *Tasks,
+                       TimeTraceStore &TimeTraces)
       : FIndex(FIndex), ServerCallbacks(ServerCallbacks), TFS(TFS),
-        Stdlib{std::make_shared<StdLibSet>()}, Tasks(Tasks) {}
+        Stdlib{std::make_shared<StdLibSet>()}, Tasks(Tasks),
+        TimeTraces(TimeTraces) {}
 
   void onPreambleAST(PathRef Path, llvm::StringRef Version,
                      const CompilerInvocation &CI, ASTContext &Ctx,
@@ -133,12 +136,19 @@ struct UpdateIndexCallbacks : public ParsingCallbacks {
       ServerCallbacks->onSemanticsMaybeChanged(File);
   }
 
+  void onBuildTimeTrace(PathRef File, BuildTimeTrace Trace) override {
+    vlog("Recorded {0} time trace for {1} version {2} ({3:f0} ms)",
+         toString(Trace.K), File, Trace.Version, Trace.TotalMs);
+    TimeTraces.record(File, std::move(Trace));
+  }
+
 private:
   FileIndex *FIndex;
   ClangdServer::Callbacks *ServerCallbacks;
   const ThreadsafeFS &TFS;
   std::shared_ptr<StdLibSet> Stdlib;
   AsyncTaskRunner *Tasks;
+  TimeTraceStore &TimeTraces;
 };
 
 class DraftStoreFS : public ThreadsafeFS {
@@ -176,6 +186,7 @@ ClangdServer::Options::operator TUScheduler::Options() const {
   Opts.UpdateDebounce = UpdateDebounce;
   Opts.ContextProvider = ContextProvider;
   Opts.PreambleThrottler = PreambleThrottler;
+  Opts.KeepStaleASTs = StaleASTReads;
   return Opts;
 }
 
@@ -188,7 +199,8 @@ ClangdServer::ClangdServer(const GlobalCompilationDatabase &CDB,
       UseDirtyHeaders(Opts.UseDirtyHeaders),
       LineFoldingOnly(Opts.LineFoldingOnly),
       PreambleParseForwardingFunctions(Opts.PreambleParseForwardingFunctions),
-      ImportInsertions(Opts.ImportInsertions),
+      ImportInsertions(Opts.ImportInsertions), LazyTokens(Opts.LazyTokens),
+      StaleASTReads(Opts.StaleASTReads),
       WorkspaceRoot(Opts.WorkspaceRoot),
       Transient(Opts.ImplicitCancellation ? TUScheduler::InvalidateOnUpdate
                                           : TUScheduler::NoInvalidation),
@@ -201,7 +213,7 @@ ClangdServer::ClangdServer(const GlobalCompilationDatabase &CDB,
   WorkScheduler.emplace(CDB, TUScheduler::Options(Opts),
                         std::make_unique<UpdateIndexCallbacks>(
                             DynamicIdx.get(), Callbacks, TFS,
-                            IndexTasks ? &*IndexTasks : nullptr));
+                            IndexTasks ? &*IndexTasks : nullptr, TimeTraces));
   // Adds an index to the stack, at higher priority than existing indexes.
   auto AddIndex = [&](SymbolIndex *Idx) {
     if (this->Index != nullptr) {
@@ -216,6 +228,8 @@ ClangdServer::ClangdServer(const GlobalCompilationDatabase &CDB,
   if (Opts.BackgroundIndex) {
     BackgroundIndex::Options BGOpts;
     BGOpts.ThreadPoolSize = std::max(Opts.AsyncThreadsCount, 1u);
+    BGOpts.MemoryBudget = Opts.BackgroundIndexMemoryBudget;
+    BGOpts.SharePreambles = Opts.BackgroundIndexSharePreambles;
     BGOpts.OnProgress = [Callbacks](BackgroundQueue::Stats S) {
       if (Callbacks)
         Callbacks->onBackgroundIndexProgress(S);
@@ -228,6 +242,12 @@ ClangdServer::ClangdServer(const GlobalCompilationDatabase &CDB,
         std::move(BGOpts));
     AddIndex(BackgroundIdx.get());
   }
+  // The dynamic index changes on every edit, it is not cached.
+  if (this->Index && Opts.IndexCacheSize) {
+    MergedIdx.push_back(
+        std::make_unique<CachingIndex>(*this->Index, Opts.IndexCacheSize));
+    this->Index = MergedIdx.back().get();
+  }
   if (DynamicIdx)
     AddIndex(DynamicIdx.get());
 
@@ -263,6 +283,8 @@ void ClangdServer::addDocument(PathRef File, llvm::StringRef Contents,
   ParseOptions Opts;
   Opts.PreambleParseForwardingFunctions = PreambleParseForwardingFunctions;
   Opts.ImportInsertions = ImportInsertions;
+  Opts.LazyTokens = LazyTokens;
+  Opts.RecordTimeTrace = TimeTraces.enabled(File);
 
   // Compile command is set asynchronously during update, as it can be slow.
   ParseInputs Inputs;
@@ -290,6 +312,27 @@ void ClangdServer::reparseOpenFilesIfNeeded(
                     WantDiagnostics::Auto);
 }
 
+void ClangdServer::recordTimeTraces(PathRef File, bool Enable) {
+  if (!Enable) {
+    TimeTraces.remove(File);
+    return;
+  }
+  TimeTraces.enable(File);
+  // Rebuild the preamble too, its cost is usually what we're interested in.
+  if (auto Draft = DraftMgr.getDraft(File))
+    addDocument(File, *Draft->Contents, Draft->Version, WantDiagnostics::Auto,
+                /*ForceRebuild=*/true);
+}
+
+std::vector<BuildTimeTrace> ClangdServer::timeTraces(PathRef File) const {
+  return TimeTraces.traces(File);
+}
+
+std::vector<TimeTraceHotspot>
+ClangdServer::timeTraceHotspots(size_t Limit) const {
+  return summarizeTimeTraces(TimeTraces.allTraces(), Limit);
+}
+
 std::shared_ptr<const std::string> ClangdServer::getDraft(PathRef File) const {
   auto Draft = DraftMgr.getDraft(File);
   if (!Draft)
@@ -631,21 +674,21 @@ void ClangdServer::enumerateTweaks(
                     Expected<InputsAndAST> InpAST) mutable {
     if (!InpAST)
       return CB(InpAST.takeError());
-    auto Selections = tweakSelection(Sel, *InpAST, /*FS=*/nullptr);
-    if (!Selections)
-      return CB(Selections.takeError());
-    std::vector<TweakRef> Res;
-    // Don't allow a tweak to fire more than once across ambiguous selections.
-    llvm::DenseSet<llvm::StringRef> PreparedTweaks;
-    auto DeduplicatingFilter = [&](const Tweak &T) {
-      return Filter(T) && !PreparedTweaks.count(T.id());
+    auto Begin = positionToOffset(InpAST->Inputs.Contents, Sel.start);
+    if (!Begin)
+      return CB(Begin.takeError());
+    auto End = positionToOffset(InpAST->Inputs.Contents, Sel.end);
+    if (!End)
+      return CB(End.takeError());
+    // Only built if the AST's cache doesn't know the answer yet.
+    auto Selections = [&] {
+      return llvm::cantFail(tweakSelection(Sel, *InpAST, /*FS=*/nullptr));
     };
-    for (const auto &Sel : *Selections) {
-      for (auto &T : prepareTweaks(*Sel, DeduplicatingFilter, FeatureModules)) {
-        Res.push_back({T->id(), T->title(), T->kind()});
-        PreparedTweaks.insert(T->id());
-        TweakAvailable.record(1, T->id());
-      }
+    std::vector<TweakRef> Res;
+    for (auto &T : prepareTweaks(InpAST->AST, *Begin, *End, Selections,
+                                 Filter, FeatureModules)) {
+      TweakAvailable.record(1, T.ID);
+      Res.push_back({std::move(T.ID), std::move(T.Title), T.Kind});
     }
 
     CB(std::move(Res));
@@ -702,16 +745,81 @@ void ClangdServer::applyTweak(PathRef File, Range Sel, StringRef TweakID,
   WorkScheduler->runWithAST("ApplyTweak", File, std::move(Action));
 }
 
+template <typename T>
+void ClangdServer::runAtPosition(
+    llvm::StringRef Name, PathRef File, Position Pos,
+    TUScheduler::ASTActionInvalidation Invalidation,
+    llvm::unique_function<T(const InputsAndAST &, Position)> Compute,
+    llvm::unique_function<bool(T &, const DraftMapping &)> MapBack,
+    Callback<T> CB) {
+  std::optional<DraftStore::Draft> Draft;
+  if (StaleASTReads)
+    Draft = DraftMgr.getDraft(File);
+  if (!Draft) {
+    auto Action = [Pos, Compute = std::move(Compute), CB = std::move(CB)](
+                      llvm::Expected<InputsAndAST> InpAST) mutable {
+      if (!InpAST)
+        return CB(InpAST.takeError());
+      CB(Compute(*InpAST, Pos));
+    };
+    return WorkScheduler->runWithAST(Name, File, std::move(Action),
+                                     Invalidation);
+  }
+
+  auto Action = [File = File.str(), Pos, Version = std::move(Draft->Version),
+                 Compute = std::move(Compute), MapBack = std::move(MapBack),
+                 CB = std::move(CB),
+                 this](llvm::Expected<InputsAndAST> InpAST,
+                       bool Stale) mutable {
+    if (!InpAST) {
+      CB(InpAST.takeError());
+      return true;
+    }
+    if (!Stale) {
+      CB(Compute(*InpAST, Pos));
+      return true;
+    }
+    auto Mapping = DraftMgr.getMapping(File, InpAST->Inputs.Version, Version);
+    if (!Mapping)
+      return false;
+    auto StalePos = Mapping->toOld(Pos);
+    if (!StalePos)
+      return false;
+    T Result = Compute(*InpAST, *StalePos);
+    if (!MapBack(Result, *Mapping))
+      return false;
+    CB(std::move(Result));
+    return true;
+  };
+  WorkScheduler->runWithStaleAST(Name, File, std::move(Action), Invalidation);
+}
+
 void ClangdServer::locateSymbolAt(PathRef File, Position Pos,
                                   Callback<std::vector<LocatedSymbol>> CB) {
-  auto Action = [Pos, CB = std::move(CB),
-                 this](llvm::Expected<InputsAndAST> InpAST) mutable {
-    if (!InpAST)
-      return CB(InpAST.takeError());
-    CB(clangd::locateSymbolAt(InpAST->AST, Pos, Index));
+  auto Compute = [this](const InputsAndAST &InpAST, Position Pos) {
+    return clangd::locateSymbolAt(InpAST.AST, Pos, Index);
   };
-
-  WorkScheduler->runWithAST("Definitions", File, std::move(Action));
+  // Only locations in File itself need mapping.
+  auto MapBack = [File = File.str()](std::vector<LocatedSymbol> &Symbols,
+                                     const DraftMapping &Mapping) {
+    auto MapLocation = [&](Location &Loc) {
+      if (Loc.uri.file() != File)
+        return true;
+      auto R = Mapping.toCurrent(Loc.range);
+      if (!R)
+        return false;
+      Loc.range = *R;
+      return true;
+    };
+    return llvm::all_of(Symbols, [&](LocatedSymbol &S) {
+      return MapLocation(S.PreferredDeclaration) &&
+             (!S.Definition || MapLocation(*S.Definition));
+    });
+  };
+  runAtPosition<std::vector<LocatedSymbol>>("Definitions", File, Pos,
+                                            TUScheduler::NoInvalidation,
+                                            std::move(Compute),
+                                            std::move(MapBack), std::move(CB));
 }
 
 void ClangdServer::switchSourceHeader(
@@ -736,28 +844,42 @@ void ClangdServer::switchSourceHeader(
 
 void ClangdServer::findDocumentHighlights(
     PathRef File, Position Pos, Callback<std::vector<DocumentHighlight>> CB) {
-  auto Action =
-      [Pos, CB = std::move(CB)](llvm::Expected<InputsAndAST> InpAST) mutable {
-        if (!InpAST)
-          return CB(InpAST.takeError());
-        CB(clangd::findDocumentHighlights(InpAST->AST, Pos));
-      };
-
-  WorkScheduler->runWithAST("Highlights", File, std::move(Action), Transient);
+  auto Compute = [](const InputsAndAST &InpAST, Position Pos) {
+    return clangd::findDocumentHighlights(InpAST.AST, Pos);
+  };
+  auto MapBack = [](std::vector<DocumentHighlight> &Highlights,
+                    const DraftMapping &Mapping) {
+    return llvm::all_of(Highlights, [&](DocumentHighlight &H) {
+      auto R = Mapping.toCurrent(H.range);
+      if (!R)
+        return false;
+      H.range = *R;
+      return true;
+    });
+  };
+  runAtPosition<std::vector<DocumentHighlight>>(
+      "Highlights", File, Pos, Transient, std::move(Compute),
+      std::move(MapBack), std::move(CB));
 }
 
 void ClangdServer::findHover(PathRef File, Position Pos,
                              Callback<std::optional<HoverInfo>> CB) {
-  auto Action = [File = File.str(), Pos, CB = std::move(CB),
-                 this](llvm::Expected<InputsAndAST> InpAST) mutable {
-    if (!InpAST)
-      return CB(InpAST.takeError());
+  auto Compute = [File = File.str(), this](const InputsAndAST &InpAST,
+                                           Position Pos) {
     format::FormatStyle Style = getFormatStyleForFile(
-        File, InpAST->Inputs.Contents, *InpAST->Inputs.TFS);
-    CB(clangd::getHover(InpAST->AST, Pos, std::move(Style), Index));
+        File, InpAST.Inputs.Contents, *InpAST.Inputs.TFS);
+    return clangd::getHover(InpAST.AST, Pos, std::move(Style), Index);
   };
-
-  WorkScheduler->runWithAST("Hover", File, std::move(Action), Transient);
+  auto MapBack = [](std::optional<HoverInfo> &Hover,
+                    const DraftMapping &Mapping) {
+    if (!Hover || !Hover->SymRange)
+      return true;
+    Hover->SymRange = Mapping.toCurrent(*Hover->SymRange);
+    return Hover->SymRange.has_value();
+  };
+  runAtPosition<std::optional<HoverInfo>>("Hover", File, Pos, Transient,
+                                          std::move(Compute),
+                                          std::move(MapBack), std::move(CB));
 }
 
 void ClangdServer::typeHierarchy(PathRef File, Position Pos, int Resolve,
@@ -836,6 +958,17 @@ void ClangdServer::onFileEvent(const DidChangeWatchedFilesParams &Params) {
   // invalidating other caches.
 }
 
+void ClangdServer::resolveCompletionDocumentation(
+    const DeferredDocumentation &Deferred, MarkupKind DocumentationFormat,
+    Callback<std::optional<MarkupContent>> CB) {
+  WorkScheduler->run("ResolveCompletion", /*Path=*/"",
+                     [Deferred, DocumentationFormat, CB = std::move(CB),
+                      this]() mutable {
+                       CB(resolveDocumentation(Deferred, Index,
+                                               DocumentationFormat));
+                     });
+}
+
 void ClangdServer::workspaceSymbols(
     llvm::StringRef Query, int Limit,
     Callback<std::vector<SymbolInformation>> CB) {
@@ -1080,6 +1213,7 @@ void ClangdServer::profile(MemoryTree &MT) const {
   if (BackgroundIdx)
     BackgroundIdx->profile(MT.child("background_index"));
   WorkScheduler->profile(MT.child("tuscheduler"));
+  TimeTraces.profile(MT.child("time_traces"));
 }
 } // namespace clangd
 } // namespace clang
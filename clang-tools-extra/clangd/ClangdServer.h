@@ -19,6 +19,7 @@
 #include "Protocol.h"
 #include "SemanticHighlighting.h"
 #include "TUScheduler.h"
+#include "TimeTrace.h"
 #include "XRefs.h"
 #include "index/Background.h"
 #include "index/FileIndex.h"
@@ -114,9 +115,19 @@ public:
     /// on background threads. The index is stored in the project root.
     bool BackgroundIndex = false;
     llvm::ThreadPriority BackgroundIndexPriority = llvm::ThreadPriority::Low;
+    /// Estimated memory, in bytes, that TUs indexed in parallel by the
+    /// background index may use. 0 means no limit.
+    size_t BackgroundIndexMemoryBudget = 0;
+    /// If true, the background index parses TUs that start with the same
+    /// includes on top of a shared preamble. Up to twice as many preambles as
+    /// there are indexing threads are kept in memory.
+    bool BackgroundIndexSharePreambles = false;
 
     /// If set, use this index to augment code completion results.
     SymbolIndex *StaticIndex = nullptr;
+    /// Memory, in bytes, used to cache the results of recent queries to the
+    /// static and background indexes. 0 disables the cache.
+    size_t IndexCacheSize = 0;
 
     /// If set, queried to derive a processing context for some work.
     /// Usually used to inject Config (see createConfiguredContextProvider).
@@ -160,6 +171,9 @@ public:
     /// Clangd will execute compiler drivers matching one of these globs to
     /// fetch system include path.
     std::vector<std::string> QueryDriverGlobs;
+    /// Directory where the results of querying drivers are persisted.
+    /// Empty to only cache them in memory.
+    std::string QueryDriverCacheDir;
 
     // Whether the client supports folding only complete lines.
     bool LineFoldingOnly = false;
@@ -175,6 +189,18 @@ public:
     /// instead of #include.
     bool ImportInsertions = false;
 
+    /// Build the token buffer of ASTs on first use, see ParseOptions.
+    bool LazyTokens = false;
+
+    /// Answer hover, go-to-definition and document highlights from the last
+    /// AST built while a newer one is pending, mapping positions through the
+    /// edits made since. Requests touching edited lines wait for the new AST.
+    bool StaleASTReads = false;
+
+    /// Measure the time, tokens and declarations of each header while building
+    /// preambles, see HeaderCost.h. Only reported by clangd --check for now.
+    bool MeasureHeaderCosts = false;
+
     explicit operator TUScheduler::Options() const;
   };
   // Sensible default options for use in tests.
@@ -282,6 +308,12 @@ public:
   void inlayHints(PathRef File, std::optional<Range> RestrictRange,
                   Callback<std::vector<InlayHint>>);
 
+  /// Fetch the documentation of a completion item, which was deferred by
+  /// CodeCompleteOptions::DeferDocumentation.
+  void resolveCompletionDocumentation(
+      const DeferredDocumentation &Deferred, MarkupKind DocumentationFormat,
+      Callback<std::optional<MarkupContent>> CB);
+
   /// Retrieve the top symbols from the workspace matching a query.
   void workspaceSymbols(StringRef Query, int Limit,
                         Callback<std::vector<SymbolInformation>> CB);
@@ -403,6 +435,18 @@ public:
   [[nodiscard]] bool
   blockUntilIdleForTest(std::optional<double> TimeoutSeconds = 10);
 
+  /// Starts or stops profiling preamble and AST builds of \p File with the
+  /// time-trace profiler. If the file is open, it is rebuilt immediately.
+  /// Stopping drops the traces recorded so far.
+  void recordTimeTraces(PathRef File, bool Enable);
+
+  /// Returns the latest time traces recorded for \p File.
+  std::vector<BuildTimeTrace> timeTraces(PathRef File) const;
+
+  /// Aggregates the recorded time traces of all files, returning the \p Limit
+  /// most expensive headers and templates.
+  std::vector<TimeTraceHotspot> timeTraceHotspots(size_t Limit) const;
+
   /// Builds a nested representation of memory used by components.
   void profile(MemoryTree &MT) const;
 
@@ -412,6 +456,19 @@ private:
   const ThreadsafeFS &getHeaderFS() const {
     return UseDirtyHeaders ? *DirtyFS : TFS;
   }
+
+  /// Runs \p Compute at \p Pos in the AST of \p File.
+  /// With StaleASTReads, the AST may be that of an older version of \p File:
+  /// \p Pos is mapped into it, and \p MapBack maps the ranges of the result
+  /// to the version \p Pos refers to. If either fails, the up-to-date AST is
+  /// used instead.
+  template <typename T>
+  void runAtPosition(
+      llvm::StringRef Name, PathRef File, Position Pos,
+      TUScheduler::ASTActionInvalidation Invalidation,
+      llvm::unique_function<T(const InputsAndAST &, Position)> Compute,
+      llvm::unique_function<bool(T &, const DraftMapping &)> MapBack,
+      Callback<T> CB);
   const ThreadsafeFS &TFS;
 
   Path ResourceDir;
@@ -420,12 +477,14 @@ private:
   //   - the dynamic index owned by ClangdServer (DynamicIdx)
   //   - the static index passed to the constructor
   //   - a merged view of a static and dynamic index (MergedIndex)
+  //   - a merged view of the dynamic index and a cache of recent queries to
+  //     the other indexes (CachingIndex)
   const SymbolIndex *Index = nullptr;
   // If present, an index of symbols in open files. Read via *Index.
   std::unique_ptr<FileIndex> DynamicIdx;
   // If present, the new "auto-index" maintained in background threads.
   std::unique_ptr<BackgroundIndex> BackgroundIdx;
-  // Storage for merged views of the various indexes.
+  // Storage for merged and cached views of the various indexes.
   std::vector<std::unique_ptr<SymbolIndex>> MergedIdx;
 
   // When set, provides clang-tidy options for a specific file.
@@ -440,12 +499,18 @@ private:
 
   bool ImportInsertions = false;
 
+  bool LazyTokens = false;
+
+  bool StaleASTReads = false;
+
   // GUARDED_BY(CachedCompletionFuzzyFindRequestMutex)
   llvm::StringMap<std::optional<FuzzyFindRequest>>
       CachedCompletionFuzzyFindRequestByFile;
   mutable std::mutex CachedCompletionFuzzyFindRequestMutex;
 
   std::optional<std::string> WorkspaceRoot;
+  // Time traces of files selected for profiling, written by WorkScheduler.
+  TimeTraceStore TimeTraces;
   std::optional<AsyncTaskRunner> IndexTasks; // for stdlib indexing.
   std::optional<TUScheduler> WorkScheduler;
   // Invalidation policy used for actions that we assume are "transient".
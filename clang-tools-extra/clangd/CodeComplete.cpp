@@ -323,6 +323,7 @@ struct CodeCompletionBuilder {
                         bool IsUsingDeclaration, tok::TokenKind NextTokenKind)
       : ASTCtx(ASTCtx),
         EnableFunctionArgSnippets(Opts.EnableFunctionArgSnippets),
+        DeferDocumentation(Opts.DeferDocumentation),
         IsUsingDeclaration(IsUsingDeclaration), NextTokenKind(NextTokenKind) {
     Completion.Deprecated = true; // cleared by any non-deprecated overload.
     add(C, SemaCCS);
@@ -447,7 +448,7 @@ struct CodeCompletionBuilder {
       S.SnippetSuffix = std::string(C.IndexResult->CompletionSnippetSuffix);
       S.ReturnType = std::string(C.IndexResult->ReturnType);
     }
-    if (!Completion.Documentation) {
+    if (!Completion.Documentation && !Completion.DeferredDocs) {
       auto SetDoc = [&](llvm::StringRef Doc) {
         if (!Doc.empty()) {
           Completion.Documentation.emplace();
@@ -455,7 +456,11 @@ struct CodeCompletionBuilder {
         }
       };
       if (C.IndexResult) {
-        SetDoc(C.IndexResult->Documentation);
+        // The client fetches it from the index later, if at all.
+        if (DeferDocumentation && !C.IndexResult->Documentation.empty())
+          Completion.DeferredDocs = C.IndexResult->ID;
+        else
+          SetDoc(C.IndexResult->Documentation);
       } else if (C.SemaResult) {
         const auto DocComment = getDocComment(*ASTCtx, *C.SemaResult,
                                               /*CommentsFromHeaders=*/false);
@@ -605,6 +610,7 @@ private:
   CodeCompletion Completion;
   llvm::SmallVector<BundledEntry, 1> Bundled;
   bool EnableFunctionArgSnippets;
+  bool DeferDocumentation;
   // No snippets will be generated for using declarations and when the function
   // arguments are already present.
   bool IsUsingDeclaration;
@@ -2233,7 +2239,10 @@ CompletionItem CodeCompletion::render(const CodeCompleteOptions &Opts) const {
   LSP.deprecated = Deprecated;
   // Combine header information and documentation in LSP `documentation` field.
   // This is not quite right semantically, but tends to display well in editors.
-  if (InsertInclude || Documentation) {
+  if (DeferredDocs) {
+    LSP.data = toJSON(DeferredDocumentation{
+        *DeferredDocs, InsertInclude ? InsertInclude->Header : ""});
+  } else if (InsertInclude || Documentation) {
     markup::Document Doc;
     if (InsertInclude)
       Doc.addParagraph().appendText("From ").appendCode(InsertInclude->Header);
@@ -2279,6 +2288,43 @@ CompletionItem CodeCompletion::render(const CodeCompleteOptions &Opts) const {
   return LSP;
 }
 
+llvm::json::Value toJSON(const DeferredDocumentation &D) {
+  llvm::json::Object Result{{"documentation", D.ID}};
+  if (!D.Header.empty())
+    Result["header"] = D.Header;
+  return std::move(Result);
+}
+
+bool fromJSON(const llvm::json::Value &Params, DeferredDocumentation &D,
+              llvm::json::Path P) {
+  llvm::json::ObjectMapper O(Params, P);
+  return O && O.map("documentation", D.ID) && O.mapOptional("header", D.Header);
+}
+
+std::optional<MarkupContent>
+resolveDocumentation(const DeferredDocumentation &Deferred,
+                     const SymbolIndex *Index, MarkupKind DocumentationFormat) {
+  markup::Document Doc;
+  bool Empty = true;
+  if (!Deferred.Header.empty()) {
+    Doc.addParagraph().appendText("From ").appendCode(Deferred.Header);
+    Empty = false;
+  }
+  if (Index) {
+    LookupRequest Req;
+    Req.IDs.insert(Deferred.ID);
+    Index->lookup(Req, [&](const Symbol &S) {
+      if (!S.Documentation.empty()) {
+        parseDocumentation(S.Documentation, Doc);
+        Empty = false;
+      }
+    });
+  }
+  if (Empty)
+    return std::nullopt;
+  return renderDoc(Doc, DocumentationFormat);
+}
+
 llvm::raw_ostream &operator<<(llvm::raw_ostream &OS, const CodeCompletion &C) {
   // For now just lean on CompletionItem.
   return OS << C.render(CodeCompleteOptions());
@@ -65,6 +65,11 @@ struct CodeCompleteOptions {
   /// Whether to present doc comments as plain-text or markdown.
   MarkupKind DocumentationFormat = MarkupKind::PlainText;
 
+  /// Leave documentation from the index out of completion items, and let the
+  /// client fetch it with completionItem/resolve for the item it shows.
+  /// Documentation of symbols only known to Sema is always included.
+  bool DeferDocumentation = false;
+
   enum IncludeInsertion {
     IWYU,
     NeverInsert,
@@ -238,10 +243,32 @@ struct CodeCompletion {
   /// Indicates if this item is deprecated.
   bool Deprecated = false;
 
+  /// Set instead of Documentation if it was deferred (see
+  /// CodeCompleteOptions::DeferDocumentation): the index symbol to take it
+  /// from.
+  std::optional<SymbolID> DeferredDocs;
+
   // Serialize this to an LSP completion item. This is a lossy operation.
   CompletionItem render(const CodeCompleteOptions &) const;
 };
 raw_ostream &operator<<(raw_ostream &, const CodeCompletion &);
+
+/// The `data` of a completion item whose documentation was deferred.
+struct DeferredDocumentation {
+  /// The index symbol to take documentation from.
+  SymbolID ID;
+  /// The header that would be included for the item, if any.
+  std::string Header;
+};
+llvm::json::Value toJSON(const DeferredDocumentation &);
+bool fromJSON(const llvm::json::Value &, DeferredDocumentation &,
+              llvm::json::Path);
+
+/// Renders deferred documentation as CodeCompletion::render() would have.
+/// Returns std::nullopt if there's nothing to show.
+std::optional<MarkupContent>
+resolveDocumentation(const DeferredDocumentation &Deferred,
+                     const SymbolIndex *Index, MarkupKind DocumentationFormat);
 struct CodeCompleteResult {
   std::vector<CodeCompletion> Completions;
   bool HasMore = false;
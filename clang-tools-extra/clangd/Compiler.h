@@ -42,6 +42,14 @@ struct ParseOptions {
   bool PreambleParseForwardingFunctions = false;
 
   bool ImportInsertions = false;
+
+  /// Record a compact log of the main file's expanded tokens while parsing,
+  /// and only build ParsedAST::getTokens() when it's first used.
+  bool LazyTokens = false;
+
+  /// Profile preamble and AST builds with the time-trace profiler, reporting
+  /// results via ParsingCallbacks::onBuildTimeTrace.
+  bool RecordTimeTrace = false;
 };
 
 /// Information required to run clang, e.g. to parse AST or do code completion.
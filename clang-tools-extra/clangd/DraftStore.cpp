@@ -8,6 +8,7 @@
 
 #include "DraftStore.h"
 #include "support/Logger.h"
+#include "llvm/ADT/STLExtras.h"
 #include "llvm/ADT/StringExtras.h"
 #include "llvm/Support/VirtualFileSystem.h"
 #include <memory>
@@ -16,6 +17,9 @@
 namespace clang {
 namespace clangd {
 
+// Enough for the edits of a few seconds of typing, as AST builds lag behind.
+static constexpr size_t MaxHistory = 64;
+
 std::optional<DraftStore::Draft> DraftStore::getDraft(PathRef File) const {
   std::lock_guard<std::mutex> Lock(Mutex);
 
@@ -59,6 +63,68 @@ static void increment(std::string &S) {
   }
 }
 
+// Finds the lines of \p Old that were changed to produce \p New: those between
+// the longest common prefix and suffix, extended to whole lines.
+static DraftMapping::LineEdit computeLineEdit(llvm::StringRef Old,
+                                              llvm::StringRef New) {
+  size_t Max = std::min(Old.size(), New.size());
+  size_t Prefix = 0;
+  while (Prefix < Max && Old[Prefix] == New[Prefix])
+    ++Prefix;
+  llvm::StringRef Before = Old.take_front(Prefix);
+  // npos + 1 wraps to 0 if the first line changed.
+  size_t FirstChanged = Before.rfind('\n') + 1;
+  // Don't let the suffix overlap the first changed line, in either version.
+  size_t Suffix = 0;
+  while (Suffix < Max - FirstChanged &&
+         Old[Old.size() - 1 - Suffix] == New[New.size() - 1 - Suffix])
+    ++Suffix;
+  // Lines starting inside the suffix are unchanged, and so is the one starting
+  // the suffix if it does so in both versions.
+  auto StartsLine = [&](llvm::StringRef Text) {
+    size_t Start = Text.size() - Suffix;
+    return Start == 0 || Text[Start - 1] == '\n';
+  };
+  llvm::StringRef After = Old.take_back(Suffix);
+  int Unchanged = After.count('\n') + (StartsLine(Old) && StartsLine(New));
+
+  DraftMapping::LineEdit Edit;
+  Edit.Line = Before.count('\n');
+  Edit.Removed = Old.count('\n') + 1 - Edit.Line - Unchanged;
+  Edit.Inserted = New.count('\n') + 1 - Edit.Line - Unchanged;
+  return Edit;
+}
+
+std::optional<Position> DraftMapping::toCurrent(Position P) const {
+  for (const LineEdit &E : Edits) {
+    if (P.line < E.Line)
+      continue;
+    if (P.line < E.Line + E.Removed)
+      return std::nullopt;
+    P.line += E.Inserted - E.Removed;
+  }
+  return P;
+}
+
+std::optional<Position> DraftMapping::toOld(Position P) const {
+  for (const LineEdit &E : llvm::reverse(Edits)) {
+    if (P.line < E.Line)
+      continue;
+    if (P.line < E.Line + E.Inserted)
+      return std::nullopt;
+    P.line += E.Removed - E.Inserted;
+  }
+  return P;
+}
+
+std::optional<Range> DraftMapping::toCurrent(Range R) const {
+  auto Start = toCurrent(R.start);
+  auto End = toCurrent(R.end);
+  if (!Start || !End)
+    return std::nullopt;
+  return Range{*Start, *End};
+}
+
 static void updateVersion(DraftStore::Draft &D,
                           llvm::StringRef SpecifiedVersion) {
   if (!SpecifiedVersion.empty()) {
@@ -79,10 +145,42 @@ std::string DraftStore::addDraft(PathRef File, llvm::StringRef Version,
   auto &D = Drafts[File];
   updateVersion(D.D, Version);
   std::time(&D.MTime);
+  // A new draft has nothing to map from, its first entry is a no-op.
+  DraftMapping::LineEdit Edit;
+  if (D.D.Contents && *D.D.Contents != Contents)
+    Edit = computeLineEdit(*D.D.Contents, Contents);
+  D.History.emplace_back(D.D.Version, Edit);
+  if (D.History.size() > MaxHistory)
+    D.History.pop_front();
   D.D.Contents = std::make_shared<std::string>(Contents);
   return D.D.Version;
 }
 
+std::optional<DraftMapping> DraftStore::getMapping(PathRef File,
+                                                   llvm::StringRef From,
+                                                   llvm::StringRef To) const {
+  std::lock_guard<std::mutex> Lock(Mutex);
+
+  auto It = Drafts.find(File);
+  if (It == Drafts.end())
+    return std::nullopt;
+  const auto &History = It->second.History;
+  auto Find = [&](llvm::StringRef Version) {
+    return llvm::find_if(llvm::reverse(History), [&](const auto &Entry) {
+             return Entry.first == Version;
+           }).base();
+  };
+  // Iterators past the entries of From and To.
+  auto Begin = Find(From), End = Find(To);
+  if (Begin == History.begin() || End == History.begin() || End < Begin)
+    return std::nullopt;
+  DraftMapping Result;
+  for (auto I = Begin; I != End; ++I)
+    if (I->second.Removed || I->second.Inserted)
+      Result.Edits.push_back(I->second);
+  return Result;
+}
+
 void DraftStore::removeDraft(PathRef File) {
   std::lock_guard<std::mutex> Lock(Mutex);
 
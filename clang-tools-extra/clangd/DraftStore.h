@@ -9,10 +9,12 @@
 #ifndef LLVM_CLANG_TOOLS_EXTRA_CLANGD_DRAFTSTORE_H
 #define LLVM_CLANG_TOOLS_EXTRA_CLANGD_DRAFTSTORE_H
 
+#include "Protocol.h"
 #include "support/Path.h"
 #include "clang/Basic/LLVM.h"
 #include "llvm/ADT/StringMap.h"
 #include "llvm/Support/VirtualFileSystem.h"
+#include <deque>
 #include <mutex>
 #include <optional>
 #include <string>
@@ -21,6 +23,33 @@
 namespace clang {
 namespace clangd {
 
+/// Maps positions between two versions of a draft.
+/// Edits are tracked with line granularity: lines touched by an edit have no
+/// counterpart in the other version, all others are shifted by the number of
+/// lines inserted or removed above them.
+class DraftMapping {
+public:
+  /// Whether the two versions have the same contents.
+  bool empty() const { return Edits.empty(); }
+
+  /// Maps a position in the newer version to the older one.
+  std::optional<Position> toOld(Position P) const;
+  /// Maps a position in the older version to the newer one.
+  std::optional<Position> toCurrent(Position P) const;
+  std::optional<Range> toCurrent(Range R) const;
+
+private:
+  friend class DraftStore;
+  // Lines [Line, Line+Removed) were replaced by [Line, Line+Inserted).
+  struct LineEdit {
+    int Line = 0;
+    int Removed = 0;
+    int Inserted = 0;
+  };
+  // In the order they were made.
+  std::vector<LineEdit> Edits;
+};
+
 /// A thread-safe container for files opened in a workspace, addressed by
 /// filenames. The contents are owned by the DraftStore.
 /// Each time a draft is updated, it is assigned a version. This can be
@@ -45,6 +74,12 @@ public:
   std::string addDraft(PathRef File, llvm::StringRef Version,
                        StringRef Contents);
 
+  /// \return the mapping from version \p From of \p File to the later
+  /// version \p To. std::nullopt if the file is untracked or either version is
+  /// unknown, e.g. because too many edits have been made since.
+  std::optional<DraftMapping> getMapping(PathRef File, llvm::StringRef From,
+                                         llvm::StringRef To) const;
+
   /// Remove the draft from the store.
   void removeDraft(PathRef File);
 
@@ -54,6 +89,8 @@ private:
   struct DraftAndTime {
     Draft D;
     std::time_t MTime;
+    /// Recent versions, and the edit that produced each from the previous.
+    std::deque<std::pair<std::string, DraftMapping::LineEdit>> History;
   };
   mutable std::mutex Mutex;
   llvm::StringMap<DraftAndTime> Drafts;
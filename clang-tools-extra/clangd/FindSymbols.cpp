@@ -39,21 +39,6 @@ struct ScoredSymbolGreater {
   }
 };
 
-// Returns true if \p Query can be found as a sub-sequence inside \p Scope.
-bool approximateScopeMatch(llvm::StringRef Scope, llvm::StringRef Query) {
-  assert(Scope.empty() || Scope.endswith("::"));
-  assert(Query.empty() || Query.endswith("::"));
-  while (!Scope.empty() && !Query.empty()) {
-    auto Colons = Scope.find("::");
-    assert(Colons != llvm::StringRef::npos);
-
-    llvm::StringRef LeadingSpecifier = Scope.slice(0, Colons + 2);
-    Scope = Scope.slice(Colons + 2, llvm::StringRef::npos);
-    Query.consume_front(LeadingSpecifier);
-  }
-  return Query.empty();
-}
-
 } // namespace
 
 llvm::Expected<Location> indexToLSPLocation(const SymbolLocation &Loc,
@@ -90,7 +75,8 @@ getWorkspaceSymbols(llvm::StringRef Query, int Limit,
   // Lookup for qualified names are performed as:
   // - Exact namespaces are boosted by the index.
   // - Approximate matches are (sub-scope match) included via AnyScope logic.
-  // - Non-matching namespaces (no sub-scope match) are post-filtered.
+  // - Non-matching namespaces (no sub-scope match) are filtered by the index,
+  //   and post-filtered for remote servers that predate ApproximateScope.
   auto Names = splitQualifiedName(Query);
 
   FuzzyFindRequest Req;
@@ -103,13 +89,10 @@ getWorkspaceSymbols(llvm::StringRef Query, int Limit,
   // Boost symbols from desired namespace.
   if (HasLeadingColons || !Names.first.empty())
     Req.Scopes = {std::string(Names.first)};
-  if (Limit) {
+  if (Req.AnyScope)
+    Req.ApproximateScope = std::string(Names.first);
+  if (Limit)
     Req.Limit = Limit;
-    // If we are boosting a specific scope allow more results to be retrieved,
-    // since some symbols from preferred namespaces might not make the cut.
-    if (Req.AnyScope && !Req.Scopes.empty())
-      *Req.Limit *= 5;
-  }
   TopN<ScoredSymbolInfo, ScoredSymbolGreater> Top(
       Req.Limit ? *Req.Limit : std::numeric_limits<size_t>::max());
   FuzzyMatcher Filter(Req.Query);
@@ -117,8 +100,8 @@ getWorkspaceSymbols(llvm::StringRef Query, int Limit,
   Index->fuzzyFind(Req, [HintPath, &Top, &Filter, AnyScope = Req.AnyScope,
                          ReqScope = Names.first](const Symbol &Sym) {
     llvm::StringRef Scope = Sym.Scope;
-    // Fuzzyfind might return symbols from irrelevant namespaces if query was
-    // not fully-qualified, drop those.
+    // Old remote servers ignore ApproximateScope and may return symbols from
+    // irrelevant namespaces if query was not fully-qualified, drop those.
     if (AnyScope && !approximateScopeMatch(Scope, ReqScope))
       return;
 
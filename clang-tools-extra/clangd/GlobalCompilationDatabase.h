@@ -163,11 +163,13 @@ private:
 
 /// Extracts system include search path from drivers matching QueryDriverGlobs
 /// and adds them to the compile flags.
+/// If \p CacheDir is non-empty, results are persisted there across runs.
 /// Returns null when \p QueryDriverGlobs is empty.
 using SystemIncludeExtractorFn = llvm::unique_function<void(
     tooling::CompileCommand &, llvm::StringRef) const>;
 SystemIncludeExtractorFn
-getSystemIncludeExtractor(llvm::ArrayRef<std::string> QueryDriverGlobs);
+getSystemIncludeExtractor(llvm::ArrayRef<std::string> QueryDriverGlobs,
+                          llvm::StringRef CacheDir = "");
 
 /// Wraps another compilation database, and supports overriding the commands
 /// using an in-memory mapping.
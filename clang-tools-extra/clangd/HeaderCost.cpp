@@ -0,0 +1,164 @@
+//===--- HeaderCost.cpp - Measuring the cost of included headers -*- C++-*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#include "HeaderCost.h"
+#include "clang/AST/Decl.h"
+#include "clang/AST/DeclCXX.h"
+#include "clang/AST/DeclTemplate.h"
+#include "clang/Basic/SourceManager.h"
+#include "clang/Lex/PPCallbacks.h"
+#include "clang/Lex/Preprocessor.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/StringMap.h"
+
+namespace clang {
+namespace clangd {
+
+class HeaderCostCollector::RecordFiles : public PPCallbacks {
+public:
+  RecordFiles(HeaderCostCollector &Out) : Out(Out) {}
+
+  void LexedFileChanged(FileID FID, LexedFileChangeReason Reason,
+                        SrcMgr::CharacteristicKind, FileID PrevFID,
+                        SourceLocation) override {
+    if (Reason == LexedFileChangeReason::EnterFile)
+      Out.enter(FID);
+    else
+      Out.exit(PrevFID);
+  }
+
+  void EndOfMainFile() override { Out.finish(); }
+
+private:
+  HeaderCostCollector &Out;
+};
+
+void HeaderCostCollector::collect(CompilerInstance &CI) {
+  SM = &CI.getSourceManager();
+  LastChange = Clock::now();
+  Preprocessor &PP = CI.getPreprocessor();
+  // Tokens of macro expansions are charged to the file being lexed, which is
+  // where the expansion was written.
+  PP.setTokenWatcher([this](const Token &) {
+    if (!Stack.empty())
+      ++Entries[Stack.back()].Exclusive.Tokens;
+  });
+  PP.addPPCallbacks(std::make_unique<RecordFiles>(*this));
+}
+
+void HeaderCostCollector::charge() {
+  auto Now = Clock::now();
+  if (!Stack.empty())
+    Entries[Stack.back()].Exclusive.TimeMs +=
+        std::chrono::duration<double, std::milli>(Now - LastChange).count();
+  LastChange = Now;
+}
+
+void HeaderCostCollector::enter(FileID FID) {
+  charge();
+  Entry E;
+  E.FID = FID;
+  E.Parent = Stack.empty() ? -1 : Stack.back();
+  EntryForFID[FID] = Entries.size();
+  Stack.push_back(Entries.size());
+  Entries.push_back(std::move(E));
+}
+
+void HeaderCostCollector::exit(FileID FID) {
+  charge();
+  // The lexer leaves files in the order it entered them, but be robust to
+  // skipped callbacks rather than corrupt the include tree.
+  auto It = llvm::find_if(llvm::reverse(Stack), [&](unsigned I) {
+    return Entries[I].FID == FID;
+  });
+  if (It != Stack.rend())
+    Stack.erase(std::next(It).base(), Stack.end());
+}
+
+void HeaderCostCollector::finish() {
+  charge();
+  Stack.clear();
+}
+
+void HeaderCostCollector::countDecls(ASTContext &Ctx) {
+  const SourceManager &SrcMgr = Ctx.getSourceManager();
+  auto Count = [&](const Decl *D, auto &Count) -> void {
+    if (D->isImplicit())
+      return;
+    SourceLocation Loc = SrcMgr.getExpansionLoc(D->getLocation());
+    if (Loc.isValid()) {
+      auto It = EntryForFID.find(SrcMgr.getFileID(Loc));
+      if (It != EntryForFID.end())
+        ++Entries[It->second].Exclusive.Decls;
+    }
+    // Function bodies are mostly skipped in preambles, and locals don't say
+    // much about a header's cost anyway. Only descend into scopes.
+    if (const auto *TD = llvm::dyn_cast<TemplateDecl>(D))
+      D = TD->getTemplatedDecl();
+    if (!D ||
+        !llvm::isa<NamespaceDecl, LinkageSpecDecl, ExportDecl, TagDecl>(D))
+      return;
+    for (const Decl *Child : llvm::cast<DeclContext>(D)->decls())
+      Count(Child, Count);
+  };
+  for (const Decl *D : Ctx.getTranslationUnitDecl()->decls())
+    Count(D, Count);
+}
+
+std::vector<HeaderCost> HeaderCostCollector::takeCosts() {
+  finish();
+  std::vector<HeaderCost> Result;
+  if (!SM)
+    return Result;
+
+  // Entries are created in include order, so includers precede includees.
+  std::vector<HeaderCostMetrics> Inclusive(Entries.size());
+  for (unsigned I = Entries.size(); I-- > 0;) {
+    Inclusive[I] += Entries[I].Exclusive;
+    if (Entries[I].Parent >= 0)
+      Inclusive[Entries[I].Parent] += Inclusive[I];
+  }
+
+  FileID MainFID = SM->getMainFileID();
+  llvm::StringMap<unsigned> ByPath;
+  for (unsigned I = 0; I < Entries.size(); ++I) {
+    const Entry &E = Entries[I];
+    if (E.FID == MainFID)
+      continue;
+    const FileEntry *FE = SM->getFileEntryForID(E.FID);
+    if (!FE)
+      continue;
+    // Same as IncludeStructure, so results can be matched with Inclusions.
+    llvm::StringRef Path = FE->tryGetRealPathName();
+    if (Path.empty())
+      continue;
+    auto Inserted = ByPath.try_emplace(Path, Result.size());
+    if (Inserted.second) {
+      Result.emplace_back();
+      Result.back().Path = Path.str();
+      Result.back().SourceBytes = FE->getSize();
+    }
+    HeaderCost &Cost = Result[Inserted.first->second];
+    ++Cost.Entries;
+    Cost.Exclusive += E.Exclusive;
+    Cost.Inclusive += Inclusive[I];
+    if (E.Parent >= 0 && Entries[E.Parent].FID == MainFID)
+      Cost.IncludedByMainFile = true;
+  }
+  llvm::sort(Result, [](const HeaderCost &L, const HeaderCost &R) {
+    return L.Inclusive.TimeMs > R.Inclusive.TimeMs;
+  });
+
+  Entries.clear();
+  EntryForFID.clear();
+  SM = nullptr;
+  return Result;
+}
+
+} // namespace clangd
+} // namespace clang
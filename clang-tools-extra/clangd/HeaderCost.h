@@ -0,0 +1,113 @@
+//===--- HeaderCost.h - Measuring the cost of included headers ---*- C++-*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// Attributes the cost of a preamble build to the headers it includes: the time
+// spent lexing and parsing each file, the tokens it produced and the top-level
+// declarations it contributed. Costs are reported both for the header itself
+// (exclusive) and for everything first entered through it (inclusive), which
+// is what an #include of the header costs its includer.
+//
+// This is used by `clangd --check` to find the includes most worth removing or
+// splitting.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_CLANG_TOOLS_EXTRA_CLANGD_HEADERCOST_H
+#define LLVM_CLANG_TOOLS_EXTRA_CLANGD_HEADERCOST_H
+
+#include "clang/AST/ASTContext.h"
+#include "clang/Basic/SourceLocation.h"
+#include "clang/Frontend/CompilerInstance.h"
+#include "llvm/ADT/DenseMap.h"
+#include <chrono>
+#include <string>
+#include <vector>
+
+namespace clang {
+namespace clangd {
+
+struct HeaderCostMetrics {
+  /// Wall time spent while the lexer was in the file, in milliseconds.
+  double TimeMs = 0;
+  /// Tokens produced by the preprocessor, including macro expansions.
+  unsigned Tokens = 0;
+  /// Declarations outside of function bodies.
+  unsigned Decls = 0;
+
+  HeaderCostMetrics &operator+=(const HeaderCostMetrics &RHS) {
+    TimeMs += RHS.TimeMs;
+    Tokens += RHS.Tokens;
+    Decls += RHS.Decls;
+    return *this;
+  }
+};
+
+/// The cost of one file in a build, summed over all times it was entered.
+struct HeaderCost {
+  /// Real path of the file, as in IncludeStructure.
+  std::string Path;
+  /// Size of the file's source text.
+  size_t SourceBytes = 0;
+  /// Number of times the file was entered, more than one if not guarded.
+  unsigned Entries = 0;
+  /// Whether the file is #included directly by the main file.
+  bool IncludedByMainFile = false;
+  /// The cost of the file's own contents.
+  HeaderCostMetrics Exclusive;
+  /// The cost of the file's contents and of the files it included.
+  /// Files that had already been entered from elsewhere cost nothing here.
+  HeaderCostMetrics Inclusive;
+};
+
+/// Measures the cost of each file entered during a build.
+///
+/// Usage: call collect() before the build runs (e.g. from an ASTListener),
+/// countDecls() once the AST is complete, then takeCosts().
+class HeaderCostCollector {
+public:
+  /// Installs PPCallbacks and a token watcher on CI's preprocessor.
+  /// The token watcher replaces any existing one, so this can't be used in
+  /// builds that record a syntax::TokenBuffer.
+  void collect(CompilerInstance &CI);
+
+  /// Attributes declarations in \p Ctx to the files they were parsed from.
+  void countDecls(ASTContext &Ctx);
+
+  /// Returns the costs of the files seen, most expensive (inclusive) first.
+  /// The main file and buffers without a file (e.g. <built-in>) are omitted.
+  std::vector<HeaderCost> takeCosts();
+
+private:
+  class RecordFiles;
+  using Clock = std::chrono::steady_clock;
+
+  // One entry of the lexer into a file.
+  struct Entry {
+    FileID FID;
+    // Index of the includer in Entries, or -1 for the main file.
+    int Parent = -1;
+    HeaderCostMetrics Exclusive;
+  };
+  void enter(FileID FID);
+  void exit(FileID FID);
+  void finish();
+  // Charges the time since the last file change to the current file.
+  void charge();
+
+  const SourceManager *SM = nullptr;
+  std::vector<Entry> Entries;
+  llvm::DenseMap<FileID, unsigned> EntryForFID;
+  // Indices in Entries of the files being lexed, innermost last.
+  std::vector<unsigned> Stack;
+  Clock::time_point LastChange;
+};
+
+} // namespace clangd
+} // namespace clang
+
+#endif // LLVM_CLANG_TOOLS_EXTRA_CLANGD_HEADERCOST_H
@@ -31,6 +31,7 @@
 #include "clang/Basic/SourceManager.h"
 #include "clang/Format/Format.h"
 #include "clang/Lex/HeaderSearch.h"
+#include "clang/Lex/Lexer.h"
 #include "clang/Lex/Preprocessor.h"
 #include "clang/Tooling/Core/Replacement.h"
 #include "clang/Tooling/Inclusions/HeaderIncludes.h"
@@ -172,8 +173,10 @@ collectMacroReferences(ParsedAST &AST) {
   //  FIXME: !!this is a hacky way to collect macro references.
   std::vector<include_cleaner::SymbolReference> Macros;
   auto &PP = AST.getPreprocessor();
+  // Lexing the main file is cheap, and unlike AST.getTokens() doesn't need the
+  // expanded tokens, which may not have been built yet.
   for (const syntax::Token &Tok :
-       AST.getTokens().spelledTokens(SM.getMainFileID())) {
+       syntax::tokenize(SM.getMainFileID(), SM, AST.getLangOpts())) {
     auto Macro = locateMacroAt(Tok, PP);
     if (!Macro)
       continue;
@@ -316,6 +319,27 @@ std::vector<Diag> generateUnusedIncludeDiagnostics(
   }
   return Result;
 }
+
+// The spelled range of a referenced token in the main file.
+// Tokens spelled in the main file are measured directly, so only references
+// in macro expansions need AST.getTokens(), which may be built lazily.
+std::optional<syntax::FileRange> spelledRange(ParsedAST &AST,
+                                              SourceLocation Loc) {
+  const auto &SM = AST.getSourceManager();
+  if (Loc.isFileID()) {
+    if (!SM.isWrittenInMainFile(Loc))
+      return std::nullopt;
+    return syntax::FileRange(
+        SM, Loc, Lexer::MeasureTokenLength(Loc, SM, AST.getLangOpts()));
+  }
+  const auto &Tokens = AST.getTokens();
+  auto SpelledForExpanded =
+      Tokens.spelledForExpanded(Tokens.expandedTokens(Loc));
+  if (!SpelledForExpanded)
+    return std::nullopt;
+  return syntax::Token::range(SM, SpelledForExpanded->front(),
+                              SpelledForExpanded->back());
+}
 } // namespace
 
 
@@ -382,15 +406,10 @@ IncludeCleanerFindings computeIncludeCleanerFindings(ParsedAST &AST) {
             Ref.RT != include_cleaner::RefType::Explicit)
           return;
 
-        auto &Tokens = AST.getTokens();
-        auto SpelledForExpanded =
-            Tokens.spelledForExpanded(Tokens.expandedTokens(Ref.RefLocation));
-        if (!SpelledForExpanded)
+        auto Range = spelledRange(AST, Ref.RefLocation);
+        if (!Range)
           return;
-
-        auto Range = syntax::Token::range(SM, SpelledForExpanded->front(),
-                                          SpelledForExpanded->back());
-        MissingIncludeDiagInfo DiagInfo{Ref.Target, Range, Providers};
+        MissingIncludeDiagInfo DiagInfo{Ref.Target, *Range, Providers};
         MissingIncludes.push_back(std::move(DiagInfo));
       });
   std::vector<const Inclusion *> UnusedIncludes =
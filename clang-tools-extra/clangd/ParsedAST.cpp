@@ -27,6 +27,8 @@
 #include "index/CanonicalIncludes.h"
 #include "index/Index.h"
 #include "index/Symbol.h"
+#include "refactor/Tweak.h"
+#include "support/Cancellation.h"
 #include "support/Logger.h"
 #include "support/Trace.h"
 #include "clang/AST/ASTContext.h"
@@ -72,8 +74,8 @@ template <class T> std::size_t getUsedBytes(const std::vector<T> &Vec) {
 
 class DeclTrackingASTConsumer : public ASTConsumer {
 public:
-  DeclTrackingASTConsumer(std::vector<Decl *> &TopLevelDecls)
-      : TopLevelDecls(TopLevelDecls) {}
+  DeclTrackingASTConsumer(std::vector<Decl *> &TopLevelDecls, bool &Aborted)
+      : TopLevelDecls(TopLevelDecls), Aborted(Aborted) {}
 
   bool HandleTopLevelDecl(DeclGroupRef DG) override {
     for (Decl *D : DG) {
@@ -90,25 +92,32 @@ public:
 
       TopLevelDecls.push_back(D);
     }
-    return true;
+    // Stop parsing if the build is no longer needed, e.g. the file changed.
+    Aborted = isCancelled();
+    return !Aborted;
   }
 
 private:
   std::vector<Decl *> &TopLevelDecls;
+  bool &Aborted;
 };
 
 class ClangdFrontendAction : public SyntaxOnlyAction {
 public:
   std::vector<Decl *> takeTopLevelDecls() { return std::move(TopLevelDecls); }
+  /// Whether parsing stopped early because the context was cancelled.
+  bool wasAborted() const { return Aborted; }
 
 protected:
   std::unique_ptr<ASTConsumer>
   CreateASTConsumer(CompilerInstance &CI, llvm::StringRef InFile) override {
-    return std::make_unique<DeclTrackingASTConsumer>(/*ref*/ TopLevelDecls);
+    return std::make_unique<DeclTrackingASTConsumer>(/*ref*/ TopLevelDecls,
+                                                     /*ref*/ Aborted);
   }
 
 private:
   std::vector<Decl *> TopLevelDecls;
+  bool Aborted = false;
 };
 
 // When using a preamble, only preprocessor events outside its bounds are seen.
@@ -630,7 +639,8 @@ ParsedAST::build(llvm::StringRef Filename, const ParseInputs &Inputs,
   Clang->getPreprocessor().addCommentHandler(IWYUHandler.get());
 
   // Collect tokens of the main file.
-  syntax::TokenCollector CollectTokens(Clang->getPreprocessor());
+  syntax::TokenCollector CollectTokens(Clang->getPreprocessor(),
+                                       /*RecordLog=*/Inputs.Opts.LazyTokens);
 
   // To remain consistent with preamble builds, these callbacks must be called
   // exactly here, after preprocessor is initialized and BeginSourceFile() was
@@ -641,13 +651,28 @@ ParsedAST::build(llvm::StringRef Filename, const ParseInputs &Inputs,
   if (llvm::Error Err = Action->Execute())
     log("Execute() failed when building AST for {0}: {1}", MainInput.getFile(),
         toString(std::move(Err)));
+  if (Action->wasAborted()) {
+    log("Aborted AST build for {0} version {1}", Filename, Inputs.Version);
+    // The token stream is truncated, don't try to map it.
+    Clang->getPreprocessor().setTokenWatcher(nullptr);
+    // The AST is incomplete, tear it down like ~ParsedAST() would.
+    Clang->getDiagnostics().setClient(new IgnoreDiagnostics);
+    Action->EndSourceFile();
+    return std::nullopt;
+  }
 
   // We have to consume the tokens before running clang-tidy to avoid collecting
   // tokens from running the preprocessor inside the checks (only
   // modernize-use-trailing-return-type does that today).
-  syntax::TokenBuffer Tokens = std::move(CollectTokens).consume();
-  // Makes SelectionTree build much faster.
-  Tokens.indexExpandedTokens();
+  syntax::TokenBuffer Tokens(Clang->getSourceManager());
+  std::optional<syntax::TokenLog> TokenLog;
+  if (Inputs.Opts.LazyTokens) {
+    TokenLog = std::move(CollectTokens).consumeLog();
+  } else {
+    Tokens = std::move(CollectTokens).consume();
+    // Makes SelectionTree build much faster.
+    Tokens.indexExpandedTokens();
+  }
   std::vector<Decl *> ParsedDecls = Action->takeTopLevelDecls();
   // AST traversals should exclude the preamble, to avoid performance cliffs.
   Clang->getASTContext().setTraversalScope(ParsedDecls);
@@ -684,9 +709,9 @@ ParsedAST::build(llvm::StringRef Filename, const ParseInputs &Inputs,
   }
   ParsedAST Result(Filename, Inputs.Version, std::move(Preamble),
                    std::move(Clang), std::move(Action), std::move(Tokens),
-                   std::move(Macros), std::move(Marks), std::move(ParsedDecls),
-                   std::move(Diags), std::move(Includes),
-                   std::move(CanonIncludes));
+                   std::move(TokenLog), std::move(Macros), std::move(Marks),
+                   std::move(ParsedDecls), std::move(Diags),
+                   std::move(Includes), std::move(CanonIncludes));
   if (Result.Diags)
     llvm::move(issueIncludeCleanerDiagnostics(Result, Inputs.Contents),
                std::back_inserter(*Result.Diags));
@@ -734,6 +759,26 @@ llvm::ArrayRef<const Decl *> ParsedAST::getLocalTopLevelDecls() const {
   return LocalTopLevelDecls;
 }
 
+const syntax::TokenBuffer &ParsedAST::getTokens() const {
+  // This mutates the AST despite being const. It is not synchronized, which is
+  // fine as TUScheduler never lets two threads use the same ParsedAST at once.
+  // Other owners of a ParsedAST must do the same.
+  if (TokenLog) {
+    trace::Span Tracer("BuildTokenBuffer");
+    SPAN_ATTACH(Tracer, "expanded", static_cast<int64_t>(TokenLog->size()));
+    Tokens = std::move(*TokenLog).build(getSourceManager(), getLangOpts());
+    Tokens.indexExpandedTokens();
+    TokenLog.reset();
+  }
+  return Tokens;
+}
+
+TweakCache &ParsedAST::getTweakCache() const {
+  if (!Tweaks)
+    Tweaks = std::make_unique<TweakCache>();
+  return *Tweaks;
+}
+
 const MainFileMacros &ParsedAST::getMacros() const { return Macros; }
 const std::vector<PragmaMark> &ParsedAST::getMarks() const { return Marks; }
 
@@ -766,6 +811,8 @@ std::size_t ParsedAST::getUsedBytes() const {
     Total += PRec->getTotalMemory();
   Total += PP.getHeaderSearchInfo().getTotalMemory();
 
+  Total += TokenLog ? TokenLog->getMemoryUsage() : Tokens.getMemoryUsage();
+
   return Total;
 }
 
@@ -781,15 +828,17 @@ ParsedAST::ParsedAST(PathRef TUPath, llvm::StringRef Version,
                      std::shared_ptr<const PreambleData> Preamble,
                      std::unique_ptr<CompilerInstance> Clang,
                      std::unique_ptr<FrontendAction> Action,
-                     syntax::TokenBuffer Tokens, MainFileMacros Macros,
-                     std::vector<PragmaMark> Marks,
+                     syntax::TokenBuffer Tokens,
+                     std::optional<syntax::TokenLog> TokenLog,
+                     MainFileMacros Macros, std::vector<PragmaMark> Marks,
                      std::vector<Decl *> LocalTopLevelDecls,
                      std::optional<std::vector<Diag>> Diags,
                      IncludeStructure Includes, CanonicalIncludes CanonIncludes)
     : TUPath(TUPath), Version(Version), Preamble(std::move(Preamble)),
       Clang(std::move(Clang)), Action(std::move(Action)),
-      Tokens(std::move(Tokens)), Macros(std::move(Macros)),
-      Marks(std::move(Marks)), Diags(std::move(Diags)),
+      Tokens(std::move(Tokens)), TokenLog(std::move(TokenLog)),
+      Macros(std::move(Macros)), Marks(std::move(Marks)),
+      Diags(std::move(Diags)),
       LocalTopLevelDecls(std::move(LocalTopLevelDecls)),
       Includes(std::move(Includes)), CanonIncludes(std::move(CanonIncludes)) {
   Resolver = std::make_unique<HeuristicResolver>(getASTContext());
@@ -42,6 +42,7 @@ namespace clang {
 class Sema;
 namespace clangd {
 class HeuristicResolver;
+class TweakCache;
 
 /// Stores and provides access to parsed AST.
 class ParsedAST {
@@ -49,6 +50,8 @@ public:
   /// Attempts to run Clang and store the parsed AST.
   /// If \p Preamble is non-null it is reused during parsing.
   /// This function does not check if preamble is valid to reuse.
+  /// If the current context is cancelled while parsing, parsing stops at the
+  /// next top-level declaration and std::nullopt is returned.
   static std::optional<ParsedAST>
   build(llvm::StringRef Filename, const ParseInputs &Inputs,
         std::unique_ptr<clang::CompilerInvocation> CI,
@@ -106,7 +109,9 @@ public:
   const std::vector<PragmaMark> &getMarks() const;
   /// Tokens recorded while parsing the main file.
   /// (!) does not have tokens from the preamble.
-  const syntax::TokenBuffer &getTokens() const { return Tokens; }
+  /// With ParseOptions::LazyTokens, this is built on the first call, which
+  /// is not thread-safe (like any other use of the AST).
+  const syntax::TokenBuffer &getTokens() const;
   /// Returns the PramaIncludes from the preamble.
   /// Might be null if AST is built without a preamble.
   const include_cleaner::PragmaIncludes *getPragmaIncludes() const;
@@ -125,12 +130,16 @@ public:
     return Resolver.get();
   }
 
+  /// Tweaks known to be available (or not) on this AST, see prepareTweaks().
+  TweakCache &getTweakCache() const;
+
 private:
   ParsedAST(PathRef TUPath, llvm::StringRef Version,
             std::shared_ptr<const PreambleData> Preamble,
             std::unique_ptr<CompilerInstance> Clang,
             std::unique_ptr<FrontendAction> Action, syntax::TokenBuffer Tokens,
-            MainFileMacros Macros, std::vector<PragmaMark> Marks,
+            std::optional<syntax::TokenLog> TokenLog, MainFileMacros Macros,
+            std::vector<PragmaMark> Marks,
             std::vector<Decl *> LocalTopLevelDecls,
             std::optional<std::vector<Diag>> Diags, IncludeStructure Includes,
             CanonicalIncludes CanonIncludes);
@@ -151,7 +160,12 @@ private:
   ///   - Includes all spelled tokens for the main file.
   ///   - Includes expanded tokens produced **after** preamble.
   ///   - Does not have spelled or expanded tokens for files from preamble.
-  syntax::TokenBuffer Tokens;
+  /// Empty until getTokens() builds it from TokenLog, if that is set.
+  mutable syntax::TokenBuffer Tokens;
+  /// The tokens recorded for a lazy build of Tokens.
+  /// Like the rest of ParsedAST, this isn't guarded: only one thread may use
+  /// the AST at a time.
+  mutable std::optional<syntax::TokenLog> TokenLog;
 
   /// All macro definitions and expansions in the main file.
   MainFileMacros Macros;
@@ -166,6 +180,8 @@ private:
   IncludeStructure Includes;
   CanonicalIncludes CanonIncludes;
   std::unique_ptr<HeuristicResolver> Resolver;
+  /// Created on the first code action request, most ASTs never see one.
+  mutable std::unique_ptr<TweakCache> Tweaks;
 };
 
 } // namespace clangd
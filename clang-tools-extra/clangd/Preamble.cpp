@@ -14,6 +14,7 @@
 #include "Protocol.h"
 #include "SourceCode.h"
 #include "clang-include-cleaner/Record.h"
+#include "support/Cancellation.h"
 #include "support/Logger.h"
 #include "support/ThreadsafeFS.h"
 #include "support/Trace.h"
@@ -171,6 +172,11 @@ public:
     return false;
   }
 
+  // The scheduler cancels the context of builds made obsolete by newer edits.
+  // Cancellation is only polled after each top-level decl and once before the
+  // ASTWriter runs, so a long decl or the serialization isn't interrupted.
+  bool shouldAbort() override { return isCancelled(); }
+
   bool shouldSkipFunctionBody(Decl *D) override {
     // Usually we don't need to look inside the bodies of header functions
     // to understand the program. However when forwarding function like
@@ -675,6 +681,11 @@ buildPreamble(PathRef FileName, CompilerInvocation CI,
     return Result;
   }
 
+  if (BuiltPreamble.getError() == BuildPreambleError::Aborted) {
+    log("Aborted preamble build for file {0} version {1} after {2} seconds",
+        FileName, Inputs.Version, PreambleTimer.getTime());
+    return nullptr;
+  }
   elog("Could not build a preamble for file {0} version {1}: {2}", FileName,
        Inputs.Version, BuiltPreamble.getError().message());
   for (const Diag &D : PreambleDiagnostics.take()) {
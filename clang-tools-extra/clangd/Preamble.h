@@ -101,6 +101,10 @@ struct PreambleBuildStats {
 /// If \p PreambleCallback is set, it will be run on top of the AST while
 /// building the preamble.
 /// If Stats is not non-null, build statistics will be exported there.
+/// If the current context is cancelled during the build, it stops at the next
+/// top-level declaration and returns null. Cancellation is only polled after
+/// each top-level declaration and once before the PCH is written, which isn't
+/// interrupted once started.
 std::shared_ptr<const PreambleData>
 buildPreamble(PathRef FileName, CompilerInvocation CI,
               const ParseInputs &Inputs, bool StoreInMemory,
@@ -355,6 +355,11 @@ bool fromJSON(const llvm::json::Value &Params, ClientCapabilities &R,
       if (auto *Item = Completion->getObject("completionItem")) {
         if (auto SnippetSupport = Item->getBoolean("snippetSupport"))
           R.CompletionSnippets = *SnippetSupport;
+        // Only documentation is deferred, so that's what must be resolvable.
+        if (auto *ResolveSupport = Item->getObject("resolveSupport"))
+          if (auto *Properties = ResolveSupport->getArray("properties"))
+            R.CompletionResolve =
+                llvm::is_contained(*Properties, "documentation");
         if (const auto *DocumentationFormat =
                 Item->getArray("documentationFormat")) {
           for (const auto &Format : *DocumentationFormat) {
@@ -1034,6 +1039,8 @@ llvm::json::Value toJSON(const CompletionItem &CI) {
   if (CI.deprecated)
     Result["deprecated"] = CI.deprecated;
   Result["score"] = CI.score;
+  if (CI.data)
+    Result["data"] = *CI.data;
   return std::move(Result);
 }
 
@@ -1047,6 +1054,17 @@ bool operator<(const CompletionItem &L, const CompletionItem &R) {
          (R.sortText.empty() ? R.label : R.sortText);
 }
 
+bool fromJSON(const llvm::json::Value &Params, ResolveCompletionItemParams &R,
+              llvm::json::Path P) {
+  const auto *Item = Params.getAsObject();
+  if (!Item) {
+    P.report("expected completion item");
+    return false;
+  }
+  R.item = *Item;
+  return true;
+}
+
 llvm::json::Value toJSON(const CompletionList &L) {
   return llvm::json::Object{
       {"isIncomplete", L.isIncomplete},
@@ -1510,6 +1528,19 @@ bool fromJSON(const llvm::json::Value &Params, ASTParams &R,
   return O && O.map("textDocument", R.textDocument) && O.map("range", R.range);
 }
 
+bool fromJSON(const llvm::json::Value &Params, TimeTraceParams &R,
+              llvm::json::Path P) {
+  llvm::json::ObjectMapper O(Params, P);
+  return O && O.map("textDocument", R.textDocument) &&
+         O.map("record", R.record);
+}
+
+bool fromJSON(const llvm::json::Value &Params, TimeTraceHotspotsParams &R,
+              llvm::json::Path P) {
+  llvm::json::ObjectMapper O(Params, P);
+  return O && O.map("limit", R.limit);
+}
+
 llvm::json::Value toJSON(const ASTNode &N) {
   llvm::json::Object Result{
       {"role", N.role},
@@ -434,6 +434,10 @@ struct ClientCapabilities {
   /// textDocument.completion.completionItem.snippetSupport
   bool CompletionSnippets = false;
 
+  /// Client can resolve the documentation of completion items lazily.
+  /// textDocument.completion.completionItem.resolveSupport.properties
+  bool CompletionResolve = false;
+
   /// Client supports completions with additionalTextEdit near the cursor.
   /// This is a clangd extension. (LSP says this is for unrelated text only).
   /// textDocument.completion.editsNearCursor
@@ -1277,19 +1281,26 @@ struct CompletionItem {
   /// This is a clangd extension.
   float score = 0.f;
 
+  /// A data entry field that is preserved on a completion item between a
+  /// completion and a completion resolve request.
+  std::optional<llvm::json::Value> data;
+
   // TODO: Add custom commitCharacters for some of the completion items. For
   // example, it makes sense to use () only for the functions.
-  // TODO(krasimir): The following optional fields defined by the language
-  // server protocol are unsupported:
-  //
-  // data?: any - A data entry field that is preserved on a completion item
-  //              between a completion and a completion resolve request.
 };
 llvm::json::Value toJSON(const CompletionItem &);
 llvm::raw_ostream &operator<<(llvm::raw_ostream &, const CompletionItem &);
 
 bool operator<(const CompletionItem &, const CompletionItem &);
 
+/// The item passed to completionItem/resolve. Only its `data` is read, the
+/// other fields are sent back unchanged.
+struct ResolveCompletionItemParams {
+  llvm::json::Object item;
+};
+bool fromJSON(const llvm::json::Value &, ResolveCompletionItemParams &,
+              llvm::json::Path);
+
 /// Represents a collection of completion items to be presented in the editor.
 struct CompletionList {
   /// The list is not complete. Further typing should result in recomputing the
@@ -1876,6 +1887,29 @@ struct ASTNode {
 llvm::json::Value toJSON(const ASTNode &);
 llvm::raw_ostream &operator<<(llvm::raw_ostream &, const ASTNode &);
 
+/// Payload for textDocument/timeTrace request.
+/// This request is a clangd extension.
+struct TimeTraceParams {
+  /// The text document.
+  TextDocumentIdentifier textDocument;
+
+  /// If set, starts (true) or stops (false) profiling builds of the document.
+  /// Starting rebuilds the document; the traces are available once the
+  /// rebuild completes. Stopping discards the recorded traces.
+  std::optional<bool> record;
+};
+bool fromJSON(const llvm::json::Value &, TimeTraceParams &, llvm::json::Path);
+
+/// Payload for $/timeTraceHotspots request.
+/// This request is a clangd extension.
+struct TimeTraceHotspotsParams {
+  /// The maximum number of hotspots to return, which must be positive.
+  /// Defaults to 50.
+  std::optional<int> limit;
+};
+bool fromJSON(const llvm::json::Value &, TimeTraceHotspotsParams &,
+              llvm::json::Path);
+
 } // namespace clangd
 } // namespace clang
 
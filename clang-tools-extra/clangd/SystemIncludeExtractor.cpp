@@ -28,11 +28,18 @@
 // database is used as compiler driver path. Due to this arbitrary binary
 // execution, this mechanism is not used by default and only executes binaries
 // in the paths that are explicitly included by the user.
+//
+// Querying a driver can take seconds, so results are optionally persisted on
+// disk. Each entry records the size, modification time and digest of the
+// driver it was extracted from, and is discarded once the driver changes.
+// Persisted queries are answered again at startup, a few at a time, as they
+// are likely to be made again. Only the most recently written ones are kept.
 
 #include "CompileCommands.h"
 #include "GlobalCompilationDatabase.h"
 #include "support/Logger.h"
 #include "support/Path.h"
+#include "support/Threading.h"
 #include "support/Trace.h"
 #include "clang/Basic/Diagnostic.h"
 #include "clang/Basic/TargetInfo.h"
@@ -44,14 +51,23 @@
 #include "llvm/ADT/StringExtras.h"
 #include "llvm/ADT/StringRef.h"
 #include "llvm/Support/FileSystem.h"
+#include "llvm/Support/FileUtilities.h"
+#include "llvm/Support/JSON.h"
 #include "llvm/Support/MemoryBuffer.h"
 #include "llvm/Support/Path.h"
 #include "llvm/Support/Program.h"
 #include "llvm/Support/Regex.h"
 #include "llvm/Support/ScopedPrinter.h"
+#include "llvm/Support/ThreadPool.h"
+#include "llvm/Support/Threading.h"
+#include "llvm/Support/xxhash.h"
 #include <algorithm>
+#include <chrono>
+#include <functional>
+#include <future>
 #include <iterator>
 #include <map>
+#include <memory>
 #include <optional>
 #include <string>
 #include <vector>
@@ -136,13 +152,45 @@ std::optional<DriverInfo> parseDriverOutput(llvm::StringRef Output) {
   return std::move(Info);
 }
 
-std::optional<DriverInfo>
-extractSystemIncludesAndTarget(llvm::SmallString<128> Driver,
-                               llvm::StringRef Lang,
-                               llvm::ArrayRef<std::string> CommandLine,
-                               const llvm::Regex &QueryDriverRegex) {
-  trace::Span Tracer("Extract system includes and target");
+// Returns the flags of \p CommandLine that affect the system include paths, and
+// so must be passed on to the driver when querying it.
+std::vector<std::string>
+preservedFlags(llvm::ArrayRef<std::string> CommandLine) {
+  std::vector<std::string> Flags;
+  // These flags will be preserved
+  const llvm::StringRef FlagsToPreserve[] = {
+      "-nostdinc", "--no-standard-includes", "-nostdinc++", "-nobuiltininc"};
+  // Preserves these flags and their values, either as separate args or with an
+  // equalsbetween them
+  const llvm::StringRef ArgsToPreserve[] = {"--sysroot", "-isysroot"};
+
+  for (size_t I = 0, E = CommandLine.size(); I < E; ++I) {
+    llvm::StringRef Arg = CommandLine[I];
+    if (llvm::is_contained(FlagsToPreserve, Arg)) {
+      Flags.push_back(Arg.str());
+    } else {
+      const auto *Found =
+          llvm::find_if(ArgsToPreserve, [&Arg](llvm::StringRef S) {
+            return Arg.startswith(S);
+          });
+      if (Found == std::end(ArgsToPreserve))
+        continue;
+      Arg = Arg.drop_front(Found->size());
+      if (Arg.empty() && I + 1 < E) {
+        Flags.push_back(CommandLine[I]);
+        Flags.push_back(CommandLine[++I]);
+      } else if (Arg.startswith("=")) {
+        Flags.push_back(CommandLine[I]);
+      }
+    }
+  }
+  return Flags;
+}
 
+// Resolves \p Driver to an absolute path, and checks it is allowed to be
+// executed.
+bool resolveDriver(llvm::SmallString<128> &Driver,
+                   const llvm::Regex &QueryDriverRegex) {
   if (!llvm::sys::path::is_absolute(Driver)) {
     assert(llvm::none_of(
         Driver, [](char C) { return llvm::sys::path::is_separator(C); }));
@@ -153,17 +201,24 @@ extractSystemIncludesAndTarget(llvm::SmallString<128> Driver,
       Driver = *DriverProgram;
     } else {
       elog("System include extraction: driver {0} not found in PATH", Driver);
-      return std::nullopt;
+      return false;
     }
   }
 
-  SPAN_ATTACH(Tracer, "driver", Driver);
-  SPAN_ATTACH(Tracer, "lang", Lang);
-
   if (!QueryDriverRegex.match(Driver)) {
     vlog("System include extraction: not allowed driver {0}", Driver);
-    return std::nullopt;
+    return false;
   }
+  return true;
+}
+
+// Runs the resolved \p Driver to extract its system includes and target.
+std::optional<DriverInfo>
+extractSystemIncludesAndTarget(llvm::StringRef Driver, llvm::StringRef Lang,
+                               llvm::ArrayRef<std::string> Flags) {
+  trace::Span Tracer("Extract system includes and target");
+  SPAN_ATTACH(Tracer, "driver", Driver);
+  SPAN_ATTACH(Tracer, "lang", Lang);
 
   llvm::SmallString<128> StdErrPath;
   if (auto EC = llvm::sys::fs::createTemporaryFile("system-includes", "clangd",
@@ -180,34 +235,7 @@ extractSystemIncludesAndTarget(llvm::SmallString<128> Driver,
 
   llvm::SmallVector<llvm::StringRef> Args = {Driver, "-E", "-x",
                                              Lang,   "-",  "-v"};
-
-  // These flags will be preserved
-  const llvm::StringRef FlagsToPreserve[] = {
-      "-nostdinc", "--no-standard-includes", "-nostdinc++", "-nobuiltininc"};
-  // Preserves these flags and their values, either as separate args or with an
-  // equalsbetween them
-  const llvm::StringRef ArgsToPreserve[] = {"--sysroot", "-isysroot"};
-
-  for (size_t I = 0, E = CommandLine.size(); I < E; ++I) {
-    llvm::StringRef Arg = CommandLine[I];
-    if (llvm::is_contained(FlagsToPreserve, Arg)) {
-      Args.push_back(Arg);
-    } else {
-      const auto *Found =
-          llvm::find_if(ArgsToPreserve, [&Arg](llvm::StringRef S) {
-            return Arg.startswith(S);
-          });
-      if (Found == std::end(ArgsToPreserve))
-        continue;
-      Arg = Arg.drop_front(Found->size());
-      if (Arg.empty() && I + 1 < E) {
-        Args.push_back(CommandLine[I]);
-        Args.push_back(CommandLine[++I]);
-      } else if (Arg.startswith("=")) {
-        Args.push_back(CommandLine[I]);
-      }
-    }
-  }
+  Args.append(Flags.begin(), Flags.end());
 
   std::string ErrMsg;
   if (int RC = llvm::sys::ExecuteAndWait(Driver, Args, /*Env=*/std::nullopt,
@@ -236,6 +264,204 @@ extractSystemIncludesAndTarget(llvm::SmallString<128> Driver,
   return Info;
 }
 
+// Identifies the version of a driver binary that a result was extracted from.
+struct DriverStamp {
+  std::string Path;
+  uint64_t Size = 0;
+  int64_t ModificationTime = 0;
+  // xxHash64 of the driver's contents. Only computed when an entry is written,
+  // and when the modification time no longer matches.
+  std::string Digest;
+};
+
+std::optional<DriverStamp> statDriver(llvm::StringRef Path) {
+  llvm::sys::fs::file_status Status;
+  if (llvm::sys::fs::status(Path, Status))
+    return std::nullopt;
+  DriverStamp Stamp;
+  Stamp.Path = Path.str();
+  Stamp.Size = Status.getSize();
+  Stamp.ModificationTime =
+      std::chrono::duration_cast<std::chrono::nanoseconds>(
+          Status.getLastModificationTime().time_since_epoch())
+          .count();
+  return Stamp;
+}
+
+std::optional<std::string> digestDriver(llvm::StringRef Path) {
+  auto Buf = llvm::MemoryBuffer::getFile(Path, /*IsText=*/false,
+                                         /*RequiresNullTerminator=*/false);
+  if (!Buf)
+    return std::nullopt;
+  return llvm::utohexstr(llvm::xxHash64(Buf->get()->getBuffer()));
+}
+
+// A driver query persisted on disk, along with its result.
+struct PersistedQuery {
+  // The query, as it appears in the compile command.
+  std::string Driver;
+  std::string Lang;
+  std::vector<std::string> Flags;
+  // The driver binary that answered it.
+  DriverStamp Stamp;
+  DriverInfo Info;
+};
+
+llvm::json::Value toJSON(const PersistedQuery &Q) {
+  return llvm::json::Object{
+      {"driver", Q.Driver},
+      {"lang", Q.Lang},
+      {"flags", Q.Flags},
+      {"path", Q.Stamp.Path},
+      {"size", static_cast<int64_t>(Q.Stamp.Size)},
+      {"mtime", Q.Stamp.ModificationTime},
+      {"digest", Q.Stamp.Digest},
+      {"includes", Q.Info.SystemIncludes},
+      {"target", Q.Info.Target},
+  };
+}
+
+bool fromJSON(const llvm::json::Value &Params, PersistedQuery &Q,
+              llvm::json::Path P) {
+  llvm::json::ObjectMapper O(Params, P);
+  int64_t Size = 0;
+  if (!O || !O.map("driver", Q.Driver) || !O.map("lang", Q.Lang) ||
+      !O.map("flags", Q.Flags) || !O.map("path", Q.Stamp.Path) ||
+      !O.map("size", Size) || !O.map("mtime", Q.Stamp.ModificationTime) ||
+      !O.map("digest", Q.Stamp.Digest) ||
+      !O.map("includes", Q.Info.SystemIncludes) ||
+      !O.map("target", Q.Info.Target))
+    return false;
+  Q.Stamp.Size = Size;
+  return true;
+}
+
+std::string queryKey(llvm::StringRef Driver, llvm::StringRef Lang,
+                     llvm::ArrayRef<std::string> Flags) {
+  return (Driver + ":" + Lang + ":" + llvm::join(Flags, " ")).str();
+}
+
+/// Stores one JSON file per driver query under a directory.
+class QueryStore {
+public:
+  QueryStore(llvm::StringRef Dir) : Dir(Dir) {}
+
+  /// Returns the stored result for a query, if it was answered by the same
+  /// version of the driver at \p Resolved.
+  std::optional<DriverInfo> load(llvm::StringRef Key,
+                                 const DriverStamp &Resolved) const {
+    static constexpr trace::Metric QueryDriverCache(
+        "query_driver_cache", trace::Metric::Counter, "result");
+    auto Q = read(path(Key));
+    if (!Q || queryKey(Q->Driver, Q->Lang, Q->Flags) != Key) {
+      QueryDriverCache.record(1, "miss");
+      return std::nullopt;
+    }
+    if (Q->Stamp.Path != Resolved.Path || Q->Stamp.Size != Resolved.Size) {
+      QueryDriverCache.record(1, "stale");
+      return std::nullopt;
+    }
+    // The driver was touched, e.g. reinstalled. Check whether its contents
+    // changed, and remember the new time so the next load can skip this.
+    if (Q->Stamp.ModificationTime != Resolved.ModificationTime) {
+      if (digestDriver(Resolved.Path) != Q->Stamp.Digest) {
+        QueryDriverCache.record(1, "stale");
+        return std::nullopt;
+      }
+      Q->Stamp.ModificationTime = Resolved.ModificationTime;
+      write(*Q);
+    }
+    QueryDriverCache.record(1, "hit");
+    return std::move(Q->Info);
+  }
+
+  void store(PersistedQuery Q) const {
+    auto Digest = digestDriver(Q.Stamp.Path);
+    if (!Digest)
+      return;
+    Q.Stamp.Digest = std::move(*Digest);
+    if (auto EC = llvm::sys::fs::create_directories(Dir)) {
+      elog("System include extraction: failed to create {0}: {1}", Dir,
+           EC.message());
+      return;
+    }
+    write(Q);
+    prune();
+  }
+
+  /// Returns the stored queries, most recently written first.
+  std::vector<PersistedQuery> list() const {
+    std::vector<PersistedQuery> Result;
+    for (const auto &Entry : entries())
+      if (auto Q = read(Entry.second))
+        Result.push_back(std::move(*Q));
+    return Result;
+  }
+
+private:
+  // Queries of drivers that are no longer used would otherwise pile up.
+  static constexpr size_t MaxEntries = 64;
+
+  void write(const PersistedQuery &Q) const {
+    std::string Path = path(queryKey(Q.Driver, Q.Lang, Q.Flags));
+    if (auto Err = llvm::writeFileAtomically(
+            Path + ".tmp.%%%%%%%%", Path, [&Q](llvm::raw_ostream &OS) {
+              OS << toJSON(Q);
+              return llvm::Error::success();
+            }))
+      elog("System include extraction: failed to write {0}: {1}", Path,
+           std::move(Err));
+  }
+
+  // Returns the entry files with their modification time, most recent first.
+  std::vector<std::pair<llvm::sys::TimePoint<>, std::string>> entries() const {
+    std::vector<std::pair<llvm::sys::TimePoint<>, std::string>> Entries;
+    std::error_code EC;
+    for (llvm::sys::fs::directory_iterator It(Dir, EC), End; !EC && It != End;
+         It.increment(EC)) {
+      if (llvm::sys::path::extension(It->path()) != ".json")
+        continue;
+      if (auto Status = It->status())
+        Entries.emplace_back(Status->getLastModificationTime(), It->path());
+    }
+    llvm::sort(Entries, std::greater<>());
+    return Entries;
+  }
+
+  // Removes all but the MaxEntries most recently written entries.
+  void prune() const {
+    auto Entries = entries();
+    for (const auto &Entry : llvm::drop_begin(Entries, MaxEntries))
+      llvm::sys::fs::remove(Entry.second);
+  }
+
+  std::string path(llvm::StringRef Key) const {
+    llvm::SmallString<128> Path(Dir);
+    llvm::sys::path::append(Path, llvm::utohexstr(llvm::xxHash64(Key)) +
+                                      ".json");
+    return Path.str().str();
+  }
+
+  static std::optional<PersistedQuery> read(llvm::StringRef Path) {
+    auto Buf = llvm::MemoryBuffer::getFile(Path);
+    if (!Buf)
+      return std::nullopt;
+    auto JSON = llvm::json::parse(Buf->get()->getBuffer());
+    if (!JSON) {
+      elog("System include extraction: bad cache entry {0}: {1}", Path,
+           JSON.takeError());
+      return std::nullopt;
+    }
+    PersistedQuery Q;
+    llvm::json::Path::Root Root;
+    if (!fromJSON(*JSON, Q, Root))
+      return std::nullopt;
+    return Q;
+  }
+
+  std::string Dir;
+};
+
 tooling::CompileCommand &
 addSystemIncludes(tooling::CompileCommand &Cmd,
                   llvm::ArrayRef<std::string> SystemIncludes) {
@@ -318,8 +544,27 @@ llvm::Regex convertGlobsToRegex(llvm::ArrayRef<std::string> Globs) {
 /// compilation database.
 class SystemIncludeExtractor {
 public:
-  SystemIncludeExtractor(llvm::ArrayRef<std::string> QueryDriverGlobs)
-      : QueryDriverRegex(convertGlobsToRegex(QueryDriverGlobs)) {}
+  SystemIncludeExtractor(llvm::ArrayRef<std::string> QueryDriverGlobs,
+                         llvm::StringRef CacheDir)
+      : QueryDriverRegex(convertGlobsToRegex(QueryDriverGlobs)),
+        Warmup(llvm::hardware_concurrency(MaxWarmupThreads)) {
+    if (CacheDir.empty())
+      return;
+    Store.emplace(CacheDir);
+    // Queries made by earlier runs are likely to be made again. Answer them
+    // now, rerunning the drivers that changed, rather than one at a time as
+    // files are opened.
+    for (PersistedQuery &Q : Store->list()) {
+      std::string Key = queryKey(Q.Driver, Q.Lang, Q.Flags);
+      if (WarmupTasks.count(Key))
+        continue;
+      WarmupTasks[Key] = Warmup.async([this, Key, Q(std::move(Q))] {
+        QueriedDrivers.get(Key, [&] {
+          return query(llvm::SmallString<128>(Q.Driver), Q.Lang, Q.Flags);
+        });
+      });
+    }
+  }
 
   void operator()(tooling::CompileCommand &Cmd, llvm::StringRef File) const {
     if (Cmd.CommandLine.empty())
@@ -350,27 +595,72 @@ public:
       // relative or absolute).
       llvm::sys::fs::make_absolute(Cmd.Directory, Driver);
 
-    if (auto Info =
-            QueriedDrivers.get(/*Key=*/(Driver + ":" + Lang).str(), [&] {
-              return extractSystemIncludesAndTarget(
-                  Driver, Lang, Cmd.CommandLine, QueryDriverRegex);
-            })) {
+    std::vector<std::string> Flags = preservedFlags(Cmd.CommandLine);
+    std::string Key = queryKey(Driver, Lang, Flags);
+    // Wait for the query being answered at startup, rather than run it twice.
+    auto Task = WarmupTasks.find(Key);
+    if (Task != WarmupTasks.end())
+      Task->getValue().wait();
+    if (auto Info = QueriedDrivers.get(Key, [&] {
+          return query(Driver, Lang, Flags);
+        })) {
       setTarget(addSystemIncludes(Cmd, Info->SystemIncludes), Info->Target);
     }
   }
 
 private:
-  // Caches includes extracted from a driver. Key is driver:lang.
+  // Answers a query from the persisted results if the driver is unchanged,
+  // and by running the driver otherwise.
+  std::optional<DriverInfo> query(llvm::SmallString<128> Driver,
+                                  llvm::StringRef Lang,
+                                  llvm::ArrayRef<std::string> Flags) const {
+    PersistedQuery Q;
+    Q.Driver = Driver.str().str();
+    if (!resolveDriver(Driver, QueryDriverRegex))
+      return std::nullopt;
+    std::optional<DriverStamp> Stamp;
+    if (Store) {
+      Stamp = statDriver(Driver);
+      if (Stamp) {
+        if (auto Info = Store->load(queryKey(Q.Driver, Lang, Flags), *Stamp))
+          return Info;
+      }
+    }
+    auto Info = extractSystemIncludesAndTarget(Driver, Lang, Flags);
+    if (Info && Stamp) {
+      Q.Lang = Lang.str();
+      Q.Flags = Flags.vec();
+      Q.Stamp = std::move(*Stamp);
+      Q.Info = *Info;
+      Store->store(std::move(Q));
+    }
+    return Info;
+  }
+
+  // Caches includes extracted from a driver. Key is driver:lang:flags.
   Memoize<llvm::StringMap<std::optional<DriverInfo>>> QueriedDrivers;
   llvm::Regex QueryDriverRegex;
+  std::optional<QueryStore> Store;
+  // Drivers run at once to answer persisted queries at startup.
+  static constexpr unsigned MaxWarmupThreads = 4;
+  // Persisted queries being answered at startup. Only written by the
+  // constructor.
+  llvm::StringMap<std::shared_future<void>> WarmupTasks;
+  // Declared last: destroying it waits for the tasks, which use the above.
+  llvm::ThreadPool Warmup;
 };
 } // namespace
 
 SystemIncludeExtractorFn
-getSystemIncludeExtractor(llvm::ArrayRef<std::string> QueryDriverGlobs) {
+getSystemIncludeExtractor(llvm::ArrayRef<std::string> QueryDriverGlobs,
+                          llvm::StringRef CacheDir) {
   if (QueryDriverGlobs.empty())
     return nullptr;
-  return SystemIncludeExtractor(QueryDriverGlobs);
+  auto Extractor =
+      std::make_shared<SystemIncludeExtractor>(QueryDriverGlobs, CacheDir);
+  return [Extractor](tooling::CompileCommand &Cmd, llvm::StringRef File) {
+    (*Extractor)(Cmd, File);
+  };
 }
 
 } // namespace clangd
@@ -417,10 +417,27 @@ private:
   std::atomic<bool> Satisfied = {false};
 };
 
+/// Identifies the preamble built for \p PI. Requests with the same key will
+/// most likely share a preamble, unless headers change on disk.
+std::string preambleKey(const ParseInputs &PI, const CompilerInvocation &CI) {
+  auto Bounds = ComputePreambleBounds(
+      *CI.getLangOpts(), llvm::MemoryBufferRef(PI.Contents, ""), 0);
+  std::string Result = PI.CompileCommand.Directory;
+  for (const auto &Arg : PI.CompileCommand.CommandLine) {
+    Result += '\0';
+    Result += Arg;
+  }
+  Result += '\0';
+  Result += llvm::StringRef(PI.Contents).take_front(Bounds.Size);
+  return Result;
+}
+
 /// Responsible for building preambles. Whenever the thread is idle and the
 /// preamble is outdated, it starts to build a fresh preamble from the latest
 /// inputs. If RunSync is true, preambles are built synchronously in update()
 /// instead.
+/// A build whose diagnostics aren't required is aborted if a newer request
+/// needs a different preamble.
 class PreambleThread {
 public:
   PreambleThread(llvm::StringRef FileName, ParsingCallbacks &Callbacks,
@@ -438,15 +455,23 @@ public:
   /// will be built.
   void update(std::unique_ptr<CompilerInvocation> CI, ParseInputs PI,
               std::vector<Diag> CIDiags, WantDiagnostics WantDiags) {
-    Request Req = {std::move(CI), std::move(PI), std::move(CIDiags), WantDiags,
-                   Context::current().clone()};
     if (RunSync) {
-      build(std::move(Req));
+      build({std::move(CI), std::move(PI), std::move(CIDiags), WantDiags,
+             Context::current().clone()});
       Status.update([](TUStatus &Status) {
         Status.PreambleActivity = PreambleAction::Idle;
       });
       return;
     }
+    std::string PreambleKey = preambleKey(PI, *CI);
+    Context Ctx = Context::current().clone();
+    Canceler Abort;
+    if (WantDiags != WantDiagnostics::Yes)
+      std::tie(Ctx, Abort) = cancelableTask();
+    Request Req = {std::move(CI),       std::move(PI),
+                   std::move(CIDiags),  WantDiags,
+                   std::move(Ctx),      std::move(PreambleKey),
+                   std::move(Abort)};
     {
       std::unique_lock<std::mutex> Lock(Mutex);
       // If NextReq was requested with WantDiagnostics::Yes we cannot just drop
@@ -457,6 +482,15 @@ public:
         return !NextReq || NextReq->WantDiags != WantDiagnostics::Yes;
       });
       NextReq = std::move(Req);
+      // The preamble being built is obsolete, unless NextReq will reuse it.
+      // Diagnostics of an Auto update are still published if the only newer
+      // update doesn't want any, so keep building for it in that case.
+      if (AbortCurrent && NextReq->WantDiags != WantDiagnostics::No &&
+          (NextReq->Inputs.ForceRebuild ||
+           NextReq->PreambleKey != CurrentKey)) {
+        AbortCurrent();
+        AbortCurrent = nullptr;
+      }
     }
     // Let the worker thread know there's a request, notify_one is safe as there
     // should be a single worker thread waiting on it.
@@ -493,6 +527,9 @@ public:
 
         CurrentReq = std::move(*NextReq);
         NextReq.reset();
+        // build() moves from CurrentReq, keep what update() needs to abort it.
+        CurrentKey = CurrentReq->PreambleKey;
+        AbortCurrent = CurrentReq->Abort;
       }
 
       {
@@ -510,6 +547,7 @@ public:
       {
         std::lock_guard<std::mutex> Lock(Mutex);
         CurrentReq.reset();
+        AbortCurrent = nullptr;
         IsEmpty = !NextReq;
       }
       if (IsEmpty) {
@@ -551,6 +589,10 @@ private:
     std::vector<Diag> CIDiags;
     WantDiagnostics WantDiags;
     Context Ctx;
+    /// See preambleKey(). Only set for asynchronous builds.
+    std::string PreambleKey;
+    /// Cancels Ctx, aborting the build. Null if the build must complete.
+    Canceler Abort;
   };
 
   bool isDone() {
@@ -566,6 +608,8 @@ private:
   bool Done = false;                  /* GUARDED_BY(Mutex) */
   std::optional<Request> NextReq;     /* GUARDED_BY(Mutex) */
   std::optional<Request> CurrentReq;  /* GUARDED_BY(Mutex) */
+  std::string CurrentKey;             /* GUARDED_BY(Mutex) */
+  Canceler AbortCurrent;              /* GUARDED_BY(Mutex) */
   // Signaled whenever a thread populates NextReq or worker thread builds a
   // Preamble.
   mutable std::condition_variable ReqCV; /* GUARDED_BY(Mutex) */
@@ -622,6 +666,11 @@ public:
   runWithAST(llvm::StringRef Name,
              llvm::unique_function<void(llvm::Expected<InputsAndAST>)> Action,
              TUScheduler::ASTActionInvalidation);
+  /// Runs \p Action on the AST of an older version of the file, if updates
+  /// made since are waiting to be built. Returns false if there's no such AST,
+  /// or if \p Action declined it. Threadsafe.
+  bool runWithStaleAST(llvm::StringRef Name,
+                       llvm::function_ref<bool(InputsAndAST)> Action) const;
   bool blockUntilIdle(Deadline Timeout) const;
 
   std::shared_ptr<const PreambleData> getPossiblyStalePreamble(
@@ -664,13 +713,32 @@ private:
     bool ContentChanged;
   };
 
+  /// Whether diagnostics being built for an older version are obsolete once
+  /// \p Update is queued. Like shouldSkipHeadLocked(), an update that doesn't
+  /// want diagnostics leaves the older ones to be published.
+  static bool supersedesDiagnostics(const UpdateType &Update) {
+    return Update.ContentChanged && Update.Diagnostics != WantDiagnostics::No;
+  }
+
   /// Publishes diagnostics for \p Inputs. It will build an AST or reuse the
   /// cached one if applicable. Assumes LatestPreamble is compatible for \p
   /// Inputs.
+  /// Unless \p WantDiags is Yes, the build is aborted if a newer update
+  /// arrives meanwhile, and nothing is published.
   void generateDiagnostics(std::unique_ptr<CompilerInvocation> Invocation,
-                           ParseInputs Inputs, std::vector<Diag> CIDiags);
+                           ParseInputs Inputs, std::vector<Diag> CIDiags,
+                           WantDiagnostics WantDiags);
 
   void updateASTSignals(ParsedAST &AST);
+  /// Takes the cached AST, unless it is stale. A stale AST stays cached for
+  /// runWithStaleAST().
+  std::optional<std::unique_ptr<ParsedAST>>
+  takeAST(const trace::Metric *AccessMetric = nullptr);
+  /// Caches an AST of the current FileInputs, replacing any stale one.
+  void putAST(std::unique_ptr<ParsedAST> AST);
+  /// Removes the cached AST, as FileInputs or the preamble are about to
+  /// change. With KeepStaleASTs, it stays cached but is marked stale.
+  void invalidateAST();
 
   // Must be called exactly once on processing thread. Will return after
   // stop() is called on a separate thread and all pending requests are
@@ -709,6 +777,7 @@ private:
   TUScheduler::ASTCache &IdleASTs;
   TUScheduler::HeaderIncluderCache &HeaderIncluders;
   const bool RunSync;
+  const bool KeepStaleASTs;
   /// Time to wait after an update to see whether another update obsoletes it.
   const DebouncePolicy UpdateDebounce;
   /// File that ASTWorker is responsible for.
@@ -735,9 +804,19 @@ private:
   bool Done;                              /* GUARDED_BY(Mutex) */
   std::deque<Request> Requests;           /* GUARDED_BY(Mutex) */
   std::optional<Request> CurrentRequest;  /* GUARDED_BY(Mutex) */
+  /// Aborts the AST build of generateDiagnostics(), if it can be.
+  Canceler AbortDiagnostics;              /* GUARDED_BY(Mutex) */
   /// Signalled whenever a new request has been scheduled or processing of a
   /// request has completed.
   mutable std::condition_variable RequestsCV;
+  /// Held by runWithStaleAST() while it leases the cached AST, and by the
+  /// worker while it takes or replaces the cached AST.
+  mutable std::mutex StaleMu;
+  /// Whether the AST in IdleASTs was built from StaleInputs rather than
+  /// FileInputs. It is subject to the retention policy like any other AST,
+  /// until the worker caches a newer one.
+  bool CachedASTIsStale = false; /* GUARDED_BY(StaleMu) */
+  ParseInputs StaleInputs;       /* GUARDED_BY(StaleMu) */
   std::shared_ptr<const ASTSignals> LatestASTSignals; /* GUARDED_BY(Mutex) */
   /// Latest build preamble for current TU.
   /// None means no builds yet, null means there was an error while building.
@@ -833,7 +912,8 @@ ASTWorker::ASTWorker(PathRef FileName, const GlobalCompilationDatabase &CDB,
                      const TUScheduler::Options &Opts,
                      ParsingCallbacks &Callbacks)
     : IdleASTs(LRUCache), HeaderIncluders(HeaderIncluders), RunSync(RunSync),
-      UpdateDebounce(Opts.UpdateDebounce), FileName(FileName),
+      KeepStaleASTs(Opts.KeepStaleASTs), UpdateDebounce(Opts.UpdateDebounce),
+      FileName(FileName),
       ContextProvider(Opts.ContextProvider), CDB(CDB), Callbacks(Callbacks),
       Barrier(Barrier), Done(false), Status(FileName, Callbacks),
       PreamblePeer(FileName, Callbacks, Opts.StorePreamblesInMemory, RunSync,
@@ -890,7 +970,7 @@ void ASTWorker::update(ParseInputs Inputs, WantDiagnostics WantDiags,
         std::tie(Inputs.CompileCommand, Inputs.Contents);
     // Cached AST is invalidated.
     if (!InputsAreTheSame) {
-      IdleASTs.take(this);
+      invalidateAST();
       RanASTCallback = false;
     }
 
@@ -917,7 +997,7 @@ void ASTWorker::update(ParseInputs Inputs, WantDiagnostics WantDiags,
     if (!Invocation) {
       elog("Could not build CompilerInvocation for file {0}", FileName);
       // Remove the old AST if it's still in cache.
-      IdleASTs.take(this);
+      takeAST();
       RanASTCallback = false;
       // Report the diagnostics we collected when parsing the command line.
       Callbacks.onFailedAST(FileName, Inputs.Version,
@@ -950,7 +1030,7 @@ void ASTWorker::update(ParseInputs Inputs, WantDiagnostics WantDiags,
     // gurantee eventual consistency.
     if (LatestPreamble && Config::current().Diagnostics.AllowStalePreamble)
       generateDiagnostics(std::move(Invocation), std::move(Inputs),
-                          std::move(CompilerInvocationDiags));
+                          std::move(CompilerInvocationDiags), WantDiags);
 
     std::unique_lock<std::mutex> Lock(Mutex);
     PreambleCV.wait(Lock, [this] {
@@ -977,7 +1057,7 @@ void ASTWorker::runWithAST(
     if (auto Reason = isCancelled())
       return Action(llvm::make_error<CancelledError>(Reason));
     std::optional<std::unique_ptr<ParsedAST>> AST =
-        IdleASTs.take(this, &ASTAccessForRead);
+        takeAST(&ASTAccessForRead);
     if (!AST) {
       StoreDiags CompilerInvocationDiagConsumer;
       std::unique_ptr<CompilerInvocation> Invocation =
@@ -990,16 +1070,24 @@ void ASTWorker::runWithAST(
       // return a compatible preamble as ASTWorker::update blocks.
       std::optional<ParsedAST> NewAST;
       if (Invocation) {
+        TimeTraceRecorder Recorder(FileInputs.Opts.RecordTimeTrace);
         NewAST = ParsedAST::build(FileName, FileInputs, std::move(Invocation),
                                   CompilerInvocationDiagConsumer.take(),
                                   getPossiblyStalePreamble());
+        // Don't cache the missing AST if the read was cancelled while parsing.
+        if (!NewAST) {
+          if (auto Reason = isCancelled())
+            return Action(llvm::make_error<CancelledError>(Reason));
+        }
         ++ASTBuildCount;
+        if (auto Trace = Recorder.take(BuildTimeTrace::AST, FileInputs.Version))
+          Callbacks.onBuildTimeTrace(FileName, std::move(*Trace));
       }
       AST = NewAST ? std::make_unique<ParsedAST>(std::move(*NewAST)) : nullptr;
     }
     // Make sure we put the AST back into the LRU cache.
     auto _ = llvm::make_scope_exit(
-        [&AST, this]() { IdleASTs.put(this, std::move(*AST)); });
+        [&AST, this]() { putAST(std::move(*AST)); });
     // Run the user-provided action.
     if (!*AST)
       return Action(error(llvm::errc::invalid_argument, "invalid AST"));
@@ -1048,11 +1136,15 @@ void PreambleThread::build(Request Req) {
   assert(Req.CI && "Got preamble request with null compiler invocation");
   const ParseInputs &Inputs = Req.Inputs;
   bool ReusedPreamble = false;
+  bool Aborted = false;
 
   Status.update([&](TUStatus &Status) {
     Status.PreambleActivity = PreambleAction::Building;
   });
-  auto _ = llvm::make_scope_exit([this, &Req, &ReusedPreamble] {
+  auto _ = llvm::make_scope_exit([this, &Req, &ReusedPreamble, &Aborted] {
+    // The request that made this one obsolete is next, it will publish.
+    if (Aborted)
+      return;
     ASTPeer.updatePreamble(std::move(Req.CI), std::move(Req.Inputs),
                            LatestBuild, std::move(Req.CIDiags),
                            std::move(Req.WantDiags));
@@ -1081,6 +1173,8 @@ void PreambleThread::build(Request Req) {
 
   PreambleBuildStats Stats;
   bool IsFirstPreamble = !LatestBuild;
+  TimeTraceRecorder Recorder(Inputs.Opts.RecordTimeTrace);
+  std::shared_ptr<const PreambleData> PreviousBuild = LatestBuild;
   LatestBuild = clang::clangd::buildPreamble(
       FileName, *Req.CI, Inputs, StoreInMemory,
       [&](ASTContext &Ctx, Preprocessor &PP,
@@ -1089,6 +1183,14 @@ void PreambleThread::build(Request Req) {
                                 CanonIncludes);
       },
       &Stats);
+  if (auto Trace = Recorder.take(BuildTimeTrace::Preamble, Inputs.Version))
+    Callbacks.onBuildTimeTrace(FileName, std::move(*Trace));
+  if (!LatestBuild && Req.Abort && isCancelled()) {
+    // Aborted by update(), keep serving the previous preamble.
+    Aborted = true;
+    LatestBuild = std::move(PreviousBuild);
+    return;
+  }
   if (!LatestBuild)
     return;
   reportPreambleBuild(Stats, IsFirstPreamble);
@@ -1112,7 +1214,7 @@ void ASTWorker::updatePreamble(std::unique_ptr<CompilerInvocation> CI,
     if (!LatestPreamble || Preamble != *LatestPreamble) {
       ++PreambleBuildCount;
       // Cached AST is no longer valid.
-      IdleASTs.take(this);
+      invalidateAST();
       RanASTCallback = false;
       std::lock_guard<std::mutex> Lock(Mutex);
       // LatestPreamble might be the last reference to old preamble, do not
@@ -1145,7 +1247,8 @@ void ASTWorker::updatePreamble(std::unique_ptr<CompilerInvocation> CI,
     // Report diagnostics with the new preamble to ensure progress. Otherwise
     // diagnostics might get stale indefinitely if user keeps invalidating the
     // preamble.
-    generateDiagnostics(std::move(CI), std::move(PI), std::move(CIDiags));
+    generateDiagnostics(std::move(CI), std::move(PI), std::move(CIDiags),
+                        WantDiags);
   };
   if (RunSync) {
     runTask(TaskName, Task);
@@ -1174,7 +1277,7 @@ void ASTWorker::updateASTSignals(ParsedAST &AST) {
 
 void ASTWorker::generateDiagnostics(
     std::unique_ptr<CompilerInvocation> Invocation, ParseInputs Inputs,
-    std::vector<Diag> CIDiags) {
+    std::vector<Diag> CIDiags, WantDiagnostics WantDiags) {
   // Tracks ast cache accesses for publishing diags.
   static constexpr trace::Metric ASTAccessForDiag(
       "ast_access_diag", trace::Metric::Counter, "result");
@@ -1207,14 +1310,43 @@ void ASTWorker::generateDiagnostics(
   // We might be able to reuse the last we've built for a read request.
   // FIXME: It might be better to not reuse this AST. That way queued AST builds
   // won't be required for diags.
-  std::optional<std::unique_ptr<ParsedAST>> AST =
-      IdleASTs.take(this, &ASTAccessForDiag);
+  std::optional<std::unique_ptr<ParsedAST>> AST = takeAST(&ASTAccessForDiag);
   if (!AST || !InputsAreLatest) {
     auto RebuildStartTime = DebouncePolicy::clock::now();
-    std::optional<ParsedAST> NewAST = ParsedAST::build(
-        FileName, Inputs, std::move(Invocation), CIDiags, *LatestPreamble);
+    TimeTraceRecorder Recorder(Inputs.Opts.RecordTimeTrace);
+    std::optional<ParsedAST> NewAST;
+    {
+      // A newer update makes these diagnostics obsolete, let startTask() abort
+      // the build.
+      std::optional<WithContext> Abortable;
+      if (!RunSync && WantDiags != WantDiagnostics::Yes) {
+        auto Task = cancelableTask();
+        Abortable.emplace(std::move(Task.first));
+        std::lock_guard<std::mutex> Lock(Mutex);
+        AbortDiagnostics = std::move(Task.second);
+        // The update may have arrived already.
+        if (llvm::any_of(Requests, [](const Request &R) {
+              return R.Update && supersedesDiagnostics(*R.Update);
+            }))
+          AbortDiagnostics();
+      }
+      NewAST = ParsedAST::build(FileName, Inputs, std::move(Invocation),
+                                CIDiags, *LatestPreamble);
+      bool Aborted = !NewAST && isCancelled();
+      if (Abortable) {
+        std::lock_guard<std::mutex> Lock(Mutex);
+        AbortDiagnostics = nullptr;
+      }
+      if (Aborted) {
+        vlog("ASTWorker aborted diagnostics of {0} version {1}", FileName,
+             Inputs.Version);
+        return;
+      }
+    }
     auto RebuildDuration = DebouncePolicy::clock::now() - RebuildStartTime;
     ++ASTBuildCount;
+    if (auto Trace = Recorder.take(BuildTimeTrace::AST, Inputs.Version))
+      Callbacks.onBuildTimeTrace(FileName, std::move(*Trace));
     // Try to record the AST-build time, to inform future update debouncing.
     // This is best-effort only: if the lock is held, don't bother.
     std::unique_lock<std::mutex> Lock(Mutex, std::try_to_lock);
@@ -1264,10 +1396,80 @@ void ASTWorker::generateDiagnostics(
   // queue can't reuse the AST.
   if (InputsAreLatest) {
     RanASTCallback = *AST != nullptr;
-    IdleASTs.put(this, std::move(*AST));
+    putAST(std::move(*AST));
   }
 }
 
+bool ASTWorker::runWithStaleAST(
+    llvm::StringRef Name, llvm::function_ref<bool(InputsAndAST)> Action) const {
+  // The AST is only leased: the worker waits for it to be put back before it
+  // takes or replaces it, so reads queued on the worker still find it.
+  std::lock_guard<std::mutex> StaleLock(StaleMu);
+  ParseInputs Inputs;
+  if (CachedASTIsStale) {
+    Inputs = StaleInputs;
+  } else {
+    std::lock_guard<std::mutex> Lock(Mutex);
+    // Otherwise the cached AST is up-to-date, and reads on the worker won't
+    // have to wait for a rebuild.
+    auto ChangesContent = [](const Request &R) {
+      return R.Update && R.Update->ContentChanged;
+    };
+    if (llvm::none_of(Requests, ChangesContent) &&
+        !(CurrentRequest && ChangesContent(*CurrentRequest)))
+      return false;
+    // The cached AST matches FileInputs, which can't change until the worker
+    // invalidates the AST, and that waits for StaleMu.
+    Inputs = FileInputs;
+  }
+  std::optional<std::unique_ptr<ParsedAST>> AST = IdleASTs.take(this);
+  if (!AST)
+    return false;
+  auto PutBack =
+      llvm::make_scope_exit([&] { IdleASTs.put(this, std::move(*AST)); });
+  if (!*AST)
+    return false;
+  vlog("ASTWorker running {0} on stale version {2} of {1}", Name, FileName,
+       Inputs.Version);
+  return Action(InputsAndAST{Inputs, **AST});
+}
+
+std::optional<std::unique_ptr<ParsedAST>>
+ASTWorker::takeAST(const trace::Metric *AccessMetric) {
+  std::lock_guard<std::mutex> Lock(StaleMu);
+  if (CachedASTIsStale) {
+    if (AccessMetric)
+      AccessMetric->record(1, "miss");
+    return std::nullopt;
+  }
+  return IdleASTs.take(this, AccessMetric);
+}
+
+void ASTWorker::putAST(std::unique_ptr<ParsedAST> AST) {
+  std::optional<std::unique_ptr<ParsedAST>> Stale;
+  std::lock_guard<std::mutex> Lock(StaleMu);
+  if (CachedASTIsStale) {
+    Stale = IdleASTs.take(this);
+    CachedASTIsStale = false;
+  }
+  IdleASTs.put(this, std::move(AST));
+  // The stale AST is destroyed after releasing the lock.
+}
+
+void ASTWorker::invalidateAST() {
+  std::optional<std::unique_ptr<ParsedAST>> AST;
+  std::lock_guard<std::mutex> Lock(StaleMu);
+  // An AST of even older inputs is kept, StaleInputs still describe it.
+  if (CachedASTIsStale)
+    return;
+  AST = IdleASTs.take(this);
+  if (!KeepStaleASTs || !AST || !*AST)
+    return;
+  IdleASTs.put(this, std::move(*AST));
+  CachedASTIsStale = true;
+  StaleInputs = FileInputs;
+}
+
 std::shared_ptr<const PreambleData> ASTWorker::getPossiblyStalePreamble(
     std::shared_ptr<const ASTSignals> *ASTSignals) const {
   std::lock_guard<std::mutex> Lock(Mutex);
@@ -1343,6 +1545,10 @@ void ASTWorker::startTask(llvm::StringRef Name,
     assert(!Done && "running a task after stop()");
     // Cancel any requests invalidated by this request.
     if (Update && Update->ContentChanged) {
+      if (AbortDiagnostics && supersedesDiagnostics(*Update)) {
+        AbortDiagnostics();
+        AbortDiagnostics = nullptr;
+      }
       for (auto &R : llvm::reverse(Requests)) {
         if (R.InvalidationPolicy == TUScheduler::InvalidateOnUpdate)
           R.Invalidate();
@@ -1754,6 +1960,91 @@ void TUScheduler::runWithAST(
   It->second->Worker->runWithAST(Name, std::move(Action), Invalidation);
 }
 
+void TUScheduler::runWithStaleAST(
+    llvm::StringRef Name, PathRef File,
+    llvm::unique_function<bool(llvm::Expected<InputsAndAST>, bool)> Action,
+    TUScheduler::ASTActionInvalidation Invalidation) {
+  auto It = Files.find(File);
+  if (It == Files.end()) {
+    Action(llvm::make_error<LSPError>("trying to get AST for non-added document",
+                                      ErrorCode::InvalidParams),
+           /*Stale=*/false);
+    return;
+  }
+  LastActiveFile = File.str();
+
+  // Without threads, the AST is always up-to-date.
+  if (!PreambleTasks) {
+    It->second->Worker->runWithAST(
+        Name,
+        [Action = std::move(Action)](
+            llvm::Expected<InputsAndAST> AST) mutable {
+          Action(std::move(AST), /*Stale=*/false);
+        },
+        Invalidation);
+    return;
+  }
+
+  // Shared by the read on the worker queue and the one on the stale AST.
+  struct StaleRead {
+    std::mutex Mu;
+    bool Done = false; /* GUARDED_BY(Mu) */
+    llvm::unique_function<bool(llvm::Expected<InputsAndAST>, bool)> Action;
+  };
+  auto Read = std::make_shared<StaleRead>();
+  Read->Action = std::move(Action);
+
+  // Queue the up-to-date read first, so it's ordered after previous updates.
+  // It's cancelled if the stale AST is accepted.
+  auto Fresh = cancelableTask();
+  {
+    WithContext FreshContext(std::move(Fresh.first));
+    It->second->Worker->runWithAST(
+        Name,
+        [Read](llvm::Expected<InputsAndAST> AST) {
+          std::lock_guard<std::mutex> Lock(Read->Mu);
+          if (Read->Done) {
+            if (!AST)
+              llvm::consumeError(AST.takeError());
+            return;
+          }
+          Read->Done = true;
+          Read->Action(std::move(AST), /*Stale=*/false);
+        },
+        Invalidation);
+  }
+
+  std::shared_ptr<const ASTWorker> Worker = It->second->Worker.lock();
+  auto Task = [Worker, Read, CancelFresh = std::move(Fresh.second),
+               Name = Name.str(), File = File.str(),
+               Ctx = Context::current().derive(FileBeingProcessed,
+                                               std::string(File)),
+               this]() mutable {
+    // Like runQuick(), don't take the barrier: it may be held by the very build
+    // this read doesn't want to wait for.
+    WithContext Guard(std::move(Ctx));
+    // The read on the worker queue reports the cancellation.
+    if (isCancelled())
+      return;
+    std::lock_guard<std::mutex> Lock(Read->Mu);
+    if (Read->Done)
+      return;
+    trace::Span Tracer(Name);
+    SPAN_ATTACH(Tracer, "file", File);
+    WithContext WithProvidedContext(Opts.ContextProvider(File));
+    bool Accepted = Worker->runWithStaleAST(Name, [&](InputsAndAST AST) {
+      return Read->Action(std::move(AST), /*Stale=*/true);
+    });
+    SPAN_ATTACH(Tracer, "stale", Accepted);
+    if (Accepted) {
+      Read->Done = true;
+      CancelFresh();
+    }
+  };
+  PreambleTasks->runAsync("stale:" + llvm::sys::path::filename(File),
+                          std::move(Task));
+}
+
 void TUScheduler::runWithPreamble(llvm::StringRef Name, PathRef File,
                                   PreambleConsistency Consistency,
                                   Callback<InputsAndPreamble> Action) {
@@ -13,6 +13,7 @@
 #include "Compiler.h"
 #include "Diagnostics.h"
 #include "GlobalCompilationDatabase.h"
+#include "TimeTrace.h"
 #include "index/CanonicalIncludes.h"
 #include "support/Function.h"
 #include "support/MemoryTree.h"
@@ -202,6 +203,10 @@ public:
   /// different highlightings). Any actions on the file are guranteed to see new
   /// preamble after the callback.
   virtual void onPreamblePublished(PathRef File) {}
+
+  /// Called after a preamble or AST build that was profiled because
+  /// ParseOptions::RecordTimeTrace was set.
+  virtual void onBuildTimeTrace(PathRef File, BuildTimeTrace Trace) {}
 };
 
 /// Handles running tasks for ClangdServer and managing the resources (e.g.,
@@ -232,6 +237,11 @@ public:
     /// This throttler controls which preambles may be built at a given time.
     clangd::PreambleThrottler *PreambleThrottler = nullptr;
 
+    /// Keep the AST of each file cached after an update invalidates it, until
+    /// a newer one is built, so runWithStaleAST() reads can use it meanwhile.
+    /// Stale ASTs count towards RetentionPolicy like any other.
+    bool KeepStaleASTs = false;
+
     /// Used to create a context that wraps each single operation.
     /// Typically to inject per-file configuration.
     /// If the path is empty, context sholud be "generic".
@@ -306,6 +316,19 @@ public:
                   Callback<InputsAndAST> Action,
                   ASTActionInvalidation = NoInvalidation);
 
+  /// Schedules an async read of the AST like runWithAST(), but also offers
+  /// \p Action the AST of an older version of \p File right away, if updates
+  /// made since are still waiting to be built.
+  /// \p Action is told whether the AST is stale, and can then return false
+  /// to decline it (e.g. if the positions it needs were edited since). It is
+  /// then called with the AST runWithAST() would use, and its result ignored.
+  /// Once \p Action accepts a stale AST, it is not called again.
+  void runWithStaleAST(
+      llvm::StringRef Name, PathRef File,
+      llvm::unique_function<bool(llvm::Expected<InputsAndAST>, bool Stale)>
+          Action,
+      ASTActionInvalidation = NoInvalidation);
+
   /// Controls whether preamble reads wait for the preamble to be up-to-date.
   enum PreambleConsistency {
     /// The preamble may be generated from an older version of the file.
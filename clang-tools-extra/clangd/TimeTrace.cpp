@@ -0,0 +1,213 @@
+//===--- TimeTrace.cpp - Capturing -ftime-trace profiles of builds -------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#include "TimeTrace.h"
+#include "support/Logger.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/TimeProfiler.h"
+#include "llvm/Support/raw_ostream.h"
+#include <algorithm>
+#include <tuple>
+
+namespace clang {
+namespace clangd {
+namespace {
+
+// Events shorter than this are dropped, as with -ftime-trace-granularity.
+// The default of 500us keeps traces of large TUs at a manageable size.
+constexpr unsigned TimeTraceGranularityUs = 500;
+
+} // namespace
+
+llvm::StringRef toString(BuildTimeTrace::Kind K) {
+  switch (K) {
+  case BuildTimeTrace::Preamble:
+    return "preamble";
+  case BuildTimeTrace::AST:
+    return "ast";
+  }
+  llvm_unreachable("Unhandled BuildTimeTrace::Kind");
+}
+
+llvm::json::Value toJSON(const BuildTimeTrace &T) {
+  llvm::json::Object Result{
+      {"kind", toString(T.K)},
+      {"version", T.Version},
+      {"totalMs", T.TotalMs},
+  };
+  auto Parsed = llvm::json::parse(T.JSON);
+  if (Parsed)
+    Result["trace"] = std::move(*Parsed);
+  else
+    elog("Malformed time trace: {0}", Parsed.takeError());
+  return Result;
+}
+
+TimeTraceRecorder::TimeTraceRecorder(bool Enabled) {
+  if (!Enabled || llvm::timeTraceProfilerEnabled())
+    return;
+  llvm::timeTraceProfilerInitialize(TimeTraceGranularityUs, "clangd");
+  Active = true;
+  Start = std::chrono::steady_clock::now();
+}
+
+TimeTraceRecorder::~TimeTraceRecorder() {
+  if (Active)
+    llvm::timeTraceProfilerCleanup();
+}
+
+std::optional<BuildTimeTrace>
+TimeTraceRecorder::take(BuildTimeTrace::Kind K, llvm::StringRef Version) {
+  if (!Active)
+    return std::nullopt;
+  BuildTimeTrace Result;
+  Result.K = K;
+  Result.Version = Version.str();
+  Result.TotalMs = std::chrono::duration<double, std::milli>(
+                       std::chrono::steady_clock::now() - Start)
+                       .count();
+  llvm::SmallString<0> Buf;
+  llvm::raw_svector_ostream OS(Buf);
+  llvm::timeTraceProfilerWrite(OS);
+  Result.JSON = Buf.str().str();
+  llvm::timeTraceProfilerCleanup();
+  Active = false;
+  return Result;
+}
+
+llvm::json::Value toJSON(const TimeTraceHotspot &H) {
+  return llvm::json::Object{
+      {"event", H.Event},
+      {"detail", H.Detail},
+      {"totalMs", H.TotalMs},
+      {"count", H.Count},
+  };
+}
+
+std::vector<TimeTraceHotspot>
+summarizeTimeTraces(llvm::ArrayRef<std::string> Traces, size_t Limit) {
+  // Keyed by event name and detail, separated by a NUL.
+  llvm::StringMap<TimeTraceHotspot> ByKey;
+  for (const std::string &Trace : Traces) {
+    auto Parsed = llvm::json::parse(Trace);
+    if (!Parsed) {
+      elog("Malformed time trace: {0}", Parsed.takeError());
+      continue;
+    }
+    const auto *Root = Parsed->getAsObject();
+    const auto *Events = Root ? Root->getArray("traceEvents") : nullptr;
+    if (!Events)
+      continue;
+    for (const llvm::json::Value &E : *Events) {
+      const auto *Event = E.getAsObject();
+      if (!Event || Event->getString("ph") != "X")
+        continue;
+      auto Name = Event->getString("name");
+      auto Dur = Event->getNumber("dur");
+      // "Total ..." events summarize a whole category; they have no detail.
+      if (!Name || !Dur || Name->starts_with("Total "))
+        continue;
+      const auto *Args = Event->getObject("args");
+      auto Detail = Args ? Args->getString("detail") : std::nullopt;
+      if (!Detail || Detail->empty())
+        continue;
+      std::string Key = (*Name + llvm::StringRef("\0", 1) + *Detail).str();
+      auto &H = ByKey[Key];
+      if (H.Count == 0) {
+        H.Event = Name->str();
+        H.Detail = Detail->str();
+      }
+      H.TotalMs += *Dur / 1000;
+      ++H.Count;
+    }
+  }
+
+  std::vector<TimeTraceHotspot> Result;
+  Result.reserve(ByKey.size());
+  for (auto &Entry : ByKey)
+    Result.push_back(std::move(Entry.second));
+  auto Cmp = [](const TimeTraceHotspot &L, const TimeTraceHotspot &R) {
+    return std::tie(R.TotalMs, L.Event, L.Detail) <
+           std::tie(L.TotalMs, R.Event, R.Detail);
+  };
+  if (Limit && Result.size() > Limit) {
+    std::partial_sort(Result.begin(), Result.begin() + Limit, Result.end(),
+                      Cmp);
+    Result.resize(Limit);
+  } else {
+    llvm::sort(Result, Cmp);
+  }
+  return Result;
+}
+
+void TimeTraceStore::enable(PathRef File) {
+  std::lock_guard<std::mutex> Lock(Mu);
+  Files.try_emplace(File);
+}
+
+bool TimeTraceStore::enabled(PathRef File) const {
+  std::lock_guard<std::mutex> Lock(Mu);
+  return Files.count(File);
+}
+
+void TimeTraceStore::remove(PathRef File) {
+  std::lock_guard<std::mutex> Lock(Mu);
+  Files.erase(File);
+}
+
+void TimeTraceStore::record(PathRef File, BuildTimeTrace Trace) {
+  std::lock_guard<std::mutex> Lock(Mu);
+  auto It = Files.find(File);
+  // The file may have been removed while it was being built.
+  if (It == Files.end())
+    return;
+  auto &Slot = Trace.K == BuildTimeTrace::Preamble ? It->second.Preamble
+                                                   : It->second.AST;
+  Slot = std::move(Trace);
+}
+
+std::vector<BuildTimeTrace> TimeTraceStore::traces(PathRef File) const {
+  std::vector<BuildTimeTrace> Result;
+  std::lock_guard<std::mutex> Lock(Mu);
+  auto It = Files.find(File);
+  if (It == Files.end())
+    return Result;
+  if (It->second.Preamble)
+    Result.push_back(*It->second.Preamble);
+  if (It->second.AST)
+    Result.push_back(*It->second.AST);
+  return Result;
+}
+
+std::vector<std::string> TimeTraceStore::allTraces() const {
+  std::vector<std::string> Result;
+  std::lock_guard<std::mutex> Lock(Mu);
+  for (const auto &Entry : Files) {
+    if (Entry.second.Preamble)
+      Result.push_back(Entry.second.Preamble->JSON);
+    if (Entry.second.AST)
+      Result.push_back(Entry.second.AST->JSON);
+  }
+  return Result;
+}
+
+void TimeTraceStore::profile(MemoryTree &MT) const {
+  std::lock_guard<std::mutex> Lock(Mu);
+  for (const auto &Entry : Files) {
+    size_t Bytes = 0;
+    if (Entry.second.Preamble)
+      Bytes += Entry.second.Preamble->JSON.capacity();
+    if (Entry.second.AST)
+      Bytes += Entry.second.AST->JSON.capacity();
+    MT.detail(Entry.first()).addUsage(Bytes);
+  }
+}
+
+} // namespace clangd
+} // namespace clang
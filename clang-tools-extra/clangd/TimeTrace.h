@@ -0,0 +1,123 @@
+//===--- TimeTrace.h - Capturing -ftime-trace profiles of builds -*- C++-*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// PreambleBuildStats tell us how long a build took, but not where inside clang
+// the time went. For selected files clangd can run the LLVM time-trace
+// profiler around preamble and AST builds, producing the same JSON as
+// `clang -ftime-trace`. The traces can be loaded in chrome://tracing or
+// aggregated across files to find the headers and templates that dominate
+// build times in a workspace.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_CLANG_TOOLS_EXTRA_CLANGD_TIMETRACE_H
+#define LLVM_CLANG_TOOLS_EXTRA_CLANGD_TIMETRACE_H
+
+#include "support/MemoryTree.h"
+#include "support/Path.h"
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/JSON.h"
+#include <chrono>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace clang {
+namespace clangd {
+
+/// A time-trace profile of a single preamble or AST build.
+struct BuildTimeTrace {
+  enum Kind { Preamble, AST };
+  Kind K = AST;
+  /// Version of the file contents that was built.
+  std::string Version;
+  /// Wall time of the whole build, in milliseconds.
+  double TotalMs = 0;
+  /// The profile, in the Chrome trace event format used by -ftime-trace.
+  std::string JSON;
+};
+llvm::StringRef toString(BuildTimeTrace::Kind);
+llvm::json::Value toJSON(const BuildTimeTrace &);
+
+/// Runs the time-trace profiler on the current thread while in scope.
+///
+/// The profiler is thread-local, so the recorder must be created on the thread
+/// performing the build. If the thread is already being profiled (e.g. clangd
+/// itself runs under -ftime-trace), the recorder does nothing.
+class TimeTraceRecorder {
+public:
+  explicit TimeTraceRecorder(bool Enabled);
+  ~TimeTraceRecorder();
+  TimeTraceRecorder(const TimeTraceRecorder &) = delete;
+  TimeTraceRecorder &operator=(const TimeTraceRecorder &) = delete;
+
+  /// Stops profiling and returns the trace, if the recorder was active.
+  std::optional<BuildTimeTrace> take(BuildTimeTrace::Kind K,
+                                     llvm::StringRef Version);
+
+private:
+  bool Active = false;
+  std::chrono::steady_clock::time_point Start;
+};
+
+/// An event that is expensive across one or more traces, e.g. parsing a
+/// particular header or instantiating a particular template.
+struct TimeTraceHotspot {
+  /// The trace event name, e.g. "Source" or "InstantiateFunction".
+  std::string Event;
+  /// The subject of the event, e.g. a header path or a function name.
+  std::string Detail;
+  /// Sum of the event durations, in milliseconds.
+  double TotalMs = 0;
+  /// Number of times the event occurred.
+  unsigned Count = 0;
+};
+llvm::json::Value toJSON(const TimeTraceHotspot &);
+
+/// Aggregates time-trace profiles, returning the \p Limit most expensive
+/// events. Only events with a detail are considered, as only they identify a
+/// header or declaration. Nested events of the same kind (e.g. a header
+/// included from another) are both counted, so their costs are inclusive.
+std::vector<TimeTraceHotspot>
+summarizeTimeTraces(llvm::ArrayRef<std::string> Traces, size_t Limit);
+
+/// Thread-safe storage for the traces of files selected for profiling.
+/// Only the latest trace of each kind is kept per file.
+class TimeTraceStore {
+public:
+  /// Requests traces for subsequent builds of \p File.
+  void enable(PathRef File);
+  /// Whether builds of \p File should be profiled.
+  bool enabled(PathRef File) const;
+  /// Stops profiling \p File and drops its traces.
+  void remove(PathRef File);
+
+  void record(PathRef File, BuildTimeTrace Trace);
+  /// Returns the traces recorded for \p File, preamble first.
+  std::vector<BuildTimeTrace> traces(PathRef File) const;
+  /// Returns the JSON of all recorded traces.
+  std::vector<std::string> allTraces() const;
+
+  void profile(MemoryTree &MT) const;
+
+private:
+  struct FileTraces {
+    std::optional<BuildTimeTrace> Preamble;
+    std::optional<BuildTimeTrace> AST;
+  };
+  mutable std::mutex Mu;
+  llvm::StringMap<FileTraces> Files;
+};
+
+} // namespace clangd
+} // namespace clang
+
+#endif // LLVM_CLANG_TOOLS_EXTRA_CLANGD_TIMETRACE_H
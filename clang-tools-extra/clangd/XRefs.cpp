@@ -51,6 +51,7 @@
 #include "clang/Tooling/Syntax/Tokens.h"
 #include "llvm/ADT/ArrayRef.h"
 #include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/DenseSet.h"
 #include "llvm/ADT/STLExtras.h"
 #include "llvm/ADT/ScopeExit.h"
 #include "llvm/ADT/SmallSet.h"
@@ -1715,22 +1716,52 @@ symbolToCallHierarchyItem(const Symbol &S, PathRef TUPath) {
   return Result;
 }
 
+using SubTypesMap =
+    llvm::DenseMap<SymbolID, std::vector<TypeHierarchyItem>>;
+
+// Copies the subtypes of ID found by fillSubTypes, with Levels levels of
+// children.
+static void collectSubTypes(const SymbolID &ID, const SubTypesMap &Found,
+                            std::vector<TypeHierarchyItem> &SubTypes,
+                            int Levels) {
+  auto It = Found.find(ID);
+  if (It == Found.end())
+    return;
+  for (const TypeHierarchyItem &Child : It->second) {
+    SubTypes.push_back(Child);
+    if (Levels > 1) {
+      SubTypes.back().children.emplace();
+      collectSubTypes(Child.data.symbolID, Found, *SubTypes.back().children,
+                      Levels - 1);
+    }
+  }
+}
+
 static void fillSubTypes(const SymbolID &ID,
                          std::vector<TypeHierarchyItem> &SubTypes,
                          const SymbolIndex *Index, int Levels, PathRef TUPath) {
-  RelationsRequest Req;
-  Req.Subjects.insert(ID);
-  Req.Predicate = RelationKind::BaseOf;
-  Index->relations(Req, [&](const SymbolID &Subject, const Symbol &Object) {
-    if (std::optional<TypeHierarchyItem> ChildSym =
-            symbolToTypeHierarchyItem(Object, TUPath)) {
-      if (Levels > 1) {
-        ChildSym->children.emplace();
-        fillSubTypes(Object.ID, *ChildSym->children, Index, Levels - 1, TUPath);
+  // Query the index once per level, for all the classes of the level. Each
+  // class is queried once, even if it's reachable through several paths: the
+  // first time it's seen is at the shallowest level, so its subtypes are
+  // known for all the places it appears.
+  SubTypesMap Found;
+  llvm::DenseSet<SymbolID> Seen = {ID};
+  std::vector<SymbolID> Level = {ID};
+  for (int Depth = 0; Depth < Levels && !Level.empty(); ++Depth) {
+    RelationsRequest Req;
+    Req.Subjects.insert(Level.begin(), Level.end());
+    Req.Predicate = RelationKind::BaseOf;
+    Level.clear();
+    Index->relations(Req, [&](const SymbolID &Subject, const Symbol &Object) {
+      if (std::optional<TypeHierarchyItem> ChildSym =
+              symbolToTypeHierarchyItem(Object, TUPath)) {
+        Found[Subject].push_back(std::move(*ChildSym));
+        if (Seen.insert(Object.ID).second)
+          Level.push_back(Object.ID);
       }
-      SubTypes.emplace_back(std::move(*ChildSym));
-    }
-  });
+    });
+  }
+  collectSubTypes(ID, Found, SubTypes, Levels);
 }
 
 using RecursionProtectionSet = llvm::SmallSet<const CXXRecordDecl *, 4>;
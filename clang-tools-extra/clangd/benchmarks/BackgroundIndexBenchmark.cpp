@@ -0,0 +1,280 @@
+//===--- BackgroundIndexBenchmark.cpp - Background indexing -----*- C++ -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// Indexes a project from scratch with BackgroundIndex, and reports as
+// benchmark counters:
+//  - TUs indexed per second and shard bytes written.
+//  - the time spent in each phase, summed over all threads, from trace spans:
+//    BackgroundIndexPreamble (shared preambles), BackgroundIndexParse (parsing
+//    and visiting the AST), BackgroundIndexCollect (building the slabs),
+//    BackgroundIndexUpdate (sharding and updating the symbols), of which
+//    SerializeShard and WriteShard, and RebuildBackgroundIndex (rebuilding
+//    the index served while indexing).
+//
+// The project is either the compile_commands.json in the given directory, or
+// a generated one. Shards are written to a temporary directory, never to the
+// project. They are serialized into memory before being written, unlike the
+// disk-backed storage which streams them, to time both apart.
+//
+//===----------------------------------------------------------------------===//
+
+#include "../GlobalCompilationDatabase.h"
+#include "../SourceCode.h"
+#include "../index/Background.h"
+#include "../support/Context.h"
+#include "../support/ThreadsafeFS.h"
+#include "../support/Trace.h"
+#include "benchmark/benchmark.h"
+#include "clang/Tooling/CompilationDatabase.h"
+#include "clang/Tooling/JSONCompilationDatabase.h"
+#include "llvm/ADT/ScopeExit.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/Twine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/FileUtilities.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+
+const char *CompileCommandsDir = nullptr;
+
+namespace clang {
+namespace clangd {
+namespace {
+
+class ToolingCDB : public GlobalCompilationDatabase {
+public:
+  explicit ToolingCDB(std::unique_ptr<tooling::CompilationDatabase> Base)
+      : Base(std::move(Base)) {}
+
+  std::optional<tooling::CompileCommand>
+  getCompileCommand(PathRef File) const override {
+    auto Cmds = Base->getCompileCommands(File);
+    if (Cmds.empty())
+      return std::nullopt;
+    return std::move(Cmds.front());
+  }
+
+private:
+  std::unique_ptr<tooling::CompilationDatabase> Base;
+};
+
+void writeFile(llvm::StringRef Path, llvm::StringRef Contents) {
+  std::error_code EC;
+  llvm::raw_fd_ostream OS(Path, EC);
+  if (EC) {
+    llvm::errs() << "Error cannot write " << Path << ": " << EC.message()
+                 << "\n";
+    exit(1);
+  }
+  OS << Contents;
+}
+
+// A project of TUs including overlapping sets of headers.
+std::unique_ptr<tooling::CompilationDatabase>
+generateProject(llvm::StringRef Dir, std::vector<std::string> &Files) {
+  constexpr unsigned Headers = 20, TUs = 100, HeadersPerTU = 5;
+  for (unsigned H = 0; H < Headers; ++H) {
+    std::string Code;
+    llvm::raw_string_ostream OS(Code);
+    OS << "#pragma once\n";
+    for (unsigned I = 0; I < 200; ++I)
+      OS << "/// Doc for S" << H << "_" << I << ".\n"
+         << "struct S" << H << "_" << I << " { int f(int X) { return X + " << I
+         << "; } };\n";
+    writeFile((Dir + "/h" + llvm::Twine(H) + ".h").str(), Code);
+  }
+  for (unsigned T = 0; T < TUs; ++T) {
+    std::string Code;
+    llvm::raw_string_ostream OS(Code);
+    for (unsigned I = 0; I < HeadersPerTU; ++I)
+      OS << "#include \"h" << (T + I) % Headers << ".h\"\n";
+    for (unsigned I = 0; I < 100; ++I)
+      OS << "int tu" << T << "_" << I << "() { return S" << T % Headers << "_"
+         << I << "().f(" << I << "); }\n";
+    Files.push_back((Dir + "/tu" + llvm::Twine(T) + ".cpp").str());
+    writeFile(Files.back(), Code);
+  }
+  return std::make_unique<tooling::FixedCompilationDatabase>(
+      Dir, std::vector<std::string>{"-std=c++17"});
+}
+
+// Sums the duration of spans by name.
+class PhaseTracer : public trace::EventTracer {
+public:
+  Context beginSpan(
+      llvm::StringRef Name,
+      llvm::function_ref<void(llvm::json::Object *)> AttachDetails) override {
+    return Context::current().derive(llvm::make_scope_exit(
+        [this, Name = Name.str(), Start = std::chrono::steady_clock::now()] {
+          std::chrono::duration<double, std::milli> Ms =
+              std::chrono::steady_clock::now() - Start;
+          std::lock_guard<std::mutex> Lock(Mu);
+          Phases[Name].Ms += Ms.count();
+          ++Phases[Name].Count;
+        }));
+  }
+
+  void addBytesWritten(size_t N) {
+    std::lock_guard<std::mutex> Lock(Mu);
+    Bytes += N;
+  }
+
+  void report(benchmark::State &State) {
+    std::lock_guard<std::mutex> Lock(Mu);
+    auto PerIteration = [](double Value) {
+      return benchmark::Counter(Value, benchmark::Counter::kAvgIterations);
+    };
+    State.counters["bytes_written"] = PerIteration(Bytes);
+    State.counters["tus"] = PerIteration(Phases["BackgroundIndex"].Count);
+    State.counters["tus_per_second"] = benchmark::Counter(
+        Phases["BackgroundIndex"].Count, benchmark::Counter::kIsRate);
+    for (const auto &Entry : Phases) {
+      State.counters[(Entry.first() + ":ms").str()] =
+          PerIteration(Entry.second.Ms);
+      State.counters[(Entry.first() + ":count").str()] =
+          PerIteration(Entry.second.Count);
+    }
+  }
+
+private:
+  struct Phase {
+    double Ms = 0;
+    unsigned Count = 0;
+  };
+  std::mutex Mu;
+  llvm::StringMap<Phase> Phases;
+  double Bytes = 0;
+};
+
+// Stores shards in a directory like the disk-backed storage does, but
+// serializes them into memory first, so that serialization and writing are
+// timed apart. Indexing starts from scratch, so no shards are loaded.
+class ShardStorage : public BackgroundIndexStorage {
+public:
+  ShardStorage(llvm::StringRef Dir, PhaseTracer &Tracer)
+      : Dir(Dir), Tracer(Tracer) {}
+
+  llvm::Error storeShard(llvm::StringRef ShardIdentifier,
+                         IndexFileOut Shard) const override {
+    std::string Data;
+    {
+      trace::Span Span("SerializeShard");
+      llvm::raw_string_ostream(Data) << Shard;
+    }
+    Tracer.addBytesWritten(Data.size());
+    trace::Span Span("WriteShard");
+    llvm::SmallString<128> Path(Dir);
+    llvm::sys::path::append(Path, llvm::sys::path::filename(ShardIdentifier) +
+                                      "." +
+                                      llvm::toHex(digest(ShardIdentifier)) +
+                                      ".idx");
+    return llvm::writeFileAtomically((Path + ".tmp.%%%%%%%%").str(), Path,
+                                     [&Data](llvm::raw_ostream &OS) {
+                                       OS << Data;
+                                       return llvm::Error::success();
+                                     });
+  }
+
+  std::unique_ptr<IndexFileIn> loadShard(llvm::StringRef) const override {
+    return nullptr;
+  }
+
+private:
+  std::string Dir;
+  PhaseTracer &Tracer;
+};
+
+static void backgroundIndex(benchmark::State &State) {
+  std::vector<std::string> Files;
+  llvm::SmallString<128> ProjectDir;
+  std::unique_ptr<tooling::CompilationDatabase> Base;
+  if (CompileCommandsDir) {
+    std::string Error;
+    Base = tooling::JSONCompilationDatabase::loadFromDirectory(
+        CompileCommandsDir, Error);
+    if (!Base) {
+      llvm::errs() << "Error loading compilation database: " << Error << "\n";
+      exit(1);
+    }
+    Files = Base->getAllFiles();
+  } else {
+    if (auto EC = llvm::sys::fs::createUniqueDirectory("clangd-bgindex-project",
+                                                       ProjectDir)) {
+      llvm::errs() << "Error creating project: " << EC.message() << "\n";
+      exit(1);
+    }
+    Base = generateProject(ProjectDir, Files);
+  }
+  auto RemoveProject = llvm::make_scope_exit([&] {
+    if (!ProjectDir.empty())
+      llvm::sys::fs::remove_directories(ProjectDir);
+  });
+  ToolingCDB CDB(std::move(Base));
+  RealThreadsafeFS TFS;
+  PhaseTracer Tracer;
+  trace::Session Session(Tracer);
+
+  for (auto _ : State) {
+    State.PauseTiming();
+    llvm::SmallString<128> ShardRoot;
+    if (auto EC =
+            llvm::sys::fs::createUniqueDirectory("clangd-bgindex", ShardRoot)) {
+      llvm::errs() << "Error creating shard directory: " << EC.message()
+                   << "\n";
+      exit(1);
+    }
+    State.ResumeTiming();
+    {
+      BackgroundIndex::Options Opts;
+      Opts.ThreadPoolSize = State.range(0);
+      Opts.SharePreambles = State.range(1);
+      ShardStorage Storage(ShardRoot, Tracer);
+      BackgroundIndex Index(
+          TFS, CDB, [&](PathRef) { return &Storage; }, std::move(Opts));
+      Index.enqueue(Files);
+      if (!Index.blockUntilIdleForTest(/*TimeoutSeconds=*/std::nullopt)) {
+        llvm::errs() << "Error: indexing did not finish\n";
+        exit(1);
+      }
+    }
+    State.PauseTiming();
+    llvm::sys::fs::remove_directories(ShardRoot);
+    State.ResumeTiming();
+  }
+  Tracer.report(State);
+}
+BENCHMARK(backgroundIndex)
+    ->ArgNames({"threads", "share_preambles"})
+    ->ArgsProduct({{1, 4, 8}, {0, 1}})
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+
+} // namespace
+} // namespace clangd
+} // namespace clang
+
+int main(int argc, char *argv[]) {
+  // An optional directory containing compile_commands.json comes first.
+  if (argc > 1 && !llvm::StringRef(argv[1]).startswith("-")) {
+    CompileCommandsDir = argv[1];
+    // Trim it and pretend it was never passed.
+    argv[1] = argv[0];
+    ++argv;
+    --argc;
+  }
+  ::benchmark::Initialize(&argc, argv);
+  ::benchmark::RunSpecifiedBenchmarks();
+}
@@ -97,6 +97,44 @@ static void dexBuild(benchmark::State &State) {
 }
 BENCHMARK(dexBuild);
 
+// Looks up the relations of every subject in the index, one subject per
+// request, like the type hierarchy does.
+static void dexRelations(benchmark::State &State) {
+  auto Buffer = llvm::MemoryBuffer::getFile(IndexFilename);
+  if (!Buffer) {
+    llvm::errs() << "Error cannot open index file " << IndexFilename << ": "
+                 << Buffer.getError().message() << "\n";
+    exit(1);
+  }
+  auto Data = readIndexFile(Buffer.get()->getBuffer(), SymbolOrigin::Static);
+  if (!Data) {
+    llvm::errs() << "Error reading index file: "
+                 << llvm::toString(Data.takeError()) << "\n";
+    exit(1);
+  }
+  RelationSlab Relations =
+      Data->Relations ? std::move(*Data->Relations) : RelationSlab();
+  std::vector<RelationsRequest> Requests;
+  for (const Relation &R : Relations) {
+    if (!Requests.empty() &&
+        *Requests.back().Subjects.begin() == R.Subject &&
+        Requests.back().Predicate == R.Predicate)
+      continue;
+    Requests.emplace_back();
+    Requests.back().Subjects.insert(R.Subject);
+    Requests.back().Predicate = R.Predicate;
+  }
+  const auto Dex = dex::Dex::build(
+      Data->Symbols ? std::move(*Data->Symbols) : SymbolSlab(),
+      Data->Refs ? std::move(*Data->Refs) : RefSlab(), std::move(Relations));
+  for (auto _ : State)
+    for (const auto &Request : Requests)
+      Dex->relations(Request, [](const SymbolID &, const Symbol &) {});
+  State.counters["memory_bytes"] = Dex->estimateMemoryUsage();
+  State.SetItemsProcessed(State.iterations() * Requests.size());
+}
+BENCHMARK(dexRelations);
+
 } // namespace
 } // namespace clangd
 } // namespace clang
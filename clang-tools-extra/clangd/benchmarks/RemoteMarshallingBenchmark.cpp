@@ -0,0 +1,141 @@
+//===--- RemoteMarshallingBenchmark.cpp - Remote index wire formats -------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// Sends references through the remote index marshalling in a loopback: the
+// server encodes them, the messages are serialized to bytes and parsed back,
+// and the client decodes them. Compares the Refs (one message per reference)
+// and BatchedRefs wire formats, without the network.
+//
+//===----------------------------------------------------------------------===//
+
+#include "Index.pb.h"
+#include "index/Ref.h"
+#include "index/remote/marshalling/Marshalling.h"
+#include "benchmark/benchmark.h"
+#include "llvm/ADT/Twine.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/StringSaver.h"
+#include "llvm/Support/raw_ostream.h"
+#include <string>
+#include <vector>
+
+namespace clang {
+namespace clangd {
+namespace remote {
+namespace {
+
+constexpr llvm::StringLiteral RemoteRoot = "/remote/llvm-project/";
+constexpr llvm::StringLiteral LocalRoot = "/home/llvm-project/";
+
+// References to a symbol spread over a few hundred files, in index order.
+std::vector<clangd::Ref> makeRefs(unsigned Count,
+                                  llvm::UniqueStringSaver &Strings) {
+  std::vector<const char *> URIs;
+  for (unsigned I = 0; I < 200; ++I)
+    URIs.push_back(Strings
+                       .save(("file://" + RemoteRoot + "clang/lib/Sema/File" +
+                              llvm::Twine(I) + ".cpp")
+                                 .str())
+                       .begin());
+  std::vector<clangd::Ref> Refs(Count);
+  for (unsigned I = 0; I < Count; ++I) {
+    clangd::Ref &R = Refs[I];
+    R.Kind = clangd::RefKind::Reference | clangd::RefKind::Spelled;
+    R.Location.FileURI = URIs[I * URIs.size() / Count];
+    R.Location.Start.setLine(I % 100 * 37 + 12);
+    R.Location.Start.setColumn(I % 13 * 4);
+    R.Location.End = R.Location.Start;
+    R.Location.End.setColumn(R.Location.Start.column() + 8);
+    R.Container = SymbolID(("c:@F@f" + llvm::Twine(I % 50)).str());
+  }
+  return Refs;
+}
+
+void check(bool OK) {
+  if (!OK) {
+    llvm::errs() << "Error: failed to marshal references\n";
+    exit(1);
+  }
+}
+
+static void refs(benchmark::State &State) {
+  llvm::BumpPtrAllocator Arena;
+  llvm::UniqueStringSaver Strings(Arena);
+  auto Refs = makeRefs(State.range(0), Strings);
+  size_t Bytes = 0;
+  for (auto _ : State) {
+    Marshaller Server(RemoteRoot, "");
+    Marshaller Client("", LocalRoot);
+    Bytes = 0;
+    std::string Wire;
+    for (const auto &R : Refs) {
+      auto Serialized = Server.toProtobuf(R);
+      check(bool(Serialized));
+      RefsReply Reply;
+      *Reply.mutable_stream_result() = std::move(*Serialized);
+      check(Reply.SerializeToString(&Wire));
+      Bytes += Wire.size();
+
+      RefsReply Received;
+      check(Received.ParseFromString(Wire));
+      auto Deserialized = Client.fromProtobuf(Received.stream_result());
+      check(bool(Deserialized));
+      benchmark::DoNotOptimize(*Deserialized);
+    }
+  }
+  State.counters["bytes_per_ref"] = double(Bytes) / Refs.size();
+  State.SetItemsProcessed(State.iterations() * Refs.size());
+}
+BENCHMARK(refs)->Arg(1000)->Arg(10000)->Arg(50000);
+
+static void batchedRefs(benchmark::State &State) {
+  llvm::BumpPtrAllocator Arena;
+  llvm::UniqueStringSaver Strings(Arena);
+  auto Refs = makeRefs(State.range(0), Strings);
+  constexpr size_t BatchSize = 1000;
+  size_t Bytes = 0;
+  for (auto _ : State) {
+    Marshaller Server(RemoteRoot, "");
+    Marshaller Client("", LocalRoot);
+    RefsBatchBuilder Builder(Server, /*WantContainer=*/true);
+    Bytes = 0;
+    std::string Wire;
+    auto Send = [&] {
+      BatchedRefsReply Reply;
+      *Reply.mutable_stream_result() = Builder.take();
+      check(Reply.SerializeToString(&Wire));
+      Bytes += Wire.size();
+
+      BatchedRefsReply Received;
+      check(Received.ParseFromString(Wire));
+      auto Deserialized = Client.fromProtobuf(Received.stream_result());
+      check(bool(Deserialized));
+      benchmark::DoNotOptimize(*Deserialized);
+    };
+    for (const auto &R : Refs) {
+      if (llvm::Error Err = Builder.add(R)) {
+        llvm::errs() << "Error: " << llvm::toString(std::move(Err)) << "\n";
+        exit(1);
+      }
+      if (Builder.size() >= BatchSize)
+        Send();
+    }
+    if (Builder.size())
+      Send();
+  }
+  State.counters["bytes_per_ref"] = double(Bytes) / Refs.size();
+  State.SetItemsProcessed(State.iterations() * Refs.size());
+}
+BENCHMARK(batchedRefs)->Arg(1000)->Arg(10000)->Arg(50000);
+
+} // namespace
+} // namespace remote
+} // namespace clangd
+} // namespace clang
+
+BENCHMARK_MAIN();
@@ -0,0 +1,313 @@
+//===--- ReplayBenchmark.cpp - Replay recorded LSP sessions -----*- C++ -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// Replays a session recorded with `clangd --input-mirror-file` against an
+// in-process ClangdLSPServer, and reports per-method latency percentiles,
+// preamble and AST builds, CPU time and peak memory as benchmark counters.
+// Use --benchmark_format=json for machine-readable output.
+//
+// The recording only holds what the client sent, not when. Messages are sent
+// as soon as the ordering allows, optionally followed by a fixed pause:
+//  - pipelined: in order, without waiting for replies.
+//  - synchronous: each message waits for replies to all previous requests,
+//    like an editor blocking on results.
+// Replies the client sent to server requests are dropped, and the server's
+// requests are answered with null instead, as their IDs change on replay.
+//
+// The recording refers to files on disk, which must still be there.
+//
+//===----------------------------------------------------------------------===//
+
+#include "../ClangdLSPServer.h"
+#include "../Transport.h"
+#include "../support/ThreadsafeFS.h"
+#include "../support/Trace.h"
+#include "benchmark/benchmark.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Config/llvm-config.h"
+#include "llvm/Support/JSON.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Process.h"
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+#ifdef LLVM_ON_UNIX
+#include <sys/resource.h>
+#endif
+
+const char *RecordingFilename;
+unsigned PauseMilliseconds = 0;
+
+namespace clang {
+namespace clangd {
+namespace {
+
+// Reads the messages of a recording in the standard LSP framing.
+std::vector<llvm::json::Value> readRecording() {
+  auto Buffer = llvm::MemoryBuffer::getFile(RecordingFilename);
+  if (!Buffer) {
+    llvm::errs() << "Error cannot open recording " << RecordingFilename << ": "
+                 << Buffer.getError().message() << "\n";
+    exit(1);
+  }
+
+  std::vector<llvm::json::Value> Messages;
+  llvm::StringRef Rest = Buffer.get()->getBuffer();
+  while (!Rest.ltrim().empty()) {
+    size_t Length = 0;
+    // Headers are terminated by an empty line. Only Content-Length matters.
+    while (true) {
+      llvm::StringRef Line;
+      std::tie(Line, Rest) = Rest.split('\n');
+      Line = Line.trim();
+      if (Line.empty())
+        break;
+      if (Line.consume_front("Content-Length:") &&
+          Line.trim().getAsInteger(10, Length)) {
+        llvm::errs() << "Error bad Content-Length in recording: " << Line
+                     << "\n";
+        exit(1);
+      }
+    }
+    if (!Length || Length > Rest.size()) {
+      llvm::errs() << "Error truncated recording at offset "
+                   << Buffer.get()->getBufferSize() - Rest.size() << "\n";
+      exit(1);
+    }
+    auto Message = llvm::json::parse(Rest.take_front(Length));
+    if (!Message) {
+      llvm::errs() << "Error when parsing recorded message: "
+                   << llvm::toString(Message.takeError()) << "\n";
+      exit(1);
+    }
+    Messages.push_back(std::move(*Message));
+    Rest = Rest.drop_front(Length);
+  }
+  return Messages;
+}
+
+// Feeds recorded messages to the server, and answers its requests.
+class ReplayTransport : public Transport {
+public:
+  ReplayTransport(llvm::ArrayRef<llvm::json::Value> Messages,
+                  bool WaitForReplies)
+      : Messages(Messages), WaitForReplies(WaitForReplies) {}
+
+  void notify(llvm::StringRef Method, llvm::json::Value Params) override {}
+
+  void call(llvm::StringRef Method, llvm::json::Value Params,
+            llvm::json::Value ID) override {
+    {
+      std::lock_guard<std::mutex> Lock(Mu);
+      ServerCalls.push_back(std::move(ID));
+    }
+    CV.notify_all();
+  }
+
+  void reply(llvm::json::Value ID,
+             llvm::Expected<llvm::json::Value> Result) override {
+    if (!Result)
+      llvm::consumeError(Result.takeError());
+    {
+      std::lock_guard<std::mutex> Lock(Mu);
+      Outstanding.erase(llvm::to_string(ID));
+    }
+    CV.notify_all();
+  }
+
+  llvm::Error loop(MessageHandler &Handler) override {
+    for (const llvm::json::Value &Message : Messages) {
+      if (WaitForReplies)
+        waitForReplies(Handler);
+      else
+        answerServerCalls(Handler);
+      if (PauseMilliseconds)
+        std::this_thread::sleep_for(
+            std::chrono::milliseconds(PauseMilliseconds));
+
+      const llvm::json::Object *Object = Message.getAsObject();
+      if (!Object)
+        continue;
+      std::optional<llvm::StringRef> Method = Object->getString("method");
+      if (!Method)
+        continue; // A reply to a request from the recorded server.
+      llvm::json::Value Params = nullptr;
+      if (const llvm::json::Value *P = Object->get("params"))
+        Params = *P;
+      if (const llvm::json::Value *ID = Object->get("id")) {
+        {
+          std::lock_guard<std::mutex> Lock(Mu);
+          Outstanding.insert(llvm::to_string(*ID));
+        }
+        if (!Handler.onCall(*Method, std::move(Params), *ID))
+          return llvm::Error::success();
+      } else if (!Handler.onNotify(*Method, std::move(Params))) {
+        return llvm::Error::success();
+      }
+    }
+    // The recording ended without an exit notification.
+    waitForReplies(Handler);
+    return llvm::Error::success();
+  }
+
+private:
+  void answerServerCalls(MessageHandler &Handler) {
+    std::deque<llvm::json::Value> Calls;
+    {
+      std::lock_guard<std::mutex> Lock(Mu);
+      std::swap(Calls, ServerCalls);
+    }
+    for (llvm::json::Value &ID : Calls)
+      Handler.onReply(std::move(ID), llvm::json::Value(nullptr));
+  }
+
+  // Replies are sent on other threads, while the server's requests must be
+  // answered on this one.
+  void waitForReplies(MessageHandler &Handler) {
+    while (true) {
+      answerServerCalls(Handler);
+      std::unique_lock<std::mutex> Lock(Mu);
+      CV.wait(Lock,
+              [&] { return Outstanding.empty() || !ServerCalls.empty(); });
+      if (ServerCalls.empty())
+        return;
+    }
+  }
+
+  llvm::ArrayRef<llvm::json::Value> Messages;
+  bool WaitForReplies;
+  std::mutex Mu;
+  std::condition_variable CV;
+  std::set<std::string> Outstanding;       // IDs of requests without replies.
+  std::deque<llvm::json::Value> ServerCalls; // IDs of requests to answer.
+};
+
+// Collects request latencies and counts AST and preamble builds.
+class ReplayTracer : public trace::EventTracer {
+public:
+  Context beginSpan(
+      llvm::StringRef Name,
+      llvm::function_ref<void(llvm::json::Object *)> AttachDetails) override {
+    if (Name == "BuildPreamble" || Name == "BuildAST") {
+      std::lock_guard<std::mutex> Lock(Mu);
+      ++Builds[Name];
+    }
+    return EventTracer::beginSpan(Name, AttachDetails);
+  }
+
+  void record(const trace::Metric &Metric, double Value,
+              llvm::StringRef Label) override {
+    if (Metric.Name != "lsp_latency")
+      return;
+    std::lock_guard<std::mutex> Lock(Mu);
+    Latencies[Label].push_back(Value);
+  }
+
+  void report(benchmark::State &State) {
+    std::lock_guard<std::mutex> Lock(Mu);
+    for (auto &Entry : Builds)
+      State.counters[Entry.first()] = benchmark::Counter(
+          Entry.second, benchmark::Counter::kAvgIterations);
+    for (auto &Entry : Latencies) {
+      std::vector<double> &Seconds = Entry.second;
+      llvm::sort(Seconds);
+      auto Percentile = [&](double P) {
+        return Seconds[std::min<size_t>(Seconds.size() - 1,
+                                        P * Seconds.size())] *
+               1000;
+      };
+      std::string Method = Entry.first().str();
+      State.counters[Method + ":count"] = benchmark::Counter(
+          Seconds.size(), benchmark::Counter::kAvgIterations);
+      State.counters[Method + ":p50_ms"] = Percentile(0.5);
+      State.counters[Method + ":p90_ms"] = Percentile(0.9);
+      State.counters[Method + ":p99_ms"] = Percentile(0.99);
+    }
+  }
+
+private:
+  std::mutex Mu;
+  llvm::StringMap<unsigned> Builds;
+  llvm::StringMap<std::vector<double>> Latencies;
+};
+
+double cpuSeconds() {
+  std::chrono::nanoseconds Elapsed, User, System;
+  llvm::sys::Process::GetTimeUsage(Elapsed, User, System);
+  return std::chrono::duration<double>(User + System).count();
+}
+
+// Returns the peak resident set size in MiB, or 0 if unknown.
+double peakMemoryMiB() {
+#ifdef LLVM_ON_UNIX
+  struct rusage Usage;
+  if (getrusage(RUSAGE_SELF, &Usage) == 0)
+#ifdef __APPLE__
+    return Usage.ru_maxrss / (1024.0 * 1024.0); // bytes
+#else
+    return Usage.ru_maxrss / 1024.0; // KiB
+#endif
+#endif
+  return 0;
+}
+
+static void replay(benchmark::State &State, bool WaitForReplies) {
+  const auto Messages = readRecording();
+  ReplayTracer Tracer;
+  trace::Session Session(Tracer);
+  RealThreadsafeFS TFS;
+  ClangdLSPServer::Options Opts;
+  double CPU = cpuSeconds();
+  for (auto _ : State) {
+    ReplayTransport Transport(Messages, WaitForReplies);
+    // The destructor waits for outstanding work, which is part of the replay.
+    ClangdLSPServer Server(Transport, TFS, Opts);
+    Server.run();
+  }
+  State.counters["cpu_seconds"] = benchmark::Counter(
+      cpuSeconds() - CPU, benchmark::Counter::kAvgIterations);
+  State.counters["peak_memory_mib"] = peakMemoryMiB();
+  Tracer.report(State);
+}
+BENCHMARK_CAPTURE(replay, pipelined, /*WaitForReplies=*/false)
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+BENCHMARK_CAPTURE(replay, synchronous, /*WaitForReplies=*/true)
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+
+} // namespace
+} // namespace clangd
+} // namespace clang
+
+int main(int argc, char *argv[]) {
+  if (argc < 2) {
+    llvm::errs() << "Usage: " << argv[0]
+                 << " session.jsonrpc [pause-ms] BENCHMARK_OPTIONS...\n";
+    return -1;
+  }
+  RecordingFilename = argv[1];
+  int Consumed = 1;
+  if (argc > 2 && llvm::StringRef(argv[2]).getAsInteger(10, PauseMilliseconds))
+    PauseMilliseconds = 0;
+  else if (argc > 2)
+    ++Consumed;
+  // Trim our arguments and pretend they were never passed.
+  argv[Consumed] = argv[0];
+  argv += Consumed;
+  argc -= Consumed;
+  ::benchmark::Initialize(&argc, argv);
+  ::benchmark::RunSpecifiedBenchmarks();
+}
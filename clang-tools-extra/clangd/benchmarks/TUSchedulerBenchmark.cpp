@@ -0,0 +1,266 @@
+//===--- TUSchedulerBenchmark.cpp - Scheduling under load -------*- C++ -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// Drives a TUScheduler with synthetic editing sessions: the given number of
+// files are open and typed in concurrently, each edit followed by a hover and
+// sometimes a code completion request. Every few edits change the preamble.
+//
+// Reports as benchmark counters:
+//  - wait percentiles of hover (runWithAST) and completion (runWithPreamble)
+//    requests, from scheduling until their action runs.
+//  - fairness: the mean hover wait of the worst file over the mean of all.
+//  - preamble and AST builds, and wasted builds, whose diagnostics were
+//    superseded by a newer edit before they were ready.
+//
+// The files are in memory and don't include the standard library, so this
+// measures scheduling rather than parsing. Use ReplayBenchmark for real
+// sessions.
+//
+//===----------------------------------------------------------------------===//
+
+#include "../Compiler.h"
+#include "../GlobalCompilationDatabase.h"
+#include "../ParsedAST.h"
+#include "../TUScheduler.h"
+#include "../support/Threading.h"
+#include "../support/ThreadsafeFS.h"
+#include "benchmark/benchmark.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/Twine.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/VirtualFileSystem.h"
+#include "llvm/Support/raw_ostream.h"
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace clang {
+namespace clangd {
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+constexpr unsigned EditsPerFile = 20;
+constexpr auto TypingInterval = std::chrono::milliseconds(20);
+// Every this many edits, the preamble of the file changes.
+constexpr unsigned PreambleEditInterval = 5;
+// Every this many edits, code completion is requested.
+constexpr unsigned CompletionInterval = 3;
+
+#ifdef _WIN32
+constexpr llvm::StringLiteral Root = "C:\\bench\\";
+#else
+constexpr llvm::StringLiteral Root = "/bench/";
+#endif
+
+std::string filePath(unsigned File) {
+  return (Root + "file" + llvm::Twine(File) + ".cpp").str();
+}
+
+// A header large enough for preamble builds to matter.
+std::string commonHeader() {
+  std::string Code;
+  llvm::raw_string_ostream OS(Code);
+  for (unsigned I = 0; I < 2000; ++I) {
+    OS << "struct S" << I << " { int f(int); S" << I << " *Next; };\n";
+    OS << "template <typename T> T g" << I << "(T X) { return X + " << I
+       << "; }\n";
+  }
+  return Code;
+}
+
+std::string contents(unsigned Version) {
+  std::string Code;
+  llvm::raw_string_ostream OS(Code);
+  OS << "#define PREAMBLE_" << Version / PreambleEditInterval << "\n"
+     << "#include \"common.h\"\n";
+  for (unsigned I = 0; I < 200; ++I)
+    OS << "int f" << I << "(S" << I << " &X) { return g" << I << "(X.f("
+       << Version << ")); }\n";
+  return Code;
+}
+
+class InMemoryFS : public ThreadsafeFS {
+public:
+  llvm::StringMap<std::string> Files;
+
+private:
+  llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> viewImpl() const override {
+    auto FS = llvm::makeIntrusiveRefCnt<llvm::vfs::InMemoryFileSystem>();
+    for (const auto &File : Files)
+      FS->addFile(File.first(), /*ModificationTime=*/0,
+                  llvm::MemoryBuffer::getMemBufferCopy(File.second,
+                                                       File.first()));
+    return FS;
+  }
+};
+
+// Collected over all iterations.
+class Stats {
+public:
+  explicit Stats(unsigned Files) : HoverWaitsByFile(Files) {}
+
+  void recordWait(llvm::StringRef Kind, unsigned File,
+                  Clock::time_point Start) {
+    double Ms = std::chrono::duration<double, std::milli>(Clock::now() - Start)
+                    .count();
+    std::lock_guard<std::mutex> Lock(Mu);
+    Waits[Kind].push_back(Ms);
+    if (Kind == "hover")
+      HoverWaitsByFile[File].push_back(Ms);
+  }
+
+  void setLatest(llvm::StringRef File, llvm::StringRef Version) {
+    std::lock_guard<std::mutex> Lock(Mu);
+    Latest[File] = Version.str();
+  }
+
+  void recordDiagnosticsBuild(llvm::StringRef File, llvm::StringRef Version) {
+    std::lock_guard<std::mutex> Lock(Mu);
+    if (Latest.lookup(File) != Version)
+      ++WastedBuilds;
+  }
+
+  void recordFileStats(const llvm::StringMap<TUScheduler::FileStats> &Files) {
+    std::lock_guard<std::mutex> Lock(Mu);
+    for (const auto &File : Files) {
+      PreambleBuilds += File.second.PreambleBuilds;
+      ASTBuilds += File.second.ASTBuilds;
+    }
+  }
+
+  void report(benchmark::State &State) {
+    std::lock_guard<std::mutex> Lock(Mu);
+    auto PerIteration = [](double Count) {
+      return benchmark::Counter(Count, benchmark::Counter::kAvgIterations);
+    };
+    State.counters["preamble_builds"] = PerIteration(PreambleBuilds);
+    State.counters["ast_builds"] = PerIteration(ASTBuilds);
+    State.counters["wasted_builds"] = PerIteration(WastedBuilds);
+    for (auto &Entry : Waits) {
+      std::vector<double> &Ms = Entry.second;
+      llvm::sort(Ms);
+      auto Percentile = [&](double P) {
+        return Ms[std::min<size_t>(Ms.size() - 1, P * Ms.size())];
+      };
+      std::string Kind = Entry.first().str();
+      State.counters[Kind + ":p50_ms"] = Percentile(0.5);
+      State.counters[Kind + ":p90_ms"] = Percentile(0.9);
+      State.counters[Kind + ":p99_ms"] = Percentile(0.99);
+      State.counters[Kind + ":max_ms"] = Ms.back();
+    }
+    double Total = 0, Worst = 0;
+    size_t Count = 0;
+    for (const auto &FileWaits : HoverWaitsByFile) {
+      if (FileWaits.empty())
+        continue;
+      double Sum = 0;
+      for (double Ms : FileWaits)
+        Sum += Ms;
+      Worst = std::max(Worst, Sum / FileWaits.size());
+      Total += Sum;
+      Count += FileWaits.size();
+    }
+    if (Count && Total)
+      State.counters["hover:fairness"] = Worst / (Total / Count);
+  }
+
+private:
+  std::mutex Mu;
+  llvm::StringMap<std::vector<double>> Waits;
+  std::vector<std::vector<double>> HoverWaitsByFile;
+  llvm::StringMap<std::string> Latest;
+  unsigned PreambleBuilds = 0;
+  unsigned ASTBuilds = 0;
+  unsigned WastedBuilds = 0;
+};
+
+class StatsCallbacks : public ParsingCallbacks {
+public:
+  explicit StatsCallbacks(Stats &S) : S(S) {}
+
+  void onMainAST(PathRef Path, ParsedAST &AST, PublishFn Publish) override {
+    S.recordDiagnosticsBuild(Path, AST.version());
+  }
+
+private:
+  Stats &S;
+};
+
+static void scheduler(benchmark::State &State, DebouncePolicy Debounce) {
+  unsigned NumFiles = State.range(0);
+  InMemoryFS FS;
+  FS.Files[(Root + "common.h").str()] = commonHeader();
+  OverlayCDB CDB(/*Base=*/nullptr, /*FallbackFlags=*/{"-std=c++17"});
+  Stats S(NumFiles);
+
+  for (auto _ : State) {
+    TUScheduler::Options Opts;
+    Opts.UpdateDebounce = Debounce;
+    Opts.StorePreamblesInMemory = true;
+    TUScheduler Scheduler(CDB, Opts, std::make_unique<StatsCallbacks>(S));
+    for (unsigned Version = 0; Version < EditsPerFile; ++Version) {
+      for (unsigned File = 0; File < NumFiles; ++File) {
+        std::string Path = filePath(File);
+        ParseInputs Inputs;
+        Inputs.CompileCommand = CDB.getFallbackCommand(Path);
+        Inputs.TFS = &FS;
+        Inputs.Contents = contents(Version);
+        Inputs.Version = std::to_string(Version);
+        S.setLatest(Path, Inputs.Version);
+        Scheduler.update(Path, std::move(Inputs), WantDiagnostics::Auto);
+
+        auto Start = Clock::now();
+        Scheduler.runWithAST(
+            "Hover", Path, [&S, File, Start](llvm::Expected<InputsAndAST> AST) {
+              if (!AST)
+                return llvm::consumeError(AST.takeError());
+              S.recordWait("hover", File, Start);
+            });
+        if (Version % CompletionInterval == 0)
+          Scheduler.runWithPreamble(
+              "CodeComplete", Path, TUScheduler::Stale,
+              [&S, File, Start](llvm::Expected<InputsAndPreamble> Preamble) {
+                if (!Preamble)
+                  return llvm::consumeError(Preamble.takeError());
+                S.recordWait("completion", File, Start);
+              });
+      }
+      std::this_thread::sleep_for(TypingInterval);
+    }
+    Scheduler.blockUntilIdle(Deadline::infinity());
+    S.recordFileStats(Scheduler.fileStats());
+  }
+  S.report(State);
+}
+// Like ClangdServer's default.
+BENCHMARK_CAPTURE(scheduler, debounced,
+                  DebouncePolicy{/*Min=*/std::chrono::milliseconds(50),
+                                 /*Max=*/std::chrono::milliseconds(500),
+                                 /*RebuildRatio=*/1})
+    ->Arg(1)
+    ->Arg(8)
+    ->Arg(32)
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+BENCHMARK_CAPTURE(scheduler, immediate, DebouncePolicy::fixed({}))
+    ->Arg(1)
+    ->Arg(8)
+    ->Arg(32)
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+
+} // namespace
+} // namespace clangd
+} // namespace clang
+
+BENCHMARK_MAIN();
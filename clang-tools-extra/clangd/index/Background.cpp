@@ -28,9 +28,14 @@
 #include "support/Threading.h"
 #include "support/ThreadsafeFS.h"
 #include "support/Trace.h"
+#include "clang/AST/ASTContext.h"
 #include "clang/Basic/SourceLocation.h"
 #include "clang/Basic/SourceManager.h"
+#include "clang/Frontend/CompilerInstance.h"
 #include "clang/Frontend/FrontendAction.h"
+#include "clang/Lex/HeaderSearch.h"
+#include "clang/Lex/Preprocessor.h"
+#include "clang/Lex/PreprocessingRecord.h"
 #include "llvm/ADT/ArrayRef.h"
 #include "llvm/ADT/DenseSet.h"
 #include "llvm/ADT/STLExtras.h"
@@ -76,6 +81,28 @@ llvm::SmallString<128> getAbsolutePath(const tooling::CompileCommand &Cmd) {
   return AbsolutePath;
 }
 
+// Approximates the memory held by the compiler while indexing a TU, which is
+// close to its peak as the AST is never freed before the end of the TU.
+size_t compilerMemoryUsage(const CompilerInstance &Clang) {
+  const ASTContext &AST = Clang.getASTContext();
+  size_t Total = AST.getASTAllocatedMemory();
+  Total += AST.getSideTableAllocatedMemory();
+  Total += AST.Idents.getAllocator().getTotalMemory();
+  Total += AST.Selectors.getTotalMemory();
+
+  const SourceManager &SM = Clang.getSourceManager();
+  Total += SM.getContentCacheSize();
+  Total += SM.getDataStructureSizes();
+  Total += SM.getMemoryBufferSizes().malloc_bytes;
+
+  const Preprocessor &PP = Clang.getPreprocessor();
+  Total += PP.getTotalMemory();
+  if (PreprocessingRecord *PRec = PP.getPreprocessingRecord())
+    Total += PRec->getTotalMemory();
+  Total += PP.getHeaderSearchInfo().getTotalMemory();
+  return Total;
+}
+
 bool shardIsStale(const LoadedShard &LS, llvm::vfs::FileSystem *FS) {
   auto Buf = FS->getBufferForFile(LS.AbsolutePath);
   if (!Buf) {
@@ -98,12 +125,16 @@ BackgroundIndex::BackgroundIndex(
       IndexedSymbols(IndexContents::All),
       Rebuilder(this, &IndexedSymbols, Opts.ThreadPoolSize),
       IndexStorageFactory(std::move(IndexStorageFactory)),
-      Queue(std::move(Opts.OnProgress)),
+      Queue(std::move(Opts.OnProgress), Opts.MemoryBudget),
       CommandsChanged(
           CDB.watch([&](const std::vector<std::string> &ChangedFiles) {
             enqueue(ChangedFiles);
           })) {
   assert(Opts.ThreadPoolSize > 0 && "Thread pool size can't be zero.");
+  // Each group holds a preamble in memory, so this bounds the memory to
+  // 2 * ThreadPoolSize preambles.
+  if (Opts.SharePreambles)
+    Preambles = std::make_unique<BackgroundPreambles>(2 * Opts.ThreadPoolSize);
   assert(this->IndexStorageFactory && "Storage factory can not be null!");
   for (unsigned I = 0; I < Opts.ThreadPoolSize; ++I) {
     ThreadPool.runAsync("background-worker-" + llvm::Twine(I + 1),
@@ -134,12 +165,16 @@ BackgroundQueue::Task BackgroundIndex::changedFilesTask(
 
     auto NeedsReIndexing = loadProject(std::move(ChangedFiles));
     // Run indexing for files that need to be updated.
-    std::shuffle(NeedsReIndexing.begin(), NeedsReIndexing.end(),
-                 std::mt19937(std::random_device{}()));
+    // Sibling files are likely to share a preamble, keep them together then.
+    if (Preambles)
+      llvm::sort(NeedsReIndexing);
+    else
+      std::shuffle(NeedsReIndexing.begin(), NeedsReIndexing.end(),
+                   std::mt19937(std::random_device{}()));
     std::vector<BackgroundQueue::Task> Tasks;
     Tasks.reserve(NeedsReIndexing.size());
-    for (const auto &File : NeedsReIndexing)
-      Tasks.push_back(indexFileTask(std::move(File)));
+    for (auto &File : NeedsReIndexing)
+      Tasks.push_back(indexFileTask(std::move(File.first), File.second));
     Queue.append(std::move(Tasks));
   });
 
@@ -153,10 +188,11 @@ static llvm::StringRef filenameWithoutExtension(llvm::StringRef Path) {
   return Path.drop_back(llvm::sys::path::extension(Path).size());
 }
 
-BackgroundQueue::Task BackgroundIndex::indexFileTask(std::string Path) {
+BackgroundQueue::Task BackgroundIndex::indexFileTask(std::string Path,
+                                                     size_t Memory) {
   std::string Tag = filenameWithoutExtension(Path).str();
   uint64_t Key = llvm::xxHash64(Path);
-  BackgroundQueue::Task T([this, Path(std::move(Path))] {
+  BackgroundQueue::Task T([this, Path] {
     std::optional<WithContext> WithProvidedContext;
     if (ContextProvider)
       WithProvidedContext.emplace(ContextProvider(Path));
@@ -170,6 +206,7 @@ BackgroundQueue::Task BackgroundIndex::indexFileTask(std::string Path) {
   T.ThreadPri = IndexingPriority;
   T.Tag = std::move(Tag);
   T.Key = Key;
+  T.Memory = Memory;
   return T;
 }
 
@@ -216,8 +253,10 @@ void BackgroundIndex::update(
 
     // Only store command line hash for main files of the TU, since our
     // current model keeps only one version of a header file.
-    if (Path != MainFile)
+    if (Path != MainFile) {
       IF->Cmd.reset();
+      IF->IndexingMemory = 0;
+    }
 
     // We need to store shards before updating the index, since the latter
     // consumes slabs.
@@ -261,13 +300,6 @@ llvm::Error BackgroundIndex::index(tooling::CompileCommand Cmd) {
     return llvm::errorCodeToError(Buf.getError());
   auto Hash = digest(Buf->get()->getBuffer());
 
-  // Take a snapshot of the versions to avoid locking for each file in the TU.
-  llvm::StringMap<ShardVersion> ShardVersionsSnapshot;
-  {
-    std::lock_guard<std::mutex> Lock(ShardVersionsMu);
-    ShardVersionsSnapshot = ShardVersions;
-  }
-
   vlog("Indexing {0} (digest:={1})", Cmd.Filename, llvm::toHex(Hash));
   ParseInputs Inputs;
   Inputs.TFS = &TFS;
@@ -277,9 +309,33 @@ llvm::Error BackgroundIndex::index(tooling::CompileCommand Cmd) {
   if (!CI)
     return error("Couldn't build compiler invocation");
 
-  auto Clang =
-      prepareCompilerInstance(std::move(CI), /*Preamble=*/nullptr,
-                              std::move(*Buf), std::move(FS), IgnoreDiags);
+  uint64_t PreambleKey = 0;
+  BackgroundPreambles::Shared Shared;
+  if (Preambles) {
+    // The indexing action sets these, a preamble must agree with it.
+    CI->getLangOpts()->CommentOpts.ParseAllComments = true;
+    CI->getLangOpts()->RetainCommentsFromSystemHeaders = true;
+    Inputs.Contents = Buf->get()->getBuffer().str();
+    PreambleKey = BackgroundPreambles::key(Inputs.CompileCommand, *CI,
+                                           Inputs.Contents);
+    if (PreambleKey) {
+      trace::Span PreambleTracer("BackgroundIndexPreamble");
+      Shared = Preambles->get(PreambleKey, AbsolutePath, *CI, Inputs);
+    }
+  }
+
+  // Take a snapshot of the versions to avoid locking for each file in the TU.
+  // This must follow the preamble lookup: the headers a preamble stands for
+  // are up to date by then.
+  llvm::StringMap<ShardVersion> ShardVersionsSnapshot;
+  {
+    std::lock_guard<std::mutex> Lock(ShardVersionsMu);
+    ShardVersionsSnapshot = ShardVersions;
+  }
+
+  auto Clang = prepareCompilerInstance(
+      std::move(CI), Shared.Preamble ? &Shared.Preamble->Preamble : nullptr,
+      std::move(*Buf), std::move(FS), IgnoreDiags);
   if (!Clang)
     return error("Couldn't build compiler instance");
 
@@ -317,13 +373,22 @@ llvm::Error BackgroundIndex::index(tooling::CompileCommand Cmd) {
   // but the leaky "recovery" is pretty scary too in a long-running process.
   // If crashes are a real problem, maybe we should fork a child process.
 
-  const FrontendInputFile &Input = Clang->getFrontendOpts().Inputs.front();
-  if (!Action->BeginSourceFile(*Clang, Input))
-    return error("BeginSourceFile() failed");
-  if (llvm::Error Err = Action->Execute())
-    return Err;
-
-  Action->EndSourceFile();
+  // The SymbolCollector sees the AST while it is parsed, and builds the slabs
+  // at the end of the file.
+  size_t Memory;
+  {
+    trace::Span ParseTracer("BackgroundIndexParse");
+    const FrontendInputFile &Input = Clang->getFrontendOpts().Inputs.front();
+    if (!Action->BeginSourceFile(*Clang, Input))
+      return error("BeginSourceFile() failed");
+    if (llvm::Error Err = Action->Execute())
+      return Err;
+    Memory = compilerMemoryUsage(*Clang);
+  }
+  {
+    trace::Span CollectTracer("BackgroundIndexCollect");
+    Action->EndSourceFile();
+  }
 
   Index.Cmd = Inputs.CompileCommand;
   assert(Index.Symbols && Index.Refs && Index.Sources &&
@@ -336,6 +401,12 @@ llvm::Error BackgroundIndex::index(tooling::CompileCommand Cmd) {
   SPAN_ATTACH(Tracer, "refs", int(Index.Refs->numRefs()));
   SPAN_ATTACH(Tracer, "sources", int(Index.Sources->size()));
 
+  Memory += Index.Symbols->bytes() + Index.Refs->bytes();
+  SPAN_ATTACH(Tracer, "memory", int64_t(Memory));
+  Queue.recordMemory(Memory);
+  // Stored in the shard of the main file, for the next time it is indexed.
+  Index.IndexingMemory = Memory;
+
   bool HadErrors = Clang->hasDiagnostics() &&
                    Clang->getDiagnostics().hasUncompilableErrorOccurred();
   if (HadErrors) {
@@ -343,7 +414,19 @@ llvm::Error BackgroundIndex::index(tooling::CompileCommand Cmd) {
     for (auto &It : *Index.Sources)
       It.second.Flags |= IncludeGraphNode::SourceFlag::HadErrors;
   }
-  update(AbsolutePath, std::move(Index), ShardVersionsSnapshot, HadErrors);
+  // Headers parsed from the preamble were not seen by the indexing action.
+  std::optional<BackgroundPreambles::Headers> IndexedHeaders;
+  if (Shared.Preamble)
+    BackgroundPreambles::addHeaders(*Shared.Indexed, *Index.Sources);
+  else if (PreambleKey && !HadErrors)
+    IndexedHeaders = BackgroundPreambles::headers(*Index.Sources);
+  {
+    trace::Span UpdateTracer("BackgroundIndexUpdate");
+    update(AbsolutePath, std::move(Index), ShardVersionsSnapshot, HadErrors);
+  }
+  // Only share the preamble once the header shards are up to date.
+  if (IndexedHeaders)
+    Preambles->recordHeaders(PreambleKey, std::move(*IndexedHeaders));
 
   Rebuilder.indexedTU();
   return llvm::Error::success();
@@ -351,8 +434,8 @@ llvm::Error BackgroundIndex::index(tooling::CompileCommand Cmd) {
 
 // Restores shards for \p MainFiles from index storage. Then checks staleness of
 // those shards and returns a list of TUs that needs to be indexed to update
-// staleness.
-std::vector<std::string>
+// staleness, with the memory last used to index them (0 if unknown).
+std::vector<std::pair<std::string, size_t>>
 BackgroundIndex::loadProject(std::vector<std::string> MainFiles) {
   // Drop files where background indexing is disabled in config.
   if (ContextProvider)
@@ -367,6 +450,7 @@ BackgroundIndex::loadProject(std::vector<std::string> MainFiles) {
   const std::vector<LoadedShard> Result =
       loadIndexShards(MainFiles, IndexStorageFactory, CDB);
   size_t LoadedShards = 0;
+  llvm::StringMap<size_t> IndexingMemory; // Keyed by main file.
   {
     // Update in-memory state.
     std::lock_guard<std::mutex> Lock(ShardVersionsMu);
@@ -388,6 +472,8 @@ BackgroundIndex::loadProject(std::vector<std::string> MainFiles) {
       SV.Digest = LS.Digest;
       SV.HadErrors = LS.HadErrors;
       ++LoadedShards;
+      if (LS.Shard->IndexingMemory)
+        IndexingMemory[LS.AbsolutePath] = LS.Shard->IndexingMemory;
 
       IndexedSymbols.update(URI::create(LS.AbsolutePath).toString(),
                             std::move(SS), std::move(RS), std::move(RelS),
@@ -415,7 +501,10 @@ BackgroundIndex::loadProject(std::vector<std::string> MainFiles) {
     TUsToIndex.insert(TUForFile);
   }
 
-  return {TUsToIndex.begin(), TUsToIndex.end()};
+  std::vector<std::pair<std::string, size_t>> TUs;
+  for (PathRef TU : TUsToIndex)
+    TUs.emplace_back(TU.str(), IndexingMemory.lookup(TU));
+  return TUs;
 }
 
 void BackgroundIndex::profile(MemoryTree &MT) const {
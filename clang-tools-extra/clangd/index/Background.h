@@ -11,6 +11,7 @@
 
 #include "GlobalCompilationDatabase.h"
 #include "SourceCode.h"
+#include "index/BackgroundPreambles.h"
 #include "index/BackgroundRebuild.h"
 #include "index/FileIndex.h"
 #include "index/Index.h"
@@ -78,8 +79,16 @@ public:
     std::string Tag;       // Allows priority to be boosted later.
     uint64_t Key = 0;      // If the key matches a previous task, drop this one.
                            // (in practice this means we never reindex a file).
-
-    bool operator<(const Task &O) const { return QueuePri < O.QueuePri; }
+    size_t Memory = 0;     // Estimated peak memory in bytes, 0 if unknown.
+                           // Unknown tasks are assumed to be average, or to
+                           // take the whole budget before any was measured.
+    uint64_t Sequence = 0; // Set by the queue: equal priorities run in order.
+
+    bool operator<(const Task &O) const {
+      if (QueuePri != O.QueuePri)
+        return QueuePri < O.QueuePri;
+      return Sequence > O.Sequence;
+    }
   };
 
   // Describes the number of tasks processed by the queue.
@@ -90,8 +99,11 @@ public:
     unsigned LastIdle = 0;  // Number of completed tasks when last empty.
   };
 
-  BackgroundQueue(std::function<void(Stats)> OnProgress = nullptr)
-      : OnProgress(OnProgress) {}
+  // If MemoryBudget is nonzero, tasks only start while the estimated memory of
+  // the active tasks fits in the budget (though one task can always run).
+  BackgroundQueue(std::function<void(Stats)> OnProgress = nullptr,
+                  size_t MemoryBudget = 0)
+      : OnProgress(OnProgress), MemoryBudget(MemoryBudget) {}
 
   // Add tasks to the queue.
   void push(Task);
@@ -108,6 +120,10 @@ public:
   // Stop processing new tasks, allowing all work() calls to return soon.
   void stop();
 
+  // Records the memory a task was measured to use. The running average is the
+  // estimate for tasks without a Memory estimate of their own.
+  void recordMemory(size_t Bytes);
+
   // Disables thread priority lowering to ensure progress on loaded systems.
   // Only affects tasks that run after the call.
   static void preventThreadStarvationInTests();
@@ -117,6 +133,8 @@ public:
 private:
   void notifyProgress() const; // Requires lock Mu
   bool adjust(Task &T);
+  size_t estimateMemory(const Task &T) const; // Requires lock Mu
+  bool admit(const Task &T) const;            // Requires lock Mu
 
   std::mutex Mu;
   Stats Stat;
@@ -126,6 +144,11 @@ private:
   llvm::StringMap<unsigned> Boosts;
   std::function<void(Stats)> OnProgress;
   llvm::DenseSet<uint64_t> SeenKeys;
+  uint64_t NextSequence = 0;
+  size_t MemoryBudget;
+  size_t ActiveMemory = 0; // Sum of estimates for the active tasks.
+  size_t MeasuredMemory = 0;
+  unsigned MeasuredTasks = 0;
 };
 
 // Builds an in-memory index by by running the static indexer action over
@@ -139,6 +162,13 @@ public:
     size_t ThreadPoolSize = 4;
     // Thread priority when indexing files.
     llvm::ThreadPriority IndexingPriority = llvm::ThreadPriority::Low;
+    // Limits how many TUs are indexed in parallel, so that the estimated peak
+    // memory of those TUs stays under this many bytes. 0 means no limit.
+    size_t MemoryBudget = 0;
+    // Whether TUs sharing their preamble with a previously indexed TU are
+    // parsed on top of a common preamble, rather than from scratch.
+    // Keeps up to 2 * ThreadPoolSize preambles in memory.
+    bool SharePreambles = false;
     // Callback that provides notifications as indexing makes progress.
     std::function<void(BackgroundQueue::Stats)> OnProgress = nullptr;
     // Function called to obtain the Context to use while indexing the specified
@@ -206,14 +236,17 @@ private:
   BackgroundIndexRebuilder Rebuilder;
   llvm::StringMap<ShardVersion> ShardVersions; // Key is absolute file path.
   std::mutex ShardVersionsMu;
+  // Set if Options::SharePreambles.
+  std::unique_ptr<BackgroundPreambles> Preambles;
 
   BackgroundIndexStorage::Factory IndexStorageFactory;
   // Tries to load shards for the MainFiles and their dependencies.
-  std::vector<std::string> loadProject(std::vector<std::string> MainFiles);
+  std::vector<std::pair<std::string, size_t>>
+  loadProject(std::vector<std::string> MainFiles);
 
   BackgroundQueue::Task
   changedFilesTask(const std::vector<std::string> &ChangedFiles);
-  BackgroundQueue::Task indexFileTask(std::string Path);
+  BackgroundQueue::Task indexFileTask(std::string Path, size_t Memory);
 
   // from lowest to highest priority
   enum QueuePriority {
@@ -0,0 +1,234 @@
+//===--- BackgroundPreambles.cpp - Preambles shared by the bg index -------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#include "index/BackgroundPreambles.h"
+#include "SourceCode.h"
+#include "URI.h"
+#include "support/Trace.h"
+#include "clang/Lex/Lexer.h"
+#include "llvm/ADT/Hashing.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringSet.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include <algorithm>
+
+namespace clang {
+namespace clangd {
+namespace {
+
+constexpr trace::Metric SharedPreambles("background_shared_preamble",
+                                        trace::Metric::Counter, "result");
+
+// Copies the header nodes of From reachable from Roots into To, keeping the
+// nodes To has already. Returns the keys in To of the roots.
+std::vector<llvm::StringRef>
+copyReachable(const IncludeGraph &From, llvm::ArrayRef<llvm::StringRef> Roots,
+              IncludeGraph &To) {
+  llvm::StringSet<> Seen, Copied;
+  std::vector<llvm::StringRef> Work(Roots.begin(), Roots.end());
+  while (!Work.empty()) {
+    llvm::StringRef URI = Work.back();
+    Work.pop_back();
+    if (!Seen.insert(URI).second)
+      continue;
+    auto It = From.find(URI);
+    if (It == From.end() ||
+        (It->getValue().Flags & IncludeGraphNode::SourceFlag::IsTU))
+      continue;
+    auto Inserted = To.try_emplace(URI);
+    if (!Inserted.second)
+      continue;
+    IncludeGraphNode &Node = Inserted.first->getValue();
+    Node.Flags = It->getValue().Flags;
+    Node.Digest = It->getValue().Digest;
+    Node.URI = Inserted.first->getKey();
+    Copied.insert(URI);
+    Work.insert(Work.end(), It->getValue().DirectIncludes.begin(),
+                It->getValue().DirectIncludes.end());
+  }
+  // Edges must point to the keys of To, which only exist once all the nodes
+  // have been copied.
+  for (const auto &Entry : Copied) {
+    IncludeGraphNode &Node = To.find(Entry.getKey())->getValue();
+    for (llvm::StringRef Include :
+         From.find(Entry.getKey())->getValue().DirectIncludes) {
+      auto It = To.find(Include);
+      if (It != To.end())
+        Node.DirectIncludes.push_back(It->getKey());
+    }
+  }
+  std::vector<llvm::StringRef> Result;
+  for (llvm::StringRef Root : Roots) {
+    auto It = To.find(Root);
+    if (It != To.end())
+      Result.push_back(It->getKey());
+  }
+  return Result;
+}
+
+// Returns the URI of the main file in an include graph.
+std::optional<llvm::StringRef> mainFile(const IncludeGraph &Sources) {
+  for (const auto &Entry : Sources)
+    if (Entry.getValue().Flags & IncludeGraphNode::SourceFlag::IsTU)
+      return Entry.getKey();
+  return std::nullopt;
+}
+
+} // namespace
+
+uint64_t BackgroundPreambles::key(const tooling::CompileCommand &Cmd,
+                                  const CompilerInvocation &CI,
+                                  llvm::StringRef Contents) {
+  auto Bounds = Lexer::ComputePreamble(Contents, *CI.getLangOpts());
+  if (!Bounds.Size)
+    return 0;
+  // Quoted includes are resolved relative to the main file's directory.
+  llvm::hash_code Hash = llvm::hash_combine(
+      Cmd.Directory, llvm::sys::path::parent_path(Cmd.Filename),
+      Contents.take_front(Bounds.Size), Bounds.PreambleEndsAtStartOfLine);
+  // Everything but the file names in the command affects the preamble.
+  for (size_t I = 0, E = Cmd.CommandLine.size(); I < E; ++I) {
+    llvm::StringRef Arg = Cmd.CommandLine[I];
+    if (Arg == Cmd.Filename)
+      continue;
+    if (Arg == "-o" || Arg == "-MF" || Arg == "-MT" || Arg == "-MQ") {
+      ++I;
+      continue;
+    }
+    if (Arg.startswith("-o"))
+      continue;
+    Hash = llvm::hash_combine(Hash, Arg);
+  }
+  return std::max<uint64_t>(static_cast<size_t>(Hash), 1);
+}
+
+BackgroundPreambles::Shared
+BackgroundPreambles::get(uint64_t Key, PathRef File,
+                         const CompilerInvocation &CI,
+                         const ParseInputs &Inputs) {
+  std::shared_ptr<const PreambleData> Preamble;
+  std::shared_ptr<const Headers> Indexed;
+  llvm::StringMap<FileDigest> IndexedDigests;
+  {
+    std::lock_guard<std::mutex> Lock(Mu);
+    Group &G = touch(Key);
+    if (!G.Indexed) {
+      SharedPreambles.record(1, "unindexed");
+      return {};
+    }
+    Preamble = G.Preamble;
+    Indexed = G.Indexed;
+    if (!Preamble)
+      for (const auto &Entry : Indexed->Graph)
+        IndexedDigests[Entry.getKey()] = Entry.getValue().Digest;
+  }
+
+  if (Preamble) {
+    auto Buffer = llvm::MemoryBuffer::getMemBuffer(Inputs.Contents, File);
+    auto Bounds = ComputePreambleBounds(*CI.getLangOpts(), *Buffer, 0);
+    auto VFS = Inputs.TFS->view(Inputs.CompileCommand.Directory);
+    if (Preamble->Preamble.CanReuse(CI, *Buffer, Bounds, *VFS)) {
+      SharedPreambles.record(1, "reused");
+      return {std::move(Preamble), std::move(Indexed)};
+    }
+    // The headers changed since they were indexed, start over.
+    SharedPreambles.record(1, "stale");
+    std::lock_guard<std::mutex> Lock(Mu);
+    Group &G = touch(Key);
+    if (G.Preamble == Preamble)
+      G = Group();
+    return {};
+  }
+
+  // The headers may have changed since the group's first TU was indexed. The
+  // preamble stands in for that TU's include graph, so check that it was
+  // built from the same contents.
+  bool HeadersChanged = false;
+  auto CheckHeaders = [&](ASTContext &Ctx, Preprocessor &,
+                          const CanonicalIncludes &) {
+    const SourceManager &SM = Ctx.getSourceManager();
+    for (auto It = SM.fileinfo_begin(); It != SM.fileinfo_end(); ++It) {
+      llvm::StringRef Path = It->first->tryGetRealPathName();
+      auto Contents = It->second->getBufferDataIfLoaded();
+      if (Path.empty() || !Contents)
+        continue;
+      auto Indexed = IndexedDigests.find(URI::create(Path).toString());
+      if (Indexed != IndexedDigests.end() &&
+          Indexed->getValue() != digest(*Contents))
+        HeadersChanged = true;
+    }
+  };
+  Preamble = buildPreamble(File, CI, Inputs, /*StoreInMemory=*/true,
+                           CheckHeaders);
+  if (!Preamble) {
+    SharedPreambles.record(1, "failed");
+    return {};
+  }
+  std::lock_guard<std::mutex> Lock(Mu);
+  Group &G = touch(Key);
+  if (HeadersChanged) {
+    SharedPreambles.record(1, "stale");
+    G = Group();
+    return {};
+  }
+  SharedPreambles.record(1, "built");
+  // The group may have been evicted or reset meanwhile.
+  if (G.Indexed == Indexed)
+    G.Preamble = Preamble;
+  return {std::move(Preamble), std::move(Indexed)};
+}
+
+BackgroundPreambles::Headers
+BackgroundPreambles::headers(const IncludeGraph &Sources) {
+  Headers Result;
+  auto Main = mainFile(Sources);
+  if (!Main)
+    return Result;
+  const auto &Includes = Sources.find(*Main)->getValue().DirectIncludes;
+  for (llvm::StringRef Include : Includes)
+    Result.MainIncludes.push_back(Include.str());
+  copyReachable(Sources, Includes, Result.Graph);
+  return Result;
+}
+
+void BackgroundPreambles::recordHeaders(uint64_t Key, Headers H) {
+  std::lock_guard<std::mutex> Lock(Mu);
+  Group &G = touch(Key);
+  if (!G.Indexed)
+    G.Indexed = std::make_shared<const Headers>(std::move(H));
+}
+
+void BackgroundPreambles::addHeaders(const Headers &H,
+                                     IncludeGraph &Sources) {
+  auto MainURI = mainFile(Sources);
+  if (!MainURI)
+    return;
+  IncludeGraphNode &Main = Sources.find(*MainURI)->getValue();
+  std::vector<llvm::StringRef> Roots(H.MainIncludes.begin(),
+                                     H.MainIncludes.end());
+  for (llvm::StringRef Include : copyReachable(H.Graph, Roots, Sources))
+    if (!llvm::is_contained(Main.DirectIncludes, Include))
+      Main.DirectIncludes.push_back(Include);
+}
+
+BackgroundPreambles::Group &BackgroundPreambles::touch(uint64_t Key) {
+  auto It = llvm::find_if(Groups, [&](const std::pair<uint64_t, Group> &G) {
+    return G.first == Key;
+  });
+  if (It != Groups.end())
+    Groups.splice(Groups.begin(), Groups, It);
+  else
+    Groups.emplace_front(Key, Group());
+  while (Groups.size() > MaxGroups)
+    Groups.pop_back();
+  return Groups.front().second;
+}
+
+} // namespace clangd
+} // namespace clang
@@ -0,0 +1,111 @@
+//===--- BackgroundPreambles.h - Preambles shared by bg index ---*- C++ -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This file contains an implementation detail of the background indexer
+// (Background.h), which is exposed for testing.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_CLANG_TOOLS_EXTRA_CLANGD_INDEX_BACKGROUNDPREAMBLES_H
+#define LLVM_CLANG_TOOLS_EXTRA_CLANGD_INDEX_BACKGROUNDPREAMBLES_H
+
+#include "Compiler.h"
+#include "Headers.h"
+#include "Preamble.h"
+#include "support/Path.h"
+#include "clang/Tooling/CompilationDatabase.h"
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace clang {
+namespace clangd {
+
+// Sibling TUs often start with the same block of #includes, and the background
+// indexer parses those headers again for each of them, only to throw away the
+// symbols because the header shards are up to date.
+//
+// BackgroundPreambles groups TUs with the same compile flags, directory and
+// preamble text. The first TU of a group is indexed from scratch, which indexes
+// its headers too. Later TUs of the group are parsed on top of a preamble built
+// once for the group, so only their main file is parsed and indexed. The
+// include graph recorded for the first TU stands in for the headers they no
+// longer see.
+//
+// Only a few groups are kept, so this pays off when TUs of a group are indexed
+// close to each other. Each group holds its preamble in memory, so up to
+// MaxGroups preambles are kept at once.
+//
+// Directives in the preamble region of a TU parsed on top of a shared preamble
+// are not seen by the indexer, so references to macros in them (e.g. in #if
+// conditions) are not indexed for that TU.
+class BackgroundPreambles {
+public:
+  /// The headers of a TU that was indexed from scratch.
+  struct Headers {
+    /// URIs of the files directly included by the main file.
+    std::vector<std::string> MainIncludes;
+    /// The include graph, without the main file.
+    IncludeGraph Graph;
+  };
+
+  explicit BackgroundPreambles(size_t MaxGroups) : MaxGroups(MaxGroups) {}
+
+  /// Identifies the group of TUs that can share a preamble with this one.
+  /// Returns 0 if the TU has no preamble.
+  static uint64_t key(const tooling::CompileCommand &Cmd,
+                      const CompilerInvocation &CI, llvm::StringRef Contents);
+
+  /// A preamble of a group, and the headers it stands for.
+  struct Shared {
+    std::shared_ptr<const PreambleData> Preamble;
+    std::shared_ptr<const Headers> Indexed;
+  };
+
+  /// Returns a preamble to index \p Inputs on top of, building it if needed.
+  /// Returns no preamble if the TU should be indexed from scratch: no TU of the
+  /// group was indexed yet, the headers changed since, or the preamble failed
+  /// to build. A new preamble is only shared if it was built from the headers
+  /// recorded for the group.
+  /// The headers are returned with it, as the group may be evicted before the
+  /// TU is indexed.
+  Shared get(uint64_t Key, PathRef File, const CompilerInvocation &CI,
+             const ParseInputs &Inputs);
+
+  /// Extracts the headers from the include graph of a TU.
+  static Headers headers(const IncludeGraph &Sources);
+  /// Records the headers of a TU of the group that was indexed from scratch,
+  /// and whose header shards are now up to date.
+  void recordHeaders(uint64_t Key, Headers H);
+  /// Adds the headers a preamble stands for to the include graph of a TU that
+  /// was indexed on top of it.
+  static void addHeaders(const Headers &H, IncludeGraph &Sources);
+
+private:
+  struct Group {
+    std::shared_ptr<const Headers> Indexed;
+    std::shared_ptr<const PreambleData> Preamble;
+  };
+  // Returns the group, creating it if needed, and marks it most recently used.
+  Group &touch(uint64_t Key); // Requires lock Mu
+
+  mutable std::mutex Mu;
+  size_t MaxGroups;
+  std::list<std::pair<uint64_t, Group>> Groups; // Most recently used first.
+};
+
+} // namespace clangd
+} // namespace clang
+
+#endif
@@ -8,6 +8,7 @@
 
 #include "index/Background.h"
 #include "support/Logger.h"
+#include "support/Trace.h"
 #include <optional>
 
 namespace clang {
@@ -19,21 +20,62 @@ void BackgroundQueue::preventThreadStarvationInTests() {
   PreventStarvation.store(true);
 }
 
+size_t BackgroundQueue::estimateMemory(const Task &T) const {
+  if (T.Memory)
+    return T.Memory;
+  // Until a task was measured, be conservative: at startup, several huge TUs
+  // must not start at once.
+  if (!MeasuredTasks)
+    return MemoryBudget;
+  return MeasuredMemory / MeasuredTasks;
+}
+
+bool BackgroundQueue::admit(const Task &T) const {
+  // Always let one task run, however large, so that the queue makes progress.
+  return !MemoryBudget || Stat.Active == 0 ||
+         ActiveMemory + estimateMemory(T) <= MemoryBudget;
+}
+
 void BackgroundQueue::work(std::function<void()> OnIdle) {
+  static constexpr trace::Metric ActiveMemoryMetric(
+      "background_queue_active_memory", trace::Metric::Distribution);
+  // Counts tasks that had to wait for memory before they could start.
+  static constexpr trace::Metric Throttled("background_queue_throttled",
+                                           trace::Metric::Counter);
   while (true) {
     std::optional<Task> Task;
+    size_t Memory = 0;
     {
       std::unique_lock<std::mutex> Lock(Mu);
-      CV.wait(Lock, [&] { return ShouldStop || !Queue.empty(); });
+      // Only the highest-priority task is considered: if it doesn't fit in the
+      // memory budget, wait for running tasks to finish rather than starting
+      // smaller ones ahead of it.
+      bool WaitedForMemory = false;
+      CV.wait(Lock, [&] {
+        if (ShouldStop)
+          return true;
+        if (Queue.empty())
+          return false;
+        if (admit(Queue.front()))
+          return true;
+        WaitedForMemory = true;
+        return false;
+      });
       if (ShouldStop) {
         Queue.clear();
         CV.notify_all();
         return;
       }
+      if (WaitedForMemory)
+        Throttled.record(1);
       ++Stat.Active;
       std::pop_heap(Queue.begin(), Queue.end());
       Task = std::move(Queue.back());
       Queue.pop_back();
+      Memory = estimateMemory(*Task);
+      ActiveMemory += Memory;
+      if (MemoryBudget)
+        ActiveMemoryMetric.record(ActiveMemory);
       notifyProgress();
     }
 
@@ -59,6 +101,7 @@ void BackgroundQueue::work(std::function<void()> OnIdle) {
       }
       assert(Stat.Active > 0 && "before decrementing");
       --Stat.Active;
+      ActiveMemory -= Memory;
       notifyProgress();
     }
     CV.notify_all();
@@ -73,6 +116,16 @@ void BackgroundQueue::stop() {
   CV.notify_all();
 }
 
+void BackgroundQueue::recordMemory(size_t Bytes) {
+  {
+    std::lock_guard<std::mutex> Lock(Mu);
+    MeasuredMemory += Bytes;
+    ++MeasuredTasks;
+  }
+  // Estimates for queued tasks changed, they may fit in the budget now.
+  CV.notify_all();
+}
+
 // Tweaks the priority of a newly-enqueued task, or returns false to cancel it.
 bool BackgroundQueue::adjust(Task &T) {
   // It is tempting to drop duplicates of queued tasks, and merely deprioritize
@@ -82,6 +135,7 @@ bool BackgroundQueue::adjust(Task &T) {
   //  - reindexing on compile flags is often a poor use of CPU in practice
   if (T.Key && !SeenKeys.insert(T.Key).second)
     return false;
+  T.Sequence = NextSequence++;
   T.QueuePri = std::max(T.QueuePri, Boosts.lookup(T.Tag));
   return true;
 }
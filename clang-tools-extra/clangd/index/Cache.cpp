@@ -0,0 +1,207 @@
+//===--- Cache.cpp - Memoize index queries ----------------------*- C++-*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#include "index/Cache.h"
+#include "Config.h"
+#include "support/Trace.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/Support/Allocator.h"
+#include "llvm/Support/StringSaver.h"
+#include "llvm/Support/raw_ostream.h"
+#include <algorithm>
+#include <vector>
+
+namespace clang {
+namespace clangd {
+
+// The results of a query, owning their strings.
+struct CachingIndex::Entry {
+  std::string Key;
+  size_t Bytes = 0;
+  bool More = false;
+  std::vector<Symbol> Symbols;
+  std::vector<SymbolID> Subjects; // For relations, parallel to Symbols.
+  std::vector<Ref> Refs;
+  llvm::BumpPtrAllocator Arena;
+  llvm::UniqueStringSaver Strings{Arena};
+
+  void add(const Symbol &S) {
+    Symbols.push_back(S);
+    visitStrings(Symbols.back(),
+                 [&](llvm::StringRef &V) { V = Strings.save(V); });
+  }
+  void add(const Ref &R) {
+    Refs.push_back(R);
+    Refs.back().Location.FileURI = Strings.save(R.Location.FileURI).data();
+  }
+  size_t bytes() const {
+    return sizeof(Entry) + Key.capacity() + Arena.getTotalMemory() +
+           Symbols.capacity() * sizeof(Symbol) +
+           Subjects.capacity() * sizeof(SymbolID) +
+           Refs.capacity() * sizeof(Ref);
+  }
+};
+
+namespace {
+
+// Keys start with the kind of request and the external index in use.
+std::string keyPrefix(char Kind) {
+  const auto &External = Config::current().Index.External;
+  std::string Key;
+  llvm::raw_string_ostream OS(Key);
+  OS << Kind << static_cast<int>(External.Kind) << '|' << External.Location
+     << '|' << External.MountPoint << '|';
+  return Key;
+}
+
+// Requests contain sets, whose order doesn't matter.
+void writeSorted(llvm::raw_ostream &OS, const llvm::DenseSet<SymbolID> &IDs) {
+  std::vector<SymbolID> Sorted(IDs.begin(), IDs.end());
+  llvm::sort(Sorted);
+  for (const SymbolID &ID : Sorted)
+    OS << ID.raw();
+  OS << '|';
+}
+
+void canonicalize(std::vector<std::string> &Strings) {
+  llvm::sort(Strings);
+  Strings.erase(std::unique(Strings.begin(), Strings.end()), Strings.end());
+}
+
+} // namespace
+
+CachingIndex::EntryPtr
+CachingIndex::get(std::string Key,
+                  llvm::function_ref<void(Entry &)> Fill) const {
+  static constexpr trace::Metric IndexCache("index_cache",
+                                            trace::Metric::Counter, "result");
+  uint64_t Current = Base.version();
+  {
+    std::lock_guard<std::mutex> Lock(Mu);
+    if (Current != Version) {
+      LRU.clear();
+      ByKey.clear();
+      Bytes = 0;
+      Version = Current;
+    }
+    auto It = ByKey.find(Key);
+    if (It != ByKey.end()) {
+      LRU.splice(LRU.begin(), LRU, It->second);
+      IndexCache.record(1, "hit");
+      return LRU.front();
+    }
+  }
+  IndexCache.record(1, "miss");
+  auto Result = std::make_shared<Entry>();
+  Result->Key = std::move(Key);
+  Fill(*Result);
+  Result->Bytes = Result->bytes();
+
+  std::lock_guard<std::mutex> Lock(Mu);
+  // Results may mix the old and new index if one was swapped meanwhile.
+  if (Version != Current || Base.version() != Current ||
+      Result->Bytes > MaxBytes || ByKey.count(Result->Key))
+    return Result;
+  LRU.push_front(Result);
+  ByKey[Result->Key] = LRU.begin();
+  Bytes += Result->Bytes;
+  while (Bytes > MaxBytes) {
+    const Entry &Evicted = *LRU.back();
+    Bytes -= Evicted.Bytes;
+    ByKey.erase(Evicted.Key);
+    LRU.pop_back();
+    IndexCache.record(1, "evict");
+  }
+  return Result;
+}
+
+bool CachingIndex::fuzzyFind(
+    const FuzzyFindRequest &Req,
+    llvm::function_ref<void(const Symbol &)> Callback) const {
+  FuzzyFindRequest Canonical = Req;
+  canonicalize(Canonical.Scopes);
+  canonicalize(Canonical.ProximityPaths);
+  canonicalize(Canonical.PreferredTypes);
+  std::string Key = keyPrefix('F');
+  llvm::raw_string_ostream(Key) << toJSON(Canonical);
+
+  auto Results = get(std::move(Key), [&](Entry &E) {
+    E.More = Base.fuzzyFind(Req, [&](const Symbol &S) { E.add(S); });
+  });
+  for (const Symbol &S : Results->Symbols)
+    Callback(S);
+  return Results->More;
+}
+
+void CachingIndex::lookup(
+    const LookupRequest &Req,
+    llvm::function_ref<void(const Symbol &)> Callback) const {
+  std::string Key = keyPrefix('L');
+  llvm::raw_string_ostream OS(Key);
+  writeSorted(OS, Req.IDs);
+  OS.flush();
+
+  auto Results = get(std::move(Key), [&](Entry &E) {
+    Base.lookup(Req, [&](const Symbol &S) { E.add(S); });
+  });
+  for (const Symbol &S : Results->Symbols)
+    Callback(S);
+}
+
+bool CachingIndex::refs(const RefsRequest &Req,
+                        llvm::function_ref<void(const Ref &)> Callback) const {
+  std::string Key = keyPrefix('R');
+  llvm::raw_string_ostream OS(Key);
+  writeSorted(OS, Req.IDs);
+  OS << static_cast<int>(Req.Filter) << '|'
+     << static_cast<int>(Req.WantContainer) << '|';
+  if (Req.Limit)
+    OS << *Req.Limit;
+  OS.flush();
+
+  auto Results = get(std::move(Key), [&](Entry &E) {
+    E.More = Base.refs(Req, [&](const Ref &R) { E.add(R); });
+  });
+  for (const Ref &R : Results->Refs)
+    Callback(R);
+  return Results->More;
+}
+
+void CachingIndex::relations(
+    const RelationsRequest &Req,
+    llvm::function_ref<void(const SymbolID &, const Symbol &)> Callback) const {
+  std::string Key = keyPrefix('X');
+  llvm::raw_string_ostream OS(Key);
+  writeSorted(OS, Req.Subjects);
+  OS << static_cast<int>(Req.Predicate) << '|';
+  if (Req.Limit)
+    OS << *Req.Limit;
+  OS.flush();
+
+  auto Results = get(std::move(Key), [&](Entry &E) {
+    Base.relations(Req, [&](const SymbolID &Subject, const Symbol &Object) {
+      E.Subjects.push_back(Subject);
+      E.add(Object);
+    });
+  });
+  for (size_t I = 0; I < Results->Symbols.size(); ++I)
+    Callback(Results->Subjects[I], Results->Symbols[I]);
+}
+
+llvm::unique_function<IndexContents(llvm::StringRef) const>
+CachingIndex::indexedFiles() const {
+  return Base.indexedFiles();
+}
+
+size_t CachingIndex::estimateMemoryUsage() const {
+  std::lock_guard<std::mutex> Lock(Mu);
+  return Base.estimateMemoryUsage() + Bytes;
+}
+
+} // namespace clangd
+} // namespace clang
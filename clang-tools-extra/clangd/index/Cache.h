@@ -0,0 +1,79 @@
+//===--- Cache.h - Memoize index queries -------------------------*- C++-*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_CLANG_TOOLS_EXTRA_CLANGD_INDEX_CACHE_H
+#define LLVM_CLANG_TOOLS_EXTRA_CLANGD_INDEX_CACHE_H
+
+#include "index/Index.h"
+#include "llvm/ADT/StringMap.h"
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+
+namespace clang {
+namespace clangd {
+
+// CachingIndex remembers the results of recent queries to another index.
+// Features often send the same queries in quick succession (e.g. hover and
+// document highlights on the same symbol, or code completion while typing),
+// and these are answered without going through the index again.
+//
+// Results are assumed to stay the same until the version of Base changes (e.g.
+// one of its indexes is swapped), and the cache is dropped then. Indexes that
+// change otherwise (e.g. a remote index) may serve stale results.
+// Requests are keyed together with the external index configured for the
+// current file, as ProjectAwareIndex answers them differently.
+//
+// The least recently used results are evicted once the cache holds more than
+// MaxBytes. Results are copied into the cache, so they don't keep the backing
+// index alive.
+class CachingIndex : public SymbolIndex {
+public:
+  CachingIndex(const SymbolIndex &Base, size_t MaxBytes)
+      : Base(Base), MaxBytes(MaxBytes) {}
+
+  bool fuzzyFind(const FuzzyFindRequest &,
+                 llvm::function_ref<void(const Symbol &)>) const override;
+  void lookup(const LookupRequest &,
+              llvm::function_ref<void(const Symbol &)>) const override;
+  bool refs(const RefsRequest &,
+            llvm::function_ref<void(const Ref &)>) const override;
+  void relations(const RelationsRequest &,
+                 llvm::function_ref<void(const SymbolID &, const Symbol &)>)
+      const override;
+
+  llvm::unique_function<IndexContents(llvm::StringRef) const>
+  indexedFiles() const override;
+
+  size_t estimateMemoryUsage() const override;
+  uint64_t version() const override { return Base.version(); }
+
+private:
+  struct Entry;
+  using EntryPtr = std::shared_ptr<const Entry>;
+
+  // Returns the cached results for Key, or queries Base through Fill and
+  // caches them.
+  EntryPtr get(std::string Key,
+               llvm::function_ref<void(Entry &)> Fill) const;
+
+  const SymbolIndex &Base;
+  size_t MaxBytes;
+
+  mutable std::mutex Mu;
+  mutable uint64_t Version = 0; // Of Base, when the cached results were added.
+  mutable size_t Bytes = 0;
+  mutable std::list<EntryPtr> LRU; // Most recently used first.
+  mutable llvm::StringMap<std::list<EntryPtr>::iterator> ByKey;
+};
+
+} // namespace clangd
+} // namespace clang
+
+#endif // LLVM_CLANG_TOOLS_EXTRA_CLANGD_INDEX_CACHE_H
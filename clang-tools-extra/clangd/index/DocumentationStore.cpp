@@ -0,0 +1,84 @@
+//===--- DocumentationStore.cpp - Compressed symbol docs ---------*- C++-*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#include "index/DocumentationStore.h"
+#include "support/Logger.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/Support/Compression.h"
+
+namespace clang {
+namespace clangd {
+namespace {
+// Small enough that decompressing a block for one symbol is cheap, large
+// enough for zlib to find redundancy between comments.
+constexpr size_t BlockSize = 4096;
+} // namespace
+
+bool DocumentationStore::isAvailable() {
+  return llvm::compression::zlib::isAvailable();
+}
+
+void DocumentationStore::Builder::add(const SymbolID &ID,
+                                      llvm::StringRef Documentation) {
+  if (Documentation.empty())
+    return;
+  Store.Entries.push_back({ID, static_cast<uint32_t>(Store.Blocks.size()),
+                           static_cast<uint32_t>(Pending.size()),
+                           static_cast<uint32_t>(Documentation.size())});
+  Pending += Documentation;
+  Store.RawBytes += Documentation.size();
+  if (Pending.size() >= BlockSize)
+    flush();
+}
+
+void DocumentationStore::Builder::flush() {
+  if (Pending.empty())
+    return;
+  assert(isAvailable() && "Can't compress documentation without zlib");
+  Block B;
+  B.UncompressedSize = Pending.size();
+  llvm::compression::zlib::compress(llvm::arrayRefFromStringRef(Pending),
+                                    B.Data);
+  Store.Blocks.push_back(std::move(B));
+  Pending.clear();
+}
+
+DocumentationStore DocumentationStore::Builder::build() && {
+  flush();
+  // Stable, so that the last entry for an ID is the one added last.
+  llvm::stable_sort(Store.Entries, [](const Entry &L, const Entry &R) {
+    return L.ID < R.ID;
+  });
+  return std::move(Store);
+}
+
+std::string DocumentationStore::get(const SymbolID &ID) const {
+  auto It = llvm::partition_point(
+      Entries, [&](const Entry &E) { return !(ID < E.ID); });
+  if (It == Entries.begin() || (--It)->ID != ID)
+    return "";
+  const Block &B = Blocks[It->Block];
+  llvm::SmallVector<uint8_t, 0> Uncompressed;
+  if (llvm::Error Err = llvm::compression::zlib::decompress(
+          B.Data, Uncompressed, B.UncompressedSize)) {
+    elog("Failed to decompress documentation: {0}", std::move(Err));
+    return "";
+  }
+  return llvm::toStringRef(Uncompressed).substr(It->Offset, It->Length).str();
+}
+
+size_t DocumentationStore::bytes() const {
+  size_t Bytes = Entries.capacity() * sizeof(Entry) +
+                 Blocks.capacity() * sizeof(Block);
+  for (const Block &B : Blocks)
+    Bytes += B.Data.capacity();
+  return Bytes;
+}
+
+} // namespace clangd
+} // namespace clang
@@ -0,0 +1,86 @@
+//===--- DocumentationStore.h - Compressed symbol docs ----------*- C++-*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// Documentation comments are a large share of an index's string data, but
+// are only read for the handful of symbols shown by hover or completion.
+// DocumentationStore keeps them compressed, apart from the symbols, and
+// indexes can attach them back to the symbols they return.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_CLANG_TOOLS_EXTRA_CLANGD_INDEX_DOCUMENTATIONSTORE_H
+#define LLVM_CLANG_TOOLS_EXTRA_CLANGD_INDEX_DOCUMENTATIONSTORE_H
+
+#include "index/SymbolID.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringRef.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace clang {
+namespace clangd {
+
+/// Symbol documentation compressed in blocks of a few KB, so that fetching the
+/// documentation of one symbol only decompresses its neighbours.
+class DocumentationStore {
+  struct Entry {
+    SymbolID ID;
+    uint32_t Block;
+    uint32_t Offset;
+    uint32_t Length;
+  };
+  struct Block {
+    llvm::SmallVector<uint8_t, 0> Data;
+    uint32_t UncompressedSize;
+  };
+
+public:
+  /// Whether documentation can be compressed (zlib is available).
+  static bool isAvailable();
+
+  /// Collects documentation, compressing each block as it fills up. Callers
+  /// drop the documentation from their symbols as they add it, so it is never
+  /// held uncompressed for the whole index.
+  class Builder {
+  public:
+    /// Adds the documentation of a symbol. If a symbol is added twice, the
+    /// last documentation wins. Requires isAvailable().
+    void add(const SymbolID &ID, llvm::StringRef Documentation);
+    /// Consumes the builder to finalize the store.
+    DocumentationStore build() &&;
+
+  private:
+    void flush();
+
+    /// Entries are in the order they were added until build().
+    DocumentationStore Store;
+    /// Documentation of the block being filled.
+    std::string Pending;
+  };
+
+  /// Returns the documentation of a symbol, empty if it has none.
+  std::string get(const SymbolID &ID) const;
+
+  bool empty() const { return Entries.empty(); }
+  /// Estimates the memory usage.
+  size_t bytes() const;
+  /// The size of the documentation before compression.
+  size_t rawBytes() const { return RawBytes; }
+
+private:
+  /// Sorted by ID.
+  std::vector<Entry> Entries;
+  std::vector<Block> Blocks;
+  size_t RawBytes = 0;
+};
+
+} // namespace clangd
+} // namespace clang
+
+#endif
@@ -197,6 +197,7 @@ FileShardedIndex::getShard(llvm::StringRef Uri) const {
   IndexFileIn IF;
   IF.Sources = It->getValue().IG;
   IF.Cmd = Index.Cmd;
+  IF.IndexingMemory = Index.IndexingMemory;
 
   SymbolSlab::Builder SymB;
   for (const auto *S : It->getValue().Symbols)
@@ -21,7 +21,9 @@ void SwapIndex::reset(std::unique_ptr<SymbolIndex> Index) {
     Pin = std::move(this->Index);
     this->Index = std::move(Index);
   }
+  ++Version;
 }
+uint64_t SwapIndex::version() const { return Version.load(); }
 std::shared_ptr<SymbolIndex> SwapIndex::snapshot() const {
   std::lock_guard<std::mutex> Lock(Mutex);
   return Index;
@@ -33,7 +35,9 @@ bool fromJSON(const llvm::json::Value &Parameters, FuzzyFindRequest &Request,
   int64_t Limit;
   bool OK =
       O && O.map("Query", Request.Query) && O.map("Scopes", Request.Scopes) &&
-      O.map("AnyScope", Request.AnyScope) && O.map("Limit", Limit) &&
+      O.map("AnyScope", Request.AnyScope) &&
+      O.mapOptional("ApproximateScope", Request.ApproximateScope) &&
+      O.map("Limit", Limit) &&
       O.map("RestrictForCodeCompletion", Request.RestrictForCodeCompletion) &&
       O.map("ProximityPaths", Request.ProximityPaths) &&
       O.map("PreferredTypes", Request.PreferredTypes);
@@ -47,6 +51,7 @@ llvm::json::Value toJSON(const FuzzyFindRequest &Request) {
       {"Query", Request.Query},
       {"Scopes", Request.Scopes},
       {"AnyScope", Request.AnyScope},
+      {"ApproximateScope", Request.ApproximateScope},
       {"Limit", Request.Limit},
       {"RestrictForCodeCompletion", Request.RestrictForCodeCompletion},
       {"ProximityPaths", Request.ProximityPaths},
@@ -54,6 +59,20 @@ llvm::json::Value toJSON(const FuzzyFindRequest &Request) {
   };
 }
 
+bool approximateScopeMatch(llvm::StringRef Scope, llvm::StringRef Query) {
+  assert(Scope.empty() || Scope.endswith("::"));
+  assert(Query.empty() || Query.endswith("::"));
+  while (!Scope.empty() && !Query.empty()) {
+    auto Colons = Scope.find("::");
+    assert(Colons != llvm::StringRef::npos);
+
+    llvm::StringRef LeadingSpecifier = Scope.slice(0, Colons + 2);
+    Scope = Scope.slice(Colons + 2, llvm::StringRef::npos);
+    Query.consume_front(LeadingSpecifier);
+  }
+  return Query.empty();
+}
+
 bool SwapIndex::fuzzyFind(const FuzzyFindRequest &R,
                           llvm::function_ref<void(const Symbol &)> CB) const {
   return snapshot()->fuzzyFind(R, CB);
@@ -16,6 +16,8 @@
 #include "llvm/ADT/DenseSet.h"
 #include "llvm/ADT/FunctionExtras.h"
 #include "llvm/Support/JSON.h"
+#include <atomic>
+#include <cstdint>
 #include <mutex>
 #include <optional>
 #include <string>
@@ -37,6 +39,11 @@ struct FuzzyFindRequest {
   /// If set to true, allow symbols from any scope. Scopes explicitly listed
   /// above will be ranked higher.
   bool AnyScope = false;
+  /// If this is non-empty, symbols' scopes must contain the components of this
+  /// scope in the same order, though not necessarily adjacent. For example, if
+  /// "a::c::" is provided, symbols in "a::b::c::" and "x::a::c::" match but
+  /// symbols in "c::a::" don't. Used to look up partially qualified names.
+  std::string ApproximateScope;
   /// The number of top candidates to return. The index may choose to
   /// return more than this, e.g. if it doesn't know which candidates are best.
   std::optional<uint32_t> Limit;
@@ -49,9 +56,10 @@ struct FuzzyFindRequest {
   std::vector<std::string> PreferredTypes;
 
   bool operator==(const FuzzyFindRequest &Req) const {
-    return std::tie(Query, Scopes, Limit, RestrictForCodeCompletion,
-                    ProximityPaths, PreferredTypes) ==
-           std::tie(Req.Query, Req.Scopes, Req.Limit,
+    return std::tie(Query, Scopes, ApproximateScope, Limit,
+                    RestrictForCodeCompletion, ProximityPaths,
+                    PreferredTypes) ==
+           std::tie(Req.Query, Req.Scopes, Req.ApproximateScope, Req.Limit,
                     Req.RestrictForCodeCompletion, Req.ProximityPaths,
                     Req.PreferredTypes);
   }
@@ -61,6 +69,10 @@ bool fromJSON(const llvm::json::Value &Value, FuzzyFindRequest &Request,
               llvm::json::Path);
 llvm::json::Value toJSON(const FuzzyFindRequest &Request);
 
+/// Returns true if the components of \p Query appear in \p Scope in order, see
+/// FuzzyFindRequest::ApproximateScope. Both are empty or end with "::".
+bool approximateScopeMatch(llvm::StringRef Scope, llvm::StringRef Query);
+
 struct LookupRequest {
   llvm::DenseSet<SymbolID> IDs;
 };
@@ -157,6 +169,11 @@ public:
 
   /// Returns estimated size of index (in bytes).
   virtual size_t estimateMemoryUsage() const = 0;
+
+  /// Changes whenever the results of queries may change, e.g. when an index is
+  /// swapped. Indexes built from others add up their versions. Indexes that
+  /// change otherwise (e.g. remote indexes) don't report it.
+  virtual uint64_t version() const { return 0; }
 };
 
 // Delegating implementation of SymbolIndex whose delegate can be swapped out.
@@ -184,10 +201,16 @@ public:
 
   size_t estimateMemoryUsage() const override;
 
-private:
+  /// Returns the current index, which stays alive while it is used.
   std::shared_ptr<SymbolIndex> snapshot() const;
+
+  /// Counts the calls to reset(). It is bumped once the new index is in place.
+  uint64_t version() const override;
+
+private:
   mutable std::mutex Mutex;
   std::shared_ptr<SymbolIndex> Index;
+  std::atomic<uint64_t> Version = {0};
 };
 
 } // namespace clangd
@@ -40,6 +40,8 @@ bool MemIndex::fuzzyFind(
     // Exact match against all possible scopes.
     if (!Req.AnyScope && !llvm::is_contained(Req.Scopes, Sym->Scope))
       continue;
+    if (!approximateScopeMatch(Sym->Scope, Req.ApproximateScope))
+      continue;
     if (Req.RestrictForCodeCompletion &&
         !(Sym->Flags & Symbol::IndexedForCodeCompletion))
       continue;
@@ -46,6 +46,9 @@ public:
   size_t estimateMemoryUsage() const override {
     return Dynamic->estimateMemoryUsage() + Static->estimateMemoryUsage();
   }
+  uint64_t version() const override {
+    return Dynamic->version() + Static->version();
+  }
 };
 
 } // namespace clangd
@@ -27,6 +27,7 @@ namespace {
 class ProjectAwareIndex : public SymbolIndex {
 public:
   size_t estimateMemoryUsage() const override;
+  uint64_t version() const override;
 
   /// Only queries the associated index with the current context.
   void lookup(const LookupRequest &Req,
@@ -77,6 +78,14 @@ size_t ProjectAwareIndex::estimateMemoryUsage() const {
   return Total;
 }
 
+uint64_t ProjectAwareIndex::version() const {
+  uint64_t Total = 0;
+  std::lock_guard<std::mutex> Lock(Mu);
+  for (auto &Entry : IndexForSpec)
+    Total += Entry.second->version();
+  return Total;
+}
+
 void ProjectAwareIndex::lookup(
     const LookupRequest &Req,
     llvm::function_ref<void(const Symbol &)> Callback) const {
@@ -22,7 +22,9 @@
 #include "llvm/Support/Endian.h"
 #include "llvm/Support/Error.h"
 #include "llvm/Support/raw_ostream.h"
+#include <algorithm>
 #include <cstdint>
+#include <limits>
 #include <vector>
 
 namespace clang {
@@ -453,14 +455,15 @@ readCompileCommand(Reader CmdReader, llvm::ArrayRef<llvm::StringRef> Strings) {
 //   - stri: string table
 //   - symb: symbols
 //   - refs: references to symbols
+//   - tmem: memory used to index the TU, in KiB (optional)
 
 // The current versioning scheme is simple - non-current versions are rejected.
 // If you make a breaking change, bump this version number to invalidate stored
 // data. Later we may want to support some backward compatibility.
 constexpr static uint32_t Version = 18;
 
-llvm::Expected<IndexFileIn> readRIFF(llvm::StringRef Data,
-                                     SymbolOrigin Origin) {
+llvm::Expected<IndexFileIn> readRIFF(llvm::StringRef Data, SymbolOrigin Origin,
+                                     bool CompressDocumentation) {
   auto RIFF = riff::readFile(Data);
   if (!RIFF)
     return RIFF.takeError();
@@ -508,11 +511,23 @@ llvm::Expected<IndexFileIn> readRIFF(llvm::StringRef Data,
   if (Chunks.count("symb")) {
     Reader SymbolReader(Chunks.lookup("symb"));
     SymbolSlab::Builder Symbols;
-    while (!SymbolReader.eof())
-      Symbols.insert(readSymbol(SymbolReader, Strings->Strings, Origin));
+    std::optional<DocumentationStore::Builder> Docs;
+    if (CompressDocumentation && DocumentationStore::isAvailable())
+      Docs.emplace();
+    while (!SymbolReader.eof()) {
+      Symbol Sym = readSymbol(SymbolReader, Strings->Strings, Origin);
+      // Strip documentation before the slab copies it.
+      if (Docs) {
+        Docs->add(Sym.ID, Sym.Documentation);
+        Sym.Documentation = "";
+      }
+      Symbols.insert(Sym);
+    }
     if (SymbolReader.err())
       return error("malformed or truncated symbol");
     Result.Symbols = std::move(Symbols).build();
+    if (Docs)
+      Result.Documentation = std::move(*Docs).build();
   }
   if (Chunks.count("refs")) {
     Reader RefsReader(Chunks.lookup("refs"));
@@ -547,6 +562,12 @@ llvm::Expected<IndexFileIn> readRIFF(llvm::StringRef Data,
     for (llvm::StringRef C : Cmd.CommandLine)
       Result.Cmd->CommandLine.emplace_back(C);
   }
+  if (Chunks.count("tmem")) {
+    Reader MemoryReader(Chunks.lookup("tmem"));
+    Result.IndexingMemory = size_t(MemoryReader.consumeVar()) * 1024;
+    if (MemoryReader.err())
+      return error("malformed or truncated memory section");
+  }
   return std::move(Result);
 }
 
@@ -669,6 +690,17 @@ void writeRIFF(const IndexFileOut &Data, llvm::raw_ostream &OS) {
     RIFF.Chunks.push_back({riff::fourCC("cmdl"), CmdlSection});
   }
 
+  std::string MemorySection;
+  if (Data.IndexingMemory) {
+    {
+      llvm::raw_string_ostream MemoryOS(MemorySection);
+      writeVar(std::min<size_t>(Data.IndexingMemory / 1024,
+                                std::numeric_limits<uint32_t>::max()),
+               MemoryOS);
+    }
+    RIFF.Chunks.push_back({riff::fourCC("tmem"), MemorySection});
+  }
+
   OS << RIFF;
 }
 
@@ -691,9 +723,10 @@ llvm::raw_ostream &operator<<(llvm::raw_ostream &OS, const IndexFileOut &O) {
 }
 
 llvm::Expected<IndexFileIn> readIndexFile(llvm::StringRef Data,
-                                          SymbolOrigin Origin) {
+                                          SymbolOrigin Origin,
+                                          bool CompressDocumentation) {
   if (Data.startswith("RIFF")) {
-    return readRIFF(Data, Origin);
+    return readRIFF(Data, Origin, CompressDocumentation);
   }
   if (auto YAMLContents = readYAML(Data, Origin)) {
     return std::move(*YAMLContents);
@@ -704,7 +737,8 @@ llvm::Expected<IndexFileIn> readIndexFile(llvm::StringRef Data,
 }
 
 std::unique_ptr<SymbolIndex> loadIndex(llvm::StringRef SymbolFilename,
-                                       SymbolOrigin Origin, bool UseDex) {
+                                       SymbolOrigin Origin, bool UseDex,
+                                       bool CompressDocumentation) {
   trace::Span OverallTracer("LoadIndex");
   auto Buffer = llvm::MemoryBuffer::getFile(SymbolFilename);
   if (!Buffer) {
@@ -715,11 +749,19 @@ std::unique_ptr<SymbolIndex> loadIndex(llvm::StringRef SymbolFilename,
   SymbolSlab Symbols;
   RefSlab Refs;
   RelationSlab Relations;
+  DocumentationStore Docs;
   {
     trace::Span Tracer("ParseIndex");
-    if (auto I = readIndexFile(Buffer->get()->getBuffer(), Origin)) {
+    // Only Dex can attach compressed documentation back to its symbols.
+    if (auto I = readIndexFile(Buffer->get()->getBuffer(), Origin,
+                               UseDex && CompressDocumentation)) {
       if (I->Symbols)
         Symbols = std::move(*I->Symbols);
+      if (I->Documentation) {
+        Docs = std::move(*I->Documentation);
+        vlog("Compressed {0} bytes of documentation to {1}", Docs.rawBytes(),
+             Docs.bytes());
+      }
       if (I->Refs)
         Refs = std::move(*I->Refs);
       if (I->Relations)
@@ -736,7 +778,7 @@ std::unique_ptr<SymbolIndex> loadIndex(llvm::StringRef SymbolFilename,
 
   trace::Span Tracer("BuildIndex");
   auto Index = UseDex ? dex::Dex::build(std::move(Symbols), std::move(Refs),
-                                        std::move(Relations))
+                                        std::move(Relations), std::move(Docs))
                       : MemIndex::build(std::move(Symbols), std::move(Refs),
                                         std::move(Relations));
   vlog("Loaded {0} from {1} with estimated memory usage {2} bytes\n"
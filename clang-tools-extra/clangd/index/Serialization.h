@@ -25,6 +25,7 @@
 #define LLVM_CLANG_TOOLS_EXTRA_CLANGD_INDEX_SERIALIZATION_H
 
 #include "Headers.h"
+#include "index/DocumentationStore.h"
 #include "index/Index.h"
 #include "index/Symbol.h"
 #include "clang/Tooling/CompilationDatabase.h"
@@ -48,9 +49,17 @@ struct IndexFileIn {
   std::optional<IncludeGraph> Sources;
   // This contains only the Directory and CommandLine.
   std::optional<tooling::CompileCommand> Cmd;
+  // Documentation moved out of Symbols, if it was compressed while reading.
+  std::optional<DocumentationStore> Documentation;
+  // Memory used to index the TU, in bytes. Only set in the shard of its main
+  // file, 0 if unknown.
+  size_t IndexingMemory = 0;
 };
 // Parse an index file. The input must be a RIFF or YAML file.
-llvm::Expected<IndexFileIn> readIndexFile(llvm::StringRef, SymbolOrigin);
+// With CompressDocumentation, documentation of symbols in a RIFF file is moved
+// into IndexFileIn::Documentation as it is read, if zlib is available.
+llvm::Expected<IndexFileIn> readIndexFile(llvm::StringRef, SymbolOrigin,
+                                          bool CompressDocumentation = false);
 
 // Specifies the contents of an index file to be written.
 struct IndexFileOut {
@@ -62,6 +71,7 @@ struct IndexFileOut {
   // TODO: Support serializing Dex posting lists.
   IndexFileFormat Format = IndexFileFormat::RIFF;
   const tooling::CompileCommand *Cmd = nullptr;
+  size_t IndexingMemory = 0; // Not written to YAML.
 
   IndexFileOut() = default;
   IndexFileOut(const IndexFileIn &I)
@@ -69,7 +79,7 @@ struct IndexFileOut {
         Refs(I.Refs ? &*I.Refs : nullptr),
         Relations(I.Relations ? &*I.Relations : nullptr),
         Sources(I.Sources ? &*I.Sources : nullptr),
-        Cmd(I.Cmd ? &*I.Cmd : nullptr) {}
+        Cmd(I.Cmd ? &*I.Cmd : nullptr), IndexingMemory(I.IndexingMemory) {}
 };
 // Serializes an index file.
 llvm::raw_ostream &operator<<(llvm::raw_ostream &OS, const IndexFileOut &O);
@@ -82,8 +92,11 @@ std::string toYAML(const Ref &);
 
 // Build an in-memory static index from an index file.
 // The size should be relatively small, so data can be managed in memory.
+// With CompressDocumentation, a Dex index keeps documentation compressed until
+// a query returns its symbol.
 std::unique_ptr<SymbolIndex> loadIndex(llvm::StringRef Filename,
-                                       SymbolOrigin Origin, bool UseDex = true);
+                                       SymbolOrigin Origin, bool UseDex = true,
+                                       bool CompressDocumentation = false);
 
 } // namespace clangd
 } // namespace clang
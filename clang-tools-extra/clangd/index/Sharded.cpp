@@ -0,0 +1,236 @@
+//===--- Sharded.cpp - Index over several projects ------------------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#include "index/Sharded.h"
+#include "URI.h"
+#include "index/Merge.h"
+#include "support/Context.h"
+#include "support/Trace.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/STLExtras.h"
+#include <algorithm>
+#include <limits>
+#include <utility>
+
+namespace clang {
+namespace clangd {
+
+ShardedIndex::ShardedIndex(unsigned Threads)
+    : Pool(llvm::hardware_concurrency(Threads)) {}
+
+SwapIndex &ShardedIndex::addShard(llvm::StringRef Root,
+                                  std::unique_ptr<SymbolIndex> Index) {
+  auto S = std::make_unique<Shard>();
+  S->RootURI = URI::createFile(Root).toString();
+  if (!llvm::StringRef(S->RootURI).endswith("/"))
+    S->RootURI += '/';
+  S->Index.reset(std::move(Index));
+  Shards.push_back(std::move(S));
+  return Shards.back()->Index;
+}
+
+void ShardedIndex::queryShards(
+    llvm::function_ref<void(size_t Shard, const SymbolIndex &)> Query) const {
+  std::vector<std::shared_ptr<SymbolIndex>> Snapshots;
+  for (const auto &S : Shards)
+    Snapshots.push_back(S->Index.snapshot());
+  if (Snapshots.size() == 1) {
+    Query(0, *Snapshots.front());
+    return;
+  }
+  // We wait for the tasks, so they can borrow our context.
+  const Context &Ctx = Context::current();
+  llvm::ThreadPoolTaskGroup Group(Pool);
+  for (size_t I = 0; I < Snapshots.size(); ++I)
+    Group.async([&, I] {
+      WithContext WithCtx(Ctx.clone());
+      Query(I, *Snapshots[I]);
+    });
+  Group.wait();
+}
+
+// Symbols passed to the callbacks may not outlive them (e.g. Dex builds their
+// documentation on the fly), so the results of each shard are copied.
+static std::vector<SymbolSlab>
+buildSlabs(std::vector<SymbolSlab::Builder> &Builders) {
+  std::vector<SymbolSlab> Slabs;
+  for (auto &Builder : Builders)
+    Slabs.push_back(std::move(Builder).build());
+  return Slabs;
+}
+
+bool ShardedIndex::fuzzyFind(
+    const FuzzyFindRequest &Req,
+    llvm::function_ref<void(const Symbol &)> Callback) const {
+  trace::Span Tracer("ShardedIndex fuzzyFind");
+  std::vector<SymbolSlab::Builder> Builders(Shards.size());
+  std::vector<std::vector<SymbolID>> Ranked(Shards.size()); // Best first.
+  std::vector<char> More(Shards.size()); // Written concurrently.
+  queryShards([&](size_t I, const SymbolIndex &Index) {
+    More[I] = Index.fuzzyFind(Req, [&](const Symbol &S) {
+      if (!Builders[I].find(S.ID))
+        Ranked[I].push_back(S.ID);
+      Builders[I].insert(S);
+    });
+  });
+  bool HasMore = llvm::is_contained(More, true);
+  auto Slabs = buildSlabs(Builders);
+
+  // The scores of different shards can't be compared (e.g. Dex boosts by
+  // proximity and scope), so we keep the order of each shard and interleave
+  // them: the N-th results of all shards come before the N+1-th ones.
+  llvm::DenseMap<SymbolID, Symbol> Merged;
+  std::vector<SymbolID> Order;
+  size_t Ranks = 0;
+  for (const auto &ShardRanked : Ranked)
+    Ranks = std::max(Ranks, ShardRanked.size());
+  for (size_t Rank = 0; Rank < Ranks; ++Rank)
+    for (size_t I = 0; I < Ranked.size(); ++I) {
+      if (Rank >= Ranked[I].size())
+        continue;
+      const Symbol &S = *Slabs[I].find(Ranked[I][Rank]);
+      auto It = Merged.try_emplace(S.ID, S);
+      if (It.second)
+        Order.push_back(S.ID);
+      else
+        It.first->second = mergeSymbol(It.first->second, S);
+    }
+  if (Req.Limit && Order.size() > *Req.Limit) {
+    Order.resize(*Req.Limit);
+    HasMore = true;
+  }
+  SPAN_ATTACH(Tracer, "shards", static_cast<int>(Shards.size()));
+  SPAN_ATTACH(Tracer, "results", static_cast<int>(Order.size()));
+  for (const SymbolID &ID : Order)
+    Callback(Merged.find(ID)->second);
+  return HasMore;
+}
+
+void ShardedIndex::lookup(
+    const LookupRequest &Req,
+    llvm::function_ref<void(const Symbol &)> Callback) const {
+  trace::Span Tracer("ShardedIndex lookup");
+  std::vector<SymbolSlab::Builder> Builders(Shards.size());
+  queryShards([&](size_t I, const SymbolIndex &Index) {
+    Index.lookup(Req, [&](const Symbol &S) { Builders[I].insert(S); });
+  });
+  auto Slabs = buildSlabs(Builders);
+  llvm::DenseMap<SymbolID, Symbol> Merged;
+  for (const SymbolSlab &Slab : Slabs)
+    for (const Symbol &S : Slab) {
+      auto It = Merged.try_emplace(S.ID, S);
+      if (!It.second)
+        It.first->second = mergeSymbol(It.first->second, S);
+    }
+  for (const auto &Entry : Merged)
+    Callback(Entry.second);
+}
+
+bool ShardedIndex::refs(const RefsRequest &Req,
+                        llvm::function_ref<void(const Ref &)> Callback) const {
+  trace::Span Tracer("ShardedIndex refs");
+  std::vector<RefSlab::Builder> Builders(Shards.size());
+  std::vector<char> More(Shards.size());
+  queryShards([&](size_t I, const SymbolIndex &Index) {
+    // Refs don't carry their symbol, query them one symbol at a time.
+    for (const SymbolID &ID : Req.IDs) {
+      RefsRequest SymbolReq = Req;
+      SymbolReq.IDs = {ID};
+      More[I] |= Index.refs(
+          SymbolReq, [&](const Ref &R) { Builders[I].insert(ID, R); });
+    }
+  });
+  bool HasMore = llvm::is_contained(More, true);
+
+  // Refs in headers shared by several projects are in several shards, the
+  // builder removes the duplicates.
+  RefSlab::Builder Merged;
+  for (auto &Builder : Builders)
+    for (const auto &Entry : std::move(Builder).build())
+      for (const Ref &R : Entry.second)
+        Merged.insert(Entry.first, R);
+  RefSlab Refs = std::move(Merged).build();
+  uint32_t Remaining =
+      Req.Limit.value_or(std::numeric_limits<uint32_t>::max());
+  for (const auto &Entry : Refs)
+    for (const Ref &R : Entry.second) {
+      if (!Remaining)
+        return true;
+      --Remaining;
+      Callback(R);
+    }
+  return HasMore;
+}
+
+void ShardedIndex::relations(
+    const RelationsRequest &Req,
+    llvm::function_ref<void(const SymbolID &, const Symbol &)> Callback) const {
+  trace::Span Tracer("ShardedIndex relations");
+  using Relation = std::pair<SymbolID, SymbolID>; // Subject, Object.
+  std::vector<SymbolSlab::Builder> Builders(Shards.size());
+  std::vector<std::vector<Relation>> Results(Shards.size());
+  queryShards([&](size_t I, const SymbolIndex &Index) {
+    Index.relations(Req, [&](const SymbolID &Subject, const Symbol &Object) {
+      Results[I].emplace_back(Subject, Object.ID);
+      Builders[I].insert(Object);
+    });
+  });
+  auto Slabs = buildSlabs(Builders);
+  llvm::DenseMap<Relation, Symbol> Merged;
+  std::vector<Relation> Order;
+  for (size_t I = 0; I < Results.size(); ++I)
+    for (const Relation &R : Results[I]) {
+      const Symbol &Object = *Slabs[I].find(R.second);
+      auto It = Merged.try_emplace(R, Object);
+      if (It.second)
+        Order.push_back(R);
+      else
+        It.first->second = mergeSymbol(It.first->second, Object);
+    }
+  uint32_t Remaining =
+      Req.Limit.value_or(std::numeric_limits<uint32_t>::max());
+  for (const Relation &Key : Order) {
+    if (!Remaining--)
+      break;
+    Callback(Key.first, Merged.find(Key)->second);
+  }
+}
+
+llvm::unique_function<IndexContents(llvm::StringRef) const>
+ShardedIndex::indexedFiles() const {
+  std::vector<std::pair<std::string, IndexedFiles>> Roots;
+  for (const auto &S : Shards)
+    Roots.emplace_back(S->RootURI, S->Index.indexedFiles());
+  // Innermost projects first.
+  llvm::stable_sort(Roots, [](const auto &L, const auto &R) {
+    return L.first.size() > R.first.size();
+  });
+  return [Roots(std::move(Roots))](llvm::StringRef FileURI) {
+    for (const auto &Root : Roots)
+      if (FileURI.startswith(Root.first))
+        return Root.second(FileURI);
+    return IndexContents::None;
+  };
+}
+
+size_t ShardedIndex::estimateMemoryUsage() const {
+  size_t Result = 0;
+  for (const auto &S : Shards)
+    Result += S->Index.estimateMemoryUsage();
+  return Result;
+}
+
+uint64_t ShardedIndex::version() const {
+  uint64_t Result = 0;
+  for (const auto &S : Shards)
+    Result += S->Index.version();
+  return Result;
+}
+
+} // namespace clangd
+} // namespace clang
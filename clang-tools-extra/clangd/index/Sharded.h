@@ -0,0 +1,75 @@
+//===--- Sharded.h - Index over several projects -----------------*- C++-*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_CLANG_TOOLS_EXTRA_CLANGD_INDEX_SHARDED_H
+#define LLVM_CLANG_TOOLS_EXTRA_CLANGD_INDEX_SHARDED_H
+
+#include "index/Index.h"
+#include "llvm/ADT/FunctionExtras.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/ThreadPool.h"
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace clang {
+namespace clangd {
+
+// ShardedIndex serves the indexes of several projects, built independently
+// (e.g. the projects of a monorepo), as a single index.
+//
+// Queries are sent to all shards in parallel, and the results are merged:
+// symbols found in several shards (e.g. from a shared header) are reported
+// once, and fuzzyFind interleaves the ranked results of the shards.
+//
+// Each shard can be reloaded independently.
+class ShardedIndex : public SymbolIndex {
+public:
+  /// At most \p Threads shards are queried concurrently, 0 means one thread
+  /// per core.
+  explicit ShardedIndex(unsigned Threads = 0);
+
+  /// Adds the index of the project at the absolute path \p Root. Shards must
+  /// be added before the index is queried. The returned index can be reset to
+  /// reload the shard.
+  SwapIndex &addShard(llvm::StringRef Root, std::unique_ptr<SymbolIndex> Index);
+
+  bool fuzzyFind(const FuzzyFindRequest &,
+                 llvm::function_ref<void(const Symbol &)>) const override;
+  void lookup(const LookupRequest &,
+              llvm::function_ref<void(const Symbol &)>) const override;
+  bool refs(const RefsRequest &,
+            llvm::function_ref<void(const Ref &)>) const override;
+  void relations(const RelationsRequest &,
+                 llvm::function_ref<void(const SymbolID &, const Symbol &)>)
+      const override;
+  /// Files are looked up in the shard of the innermost project containing
+  /// them.
+  llvm::unique_function<IndexContents(llvm::StringRef) const>
+  indexedFiles() const override;
+  size_t estimateMemoryUsage() const override;
+  uint64_t version() const override;
+
+private:
+  struct Shard {
+    std::string RootURI; // With a trailing slash.
+    SwapIndex Index;
+  };
+
+  // Runs Query on a snapshot of each shard in parallel.
+  void queryShards(
+      llvm::function_ref<void(size_t Shard, const SymbolIndex &)> Query) const;
+
+  std::vector<std::unique_ptr<Shard>> Shards;
+  mutable llvm::ThreadPool Pool;
+};
+
+} // namespace clangd
+} // namespace clang
+
+#endif // LLVM_CLANG_TOOLS_EXTRA_CLANGD_INDEX_SHARDED_H
@@ -18,11 +18,13 @@
 #include "support/Logger.h"
 #include "support/Trace.h"
 #include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallVector.h"
 #include "llvm/ADT/StringMap.h"
 #include "llvm/ADT/StringSet.h"
 #include "llvm/Support/Path.h"
 #include "llvm/Support/ScopedPrinter.h"
 #include <algorithm>
+#include <cstring>
 #include <optional>
 #include <queue>
 #include <utility>
@@ -33,20 +35,31 @@ namespace clangd {
 namespace dex {
 
 std::unique_ptr<SymbolIndex> Dex::build(SymbolSlab Symbols, RefSlab Refs,
-                                        RelationSlab Rels) {
+                                        RelationSlab Rels,
+                                        DocumentationStore Docs) {
   auto Size = Symbols.bytes() + Refs.bytes();
   // There is no need to include "Rels" in Data because the relations are self-
   // contained, without references into a backing store.
   auto Data = std::make_pair(std::move(Symbols), std::move(Refs));
-  return std::make_unique<Dex>(Data.first, Data.second, Rels, std::move(Data),
-                                Size);
+  auto Index = std::make_unique<Dex>(Data.first, Data.second, Rels,
+                                     std::move(Data), Size);
+  Index->Docs = std::move(Docs);
+  return Index;
 }
 
 namespace {
 
-// Mark symbols which are can be used for code completion.
-const Token RestrictedForCodeCompletion =
-    Token(Token::Kind::Sentinel, "Restricted For Code Completion");
+// Splits "a::b::" into "a::" and "b::".
+llvm::SmallVector<llvm::StringRef> scopeComponents(llvm::StringRef Scope) {
+  llvm::SmallVector<llvm::StringRef> Components;
+  while (!Scope.empty()) {
+    size_t End = Scope.find("::");
+    assert(End != llvm::StringRef::npos && "Scopes end with ::");
+    Components.push_back(Scope.take_front(End + 2));
+    Scope = Scope.drop_front(End + 2);
+  }
+  return Components;
+}
 
 // Helper to efficiently assemble the inverse index (token -> matching docs).
 // The output is a nice uniform structure keyed on Token, but constructing
@@ -55,9 +68,9 @@ const Token RestrictedForCodeCompletion =
 // and produce the Token keys once at the end.
 class IndexBuilder {
   llvm::DenseMap<Trigram, std::vector<DocID>> TrigramDocs;
-  std::vector<DocID> RestrictedCCDocs;
   llvm::StringMap<std::vector<DocID>> TypeDocs;
   llvm::StringMap<std::vector<DocID>> ScopeDocs;
+  llvm::StringMap<std::vector<DocID>> ScopeComponentDocs;
   llvm::StringMap<std::vector<DocID>> ProximityDocs;
   std::vector<Trigram> TrigramScratch;
 
@@ -71,12 +84,16 @@ public:
     for (Trigram T : TrigramScratch)
       TrigramDocs[T].push_back(D);
     ScopeDocs[Sym.Scope].push_back(D);
+    for (llvm::StringRef Component : scopeComponents(Sym.Scope)) {
+      auto &Docs = ScopeComponentDocs[Component];
+      // Scopes like a::b::a:: name a component twice.
+      if (Docs.empty() || Docs.back() != D)
+        Docs.push_back(D);
+    }
     if (!llvm::StringRef(Sym.CanonicalDeclaration.FileURI).empty())
       for (const auto &ProximityURI :
            generateProximityURIs(Sym.CanonicalDeclaration.FileURI))
         ProximityDocs[ProximityURI].push_back(D);
-    if (Sym.Flags & Symbol::IndexedForCodeCompletion)
-      RestrictedCCDocs.push_back(D);
     if (!Sym.Type.empty())
       TypeDocs[Sym.Type].push_back(D);
   }
@@ -85,9 +102,9 @@ public:
   llvm::DenseMap<Token, PostingList> build() && {
     llvm::DenseMap<Token, PostingList> Result(/*InitialReserve=*/
                                               TrigramDocs.size() +
-                                              RestrictedCCDocs.size() +
                                               TypeDocs.size() +
                                               ScopeDocs.size() +
+                                              ScopeComponentDocs.size() +
                                               ProximityDocs.size());
     // Tear down intermediate structs as we go to reduce memory usage.
     // Since we're trying to get rid of underlying allocations, clearing the
@@ -102,41 +119,25 @@ public:
         };
     CreatePostingList(Token::Kind::Type, TypeDocs);
     CreatePostingList(Token::Kind::Scope, ScopeDocs);
+    CreatePostingList(Token::Kind::ScopeComponent, ScopeComponentDocs);
     CreatePostingList(Token::Kind::ProximityURI, ProximityDocs);
 
-    // TrigramDocs are stored in a DenseMap and RestrictedCCDocs is not even a
-    // map, treat them specially.
+    // TrigramDocs are stored in a DenseMap, treat them specially.
     for (auto &E : TrigramDocs) {
       Result.try_emplace(Token(Token::Kind::Trigram, E.first.str()), E.second);
       E.second = {};
     }
     TrigramDocs = llvm::DenseMap<Trigram, std::vector<DocID>>{};
-    if (!RestrictedCCDocs.empty())
-      Result.try_emplace(RestrictedForCodeCompletion,
-                         std::move(RestrictedCCDocs));
     return Result;
   }
 };
 
 } // namespace
 
-void Dex::buildIndex() {
-  this->Corpus = dex::Corpus(Symbols.size());
-  std::vector<std::pair<float, const Symbol *>> ScoredSymbols(Symbols.size());
-
-  for (size_t I = 0; I < Symbols.size(); ++I) {
-    const Symbol *Sym = Symbols[I];
-    LookupTable[Sym->ID] = Sym;
-    ScoredSymbols[I] = {quality(*Sym), Sym};
-  }
-
-  // Symbols are sorted by symbol qualities so that items in the posting lists
-  // are stored in the descending order of symbol quality.
-  llvm::sort(ScoredSymbols, std::greater<std::pair<float, const Symbol *>>());
-
-  // SymbolQuality was empty up until now.
-  SymbolQuality.resize(Symbols.size());
-  // Populate internal storage using Symbol + Score pairs.
+void Dex::Partition::build(llvm::ArrayRef<ScoredSymbol> ScoredSymbols) {
+  Corpus = dex::Corpus(ScoredSymbols.size());
+  Symbols.resize(ScoredSymbols.size());
+  SymbolQuality.resize(ScoredSymbols.size());
   for (size_t I = 0; I < ScoredSymbols.size(); ++I) {
     SymbolQuality[I] = ScoredSymbols[I].first;
     Symbols[I] = ScoredSymbols[I].second;
@@ -149,15 +150,73 @@ void Dex::buildIndex() {
   InvertedIndex = std::move(Builder).build();
 }
 
-std::unique_ptr<Iterator> Dex::iterator(const Token &Tok) const {
+std::unique_ptr<Iterator> Dex::Partition::iterator(const Token &Tok) const {
   auto It = InvertedIndex.find(Tok);
   return It == InvertedIndex.end() ? Corpus.none()
                                    : It->second.iterator(&It->first);
 }
 
+size_t Dex::Partition::bytes() const {
+  size_t Bytes = Symbols.size() * sizeof(const Symbol *);
+  Bytes += SymbolQuality.size() * sizeof(float);
+  Bytes += InvertedIndex.getMemorySize();
+  for (const auto &TokenToPostingList : InvertedIndex)
+    Bytes += TokenToPostingList.second.bytes();
+  return Bytes;
+}
+
+void Dex::buildIndex(std::vector<const Symbol *> Symbols,
+                     std::vector<Relation> Rels) {
+  // Relations are grouped by kind, then by subject.
+  llvm::sort(Rels, [](const Relation &L, const Relation &R) {
+    return std::tie(L.Predicate, L.Subject, L.Object) <
+           std::tie(R.Predicate, R.Subject, R.Object);
+  });
+  Rels.erase(std::unique(Rels.begin(), Rels.end()), Rels.end());
+  for (const Relation &Rel : Rels) {
+    auto Kind = static_cast<uint8_t>(Rel.Predicate);
+    if (Relations.size() <= Kind)
+      Relations.resize(Kind + 1);
+    RelationTable &Table = Relations[Kind];
+    if (Table.Subjects.empty() || Table.Subjects.back() != Rel.Subject) {
+      Table.Subjects.push_back(Rel.Subject);
+      Table.Offsets.push_back(Table.Objects.size());
+    }
+    Table.Objects.push_back(Rel.Object);
+  }
+  for (RelationTable &Table : Relations) {
+    Table.Offsets.push_back(Table.Objects.size());
+    Table.Subjects.shrink_to_fit();
+    Table.Offsets.shrink_to_fit();
+    Table.Objects.shrink_to_fit();
+    Table.buildBuckets();
+  }
+
+  std::vector<ScoredSymbol> ScoredSymbols(Symbols.size());
+
+  for (size_t I = 0; I < Symbols.size(); ++I) {
+    const Symbol *Sym = Symbols[I];
+    LookupTable[Sym->ID] = Sym;
+    ScoredSymbols[I] = {quality(*Sym), Sym};
+  }
+
+  // Symbols are sorted by symbol qualities so that items in the posting lists
+  // are stored in the descending order of symbol quality.
+  llvm::sort(ScoredSymbols, std::greater<ScoredSymbol>());
+  // Each partition keeps this order, with its own DocIDs.
+  auto Split = std::stable_partition(
+      ScoredSymbols.begin(), ScoredSymbols.end(), [](const ScoredSymbol &S) {
+        return static_cast<bool>(S.second->Flags &
+                                 Symbol::IndexedForCodeCompletion);
+      });
+  llvm::ArrayRef<ScoredSymbol> Sorted = ScoredSymbols;
+  CodeCompletion.build(Sorted.take_front(Split - ScoredSymbols.begin()));
+  Rest.build(Sorted.drop_front(Split - ScoredSymbols.begin()));
+}
+
 // Constructs BOOST iterators for Path Proximities.
 std::unique_ptr<Iterator> Dex::createFileProximityIterator(
-    llvm::ArrayRef<std::string> ProximityPaths) const {
+    const Partition &P, llvm::ArrayRef<std::string> ProximityPaths) const {
   std::vector<std::unique_ptr<Iterator>> BoostingIterators;
   // Deduplicate parent URIs extracted from the ProximityPaths.
   llvm::StringSet<> ParentURIs;
@@ -181,29 +240,30 @@ std::unique_ptr<Iterator> Dex::createFileProximityIterator(
   // Proximity Path: the closer processed path is, the higher boosting factor.
   for (const auto &ParentURI : ParentURIs.keys()) {
     // FIXME(kbobyrev): Append LIMIT on top of every BOOST iterator.
-    auto It = iterator(Token(Token::Kind::ProximityURI, ParentURI));
+    auto It = P.iterator(Token(Token::Kind::ProximityURI, ParentURI));
     if (It->kind() != Iterator::Kind::False) {
       PathProximitySignals.SymbolURI = ParentURI;
-      BoostingIterators.push_back(Corpus.boost(
+      BoostingIterators.push_back(P.Corpus.boost(
           std::move(It), PathProximitySignals.evaluateHeuristics()));
     }
   }
-  BoostingIterators.push_back(Corpus.all());
-  return Corpus.unionOf(std::move(BoostingIterators));
+  BoostingIterators.push_back(P.Corpus.all());
+  return P.Corpus.unionOf(std::move(BoostingIterators));
 }
 
 // Constructs BOOST iterators for preferred types.
 std::unique_ptr<Iterator>
-Dex::createTypeBoostingIterator(llvm::ArrayRef<std::string> Types) const {
+Dex::createTypeBoostingIterator(const Partition &P,
+                                llvm::ArrayRef<std::string> Types) const {
   std::vector<std::unique_ptr<Iterator>> BoostingIterators;
   SymbolRelevanceSignals PreferredTypeSignals;
   PreferredTypeSignals.TypeMatchesPreferred = true;
   auto Boost = PreferredTypeSignals.evaluateHeuristics();
   for (const auto &T : Types)
     BoostingIterators.push_back(
-        Corpus.boost(iterator(Token(Token::Kind::Type, T)), Boost));
-  BoostingIterators.push_back(Corpus.all());
-  return Corpus.unionOf(std::move(BoostingIterators));
+        P.Corpus.boost(P.iterator(Token(Token::Kind::Type, T)), Boost));
+  BoostingIterators.push_back(P.Corpus.all());
+  return P.Corpus.unionOf(std::move(BoostingIterators));
 }
 
 /// Constructs iterators over tokens extracted from the query and exhausts it
@@ -214,11 +274,35 @@ bool Dex::fuzzyFind(const FuzzyFindRequest &Req,
   assert(!StringRef(Req.Query).contains("::") &&
          "There must be no :: in query.");
   trace::Span Tracer("Dex fuzzyFind");
-  FuzzyMatcher Filter(Req.Query);
   // For short queries we use specialized trigrams that don't yield all results.
   // Prevent clients from postfiltering them for longer queries.
   bool More = !Req.Query.empty() && Req.Query.size() < 3;
+  // Code completion only looks at the symbols it can use, other queries look
+  // at both partitions and merge their results.
+  auto Scored = fuzzyFind(CodeCompletion, Req, More);
+  if (!Req.RestrictForCodeCompletion) {
+    auto Compare = [](const ScoredSymbol &LHS, const ScoredSymbol &RHS) {
+      return LHS.first > RHS.first;
+    };
+    TopN<ScoredSymbol, decltype(Compare)> Top(
+        Req.Limit ? *Req.Limit : std::numeric_limits<size_t>::max(), Compare);
+    for (auto &S : Scored)
+      Top.push(std::move(S));
+    for (auto &S : fuzzyFind(Rest, Req, More))
+      if (Top.push(std::move(S)))
+        More = true;
+    Scored = std::move(Top).items();
+  }
+  for (const auto &S : Scored)
+    report(*S.second, Callback);
+  return More;
+}
 
+std::vector<Dex::ScoredSymbol> Dex::fuzzyFind(const Partition &P,
+                                              const FuzzyFindRequest &Req,
+                                              bool &More) const {
+  trace::Span Tracer("Dex partition");
+  FuzzyMatcher Filter(Req.Query);
   std::vector<std::unique_ptr<Iterator>> Criteria;
   const auto TrigramTokens = generateQueryTrigrams(Req.Query);
 
@@ -226,39 +310,55 @@ bool Dex::fuzzyFind(const FuzzyFindRequest &Req,
   // trigrams.
   std::vector<std::unique_ptr<Iterator>> TrigramIterators;
   for (const auto &Trigram : TrigramTokens)
-    TrigramIterators.push_back(iterator(Trigram));
-  Criteria.push_back(Corpus.intersect(std::move(TrigramIterators)));
+    TrigramIterators.push_back(P.iterator(Trigram));
+  Criteria.push_back(P.Corpus.intersect(std::move(TrigramIterators)));
 
   // Generate scope tokens for search query.
   std::vector<std::unique_ptr<Iterator>> ScopeIterators;
   for (const auto &Scope : Req.Scopes)
-    ScopeIterators.push_back(iterator(Token(Token::Kind::Scope, Scope)));
+    ScopeIterators.push_back(P.iterator(Token(Token::Kind::Scope, Scope)));
   if (Req.AnyScope)
     ScopeIterators.push_back(
-        Corpus.boost(Corpus.all(), ScopeIterators.empty() ? 1.0 : 0.2));
-  Criteria.push_back(Corpus.unionOf(std::move(ScopeIterators)));
+        P.Corpus.boost(P.Corpus.all(), ScopeIterators.empty() ? 1.0 : 0.2));
+  Criteria.push_back(P.Corpus.unionOf(std::move(ScopeIterators)));
+  // Symbols must be nested in all components of the approximate scope. Their
+  // order is checked when scoring.
+  if (!Req.ApproximateScope.empty()) {
+    std::vector<std::unique_ptr<Iterator>> ComponentIterators;
+    for (llvm::StringRef Component : scopeComponents(Req.ApproximateScope))
+      ComponentIterators.push_back(
+          P.iterator(Token(Token::Kind::ScopeComponent, Component)));
+    Criteria.push_back(P.Corpus.intersect(std::move(ComponentIterators)));
+  }
 
   // Add proximity paths boosting (all symbols, some boosted).
-  Criteria.push_back(createFileProximityIterator(Req.ProximityPaths));
+  Criteria.push_back(createFileProximityIterator(P, Req.ProximityPaths));
   // Add boosting for preferred types.
-  Criteria.push_back(createTypeBoostingIterator(Req.PreferredTypes));
-
-  if (Req.RestrictForCodeCompletion)
-    Criteria.push_back(iterator(RestrictedForCodeCompletion));
+  Criteria.push_back(createTypeBoostingIterator(P, Req.PreferredTypes));
 
   // Use TRUE iterator if both trigrams and scopes from the query are not
   // present in the symbol index.
-  auto Root = Corpus.intersect(std::move(Criteria));
-  // Retrieve more items than it was requested: some of  the items with high
-  // final score might not be retrieved otherwise.
-  // FIXME(kbobyrev): Tune this ratio.
-  if (Req.Limit)
-    Root = Corpus.limit(std::move(Root), *Req.Limit * 100);
+  auto Root = P.Corpus.intersect(std::move(Criteria));
   SPAN_ATTACH(Tracer, "query", llvm::to_string(*Root));
   vlog("Dex query tree: {0}", *Root);
 
+  // Retrieve more items than it was requested: some of  the items with high
+  // final score might not be retrieved otherwise.
+  // FIXME(kbobyrev): Tune this ratio.
+  size_t RetrievalLimit =
+      Req.Limit ? *Req.Limit * 100 : std::numeric_limits<size_t>::max();
   using IDAndScore = std::pair<DocID, float>;
-  std::vector<IDAndScore> IDAndScores = consume(*Root);
+  std::vector<IDAndScore> IDAndScores;
+  for (; !Root->reachedEnd() && IDAndScores.size() < RetrievalLimit;
+       Root->advance()) {
+    DocID ID = Root->peek();
+    // The posting lists only ensure that all scope components are present.
+    // Drop symbols that have them in the wrong order before they count
+    // against the limit.
+    if (!approximateScopeMatch(P.Symbols[ID]->Scope, Req.ApproximateScope))
+      continue;
+    IDAndScores.emplace_back(ID, Root->consume());
+  }
 
   auto Compare = [](const IDAndScore &LHS, const IDAndScore &RHS) {
     return LHS.second > RHS.second;
@@ -267,25 +367,24 @@ bool Dex::fuzzyFind(const FuzzyFindRequest &Req,
       Req.Limit ? *Req.Limit : std::numeric_limits<size_t>::max(), Compare);
   for (const auto &IDAndScore : IDAndScores) {
     const DocID SymbolDocID = IDAndScore.first;
-    const auto *Sym = Symbols[SymbolDocID];
+    const auto *Sym = P.Symbols[SymbolDocID];
     const std::optional<float> Score = Filter.match(Sym->Name);
     if (!Score)
       continue;
     // Combine Fuzzy Matching score, precomputed symbol quality and boosting
     // score for a cumulative final symbol score.
     const float FinalScore =
-        (*Score) * SymbolQuality[SymbolDocID] * IDAndScore.second;
+        (*Score) * P.SymbolQuality[SymbolDocID] * IDAndScore.second;
     // If Top.push(...) returns true, it means that it had to pop an item. In
     // this case, it is possible to retrieve more symbols.
     if (Top.push({SymbolDocID, FinalScore}))
       More = true;
   }
 
-  // Apply callback to the top Req.Limit items in the descending
-  // order of cumulative score.
+  std::vector<ScoredSymbol> Result;
   for (const auto &Item : std::move(Top).items())
-    Callback(*Symbols[Item.first]);
-  return More;
+    Result.emplace_back(Item.second, P.Symbols[Item.first]);
+  return Result;
 }
 
 void Dex::lookup(const LookupRequest &Req,
@@ -294,10 +393,22 @@ void Dex::lookup(const LookupRequest &Req,
   for (const auto &ID : Req.IDs) {
     auto I = LookupTable.find(ID);
     if (I != LookupTable.end())
-      Callback(*I->second);
+      report(*I->second, Callback);
   }
 }
 
+void Dex::report(const Symbol &Sym,
+                 llvm::function_ref<void(const Symbol &)> Callback) const {
+  if (Docs.empty())
+    return Callback(Sym);
+  std::string Documentation = Docs.get(Sym.ID);
+  if (Documentation.empty())
+    return Callback(Sym);
+  Symbol WithDocs = Sym;
+  WithDocs.Documentation = Documentation;
+  Callback(WithDocs);
+}
+
 bool Dex::refs(const RefsRequest &Req,
                llvm::function_ref<void(const Ref &)> Callback) const {
   trace::Span Tracer("Dex refs");
@@ -319,22 +430,67 @@ void Dex::relations(
     llvm::function_ref<void(const SymbolID &, const Symbol &)> Callback) const {
   trace::Span Tracer("Dex relations");
   uint32_t Remaining = Req.Limit.value_or(std::numeric_limits<uint32_t>::max());
+  auto Kind = static_cast<uint8_t>(Req.Predicate);
+  if (Kind >= Relations.size())
+    return;
+  const RelationTable &Table = Relations[Kind];
   for (const SymbolID &Subject : Req.Subjects) {
-    LookupRequest LookupReq;
-    auto It = Relations.find(
-        std::make_pair(Subject, static_cast<uint8_t>(Req.Predicate)));
-    if (It != Relations.end()) {
-      for (const auto &Object : It->second) {
-        if (Remaining > 0) {
-          --Remaining;
-          LookupReq.IDs.insert(Object);
-        }
-      }
+    auto Report = [&](const Symbol &Object) { Callback(Subject, Object); };
+    for (const auto &Object : Table.objects(Subject)) {
+      if (Remaining == 0)
+        return;
+      --Remaining;
+      auto Sym = LookupTable.find(Object);
+      if (Sym != LookupTable.end())
+        report(*Sym->second, Report);
     }
-    lookup(LookupReq, [&](const Symbol &Object) { Callback(Subject, Object); });
   }
 }
 
+// The top Bits of ID, in the order of SymbolID::operator<.
+static size_t bucket(const SymbolID &ID, unsigned Bits) {
+  if (Bits == 0)
+    return 0;
+  uint64_t Hash;
+  static_assert(sizeof(Hash) == SymbolID::RawSize);
+  memcpy(&Hash, ID.raw().data(), sizeof(Hash));
+  return Hash >> (64 - Bits);
+}
+
+void Dex::RelationTable::buildBuckets() {
+  // About 4 subjects per bucket.
+  BucketBits = 0;
+  while ((size_t(1) << BucketBits) < Subjects.size() / 4)
+    ++BucketBits;
+  Buckets.assign((size_t(1) << BucketBits) + 1, 0);
+  for (const SymbolID &Subject : Subjects)
+    ++Buckets[bucket(Subject, BucketBits) + 1];
+  for (size_t B = 1; B < Buckets.size(); ++B)
+    Buckets[B] += Buckets[B - 1];
+}
+
+llvm::ArrayRef<SymbolID>
+Dex::RelationTable::objects(const SymbolID &Subject) const {
+  if (Subjects.empty())
+    return {};
+  size_t B = bucket(Subject, BucketBits);
+  auto First = Subjects.begin() + Buckets[B];
+  auto Last = Subjects.begin() + Buckets[B + 1];
+  auto It = std::lower_bound(First, Last, Subject);
+  if (It == Last || *It != Subject)
+    return {};
+  size_t I = It - Subjects.begin();
+  llvm::ArrayRef<SymbolID> All = Objects;
+  return All.slice(Offsets[I], Offsets[I + 1] - Offsets[I]);
+}
+
+size_t Dex::RelationTable::bytes() const {
+  return Subjects.capacity() * sizeof(SymbolID) +
+         Offsets.capacity() * sizeof(uint32_t) +
+         Objects.capacity() * sizeof(SymbolID) +
+         Buckets.capacity() * sizeof(uint32_t);
+}
+
 llvm::unique_function<IndexContents(llvm::StringRef) const>
 Dex::indexedFiles() const {
   return [this](llvm::StringRef FileURI) {
@@ -343,14 +499,12 @@ Dex::indexedFiles() const {
 }
 
 size_t Dex::estimateMemoryUsage() const {
-  size_t Bytes = Symbols.size() * sizeof(const Symbol *);
-  Bytes += SymbolQuality.size() * sizeof(float);
+  size_t Bytes = CodeCompletion.bytes() + Rest.bytes();
   Bytes += LookupTable.getMemorySize();
-  Bytes += InvertedIndex.getMemorySize();
-  for (const auto &TokenToPostingList : InvertedIndex)
-    Bytes += TokenToPostingList.second.bytes();
   Bytes += Refs.getMemorySize();
-  Bytes += Relations.getMemorySize();
+  for (const RelationTable &Table : Relations)
+    Bytes += Table.bytes();
+  Bytes += Docs.bytes();
   return Bytes + BackingDataSize;
 }
 
@@ -21,6 +21,7 @@
 #define LLVM_CLANG_TOOLS_EXTRA_CLANGD_INDEX_DEX_DEX_H
 
 #include "index/dex/Iterator.h"
+#include "index/DocumentationStore.h"
 #include "index/Index.h"
 #include "index/Relation.h"
 #include "index/dex/PostingList.h"
@@ -36,17 +37,16 @@ class Dex : public SymbolIndex {
 public:
   // All data must outlive this index.
   template <typename SymbolRange, typename RefsRange, typename RelationsRange>
-  Dex(SymbolRange &&Symbols, RefsRange &&Refs, RelationsRange &&Relations)
-      : Corpus(0) {
+  Dex(SymbolRange &&Symbols, RefsRange &&Refs, RelationsRange &&Relations) {
+    std::vector<const Symbol *> Syms;
     for (auto &&Sym : Symbols)
-      this->Symbols.push_back(&Sym);
+      Syms.push_back(&Sym);
     for (auto &&Ref : Refs)
       this->Refs.try_emplace(Ref.first, Ref.second);
+    std::vector<Relation> Rels;
     for (auto &&Rel : Relations)
-      this->Relations[std::make_pair(Rel.Subject,
-                                     static_cast<uint8_t>(Rel.Predicate))]
-          .push_back(Rel.Object);
-    buildIndex();
+      Rels.push_back(Rel);
+    buildIndex(std::move(Syms), std::move(Rels));
   }
   // Symbols and Refs are owned by BackingData, Index takes ownership.
   template <typename SymbolRange, typename RefsRange, typename RelationsRange,
@@ -73,7 +73,10 @@ public:
   }
 
   /// Builds an index from slabs. The index takes ownership of the slab.
-  static std::unique_ptr<SymbolIndex> build(SymbolSlab, RefSlab, RelationSlab);
+  /// Documentation moved out of the symbols into \p Docs is attached back to
+  /// the symbols returned by queries.
+  static std::unique_ptr<SymbolIndex> build(SymbolSlab, RefSlab, RelationSlab,
+                                            DocumentationStore Docs = {});
 
   bool
   fuzzyFind(const FuzzyFindRequest &Req,
@@ -95,30 +98,80 @@ public:
   size_t estimateMemoryUsage() const override;
 
 private:
-  void buildIndex();
-  std::unique_ptr<Iterator> iterator(const Token &Tok) const;
+  /// Relations of one kind in a compressed sparse row layout: the objects of
+  /// Subjects[I] are Objects[Offsets[I]] up to Objects[Offsets[I + 1]].
+  /// All arrays are flat, so the table can be written out as is.
+  ///
+  /// SymbolIDs are hashes, so the top bits of the subjects are spread evenly:
+  /// Buckets maps them to a range of a few subjects, which keeps lookups from
+  /// binary searching (and missing the cache) across all of the subjects.
+  struct RelationTable {
+    std::vector<SymbolID> Subjects; // Sorted.
+    std::vector<uint32_t> Offsets;  // One more than Subjects.
+    std::vector<SymbolID> Objects;
+    // The subjects with top bits B are Subjects[Buckets[B]] up to
+    // Subjects[Buckets[B + 1]].
+    std::vector<uint32_t> Buckets;
+    unsigned BucketBits = 0;
+
+    /// Builds Buckets once Subjects are complete.
+    void buildBuckets();
+    llvm::ArrayRef<SymbolID> objects(const SymbolID &Subject) const;
+    size_t bytes() const;
+  };
+
+  using ScoredSymbol = std::pair<float, const Symbol *>;
+
+  /// Symbols and the posting lists over them. DocIDs are indices into Symbols.
+  struct Partition {
+    /// Stores symbols sorted in the descending order of symbol quality.
+    std::vector<const Symbol *> Symbols;
+    /// SymbolQuality[I] is the quality of Symbols[I].
+    std::vector<float> SymbolQuality;
+    /// Inverted index is a mapping from the search token to the posting list,
+    /// which contains all items which can be characterized by such search
+    /// token. For example, if the search token is scope "std::", the
+    /// corresponding posting list would contain all indices of symbols defined
+    /// in namespace std. Inverted index is used to retrieve posting lists which
+    /// are processed during the fuzzyFind process.
+    llvm::DenseMap<Token, PostingList> InvertedIndex;
+    dex::Corpus Corpus{0};
+
+    /// Takes symbols sorted in the descending order of their quality.
+    void build(llvm::ArrayRef<ScoredSymbol> ScoredSymbols);
+    std::unique_ptr<Iterator> iterator(const Token &Tok) const;
+    size_t bytes() const;
+  };
+
+  void buildIndex(std::vector<const Symbol *> Symbols,
+                  std::vector<Relation> Rels);
+  /// Runs \p Req over the symbols of \p P. Returns the best Req.Limit matches
+  /// with their scores, best first, and sets \p More if others were dropped.
+  std::vector<ScoredSymbol> fuzzyFind(const Partition &P,
+                                      const FuzzyFindRequest &Req,
+                                      bool &More) const;
   std::unique_ptr<Iterator>
-  createFileProximityIterator(llvm::ArrayRef<std::string> ProximityPaths) const;
+  createFileProximityIterator(const Partition &P,
+                              llvm::ArrayRef<std::string> ProximityPaths) const;
   std::unique_ptr<Iterator>
-  createTypeBoostingIterator(llvm::ArrayRef<std::string> Types) const;
-
-  /// Stores symbols sorted in the descending order of symbol quality..
-  std::vector<const Symbol *> Symbols;
-  /// SymbolQuality[I] is the quality of Symbols[I].
-  std::vector<float> SymbolQuality;
+  createTypeBoostingIterator(const Partition &P,
+                             llvm::ArrayRef<std::string> Types) const;
+  /// Calls \p Callback with the symbol, with its documentation restored.
+  void report(const Symbol &Sym,
+              llvm::function_ref<void(const Symbol &)> Callback) const;
+
+  /// The symbols IndexedForCodeCompletion. Code completion queries are the
+  /// most frequent and latency-sensitive ones, and run over these shorter
+  /// posting lists rather than filtering the whole corpus.
+  Partition CodeCompletion;
+  /// The other symbols. Other queries run over both partitions, which are
+  /// disjoint so that no posting list is stored twice.
+  Partition Rest;
   llvm::DenseMap<SymbolID, const Symbol *> LookupTable;
-  /// Inverted index is a mapping from the search token to the posting list,
-  /// which contains all items which can be characterized by such search token.
-  /// For example, if the search token is scope "std::", the corresponding
-  /// posting list would contain all indices of symbols defined in namespace
-  /// std. Inverted index is used to retrieve posting lists which are processed
-  /// during the fuzzyFind process.
-  llvm::DenseMap<Token, PostingList> InvertedIndex;
-  dex::Corpus Corpus;
   llvm::DenseMap<SymbolID, llvm::ArrayRef<Ref>> Refs;
   static_assert(sizeof(RelationKind) == sizeof(uint8_t),
                 "RelationKind should be of same size as a uint8_t");
-  llvm::DenseMap<std::pair<SymbolID, uint8_t>, std::vector<SymbolID>> Relations;
+  std::vector<RelationTable> Relations; // Indexed by RelationKind.
   std::shared_ptr<void> KeepAlive; // poor man's move-only std::any
   // Set of files which were used during this index build.
   llvm::StringSet<> Files;
@@ -126,6 +179,8 @@ private:
   IndexContents IdxContents;
   // Size of memory retained by KeepAlive.
   size_t BackingDataSize = 0;
+  // Documentation moved out of the symbols, if compressed.
+  DocumentationStore Docs;
 };
 
 /// Returns Search Token for a number of parent directories of given Path.
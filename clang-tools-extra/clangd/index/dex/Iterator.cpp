@@ -30,7 +30,6 @@ public:
     // Establish invariants.
     for (const auto &Child : Children)
       ReachedEnd |= Child->reachedEnd();
-    sync();
     // When children are sorted by the estimateSize(), sync() calls are more
     // effective. Each sync() starts with the first child and makes sure all
     // children point to the same element. If any child is "above" the previous
@@ -42,6 +41,7 @@ public:
                             const std::unique_ptr<Iterator> &RHS) {
       return LHS->estimateSize() < RHS->estimateSize();
     });
+    sync();
   }
 
   bool reachedEnd() const override { return ReachedEnd; }
@@ -219,13 +219,71 @@ private:
   friend Corpus; // For optimizations.
 };
 
+/// Implements Iterator over the union of an iterator yielding every item
+/// (typically TRUE) with other iterators, which then only contribute boosts.
+///
+/// This is the shape of boosting criteria, e.g. (| true (* 2 [proximity]) ...).
+/// Unlike OrIterator, it only moves the child yielding every item while
+/// iterating, and advances the others when an item is consumed: the cost of
+/// boosting is paid for results only, not for each candidate of the query.
+class BoostAllIterator : public Iterator {
+public:
+  BoostAllIterator(std::vector<std::unique_ptr<Iterator>> AllChildren,
+                   size_t AllIndex)
+      : Children(std::move(AllChildren)), All(*Children[AllIndex]) {}
+
+  bool reachedEnd() const override { return All.reachedEnd(); }
+
+  void advance() override { All.advance(); }
+
+  void advanceTo(DocID ID) override { All.advanceTo(ID); }
+
+  DocID peek() const override { return All.peek(); }
+
+  // Returns the maximum boosting score among all Children containing the
+  // current ID, like OrIterator.
+  float consume() override {
+    assert(!reachedEnd() && "BoostAll iterator can't consume() at the end.");
+    const DocID ID = peek();
+    float Boost = 1;
+    for (const auto &Child : Children) {
+      if (!Child->reachedEnd() && Child->peek() < ID)
+        Child->advanceTo(ID);
+      if (!Child->reachedEnd() && Child->peek() == ID)
+        Boost = std::max(Boost, Child->consume());
+    }
+    return Boost;
+  }
+
+  size_t estimateSize() const override { return All.estimateSize(); }
+
+private:
+  llvm::raw_ostream &dump(llvm::raw_ostream &OS) const override {
+    OS << "(| ";
+    auto *Separator = "";
+    for (const auto &Child : Children) {
+      OS << Separator << *Child;
+      Separator = " ";
+    }
+    OS << ')';
+    return OS;
+  }
+
+  std::vector<std::unique_ptr<Iterator>> Children;
+  Iterator &All;
+};
+
 /// TrueIterator handles PostingLists which contain all items of the index. It
 /// stores size of the virtual posting list, and all operations are performed
-/// in O(1).
+/// in O(1). Boosting it scales the score of every item, so that a boosted TRUE
+/// can still be recognized by unionOf().
 class TrueIterator : public Iterator {
 public:
   explicit TrueIterator(DocID Size) : Iterator(Kind::True), Size(Size) {}
 
+  void boost(float Factor) { Boost *= Factor; }
+  bool isBoosted() const { return Boost != 1; }
+
   bool reachedEnd() const override { return Index >= Size; }
 
   void advance() override {
@@ -245,17 +303,20 @@ public:
 
   float consume() override {
     assert(!reachedEnd() && "TRUE iterator can't consume() at the end.");
-    return 1;
+    return Boost;
   }
 
   size_t estimateSize() const override { return Size; }
 
 private:
   llvm::raw_ostream &dump(llvm::raw_ostream &OS) const override {
+    if (isBoosted())
+      return OS << "(* " << Boost << " true)";
     return OS << "true";
   }
 
   DocID Index = 0;
+  float Boost = 1;
   /// Size of the underlying virtual PostingList.
   DocID Size;
 };
@@ -367,7 +428,10 @@ Corpus::intersect(std::vector<std::unique_ptr<Iterator>> Children) const {
   for (auto &Child : Children) {
     switch (Child->kind()) {
     case Iterator::Kind::True:
-      break; // No effect, drop the iterator.
+      // No effect, drop the iterator. A boosted one still scales the scores.
+      if (static_cast<TrueIterator *>(Child.get())->isBoosted())
+        RealChildren.push_back(std::move(Child));
+      break;
     case Iterator::Kind::False:
       return std::move(Child); // Intersection is empty.
     case Iterator::Kind::And: {
@@ -406,7 +470,8 @@ Corpus::unionOf(std::vector<std::unique_ptr<Iterator>> Children) const {
       break;
     }
     case Iterator::Kind::True:
-      // Don't return all(), which would discard sibling boosts.
+      // Don't return all(), which would discard sibling boosts. This includes
+      // a boosted TRUE, e.g. the fallback of AnyScope queries.
     default:
       RealChildren.push_back(std::move(Child));
     }
@@ -417,6 +482,10 @@ Corpus::unionOf(std::vector<std::unique_ptr<Iterator>> Children) const {
   case 1:
     return std::move(RealChildren.front());
   default:
+    // The other children can't add items to TRUE, only boost them.
+    for (size_t I = 0; I < RealChildren.size(); ++I)
+      if (RealChildren[I]->kind() == Iterator::Kind::True)
+        return std::make_unique<BoostAllIterator>(std::move(RealChildren), I);
     return std::make_unique<OrIterator>(std::move(RealChildren));
   }
 }
@@ -435,6 +504,11 @@ std::unique_ptr<Iterator> Corpus::boost(std::unique_ptr<Iterator> Child,
     return Child;
   if (Child->kind() == Iterator::Kind::False)
     return Child;
+  // Stays a TRUE iterator, see unionOf().
+  if (Child->kind() == Iterator::Kind::True) {
+    static_cast<TrueIterator *>(Child.get())->boost(Factor);
+    return Child;
+  }
   return std::make_unique<BoostIterator>(std::move(Child), Factor);
 }
 
@@ -149,6 +149,9 @@ public:
   ///
   /// consume(): OR Iterator returns the highest boost value among children
   /// containing the requested item.
+  ///
+  /// If a child is TRUE, the other children can only boost its items. They are
+  /// then advanced only when an item is consumed.
   std::unique_ptr<Iterator>
   unionOf(std::vector<std::unique_ptr<Iterator>> Children) const;
 
@@ -55,6 +55,11 @@ public:
     /// Data stroes full scope name, e.g. "foo::bar::baz::" or "" (for global
     /// scope).
     Scope,
+    /// One component of a symbol's scope, e.g. "symbol is nested in some
+    /// namespace bar".
+    ///
+    /// Data stores the component with trailing colons, e.g. "bar::".
+    ScopeComponent,
     /// Path Proximity URI to symbol declaration.
     ///
     /// Data stores path URI of symbol declaration file or its parent.
@@ -84,6 +89,9 @@ public:
     case Kind::Scope:
       OS << "S=";
       break;
+    case Kind::ScopeComponent:
+      OS << "SC=";
+      break;
     case Kind::ProximityURI:
       OS << "U=";
       break;
@@ -15,6 +15,7 @@
 #include "marshalling/Marshalling.h"
 #include "support/Logger.h"
 #include "support/Trace.h"
+#include "llvm/ADT/ArrayRef.h"
 #include "llvm/ADT/SmallString.h"
 #include "llvm/ADT/StringRef.h"
 #include "llvm/Support/Error.h"
@@ -61,8 +62,8 @@ class IndexClient : public clangd::SymbolIndex {
   template <typename RequestT, typename ReplyT, typename ClangdRequestT,
             typename CallbackT>
   bool streamRPC(ClangdRequestT Request,
-                 StreamingCall<RequestT, ReplyT> RPCCall,
-                 CallbackT Callback) const {
+                 StreamingCall<RequestT, ReplyT> RPCCall, CallbackT Callback,
+                 grpc::Status *Result = nullptr) const {
     updateConnectionStatus();
     // We initialize to true because stream might be broken before we see the
     // final message. In such a case there are actually more results on the
@@ -106,10 +107,13 @@ class IndexClient : public clangd::SymbolIndex {
                       .count();
     vlog("Remote index [{0}]: {1} => {2} results in {3}ms.", ServerAddress,
          RequestT::descriptor()->name(), Successful, Millis);
-    SPAN_ATTACH(Tracer, "Status", Reader->Finish().ok());
+    grpc::Status Status = Reader->Finish();
+    SPAN_ATTACH(Tracer, "Status", Status.ok());
     SPAN_ATTACH(Tracer, "Successful", Successful);
     SPAN_ATTACH(Tracer, "Failed to parse", FailedToParse);
     updateConnectionStatus();
+    if (Result)
+      *Result = std::move(Status);
     return HasMore;
   }
 
@@ -143,6 +147,21 @@ public:
   bool
   refs(const clangd::RefsRequest &Request,
        llvm::function_ref<void(const clangd::Ref &)> Callback) const override {
+    if (SupportsBatchedRefs) {
+      grpc::Status Status;
+      bool HasMore = streamRPC(
+          Request, &remote::v1::SymbolIndex::Stub::BatchedRefs,
+          [&](llvm::ArrayRef<clangd::Ref> Batch) {
+            for (const clangd::Ref &R : Batch)
+              Callback(R);
+          },
+          &Status);
+      if (Status.error_code() != grpc::StatusCode::UNIMPLEMENTED)
+        return HasMore;
+      log("Remote index [{0}] does not support batched refs, using Refs.",
+          ServerAddress);
+      SupportsBatchedRefs = false;
+    }
     return streamRPC(Request, &remote::v1::SymbolIndex::Stub::Refs, Callback);
   }
 
@@ -176,6 +195,8 @@ private:
   llvm::SmallString<256> ServerAddress;
   mutable std::atomic<grpc_connectivity_state> ConnectionStatus;
   std::unique_ptr<Marshaller> ProtobufMarshaller;
+  // Cleared once the server answers BatchedRefs with UNIMPLEMENTED.
+  mutable std::atomic<bool> SupportsBatchedRefs = true;
   // Each request will be terminated if it takes too long.
   std::chrono::milliseconds DeadlineWaitingTime;
 };
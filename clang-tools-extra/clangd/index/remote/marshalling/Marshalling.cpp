@@ -93,6 +93,7 @@ Marshaller::fromProtobuf(const FuzzyFindRequest *Message) {
   for (const auto &Scope : Message->scopes())
     Result.Scopes.push_back(Scope);
   Result.AnyScope = Message->any_scope();
+  Result.ApproximateScope = Message->approximate_scope();
   if (Message->limit())
     Result.Limit = Message->limit();
   Result.RestrictForCodeCompletion = Message->restricted_for_code_completion();
@@ -192,6 +193,50 @@ llvm::Expected<clangd::Ref> Marshaller::fromProtobuf(const Ref &Message) {
   return Result;
 }
 
+llvm::Expected<std::vector<clangd::Ref>>
+Marshaller::fromProtobuf(const RefsBatch &Message) {
+  size_t Size = Message.files_size();
+  if (Message.kinds_size() != static_cast<int>(Size) ||
+      Message.start_line_deltas_size() != static_cast<int>(Size) ||
+      Message.start_columns_size() != static_cast<int>(Size) ||
+      Message.end_line_deltas_size() != static_cast<int>(Size) ||
+      Message.end_columns_size() != static_cast<int>(Size))
+    return error("Mismatched sizes in RefsBatch.");
+  const std::string &Containers = Message.containers();
+  if (!Containers.empty() && Containers.size() != Size * SymbolID::RawSize)
+    return error("Expected {0} containers in RefsBatch, got {1} bytes.", Size,
+                 Containers.size());
+  std::vector<const char *> URIs;
+  URIs.reserve(Message.file_paths_size());
+  for (const auto &Path : Message.file_paths()) {
+    auto URIString = relativePathToURI(Path);
+    if (!URIString)
+      return URIString.takeError();
+    URIs.push_back(Strings.save(*URIString).begin());
+  }
+  std::vector<clangd::Ref> Result(Size);
+  int64_t Line = 0;
+  for (size_t I = 0; I < Size; ++I) {
+    clangd::Ref &R = Result[I];
+    if (Message.files(I) >= URIs.size())
+      return error("File index {0} out of range in RefsBatch.",
+                   Message.files(I));
+    R.Location.FileURI = URIs[Message.files(I)];
+    Line += Message.start_line_deltas(I);
+    if (Line < 0)
+      return error("Negative line in RefsBatch.");
+    R.Location.Start.setLine(Line);
+    R.Location.Start.setColumn(Message.start_columns(I));
+    R.Location.End.setLine(Line + Message.end_line_deltas(I));
+    R.Location.End.setColumn(Message.end_columns(I));
+    R.Kind = static_cast<RefKind>(Message.kinds(I));
+    if (!Containers.empty())
+      R.Container = SymbolID::fromRaw(llvm::StringRef(
+          Containers.data() + I * SymbolID::RawSize, SymbolID::RawSize));
+  }
+  return Result;
+}
+
 llvm::Expected<std::pair<clangd::SymbolID, clangd::Symbol>>
 Marshaller::fromProtobuf(const Relation &Message) {
   auto SubjectID = SymbolID::fromStr(Message.subject_id());
@@ -219,6 +264,7 @@ FuzzyFindRequest Marshaller::toProtobuf(const clangd::FuzzyFindRequest &From) {
   for (const auto &Scope : From.Scopes)
     RPCRequest.add_scopes(Scope);
   RPCRequest.set_any_scope(From.AnyScope);
+  RPCRequest.set_approximate_scope(From.ApproximateScope);
   if (From.Limit)
     RPCRequest.set_limit(*From.Limit);
   RPCRequest.set_restricted_for_code_completion(From.RestrictForCodeCompletion);
@@ -436,6 +482,43 @@ Marshaller::fromProtobuf(const HeaderWithReferences &Message) {
       Strings.save(Header), Message.references(), Directives};
 }
 
+llvm::Error RefsBatchBuilder::add(const clangd::Ref &From) {
+  auto Path = PathIndex.try_emplace(From.Location.FileURI, Paths.size());
+  if (Path.second) {
+    auto RelativePath = M.uriToRelativePath(From.Location.FileURI);
+    if (!RelativePath) {
+      PathIndex.erase(Path.first);
+      return RelativePath.takeError();
+    }
+    Paths.push_back(std::move(*RelativePath));
+  }
+  auto File =
+      BatchPathIndex.try_emplace(Path.first->second, Batch.file_paths_size());
+  if (File.second)
+    Batch.add_file_paths(Paths[Path.first->second]);
+
+  uint32_t Line = From.Location.Start.line();
+  Batch.add_files(File.first->second);
+  Batch.add_kinds(static_cast<uint32_t>(From.Kind));
+  Batch.add_start_line_deltas(static_cast<int32_t>(Line - LastLine));
+  Batch.add_start_columns(From.Location.Start.column());
+  Batch.add_end_line_deltas(From.Location.End.line() - Line);
+  Batch.add_end_columns(From.Location.End.column());
+  if (WantContainer)
+    Batch.mutable_containers()->append(From.Container.raw().data(),
+                                       SymbolID::RawSize);
+  LastLine = Line;
+  return llvm::Error::success();
+}
+
+RefsBatch RefsBatchBuilder::take() {
+  RefsBatch Result;
+  Result.Swap(&Batch);
+  BatchPathIndex.clear();
+  LastLine = 0;
+  return Result;
+}
+
 } // namespace remote
 } // namespace clangd
 } // namespace clang
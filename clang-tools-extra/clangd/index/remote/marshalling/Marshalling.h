@@ -11,8 +11,11 @@
 
 #include "Index.pb.h"
 #include "index/Index.h"
+#include "llvm/ADT/DenseMap.h"
 #include "llvm/ADT/StringRef.h"
 #include "llvm/Support/StringSaver.h"
+#include <string>
+#include <vector>
 
 namespace clang {
 namespace clangd {
@@ -40,6 +43,8 @@ public:
 
   llvm::Expected<clangd::Symbol> fromProtobuf(const Symbol &Message);
   llvm::Expected<clangd::Ref> fromProtobuf(const Ref &Message);
+  llvm::Expected<std::vector<clangd::Ref>>
+  fromProtobuf(const RefsBatch &Message);
   llvm::Expected<std::pair<clangd::SymbolID, clangd::Symbol>>
   fromProtobuf(const Relation &Message);
 
@@ -101,6 +106,30 @@ private:
   llvm::UniqueStringSaver Strings;
 };
 
+/// Encodes the references sent in reply to a BatchedRefs request. Each file
+/// path is computed once per request and sent once per batch.
+class RefsBatchBuilder {
+public:
+  RefsBatchBuilder(Marshaller &M, bool WantContainer)
+      : M(M), WantContainer(WantContainer) {}
+
+  llvm::Error add(const clangd::Ref &From);
+  /// Number of references in the current batch.
+  size_t size() const { return Batch.files_size(); }
+  /// Returns the current batch and starts a new one.
+  RefsBatch take();
+
+private:
+  Marshaller &M;
+  bool WantContainer;
+  RefsBatch Batch;
+  // FileURIs come from the index, which interns them.
+  llvm::DenseMap<const char *, unsigned> PathIndex; // Into Paths.
+  std::vector<std::string> Paths;
+  llvm::DenseMap<unsigned, unsigned> BatchPathIndex; // Into file_paths.
+  uint32_t LastLine = 0;
+};
+
 } // namespace remote
 } // namespace clangd
 } // namespace clang
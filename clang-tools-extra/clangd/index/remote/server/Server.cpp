@@ -14,10 +14,12 @@
 #include "Service.pb.h"
 #include "index/Index.h"
 #include "index/Serialization.h"
+#include "index/Sharded.h"
 #include "index/Symbol.h"
 #include "index/remote/marshalling/Marshalling.h"
 #include "support/Context.h"
 #include "support/Logger.h"
+#include "support/Path.h"
 #include "support/Shutdown.h"
 #include "support/ThreadsafeFS.h"
 #include "support/Trace.h"
@@ -32,6 +34,7 @@
 #include "llvm/Support/Signals.h"
 #include "llvm/Support/VirtualFileSystem.h"
 
+#include <algorithm>
 #include <chrono>
 #include <grpc++/grpc++.h>
 #include <grpc++/health_check_service_interface.h>
@@ -40,6 +43,7 @@
 #include <string>
 #include <thread>
 #include <utility>
+#include <vector>
 
 #if ENABLE_GRPC_REFLECTION
 #include <grpc++/ext/proto_server_reflection_plugin.h>
@@ -111,6 +115,23 @@ llvm::cl::opt<size_t> LimitResults(
                    "single request. Limit is to keep the server from being "
                    "DOS'd. Defaults to 10000."));
 
+llvm::cl::opt<size_t> RefsBatchSize(
+    "refs-batch-size", llvm::cl::init(1000),
+    llvm::cl::desc("Maximum number of references sent in a single message in "
+                   "reply to BatchedRefs requests. Defaults to 1000."));
+
+llvm::cl::list<std::string> IndexShards(
+    "index-shard",
+    llvm::cl::desc("Also serve the index of another project, given as "
+                   "ROOT=PATH where ROOT is the absolute path of the project, "
+                   "in <PROJECT ROOT>. May be repeated. Queries are sent to "
+                   "all shards and the results merged."));
+
+llvm::cl::opt<unsigned> ShardQueryThreads(
+    "shard-query-threads", llvm::cl::init(0),
+    llvm::cl::desc("Maximum number of index shards queried concurrently. "
+                   "Defaults to one per core."));
+
 static Key<grpc::ServerContext *> CurrentRequest;
 
 class RemoteIndexServer final : public v1::SymbolIndex::Service {
@@ -258,6 +279,54 @@ private:
     return grpc::Status::OK;
   }
 
+  grpc::Status
+  BatchedRefs(grpc::ServerContext *Context, const RefsRequest *Request,
+              grpc::ServerWriter<BatchedRefsReply> *Reply) override {
+    auto StartTime = stopwatch::now();
+    WithContextValue WithRequestContext(CurrentRequest, Context);
+    logRequest(*Request);
+    trace::Span Tracer("BatchedRefsRequest");
+    auto Req = ProtobufMarshaller->fromProtobuf(Request);
+    if (!Req) {
+      elog("Can not parse RefsRequest from protobuf: {0}", Req.takeError());
+      return grpc::Status::CANCELLED;
+    }
+    if (!Req->Limit || *Req->Limit > LimitResults) {
+      log("[public] Limiting result size for Refs request from {0} to {1}.",
+          Req->Limit, LimitResults);
+      Req->Limit = LimitResults;
+    }
+    unsigned Sent = 0;
+    unsigned FailedToSend = 0;
+    RefsBatchBuilder Batch(*ProtobufMarshaller, Req->WantContainer);
+    auto Flush = [&] {
+      BatchedRefsReply NextMessage;
+      *NextMessage.mutable_stream_result() = Batch.take();
+      logResponse(NextMessage);
+      Reply->Write(NextMessage);
+    };
+    bool HasMore = Index.refs(*Req, [&](const clangd::Ref &Item) {
+      if (auto Err = Batch.add(Item)) {
+        elog("Unable to convert Ref to protobuf: {0}", std::move(Err));
+        ++FailedToSend;
+        return;
+      }
+      ++Sent;
+      if (Batch.size() >= RefsBatchSize)
+        Flush();
+    });
+    if (Batch.size())
+      Flush();
+    BatchedRefsReply LastMessage;
+    LastMessage.mutable_final_result()->set_has_more(HasMore);
+    logResponse(LastMessage);
+    Reply->Write(LastMessage);
+    SPAN_ATTACH(Tracer, "Sent", Sent);
+    SPAN_ATTACH(Tracer, "Failed to send", FailedToSend);
+    logRequestSummary("v1/BatchedRefs", Sent, StartTime);
+    return grpc::Status::OK;
+  }
+
   grpc::Status Relations(grpc::ServerContext *Context,
                          const RelationsRequest *Request,
                          grpc::ServerWriter<RelationsReply> *Reply) override {
@@ -403,8 +472,9 @@ void hotReload(clangd::SwapIndex &Index, llvm::StringRef IndexPath,
   }
   Index.reset(std::move(NewIndex));
   Monitor.updateIndex(Status->getLastModificationTime());
-  log("New index version loaded. Last modification time: {0}, size: {1} bytes.",
-      Status->getLastModificationTime(), Status->getSize());
+  log("New index version loaded from {0}. Last modification time: {1}, size: "
+      "{2} bytes.",
+      IndexPath, Status->getLastModificationTime(), Status->getSize());
 }
 
 void runServerAndWait(clangd::SymbolIndex &Index, llvm::StringRef ServerAddress,
@@ -526,34 +596,79 @@ int main(int argc, char *argv[]) {
   if (Tracer)
     TracingSession.emplace(*Tracer);
 
+  // The project root and path of each index to serve.
+  std::vector<std::pair<std::string, std::string>> Specs = {
+      {IndexRoot, IndexPath}};
+  for (llvm::StringRef Shard : IndexShards) {
+    auto [Root, Path] = Shard.split('=');
+    if (Path.empty() || !llvm::sys::path::is_absolute(Root) ||
+        !pathStartsWith(IndexRoot, Root)) {
+      llvm::errs() << "Index shard should be ROOT=PATH, with ROOT an absolute "
+                      "path in the index root: "
+                   << Shard << "\n";
+      return -1;
+    }
+    Specs.emplace_back(Root.str(), Path.str());
+  }
+
+  // A shard being served, and the state of its file when it was loaded.
+  struct LoadedShard {
+    std::string Path;
+    clang::clangd::SwapIndex *Index;
+    llvm::vfs::Status LastStatus;
+  };
+  std::vector<LoadedShard> Shards;
+  std::unique_ptr<clang::clangd::SymbolIndex> Index;
+  clang::clangd::ShardedIndex *Sharded = nullptr;
+  if (Specs.size() > 1) {
+    auto ShardedIndex =
+        std::make_unique<clang::clangd::ShardedIndex>(ShardQueryThreads);
+    Sharded = ShardedIndex.get();
+    Index = std::move(ShardedIndex);
+  }
+
   clang::clangd::RealThreadsafeFS TFS;
   auto FS = TFS.view(std::nullopt);
-  auto Status = FS->status(IndexPath);
-  if (!Status) {
-    elog("{0} does not exist.", IndexPath);
-    return Status.getError().value();
-  }
+  llvm::sys::TimePoint<> LastModified;
+  for (const auto &[Root, Path] : Specs) {
+    auto Status = FS->status(Path);
+    if (!Status) {
+      elog("{0} does not exist.", Path);
+      return Status.getError().value();
+    }
 
-  auto SymIndex =
-      clang::clangd::loadIndex(IndexPath, clang::clangd::SymbolOrigin::Static);
-  if (!SymIndex) {
-    llvm::errs() << "Failed to open the index.\n";
-    return -1;
+    auto SymIndex =
+        clang::clangd::loadIndex(Path, clang::clangd::SymbolOrigin::Static);
+    if (!SymIndex) {
+      llvm::errs() << "Failed to open the index " << Path << ".\n";
+      return -1;
+    }
+    clang::clangd::SwapIndex *Swap;
+    if (Sharded) {
+      Swap = &Sharded->addShard(Root, std::move(SymIndex));
+      clang::clangd::log("Serving {0} for {1}", Path, Root);
+    } else {
+      auto SwapIndex =
+          std::make_unique<clang::clangd::SwapIndex>(std::move(SymIndex));
+      Swap = SwapIndex.get();
+      Index = std::move(SwapIndex);
+    }
+    Shards.push_back({Path, Swap, *Status});
+    LastModified = std::max(LastModified, Status->getLastModificationTime());
   }
-  clang::clangd::SwapIndex Index(std::move(SymIndex));
 
-  Monitor Monitor(Status->getLastModificationTime());
+  Monitor Monitor(LastModified);
 
-  std::thread HotReloadThread([&Index, &Status, &FS, &Monitor]() {
-    llvm::vfs::Status LastStatus = *Status;
+  std::thread HotReloadThread([&Shards, &FS, &Monitor]() {
     static constexpr auto RefreshFrequency = std::chrono::seconds(30);
     while (!clang::clangd::shutdownRequested()) {
-      hotReload(Index, llvm::StringRef(IndexPath), LastStatus, FS, Monitor);
+      for (LoadedShard &Shard : Shards)
+        hotReload(*Shard.Index, Shard.Path, Shard.LastStatus, FS, Monitor);
       std::this_thread::sleep_for(RefreshFrequency);
     }
   });
 
-  runServerAndWait(Index, ServerAddress, IndexPath, Monitor);
+  runServerAndWait(*Index, ServerAddress, IndexPath, Monitor);
 
   HotReloadThread.join();
 }
@@ -6,6 +6,7 @@
 //
 //===----------------------------------------------------------------------===//
 #include "Tweak.h"
+#include "Config.h"
 #include "FeatureModule.h"
 #include "SourceCode.h"
 #include "index/Index.h"
@@ -14,6 +15,7 @@
 #include "llvm/ADT/STLExtras.h"
 #include "llvm/ADT/StringMap.h"
 #include "llvm/ADT/StringRef.h"
+#include "llvm/ADT/StringSet.h"
 #include "llvm/Support/Error.h"
 #include "llvm/Support/Registry.h"
 #include <functional>
@@ -55,6 +57,36 @@ getAllTweaks(const FeatureModuleSet *Modules) {
   }
   return All;
 }
+
+/// Kinds of the common ancestor of the selection and all its parents.
+std::vector<ASTNodeKind> ancestorKinds(const SelectionTree &Tree) {
+  std::vector<ASTNodeKind> Kinds;
+  for (const SelectionTree::Node *N = Tree.commonAncestor(); N; N = N->Parent)
+    Kinds.push_back(N->ASTNode.getNodeKind());
+  return Kinds;
+}
+
+/// Checks the prefilter of the tweak, see Tweak::nodeKinds().
+bool mayApply(const Tweak &T, llvm::ArrayRef<ASTNodeKind> Ancestors) {
+  llvm::ArrayRef<ASTNodeKind> Kinds = T.nodeKinds();
+  if (Kinds.empty())
+    return true;
+  return llvm::any_of(Ancestors, [&](ASTNodeKind A) {
+    return llvm::any_of(Kinds, [&](ASTNodeKind K) { return K.isBaseOf(A); });
+  });
+}
+
+bool byID(const std::unique_ptr<Tweak> &L, const std::unique_ptr<Tweak> &R) {
+  return llvm::StringRef(L->id()) < R->id();
+}
+
+// The parts of the config read by the prepare() of some tweak. Tweaks that
+// read more of it in prepare() must add it here, or cached outcomes would
+// outlive a config change.
+llvm::hash_code configHash(const Config &Cfg) {
+  return llvm::hash_combine_range(Cfg.Style.FullyQualifiedNamespaces.begin(),
+                                  Cfg.Style.FullyQualifiedNamespaces.end());
+}
 } // namespace
 
 Tweak::Selection::Selection(const SymbolIndex *Index, ParsedAST &AST,
@@ -74,16 +106,76 @@ prepareTweaks(const Tweak::Selection &S,
               const FeatureModuleSet *Modules) {
   validateRegistry();
 
+  std::vector<ASTNodeKind> Ancestors = ancestorKinds(S.ASTSelection);
   std::vector<std::unique_ptr<Tweak>> Available;
   for (auto &T : getAllTweaks(Modules)) {
-    if (!Filter(*T) || !T->prepare(S))
+    if (!Filter(*T) || !mayApply(*T, Ancestors) || !T->prepare(S))
       continue;
     Available.push_back(std::move(T));
   }
   // Ensure deterministic order of the results.
-  llvm::sort(Available,
-             [](const std::unique_ptr<Tweak> &L,
-                const std::unique_ptr<Tweak> &R) { return L->id() < R->id(); });
+  llvm::sort(Available, byID);
+  return Available;
+}
+
+std::vector<TweakCache::Results> &TweakCache::get(unsigned Begin,
+                                                  unsigned End) {
+  llvm::hash_code Hash = configHash(Config::current());
+  if (ConfigHash != Hash) {
+    Ranges.clear();
+    ConfigHash = Hash;
+  }
+  if (Ranges.size() >= MaxRanges && !Ranges.count({Begin, End}))
+    Ranges.clear();
+  return Ranges[{Begin, End}];
+}
+
+std::vector<TweakCache::Prepared> prepareTweaks(
+    ParsedAST &AST, unsigned Begin, unsigned End,
+    llvm::function_ref<std::vector<std::unique_ptr<Tweak::Selection>>()>
+        Selections,
+    llvm::function_ref<bool(const Tweak &)> Filter,
+    const FeatureModuleSet *Modules) {
+  validateRegistry();
+
+  std::vector<TweakCache::Results> &Cached =
+      AST.getTweakCache().get(Begin, End);
+  std::vector<std::unique_ptr<Tweak::Selection>> Built;
+  if (Cached.empty()) {
+    Built = Selections();
+    Cached.resize(Built.size());
+  }
+
+  std::vector<TweakCache::Prepared> Available;
+  llvm::StringSet<> Seen;
+  for (unsigned I = 0; I < Cached.size(); ++I) {
+    std::optional<std::vector<ASTNodeKind>> Ancestors;
+    // Tweaks keep state from prepare(), so each selection gets fresh ones.
+    std::vector<std::unique_ptr<Tweak>> All = getAllTweaks(Modules);
+    llvm::sort(All, byID);
+    for (auto &T : All) {
+      // Don't allow a tweak to fire more than once across selections.
+      if (Seen.contains(T->id()) || !Filter(*T))
+        continue;
+      auto It = Cached[I].find(T->id());
+      if (It == Cached[I].end()) {
+        if (Built.empty())
+          Built = Selections();
+        assert(Built.size() == Cached.size() && "Selections changed");
+        const Tweak::Selection &S = *Built[I];
+        if (!Ancestors)
+          Ancestors = ancestorKinds(S.ASTSelection);
+        std::optional<TweakCache::Prepared> Result;
+        if (mayApply(*T, *Ancestors) && T->prepare(S))
+          Result = TweakCache::Prepared{T->id(), T->title(), T->kind()};
+        It = Cached[I].try_emplace(T->id(), std::move(Result)).first;
+      }
+      if (It->second) {
+        Available.push_back(*It->second);
+        Seen.insert(T->id());
+      }
+    }
+  }
   return Available;
 }
 
@@ -93,7 +185,7 @@ prepareTweak(StringRef ID, const Tweak::Selection &S,
   for (auto &T : getAllTweaks(Modules)) {
     if (T->id() != ID)
       continue;
-    if (!T->prepare(S))
+    if (!mayApply(*T, ancestorKinds(S.ASTSelection)) || !T->prepare(S))
       return error("failed to prepare() tweak {0}", ID);
     return std::move(T);
   }
@@ -24,7 +24,11 @@
 #include "SourceCode.h"
 #include "index/Index.h"
 #include "support/Path.h"
+#include "clang/AST/ASTTypeTraits.h"
 #include "clang/Tooling/Core/Replacement.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/Hashing.h"
+#include "llvm/ADT/StringMap.h"
 #include "llvm/ADT/StringRef.h"
 #include "llvm/Support/Error.h"
 #include <optional>
@@ -123,6 +127,10 @@ public:
   virtual llvm::StringLiteral kind() const = 0;
   /// Is this a 'hidden' tweak, which are off by default.
   virtual bool hidden() const { return false; }
+  /// A cheap prefilter checked before prepare(): the tweak is only available
+  /// if the common ancestor of the selection, or one of its parents, is a node
+  /// of one of these kinds. Empty if the tweak can run on any selection.
+  virtual llvm::ArrayRef<ASTNodeKind> nodeKinds() const { return {}; }
 };
 
 // All tweaks must be registered in the .cpp file next to their definition.
@@ -138,6 +146,46 @@ prepareTweaks(const Tweak::Selection &S,
               llvm::function_ref<bool(const Tweak &)> Filter,
               const FeatureModuleSet *Modules);
 
+/// Remembers which tweaks are available on the selections of a range, so that
+/// repeated code action requests for the same AST don't prepare() them again.
+/// Owned by the ParsedAST, see ParsedAST::getTweakCache().
+/// Outcomes are dropped when the parts of Config::current() that prepare()
+/// reads change, see configHash() in Tweak.cpp.
+class TweakCache {
+public:
+  /// A tweak whose prepare() succeeded.
+  struct Prepared {
+    std::string ID;
+    std::string Title;
+    llvm::StringLiteral Kind;
+  };
+  /// The outcome of prepare() on one selection, by tweak ID.
+  using Results = llvm::StringMap<std::optional<Prepared>>;
+
+  /// Returns the outcomes for each selection of [Begin, End). Empty if the
+  /// range wasn't seen before or the config changed, callers fill it in.
+  std::vector<Results> &get(unsigned Begin, unsigned End);
+
+private:
+  // Ranges seen by code action requests are mostly cursor positions, drop them
+  // all rather than tracking recency once there are too many.
+  static constexpr unsigned MaxRanges = 256;
+  std::optional<llvm::hash_code> ConfigHash;
+  llvm::DenseMap<std::pair<unsigned, unsigned>, std::vector<Results>> Ranges;
+};
+
+/// Returns the tweaks that satisfy the filter and can run on one of the
+/// selections of [Begin, End), as calling prepareTweaks() on each selection in
+/// turn would. Tweaks available on several selections are listed once.
+/// Outcomes are cached in the AST, \p Selections is called to build the
+/// selections only if some tweak hasn't been prepared on this range yet.
+std::vector<TweakCache::Prepared> prepareTweaks(
+    ParsedAST &AST, unsigned Begin, unsigned End,
+    llvm::function_ref<std::vector<std::unique_ptr<Tweak::Selection>>()>
+        Selections,
+    llvm::function_ref<bool(const Tweak &)> Filter,
+    const FeatureModuleSet *Modules);
+
 // Calls prepare() on the tweak with a given ID.
 // If prepare() returns false, returns an error.
 // If prepare() returns true, returns the corresponding tweak.
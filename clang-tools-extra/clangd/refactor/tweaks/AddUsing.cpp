@@ -34,6 +34,12 @@ class AddUsing : public Tweak {
 public:
   const char *id() const override;
 
+  llvm::ArrayRef<ASTNodeKind> nodeKinds() const override {
+    static constexpr ASTNodeKind Kinds[] = {
+        ASTNodeKind::getFromNodeKind<DeclRefExpr>(),
+        ASTNodeKind::getFromNodeKind<TypeLoc>()};
+    return Kinds;
+  }
   bool prepare(const Selection &Inputs) override;
   Expected<Effect> apply(const Selection &Inputs) override;
   std::string title() const override;
@@ -215,6 +221,7 @@ bool isNamespaceForbidden(const Tweak::Selection &Inputs,
                           const NestedNameSpecifier &Namespace) {
   std::string NamespaceStr = printNamespaceScope(*Namespace.getAsNamespace());
 
+  // Cached prepare() outcomes depend on this, see configHash() in Tweak.cpp.
   for (StringRef Banned : Config::current().Style.FullyQualifiedNamespaces) {
     StringRef PrefixMatch = NamespaceStr;
     if (PrefixMatch.consume_front(Banned) && PrefixMatch.consume_front("::"))
@@ -395,6 +395,11 @@ public:
 
   // Returns true when selection is on a function definition that does not
   // make use of any internal symbols.
+  llvm::ArrayRef<ASTNodeKind> nodeKinds() const override {
+    static constexpr ASTNodeKind Kinds[] = {
+        ASTNodeKind::getFromNodeKind<FunctionDecl>()};
+    return Kinds;
+  }
   bool prepare(const Selection &Sel) override {
     const SelectionTree::Node *SelNode = Sel.ASTSelection.commonAncestor();
     if (!SelNode)
@@ -371,6 +371,11 @@ public:
     return "Move function body to out-of-line";
   }
 
+  llvm::ArrayRef<ASTNodeKind> nodeKinds() const override {
+    static constexpr ASTNodeKind Kinds[] = {
+        ASTNodeKind::getFromNodeKind<FunctionDecl>()};
+    return Kinds;
+  }
   bool prepare(const Selection &Sel) override {
     // Bail out if we are not in a header file.
     // FIXME: We might want to consider moving method definitions below class
@@ -42,6 +42,11 @@ public:
   llvm::StringLiteral kind() const override {
     return CodeAction::REFACTOR_KIND;
   }
+  llvm::ArrayRef<ASTNodeKind> nodeKinds() const override {
+    static constexpr ASTNodeKind Kinds[] = {
+        ASTNodeKind::getFromNodeKind<TypeLoc>()};
+    return Kinds;
+  }
   bool prepare(const Selection &Inputs) override;
   Expected<Effect> apply(const Selection &Inputs) override;
   std::string title() const override;
@@ -805,6 +805,11 @@ llvm::Expected<NewFunction> getExtractedFunction(ExtractionZone &ExtZone,
 class ExtractFunction : public Tweak {
 public:
   const char *id() const final;
+  llvm::ArrayRef<ASTNodeKind> nodeKinds() const override {
+    static constexpr ASTNodeKind Kinds[] = {
+        ASTNodeKind::getFromNodeKind<FunctionDecl>()};
+    return Kinds;
+  }
   bool prepare(const Selection &Inputs) override;
   Expected<Effect> apply(const Selection &Inputs) override;
   std::string title() const override { return "Extract to function"; }
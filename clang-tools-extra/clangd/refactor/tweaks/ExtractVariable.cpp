@@ -486,6 +486,11 @@ const SelectionTree::Node *computeExtractedExpr(const SelectionTree::Node *N) {
 class ExtractVariable : public Tweak {
 public:
   const char *id() const final;
+  llvm::ArrayRef<ASTNodeKind> nodeKinds() const override {
+    static constexpr ASTNodeKind Kinds[] = {
+        ASTNodeKind::getFromNodeKind<Expr>()};
+    return Kinds;
+  }
   bool prepare(const Selection &Inputs) override;
   Expected<Effect> apply(const Selection &Inputs) override;
   std::string title() const override {
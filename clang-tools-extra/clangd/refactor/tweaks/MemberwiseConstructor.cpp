@@ -40,6 +40,11 @@ public:
     return llvm::formatv("Define constructor");
   }
 
+  llvm::ArrayRef<ASTNodeKind> nodeKinds() const override {
+    static constexpr ASTNodeKind Kinds[] = {
+        ASTNodeKind::getFromNodeKind<CXXRecordDecl>()};
+    return Kinds;
+  }
   bool prepare(const Selection &Inputs) override {
     // This tweak assumes move semantics.
     if (!Inputs.AST->getLangOpts().CPlusPlus11)
@@ -34,6 +34,11 @@ public:
     return CodeAction::REFACTOR_KIND;
   }
 
+  llvm::ArrayRef<ASTNodeKind> nodeKinds() const override {
+    static constexpr ASTNodeKind Kinds[] = {
+        ASTNodeKind::getFromNodeKind<ObjCStringLiteral>()};
+    return Kinds;
+  }
   bool prepare(const Selection &Inputs) override;
   Expected<Tweak::Effect> apply(const Selection &Inputs) override;
   std::string title() const override;
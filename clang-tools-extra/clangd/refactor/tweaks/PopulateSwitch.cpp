@@ -49,6 +49,11 @@ namespace clangd {
 namespace {
 class PopulateSwitch : public Tweak {
   const char *id() const override;
+  llvm::ArrayRef<ASTNodeKind> nodeKinds() const override {
+    static constexpr ASTNodeKind Kinds[] = {
+        ASTNodeKind::getFromNodeKind<SwitchStmt>()};
+    return Kinds;
+  }
   bool prepare(const Selection &Sel) override;
   Expected<Effect> apply(const Selection &Sel) override;
   std::string title() const override { return "Populate switch"; }
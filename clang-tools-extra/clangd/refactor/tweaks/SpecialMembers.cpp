@@ -95,6 +95,11 @@ public:
                          NeedCopy ? NeedMove ? "copy/move" : "copy" : "move");
   }
 
+  llvm::ArrayRef<ASTNodeKind> nodeKinds() const override {
+    static constexpr ASTNodeKind Kinds[] = {
+        ASTNodeKind::getFromNodeKind<CXXRecordDecl>()};
+    return Kinds;
+  }
   bool prepare(const Selection &Inputs) override {
     // This tweak relies on =default and =delete.
     if (!Inputs.AST->getLangOpts().CPlusPlus11)
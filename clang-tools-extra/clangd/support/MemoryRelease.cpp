@@ -0,0 +1,87 @@
+//===--- MemoryRelease.cpp - Returning freed memory to the OS ------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#include "support/MemoryRelease.h"
+#include "support/Logger.h"
+#include "support/Trace.h"
+#include <climits>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+namespace clang {
+namespace clangd {
+namespace {
+
+#ifdef __GLIBC__
+struct HeapStats {
+  /// Bytes obtained from the OS for the heaps, excluding separate mappings.
+  size_t Heap = 0;
+  /// Bytes in free chunks of the heaps, whether their pages were released or
+  /// not.
+  size_t Free = 0;
+};
+
+HeapStats heapStats() {
+  HeapStats Stats;
+#if __GLIBC_PREREQ(2, 33)
+  struct mallinfo2 Info = ::mallinfo2();
+#else
+  // Fields are ints and wrap above 4GB, but it's all older glibc offers.
+  struct mallinfo Info = ::mallinfo();
+#endif
+  Stats.Heap = static_cast<size_t>(Info.arena);
+  Stats.Free = static_cast<size_t>(Info.fordblks);
+  return Stats;
+}
+#endif
+
+} // namespace
+
+bool mapLargeAllocations(size_t Threshold) {
+#ifdef __GLIBC__
+  if (Threshold > static_cast<size_t>(INT_MAX))
+    return false;
+  // Setting the threshold explicitly also turns off its dynamic adjustment.
+  return ::mallopt(M_MMAP_THRESHOLD, static_cast<int>(Threshold)) == 1;
+#else
+  return false;
+#endif
+}
+
+size_t trimHeap(size_t Pad) {
+#ifdef __GLIBC__
+  // Tracks bytes returned to the OS by trimming.
+  static constexpr trace::Metric ReleasedMemory(
+      "released_memory", trace::Metric::Distribution);
+  HeapStats Before = heapStats();
+  if (!::malloc_trim(Pad))
+    return 0;
+  HeapStats After = heapStats();
+  // malloc_trim also releases whole free pages in the middle of the heaps.
+  // Those stay part of the heap and can't be told apart, so they're not
+  // counted.
+  size_t Released = Before.Heap > After.Heap ? Before.Heap - After.Heap : 0;
+  ReleasedMemory.record(Released);
+  vlog("Released {0} bytes of memory via malloc_trim", Released);
+  return Released;
+#else
+  return 0;
+#endif
+}
+
+void recordRetainedMemory() {
+#ifdef __GLIBC__
+  static constexpr trace::Metric RetainedMemory("retained_memory",
+                                                trace::Metric::Value);
+  RetainedMemory.record(heapStats().Free);
+#endif
+}
+
+} // namespace clangd
+} // namespace clang
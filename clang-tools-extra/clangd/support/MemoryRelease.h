@@ -0,0 +1,49 @@
+//===--- MemoryRelease.h - Returning freed memory to the OS ------*- C++-*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// Freeing memory doesn't shrink the process: the system allocator keeps freed
+// chunks around for reuse. After a large AST or preamble is dropped, RSS stays
+// at its peak until the allocator decides (or is told) to give memory back.
+//
+// ASTs and preambles allocate most of their memory in large slabs (the
+// ASTContext's BumpPtrAllocator, PCH buffers). If these get their own
+// mappings, destroying the AST unmaps them right away, and only the small
+// side tables are left for trimHeap() to deal with.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_CLANG_TOOLS_EXTRA_CLANGD_SUPPORT_MEMORYRELEASE_H
+#define LLVM_CLANG_TOOLS_EXTRA_CLANGD_SUPPORT_MEMORYRELEASE_H
+
+#include <cstddef>
+
+namespace clang {
+namespace clangd {
+
+/// Makes the system allocator serve each allocation of at least \p Threshold
+/// bytes from its own mapping, which is returned to the OS when it is freed.
+/// By default glibc raises this threshold whenever such a block is freed, so a
+/// long-running process ends up keeping AST slabs in its heap.
+/// Returns false if the allocator can't be configured.
+bool mapLargeAllocations(size_t Threshold);
+
+/// Returns free memory held by the allocator to the OS, keeping \p Pad bytes
+/// at the top of the main heap. Returns the number of bytes the heaps shrank
+/// by, which is zero if the allocator doesn't support trimming.
+size_t trimHeap(size_t Pad);
+
+/// Records the bytes the allocator holds in free chunks of its heaps as the
+/// "retained_memory" metric. These are not used by any component, but count
+/// towards RSS until trimHeap() releases them. Does nothing if the allocator
+/// can't be inspected.
+void recordRetainedMemory();
+
+} // namespace clangd
+} // namespace clang
+
+#endif
@@ -31,18 +31,23 @@
 #include "CompileCommands.h"
 #include "Config.h"
 #include "Feature.h"
+#include "FeatureModule.h"
 #include "GlobalCompilationDatabase.h"
+#include "HeaderCost.h"
 #include "Hover.h"
+#include "IncludeCleaner.h"
 #include "InlayHints.h"
 #include "ParsedAST.h"
 #include "Preamble.h"
 #include "Protocol.h"
 #include "SemanticHighlighting.h"
 #include "SourceCode.h"
+#include "TimeTrace.h"
 #include "XRefs.h"
 #include "index/CanonicalIncludes.h"
 #include "index/FileIndex.h"
 #include "refactor/Tweak.h"
+#include "support/Threading.h"
 #include "support/ThreadsafeFS.h"
 #include "support/Trace.h"
 #include "clang/AST/ASTContext.h"
@@ -51,8 +56,15 @@
 #include "clang/Frontend/CompilerInvocation.h"
 #include "clang/Tooling/CompilationDatabase.h"
 #include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringSet.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/FormatVariadic.h"
 #include "llvm/Support/Path.h"
 #include "llvm/Support/Process.h"
+#include <atomic>
+#include <chrono>
+#include <mutex>
 #include <optional>
 
 namespace clang {
@@ -82,6 +94,19 @@ llvm::cl::opt<bool> CheckCompletion{
     "check-completion",
     llvm::cl::desc("Run code-completion at each point (slow)"),
     llvm::cl::init(false)};
+llvm::cl::opt<std::string> CheckTimeTrace{
+    "check-time-trace",
+    llvm::cl::desc(
+        "Profile the preamble and AST builds, writing -ftime-trace JSON to "
+        "<prefix>.preamble.json and <prefix>.ast.json, and print the most "
+        "expensive headers and templates"),
+    llvm::cl::value_desc("prefix"), llvm::cl::init("")};
+llvm::cl::opt<bool> CheckHeaderCosts{
+    "check-header-costs",
+    llvm::cl::desc("Measure the time, tokens and declarations of each header "
+                   "in the preamble, and print the includes most worth "
+                   "removing or splitting"),
+    llvm::cl::init(false)};
 
 // Print (and count) the error-level diagnostics (warnings are ignored).
 unsigned showErrors(llvm::ArrayRef<Diag> Diags) {
@@ -108,6 +133,136 @@ std::vector<std::string> listTidyChecks(llvm::StringRef Glob) {
   return Result;
 }
 
+// The compilation database clangd would use, including command adjustments.
+struct CheckCDB {
+  CheckCDB(const ThreadsafeFS &TFS, const ClangdLSPServer::Options &Opts,
+           std::optional<Path> CompileCommandsDir) {
+    DirectoryBasedGlobalCompilationDatabase::Options CDBOpts(TFS);
+    CDBOpts.CompileCommandsDir = std::move(CompileCommandsDir);
+    Base = std::make_unique<DirectoryBasedGlobalCompilationDatabase>(CDBOpts);
+    auto Mangler = CommandMangler::detect();
+    Mangler.SystemIncludeExtractor =
+        getSystemIncludeExtractor(llvm::ArrayRef(Opts.QueryDriverGlobs),
+                                  Opts.QueryDriverCacheDir);
+    if (Opts.ResourceDir)
+      Mangler.ResourceDir = *Opts.ResourceDir;
+    CDB = std::make_unique<OverlayCDB>(
+        Base.get(), std::vector<std::string>{}, std::move(Mangler));
+  }
+
+  std::unique_ptr<GlobalCompilationDatabase> Base;
+  std::unique_ptr<OverlayCDB> CDB;
+};
+
+// Feeds the builds it is attached to into a HeaderCostCollector.
+class HeaderCostModule final : public FeatureModule {
+public:
+  HeaderCostModule(HeaderCostCollector &Collector) : Collector(Collector) {}
+
+  std::unique_ptr<ASTListener> astListeners() override {
+    struct Listener : ASTListener {
+      Listener(HeaderCostCollector &Collector) : Collector(Collector) {}
+      void beforeExecute(CompilerInstance &CI) override {
+        Collector.collect(CI);
+      }
+      HeaderCostCollector &Collector;
+    };
+    return std::make_unique<Listener>(Collector);
+  }
+
+private:
+  HeaderCostCollector &Collector;
+};
+
+// Header costs summed over the files that were checked. Thread-safe.
+class HeaderCostReport {
+public:
+  // Adds the costs of one file, \p Unused are its unused direct includes.
+  void add(llvm::ArrayRef<HeaderCost> Costs, const llvm::StringSet<> &Unused,
+           size_t PreambleBytes) {
+    std::lock_guard<std::mutex> Lock(Mu);
+    ++Files;
+    TotalPreambleBytes += PreambleBytes;
+    for (const HeaderCost &Cost : Costs) {
+      Total &T = Totals[Cost.Path];
+      T.Exclusive += Cost.Exclusive;
+      T.Inclusive += Cost.Inclusive;
+      T.SourceBytes = Cost.SourceBytes;
+      ++T.Files;
+      if (Cost.IncludedByMainFile) {
+        ++T.DirectFiles;
+        if (Unused.contains(Cost.Path))
+          ++T.UnusedFiles;
+      }
+    }
+  }
+
+  void print(size_t Limit) const {
+    std::lock_guard<std::mutex> Lock(Mu);
+    using Entry = std::pair<llvm::StringRef, const Total *>;
+    std::vector<Entry> Sorted;
+    for (const auto &E : Totals)
+      Sorted.emplace_back(E.first(), &E.second);
+    auto Top = [&](llvm::function_ref<double(const Total &)> Score) {
+      llvm::sort(Sorted, [&](const Entry &L, const Entry &R) {
+        return Score(*L.second) > Score(*R.second);
+      });
+      std::vector<Entry> Result;
+      for (const Entry &E : Sorted)
+        if (Result.size() < Limit && Score(*E.second) > 0)
+          Result.push_back(E);
+      return Result;
+    };
+
+    log("Header costs over {0} files, {1} bytes of preambles:", Files,
+        TotalPreambleBytes);
+    log("  {0,10} {1,10} {2,9} {3,7} {4,9} {5,5}  header", "incl ms",
+        "excl ms", "tokens", "decls", "bytes", "files");
+    for (const Entry &E : Top([](const Total &T) {
+           return T.Inclusive.TimeMs;
+         }))
+      log("  {0,10:f1} {1,10:f1} {2,9} {3,7} {4,9} {5,5}  {6}",
+          E.second->Inclusive.TimeMs, E.second->Exclusive.TimeMs,
+          E.second->Exclusive.Tokens, E.second->Exclusive.Decls,
+          E.second->SourceBytes, E.second->Files, E.first);
+
+    // Removing an unused include saves its average inclusive cost in each
+    // file where it is unused.
+    auto Savings = [](const Total &T) {
+      return T.Inclusive.TimeMs / T.Files * T.UnusedFiles;
+    };
+    log("Candidates for removal (unused direct includes):");
+    for (const Entry &E : Top(Savings))
+      log("  {0,10:f1} ms  {1} (unused in {2} of {3} includers)",
+          Savings(*E.second), E.first, E.second->UnusedFiles,
+          E.second->DirectFiles);
+
+    // Headers whose own content is expensive and included widely are most
+    // likely to benefit from being split up.
+    log("Candidates for splitting (most expensive contents):");
+    for (const Entry &E : Top([](const Total &T) {
+           return T.Files > 1 ? T.Exclusive.TimeMs : 0;
+         }))
+      log("  {0,10:f1} ms  {1} ({2} decls, included by {3} files)",
+          E.second->Exclusive.TimeMs, E.first, E.second->Exclusive.Decls,
+          E.second->Files);
+  }
+
+private:
+  struct Total {
+    HeaderCostMetrics Exclusive;
+    HeaderCostMetrics Inclusive;
+    size_t SourceBytes = 0;
+    unsigned Files = 0;
+    unsigned DirectFiles = 0;
+    unsigned UnusedFiles = 0;
+  };
+  mutable std::mutex Mu;
+  llvm::StringMap<Total> Totals; // GUARDED_BY(Mu)
+  unsigned Files = 0;            // GUARDED_BY(Mu)
+  size_t TotalPreambleBytes = 0; // GUARDED_BY(Mu)
+};
+
 // This class is just a linear pipeline whose functions get called in sequence.
 // Each exercises part of clangd's logic on our test file and logs results.
 // Later steps depend on state built in earlier ones (such as the AST).
@@ -127,6 +282,9 @@ class Checker {
   std::shared_ptr<const PreambleData> Preamble;
   std::optional<ParsedAST> AST;
   FileIndex Index;
+  std::vector<BuildTimeTrace> TimeTraces;
+  PreambleBuildStats PreambleStats;
+  std::vector<HeaderCost> HeaderCosts;
 
 public:
   // Number of non-fatal errors seen.
@@ -138,26 +296,20 @@ public:
   // Read compilation database and choose a compile command for the file.
   bool buildCommand(const ThreadsafeFS &TFS) {
     log("Loading compilation database...");
-    DirectoryBasedGlobalCompilationDatabase::Options CDBOpts(TFS);
-    CDBOpts.CompileCommandsDir =
-        Config::current().CompileFlags.CDBSearch.FixedCDBPath;
-    std::unique_ptr<GlobalCompilationDatabase> BaseCDB =
-        std::make_unique<DirectoryBasedGlobalCompilationDatabase>(CDBOpts);
-    auto Mangler = CommandMangler::detect();
-    Mangler.SystemIncludeExtractor =
-        getSystemIncludeExtractor(llvm::ArrayRef(Opts.QueryDriverGlobs));
-    if (Opts.ResourceDir)
-      Mangler.ResourceDir = *Opts.ResourceDir;
-    auto CDB = std::make_unique<OverlayCDB>(
-        BaseCDB.get(), std::vector<std::string>{}, std::move(Mangler));
+    CheckCDB CDB(TFS, Opts,
+                 Config::current().CompileFlags.CDBSearch.FixedCDBPath);
+    return buildCommand(*CDB.CDB);
+  }
 
-    if (auto TrueCmd = CDB->getCompileCommand(File)) {
+  // Choose a compile command for the file from an already loaded database.
+  bool buildCommand(const GlobalCompilationDatabase &CDB) {
+    if (auto TrueCmd = CDB.getCompileCommand(File)) {
       Cmd = std::move(*TrueCmd);
       log("Compile command {0} is: {1}",
           Cmd.Heuristic.empty() ? "from CDB" : Cmd.Heuristic,
           printArgv(Cmd.CommandLine));
     } else {
-      Cmd = CDB->getFallbackCommand(File);
+      Cmd = CDB.getFallbackCommand(File);
       log("Generic fallback command is: {0}", printArgv(Cmd.CommandLine));
     }
 
@@ -174,6 +326,7 @@ public:
     Inputs.ClangTidyProvider = Opts.ClangTidyProvider;
     Inputs.Opts.PreambleParseForwardingFunctions =
         Opts.PreambleParseForwardingFunctions;
+    Inputs.Opts.LazyTokens = Opts.LazyTokens;
     if (Contents) {
       Inputs.Contents = *Contents;
       log("Imaginary source file contents:\n{0}", Inputs.Contents);
@@ -206,28 +359,55 @@ public:
   // Build preamble and AST, and index them.
   bool buildAST() {
     log("Building preamble...");
-    Preamble = buildPreamble(File, *Invocation, Inputs, /*StoreInMemory=*/true,
-                             [&](ASTContext &Ctx, Preprocessor &PP,
-                                 const CanonicalIncludes &Includes) {
-                               if (!Opts.BuildDynamicSymbolIndex)
-                                 return;
-                               log("Indexing headers...");
-                               Index.updatePreamble(File, /*Version=*/"null",
-                                                    Ctx, PP, Includes);
-                             });
+    TimeTraceRecorder PreambleRecorder(!CheckTimeTrace.empty());
+    HeaderCostCollector CostCollector;
+    FeatureModuleSet CostModules;
+    if (Opts.MeasureHeaderCosts) {
+      CostModules.add(std::make_unique<HeaderCostModule>(CostCollector));
+      Inputs.FeatureModules = &CostModules;
+    }
+    Preamble = buildPreamble(
+        File, *Invocation, Inputs, /*StoreInMemory=*/true,
+        [&](ASTContext &Ctx, Preprocessor &PP,
+            const CanonicalIncludes &Includes) {
+          if (Opts.MeasureHeaderCosts)
+            CostCollector.countDecls(Ctx);
+          if (!Opts.BuildDynamicSymbolIndex)
+            return;
+          log("Indexing headers...");
+          Index.updatePreamble(File, /*Version=*/"null", Ctx, PP, Includes);
+        },
+        &PreambleStats);
+    Inputs.FeatureModules = nullptr;
+    HeaderCosts = CostCollector.takeCosts();
+    if (auto Trace = PreambleRecorder.take(BuildTimeTrace::Preamble,
+                                           Inputs.Version))
+      TimeTraces.push_back(std::move(*Trace));
     if (!Preamble) {
       elog("Failed to build preamble");
       return false;
     }
     ErrCount += showErrors(Preamble->Diags);
+    log("Preamble built in {0:f1} ms, {1} bytes serialized",
+        PreambleStats.TotalBuildTime * 1000, PreambleStats.SerializedSize);
 
     log("Building AST...");
+    TimeTraceRecorder ASTRecorder(!CheckTimeTrace.empty());
+    auto ASTStart = std::chrono::steady_clock::now();
     AST = ParsedAST::build(File, Inputs, std::move(Invocation),
                            /*InvocationDiags=*/std::vector<Diag>{}, Preamble);
+    std::chrono::duration<double, std::milli> ASTTime =
+        std::chrono::steady_clock::now() - ASTStart;
+    if (auto Trace = ASTRecorder.take(BuildTimeTrace::AST, Inputs.Version))
+      TimeTraces.push_back(std::move(*Trace));
+    if (!CheckTimeTrace.empty())
+      writeTimeTraces();
     if (!AST) {
       elog("Failed to build AST");
       return false;
     }
+    log("AST built in {0:f1} ms, {1} bytes used", ASTTime.count(),
+        AST->getUsedBytes());
     ErrCount += showErrors(llvm::ArrayRef(*AST->getDiagnostics())
                                .drop_front(Preamble->Diags.size()));
 
@@ -250,6 +430,39 @@ public:
     return true;
   }
 
+  // Adds the header costs measured while building the preamble to \p Report.
+  void reportHeaderCosts(HeaderCostReport &Report) {
+    llvm::StringSet<> Unused;
+    IncludeCleanerFindings Findings = computeIncludeCleanerFindings(*AST);
+    for (const Inclusion *Inc : Findings.UnusedIncludes)
+      Unused.insert(Inc->Resolved);
+    Report.add(HeaderCosts, Unused, PreambleStats.SerializedSize);
+  }
+
+  // Save the time traces next to each other and summarize them.
+  void writeTimeTraces() {
+    std::vector<std::string> JSON;
+    for (const BuildTimeTrace &Trace : TimeTraces) {
+      std::string Out = llvm::formatv("{0}.{1}.json", CheckTimeTrace.getValue(),
+                                      toString(Trace.K));
+      std::error_code EC;
+      llvm::raw_fd_ostream OS(Out, EC, llvm::sys::fs::OF_Text);
+      if (EC) {
+        elog("Couldn't write time trace to {0}: {1}", Out, EC.message());
+        ++ErrCount;
+      } else {
+        OS << Trace.JSON;
+        log("Wrote {0} time trace ({1:f0} ms) to {2}", toString(Trace.K),
+            Trace.TotalMs, Out);
+      }
+      JSON.push_back(Trace.JSON);
+    }
+    log("Most expensive headers and templates:");
+    for (const TimeTraceHotspot &H : summarizeTimeTraces(JSON, /*Limit=*/20))
+      log("  {0,8:f1} ms  {1} {2} (x{3})", H.TotalMs, H.Event, H.Detail,
+          H.Count);
+  }
+
   // For each check foo, we want to build with checks=-* and checks=-*,foo.
   // (We do a full build rather than just AST matchers to meausre PPCallbacks).
   //
@@ -458,10 +671,17 @@ bool check(llvm::StringRef File, const ThreadsafeFS &TFS,
       FakeFile.empty()
           ? File
           : /*Don't turn on local configs for an arbitrary temp path.*/ ""));
-  Checker C(File, Opts);
+  ClangdLSPServer::Options FileOpts = Opts;
+  FileOpts.MeasureHeaderCosts |= CheckHeaderCosts;
+  Checker C(File, FileOpts);
   if (!C.buildCommand(TFS) || !C.buildInvocation(TFS, Contents) ||
       !C.buildAST())
     return false;
+  if (FileOpts.MeasureHeaderCosts) {
+    HeaderCostReport Report;
+    C.reportHeaderCosts(Report);
+    Report.print(/*Limit=*/20);
+  }
   C.buildInlayHints(LineRange);
   C.buildSemanticHighlighting(LineRange);
   if (CheckLocations)
@@ -471,5 +691,57 @@ bool check(llvm::StringRef File, const ThreadsafeFS &TFS,
   return C.ErrCount == 0;
 }
 
+bool checkHeaderCosts(PathRef CompileCommandsDir, const ThreadsafeFS &TFS,
+                      const ClangdLSPServer::Options &Opts) {
+  std::string Error;
+  auto Tooling = tooling::CompilationDatabase::loadFromDirectory(
+      CompileCommandsDir, Error);
+  if (!Tooling) {
+    elog("Failed to load compilation database from {0}: {1}",
+         CompileCommandsDir, Error);
+    return false;
+  }
+  std::vector<std::string> Files = Tooling->getAllFiles();
+  log("Measuring header costs of {0} files from {1}", Files.size(),
+      CompileCommandsDir);
+
+  ClangdLSPServer::Options FileOpts = Opts;
+  FileOpts.BuildDynamicSymbolIndex = false;
+  FileOpts.MeasureHeaderCosts = true;
+  CheckCDB CDB(TFS, Opts, CompileCommandsDir.str());
+  auto ContextProvider = ClangdServer::createConfiguredContextProvider(
+      Opts.ConfigProvider, nullptr);
+
+  HeaderCostReport Report;
+  std::atomic<unsigned> Failed = {0};
+  std::atomic<unsigned> Next = {0};
+  auto Work = [&] {
+    for (unsigned I = Next++; I < Files.size(); I = Next++) {
+      WithContext Ctx(ContextProvider(Files[I]));
+      log("[{0}/{1}] {2}", I + 1, Files.size(), Files[I]);
+      Checker C(Files[I], FileOpts);
+      if (!C.buildCommand(*CDB.CDB) ||
+          !C.buildInvocation(TFS, std::nullopt) || !C.buildAST()) {
+        ++Failed;
+        continue;
+      }
+      C.reportHeaderCosts(Report);
+    }
+  };
+  if (Opts.AsyncThreadsCount == 0) {
+    Work();
+  } else {
+    AsyncTaskRunner Tasks;
+    for (unsigned I = 0; I < Opts.AsyncThreadsCount; ++I)
+      Tasks.runAsync("header-costs:" + llvm::Twine(I), Work);
+    Tasks.wait();
+  }
+
+  Report.print(/*Limit=*/50);
+  log("Header costs measured, {0} of {1} files failed to build",
+      Failed.load(), Files.size());
+  return Failed == 0;
+}
+
 } // namespace clangd
 } // namespace clang
@@ -23,6 +23,7 @@
 #include "index/Merge.h"
 #include "index/ProjectAware.h"
 #include "index/remote/Client.h"
+#include "support/MemoryRelease.h"
 #include "support/Path.h"
 #include "support/Shutdown.h"
 #include "support/ThreadCrashReporter.h"
@@ -53,16 +54,14 @@
 #include <unistd.h>
 #endif
 
-#ifdef __GLIBC__
-#include <malloc.h>
-#endif
-
 namespace clang {
 namespace clangd {
 
 // Implemented in Check.cpp.
 bool check(const llvm::StringRef File, const ThreadsafeFS &TFS,
            const ClangdLSPServer::Options &Opts);
+bool checkHeaderCosts(PathRef CompileCommandsDir, const ThreadsafeFS &TFS,
+                      const ClangdLSPServer::Options &Opts);
 
 namespace {
 
@@ -141,6 +140,15 @@ list<std::string> QueryDriverGlobs{
     CommaSeparated,
 };
 
+opt<bool> PersistQueryDriver{
+    "persist-query-driver",
+    cat(CompileCommands),
+    desc("Cache the system includes extracted from --query-driver drivers "
+         "on disk, and reuse them until the driver changes"),
+    init(false),
+    Hidden,
+};
+
 // FIXME: Flags are the wrong mechanism for user preferences.
 // We should probably read a dotfile or similar.
 opt<bool> AllScopesCompletion{
@@ -183,6 +191,34 @@ opt<llvm::ThreadPriority> BackgroundIndexPriority{
     init(llvm::ThreadPriority::Low),
 };
 
+opt<unsigned> BackgroundIndexMemoryBudget{
+    "background-index-memory-budget",
+    cat(Features),
+    desc("Index fewer files in parallel when the memory they are estimated to "
+         "need exceeds this many MiB. 0 means no limit."),
+    init(0),
+    Hidden,
+};
+
+opt<bool> BackgroundIndexSharePreambles{
+    "background-index-share-preambles",
+    cat(Features),
+    desc("Parse files starting with the same includes on top of a shared "
+         "preamble when building the background index. Keeps up to two "
+         "preambles per indexing thread in memory"),
+    init(false),
+    Hidden,
+};
+
+opt<unsigned> IndexCacheSize{
+    "index-cache-size",
+    cat(Features),
+    desc("Cache the results of recent queries to the static and background "
+         "indexes, using at most this many MiB. 0 disables the cache."),
+    init(0),
+    Hidden,
+};
+
 opt<bool> EnableClangTidy{
     "clang-tidy",
     cat(Features),
@@ -399,6 +435,15 @@ opt<Path> CheckFile{
     ValueOptional,
 };
 
+opt<Path> CheckHeaderCostsDir{
+    "check-header-costs-in",
+    cat(Misc),
+    desc("Measure the cost of the headers included by every file in the "
+         "compilation database in this directory, instead of acting as a "
+         "language server. Files are built in parallel (see -j)."),
+    init(""),
+};
+
 enum PCHStorageFlag { Disk, Memory };
 opt<PCHStorageFlag> PCHStorage{
     "pch-storage",
@@ -519,6 +564,35 @@ opt<bool> PreambleParseForwardingFunctions{
     init(ParseOptions().PreambleParseForwardingFunctions),
 };
 
+opt<bool> LazyTokens{
+    "lazy-tokens",
+    cat(Misc),
+    desc("Record the expanded tokens of the main file compactly while "
+         "parsing, and only map them to spelled tokens when a feature needs "
+         "them"),
+    Hidden,
+    init(ParseOptions().LazyTokens),
+};
+
+opt<bool> CompressStaticDocumentation{
+    "compress-static-documentation",
+    cat(Misc),
+    desc("Keep documentation in static indexes compressed until a symbol is "
+         "shown by hover or completion"),
+    Hidden,
+    init(false),
+};
+
+opt<bool> StaleASTReads{
+    "stale-ast-reads",
+    cat(Misc),
+    desc("Answer hover, go-to-definition and document highlights from the "
+         "last built AST while the file is rebuilt, unless the request "
+         "touches lines edited since"),
+    Hidden,
+    init(ClangdServer::Options().StaleASTReads),
+};
+
 #if defined(__GLIBC__) && CLANGD_MALLOC_TRIM
 opt<bool> EnableMallocTrim{
     "malloc-trim",
@@ -533,15 +607,21 @@ std::function<void()> getMemoryCleanupFunction() {
   // Leave a few MB at the top of the heap: it is insignificant
   // and will most likely be needed by the main thread
   constexpr size_t MallocTrimPad = 20'000'000;
-  return []() {
-    if (malloc_trim(MallocTrimPad))
-      vlog("Released memory via malloc_trim");
-  };
+  return []() { trimHeap(MallocTrimPad); };
 }
 #else
 std::function<void()> getMemoryCleanupFunction() { return nullptr; }
 #endif
 
+opt<bool> MapLargeAllocations{
+    "map-large-allocations",
+    cat(Misc),
+    desc("Give large allocations, such as AST storage, their own memory "
+         "mappings so they are returned to the OS as soon as they are freed, "
+         "rather than by the next periodic memory release"),
+    init(false),
+};
+
 #if CLANGD_ENABLE_REMOTE
 opt<std::string> RemoteIndexAddress{
     "remote-index-address",
@@ -620,7 +700,8 @@ loadExternalIndex(const Config::ExternalIndexSpec &External,
     auto NewIndex = std::make_unique<SwapIndex>(std::make_unique<MemIndex>());
     auto IndexLoadTask = [File = External.Location,
                           PlaceHolder = NewIndex.get()] {
-      if (auto Idx = loadIndex(File, SymbolOrigin::Static, /*UseDex=*/true))
+      if (auto Idx = loadIndex(File, SymbolOrigin::Static, /*UseDex=*/true,
+                               CompressStaticDocumentation))
         PlaceHolder->reset(std::move(Idx));
     };
     if (Tasks) {
@@ -843,7 +924,8 @@ clangd accepts flags on the commandline, and in the CLANGD_FLAGS environment var
   // it's somewhat likely they're confused about how to use clangd.
   // Show them the help overview, which explains.
   if (llvm::outs().is_displayed() && llvm::errs().is_displayed() &&
-      !CheckFile.getNumOccurrences())
+      !CheckFile.getNumOccurrences() &&
+      !CheckHeaderCostsDir.getNumOccurrences())
     llvm::errs() << Overview << "\n";
   // Use buffered stream to stderr (we still flush each log message). Unbuffered
   // stream can cause significant (non-deterministic) latency for the logger.
@@ -901,6 +983,10 @@ clangd accepts flags on the commandline, and in the CLANGD_FLAGS environment var
 #endif
   Opts.BackgroundIndex = EnableBackgroundIndex;
   Opts.BackgroundIndexPriority = BackgroundIndexPriority;
+  Opts.BackgroundIndexMemoryBudget =
+      size_t(BackgroundIndexMemoryBudget) * 1024 * 1024;
+  Opts.BackgroundIndexSharePreambles = BackgroundIndexSharePreambles;
+  Opts.IndexCacheSize = size_t(IndexCacheSize) * 1024 * 1024;
   Opts.ReferencesLimit = ReferencesLimit;
   Opts.Rename.LimitFiles = RenameFileLimit;
   auto PAI = createProjectAwareIndex(loadExternalIndex, Sync);
@@ -914,6 +1000,14 @@ clangd accepts flags on the commandline, and in the CLANGD_FLAGS environment var
   }
   Opts.AsyncThreadsCount = WorkerThreadsCount;
   Opts.MemoryCleanup = getMemoryCleanupFunction();
+  if (MapLargeAllocations) {
+    // AST slabs start at 4KiB and double every 128 slabs, so they reach this
+    // size once an AST uses about 16MB. This is also glibc's initial
+    // threshold, which it raises as blocks are freed.
+    constexpr size_t LargeAllocation = 128 * 1024;
+    if (!mapLargeAllocations(LargeAllocation))
+      elog("Failed to configure the allocator to map large allocations");
+  }
 
   Opts.CodeComplete.IncludeIneligibleResults = IncludeIneligibleResults;
   Opts.CodeComplete.Limit = LimitResults;
@@ -970,7 +1064,16 @@ clangd accepts flags on the commandline, and in the CLANGD_FLAGS environment var
   Opts.UseDirtyHeaders = UseDirtyHeaders;
   Opts.PreambleParseForwardingFunctions = PreambleParseForwardingFunctions;
   Opts.ImportInsertions = ImportInsertions;
+  Opts.LazyTokens = LazyTokens;
+  Opts.StaleASTReads = StaleASTReads;
   Opts.QueryDriverGlobs = std::move(QueryDriverGlobs);
+  if (PersistQueryDriver) {
+    llvm::SmallString<128> CacheDir;
+    if (llvm::sys::path::cache_directory(CacheDir)) {
+      llvm::sys::path::append(CacheDir, "clangd", "query-driver");
+      Opts.QueryDriverCacheDir = CacheDir.str().str();
+    }
+  }
   Opts.TweakFilter = [&](const Tweak &T) {
     if (T.hidden() && !HiddenFeatures)
       return false;
@@ -995,6 +1098,20 @@ clangd accepts flags on the commandline, and in the CLANGD_FLAGS environment var
                : static_cast<int>(ErrorResultCode::CheckFailed);
   }
 
+  if (CheckHeaderCostsDir.getNumOccurrences()) {
+    llvm::SmallString<256> Path;
+    if (auto Error = llvm::sys::fs::real_path(CheckHeaderCostsDir, Path,
+                                              /*expand_tilde=*/true)) {
+      elog("Failed to resolve path {0}: {1}", CheckHeaderCostsDir,
+           Error.message());
+      return 1;
+    }
+    log("Entering header cost analysis mode (no LSP server)");
+    return checkHeaderCosts(Path, TFS, Opts)
+               ? 0
+               : static_cast<int>(ErrorResultCode::CheckFailed);
+  }
+
   // Initialize and run ClangdLSPServer.
   // Change stdin to binary to not lose \r\n on windows.
   llvm::sys::ChangeStdinToBinary();
@@ -1,10 +1,13 @@
 #include "CompileCommands.h"
 #include "Config.h"
+#include "Compiler.h"
 #include "Headers.h"
+#include "SourceCode.h"
 #include "SyncAPI.h"
 #include "TestFS.h"
 #include "TestTU.h"
 #include "index/Background.h"
+#include "index/BackgroundPreambles.h"
 #include "index/BackgroundRebuild.h"
 #include "index/MemIndex.h"
 #include "clang/Tooling/ArgumentsAdjusters.h"
@@ -333,6 +336,182 @@ TEST_F(BackgroundIndexTest, ShardStorageTest) {
               UnorderedElementsAre(Relation{A, RelationKind::BaseOf, B}));
 }
 
+TEST_F(BackgroundIndexTest, SharePreambles) {
+  MockFS FS;
+  FS.Files[testPath("root/A.h")] = "void common();";
+  FS.Files[testPath("root/A.cc")] = R"cpp(#include "A.h"
+      void a() { common(); }
+      )cpp";
+  FS.Files[testPath("root/B.cc")] = R"cpp(#include "A.h"
+      void b() { common(); }
+      )cpp";
+
+  llvm::StringMap<std::string> Storage;
+  size_t CacheHits = 0;
+  MemoryShardStorage MSS(Storage, CacheHits);
+  OverlayCDB CDB(/*Base=*/nullptr);
+  BackgroundIndex::Options Opts;
+  Opts.ThreadPoolSize = 1;
+  Opts.SharePreambles = true;
+  BackgroundIndex Idx(FS, CDB, [&](llvm::StringRef) { return &MSS; }, Opts);
+
+  // A.cc is indexed from scratch, B.cc on top of the preamble of A.cc.
+  for (llvm::StringRef File : {"A.cc", "B.cc"}) {
+    tooling::CompileCommand Cmd;
+    Cmd.Filename = testPath(("root/" + File).str());
+    Cmd.Directory = testPath("root");
+    Cmd.CommandLine = {"clang++", Cmd.Filename};
+    CDB.setCompileCommand(Cmd.Filename, Cmd);
+    ASSERT_TRUE(Idx.blockUntilIdleForTest());
+  }
+  EXPECT_THAT(runFuzzyFind(Idx, ""),
+              UnorderedElementsAre(named("common"), named("a"), named("b")));
+
+  auto ShardHeader = MSS.loadShard(testPath("root/A.h"));
+  ASSERT_TRUE(ShardHeader);
+  EXPECT_THAT(*ShardHeader->Symbols, ElementsAre(named("common")));
+  auto ShardSource = MSS.loadShard(testPath("root/B.cc"));
+  ASSERT_TRUE(ShardSource);
+  EXPECT_THAT(*ShardSource->Symbols, ElementsAre(named("b")));
+  // The include graph still records the header parsed from the preamble.
+  auto Main = ShardSource->Sources->lookup("unittest:///root/B.cc");
+  EXPECT_THAT(Main.DirectIncludes, ElementsAre("unittest:///root/A.h"));
+}
+
+TEST_F(BackgroundIndexTest, SharePreamblesHeadersChanged) {
+  MockFS FS;
+  FS.Files[testPath("root/A.h")] = "void common();";
+  FS.Files[testPath("root/A.cc")] = R"cpp(#include "A.h"
+      void a() { common(); }
+      )cpp";
+  FS.Files[testPath("root/B.cc")] = R"cpp(#include "A.h"
+      void b() { common(); }
+      )cpp";
+
+  llvm::StringMap<std::string> Storage;
+  size_t CacheHits = 0;
+  MemoryShardStorage MSS(Storage, CacheHits);
+  OverlayCDB CDB(/*Base=*/nullptr);
+  BackgroundIndex::Options Opts;
+  Opts.ThreadPoolSize = 1;
+  Opts.SharePreambles = true;
+  BackgroundIndex Idx(FS, CDB, [&](llvm::StringRef) { return &MSS; }, Opts);
+
+  auto Index = [&](llvm::StringRef File) {
+    tooling::CompileCommand Cmd;
+    Cmd.Filename = testPath(("root/" + File).str());
+    Cmd.Directory = testPath("root");
+    Cmd.CommandLine = {"clang++", Cmd.Filename};
+    CDB.setCompileCommand(Cmd.Filename, Cmd);
+    ASSERT_TRUE(Idx.blockUntilIdleForTest());
+  };
+  Index("A.cc");
+  // The preamble would be built from the new header, but the group recorded
+  // the old one. B.cc must be indexed from scratch to update the header.
+  FS.Files[testPath("root/A.h")] = "void common(); void added();";
+  Index("B.cc");
+
+  auto ShardHeader = MSS.loadShard(testPath("root/A.h"));
+  ASSERT_TRUE(ShardHeader);
+  EXPECT_THAT(*ShardHeader->Symbols,
+              UnorderedElementsAre(named("common"), named("added")));
+}
+
+TEST_F(BackgroundIndexTest, SharePreamblesSkipPreambleDirectives) {
+  MockFS FS;
+  FS.Files[testPath("root/A.h")] = "#define HEADER_MACRO 1\nvoid common();";
+  FS.Files[testPath("root/A.cc")] = R"cpp(#include "A.h"
+#if HEADER_MACRO
+#endif
+void a() { common(); }
+)cpp";
+  FS.Files[testPath("root/B.cc")] = R"cpp(#include "A.h"
+#if HEADER_MACRO
+#endif
+void b() { common(); }
+)cpp";
+
+  llvm::StringMap<std::string> Storage;
+  size_t CacheHits = 0;
+  MemoryShardStorage MSS(Storage, CacheHits);
+  OverlayCDB CDB(/*Base=*/nullptr);
+  BackgroundIndex::Options Opts;
+  Opts.ThreadPoolSize = 1;
+  Opts.SharePreambles = true;
+  BackgroundIndex Idx(FS, CDB, [&](llvm::StringRef) { return &MSS; }, Opts);
+  for (llvm::StringRef File : {"A.cc", "B.cc"}) {
+    tooling::CompileCommand Cmd;
+    Cmd.Filename = testPath(("root/" + File).str());
+    Cmd.Directory = testPath("root");
+    Cmd.CommandLine = {"clang++", Cmd.Filename};
+    CDB.setCompileCommand(Cmd.Filename, Cmd);
+    ASSERT_TRUE(Idx.blockUntilIdleForTest());
+  }
+
+  auto RefLines = [&](llvm::StringRef File) {
+    std::vector<uint32_t> Lines;
+    auto Shard = MSS.loadShard(testPath(File));
+    if (Shard && Shard->Refs)
+      for (const auto &Entry : *Shard->Refs)
+        for (const Ref &R : Entry.second)
+          Lines.push_back(R.Location.Start.line());
+    return Lines;
+  };
+  // The #if references the macro when the TU is indexed from scratch.
+  EXPECT_THAT(RefLines("root/A.cc"), Contains(1u));
+  // B.cc is parsed on top of the preamble of A.cc, and the directives of its
+  // preamble region are not seen: this reference is not indexed.
+  EXPECT_THAT(RefLines("root/B.cc"), Not(Contains(1u)));
+  EXPECT_THAT(RefLines("root/B.cc"), Contains(3u));
+}
+
+IncludeGraphNode &addNode(IncludeGraph &Graph, llvm::StringRef URI,
+                          IncludeGraphNode::SourceFlag Flags) {
+  auto &Entry = *Graph.try_emplace(URI).first;
+  Entry.getValue().URI = Entry.getKey();
+  Entry.getValue().Flags = Flags;
+  return Entry.getValue();
+}
+
+TEST(BackgroundPreamblesTest, HeadersOutliveGroup) {
+  MockFS FS;
+  FS.Files[testPath("root/A.h")] = "void common();";
+  FS.Files[testPath("root/B.cc")] = "#include \"A.h\"\nvoid b() { common(); }";
+  ParseInputs Inputs;
+  Inputs.TFS = &FS;
+  Inputs.CompileCommand.Filename = testPath("root/B.cc");
+  Inputs.CompileCommand.Directory = testPath("root");
+  Inputs.CompileCommand.CommandLine = {"clang++", testPath("root/B.cc")};
+  Inputs.Contents = FS.Files[testPath("root/B.cc")];
+  IgnoreDiagnostics Diags;
+  auto CI = buildCompilerInvocation(Inputs, Diags);
+  ASSERT_TRUE(CI);
+  uint64_t Key =
+      BackgroundPreambles::key(Inputs.CompileCommand, *CI, Inputs.Contents);
+  ASSERT_NE(Key, 0u);
+
+  // A.cc, of the same group, was indexed from scratch.
+  IncludeGraph Indexed;
+  addNode(Indexed, "unittest:///root/A.h", IncludeGraphNode::SourceFlag::None)
+      .Digest = digest(FS.Files[testPath("root/A.h")]);
+  addNode(Indexed, "unittest:///root/A.cc", IncludeGraphNode::SourceFlag::IsTU)
+      .DirectIncludes.push_back(Indexed.find("unittest:///root/A.h")->getKey());
+  BackgroundPreambles Preambles(/*MaxGroups=*/1);
+  Preambles.recordHeaders(Key, BackgroundPreambles::headers(Indexed));
+  auto Shared = Preambles.get(Key, testPath("root/B.cc"), *CI, Inputs);
+  ASSERT_TRUE(Shared.Preamble);
+  ASSERT_TRUE(Shared.Indexed);
+
+  // The group is evicted while B.cc is parsed, its headers are still added.
+  Preambles.recordHeaders(Key + 1, BackgroundPreambles::Headers());
+  IncludeGraph Sources;
+  addNode(Sources, "unittest:///root/B.cc", IncludeGraphNode::SourceFlag::IsTU);
+  BackgroundPreambles::addHeaders(*Shared.Indexed, Sources);
+  EXPECT_THAT(Sources.lookup("unittest:///root/B.cc").DirectIncludes,
+              ElementsAre("unittest:///root/A.h"));
+  EXPECT_TRUE(Sources.count("unittest:///root/A.h"));
+}
+
 TEST_F(BackgroundIndexTest, DirectIncludesTest) {
   MockFS FS;
   FS.Files[testPath("root/B.h")] = "";
@@ -455,6 +634,32 @@ TEST_F(BackgroundIndexTest, ShardStorageLoad) {
               Contains(AllOf(named("f_b"), declared(), defined())));
 }
 
+TEST_F(BackgroundIndexTest, ShardStoresIndexingMemory) {
+  MockFS FS;
+  FS.Files[testPath("root/A.h")] = "void common();";
+  FS.Files[testPath("root/A.cc")] = "#include \"A.h\"\nvoid g() { common(); }";
+  llvm::StringMap<std::string> Storage;
+  size_t CacheHits = 0;
+  MemoryShardStorage MSS(Storage, CacheHits);
+  OverlayCDB CDB(/*Base=*/nullptr);
+  BackgroundIndex Idx(FS, CDB, [&](llvm::StringRef) { return &MSS; },
+                      /*Opts=*/{});
+  tooling::CompileCommand Cmd;
+  Cmd.Filename = testPath("root/A.cc");
+  Cmd.Directory = testPath("root");
+  Cmd.CommandLine = {"clang++", testPath("root/A.cc")};
+  CDB.setCompileCommand(testPath("root/A.cc"), Cmd);
+  ASSERT_TRUE(Idx.blockUntilIdleForTest());
+
+  // The estimate for the next time the TU is indexed is in its main file.
+  auto ShardSource = MSS.loadShard(testPath("root/A.cc"));
+  ASSERT_TRUE(ShardSource);
+  EXPECT_GT(ShardSource->IndexingMemory, 0u);
+  auto ShardHeader = MSS.loadShard(testPath("root/A.h"));
+  ASSERT_TRUE(ShardHeader);
+  EXPECT_EQ(ShardHeader->IndexingMemory, 0u);
+}
+
 TEST_F(BackgroundIndexTest, ShardStorageEmptyFile) {
   MockFS FS;
   FS.Files[testPath("root/A.h")] = R"cpp(
@@ -897,6 +1102,56 @@ TEST(BackgroundQueueTest, Progress) {
   EXPECT_EQ(S.LastIdle, 2000u);
 }
 
+TEST(BackgroundQueueTest, MemoryBudget) {
+  BackgroundQueue Q(/*OnProgress=*/nullptr, /*MemoryBudget=*/100);
+  std::atomic<unsigned> Running(0), MaxRunning(0), Ran(0);
+  auto Run = [&] {
+    unsigned Now = ++Running;
+    unsigned Max = MaxRunning.load();
+    while (Now > Max && !MaxRunning.compare_exchange_weak(Max, Now))
+      ;
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    --Running;
+    ++Ran;
+  };
+  BackgroundQueue::Task Big(Run);
+  Big.Memory = 60;
+  Q.append(std::vector<BackgroundQueue::Task>(10, Big));
+
+  AsyncTaskRunner ThreadPool;
+  for (unsigned I = 0; I < 4; ++I)
+    ThreadPool.runAsync("worker", [&] { Q.work([&] { Q.stop(); }); });
+  ThreadPool.wait();
+  EXPECT_EQ(Ran.load(), 10u);
+  EXPECT_EQ(MaxRunning.load(), 1u) << "two big tasks exceed the budget";
+
+  // Before any task was measured, tasks without an estimate run alone.
+  BackgroundQueue Unmeasured(/*OnProgress=*/nullptr, /*MemoryBudget=*/100);
+  Ran = MaxRunning = 0;
+  Unmeasured.append(std::vector<BackgroundQueue::Task>(
+      10, BackgroundQueue::Task(Run)));
+  for (unsigned I = 0; I < 4; ++I)
+    ThreadPool.runAsync("worker",
+                        [&] { Unmeasured.work([&] { Unmeasured.stop(); }); });
+  ThreadPool.wait();
+  EXPECT_EQ(Ran.load(), 10u);
+  EXPECT_EQ(MaxRunning.load(), 1u);
+
+  // Tasks without an estimate are assumed to be average.
+  BackgroundQueue Measured(/*OnProgress=*/nullptr, /*MemoryBudget=*/100);
+  Measured.recordMemory(40);
+  Measured.recordMemory(60);
+  Ran = MaxRunning = 0;
+  Measured.append(std::vector<BackgroundQueue::Task>(
+      10, BackgroundQueue::Task(Run)));
+  for (unsigned I = 0; I < 4; ++I)
+    ThreadPool.runAsync("worker",
+                        [&] { Measured.work([&] { Measured.stop(); }); });
+  ThreadPool.wait();
+  EXPECT_EQ(Ran.load(), 10u);
+  EXPECT_LE(MaxRunning.load(), 2u);
+}
+
 TEST(BackgroundIndex, Profile) {
   MockFS FS;
   MockCompilationDatabase CDB;
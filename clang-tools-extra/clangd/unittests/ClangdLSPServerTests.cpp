@@ -177,6 +177,20 @@ TEST_F(LSPTest, RecordsLatencies) {
   EXPECT_THAT(Tracer.takeMetric("lsp_latency", MethodName), testing::SizeIs(1));
 }
 
+TEST_F(LSPTest, TimeTraceHotspotsLimit) {
+  auto &Client = start();
+  EXPECT_THAT(Client.call("$/timeTraceHotspots", llvm::json::Object{})
+                  .takeValue(),
+              llvm::json::Value(llvm::json::Array{}));
+  for (int Limit : {0, -1}) {
+    auto Result = Client
+                      .call("$/timeTraceHotspots",
+                            llvm::json::Object{{"limit", Limit}})
+                      .take();
+    EXPECT_THAT_EXPECTED(Result, llvm::Failed()) << Limit;
+  }
+}
+
 TEST_F(LSPTest, IncomingCalls) {
   Annotations Code(R"cpp(
     void calle^e(int);
@@ -1029,6 +1029,34 @@ TEST(CompletionTest, Documentation) {
               Contains(AllOf(named("baz"), doc("Multi-line block comment"))));
 }
 
+TEST(CompletionTest, DeferDocumentation) {
+  Symbol Sym = func("xyzzy");
+  Sym.Documentation = "From the index.";
+  CodeCompleteOptions Opts;
+  Opts.DeferDocumentation = true;
+  Opts.DocumentationFormat = MarkupKind::PlainText;
+
+  auto Results = completions("int main() { xyz^ }", {Sym}, Opts);
+  ASSERT_THAT(Results.Completions, ElementsAre(named("xyzzy")));
+  const CodeCompletion &C = Results.Completions.front();
+  EXPECT_FALSE(C.Documentation);
+  EXPECT_EQ(C.DeferredDocs, Sym.ID);
+
+  CompletionItem Item = C.render(Opts);
+  EXPECT_FALSE(Item.documentation);
+  ASSERT_TRUE(Item.data);
+  DeferredDocumentation Deferred;
+  llvm::json::Path::Root Root;
+  ASSERT_TRUE(fromJSON(*Item.data, Deferred, Root));
+  EXPECT_EQ(Deferred.ID, Sym.ID);
+
+  auto Index = memIndex({Sym});
+  auto Resolved =
+      resolveDocumentation(Deferred, Index.get(), MarkupKind::PlainText);
+  ASSERT_TRUE(Resolved);
+  EXPECT_EQ(Resolved->value, "From the index.");
+}
+
 TEST(CompletionTest, CommentsFromSystemHeaders) {
   MockFS FS;
   MockCompilationDatabase CDB;
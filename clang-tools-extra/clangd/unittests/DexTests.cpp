@@ -23,6 +23,8 @@
 using ::testing::AnyOf;
 using ::testing::ElementsAre;
 using ::testing::IsEmpty;
+using ::testing::Pair;
+using ::testing::SizeIs;
 using ::testing::UnorderedElementsAre;
 
 namespace clang {
@@ -313,6 +315,29 @@ TEST(DexIterators, Boost) {
   EXPECT_THAT(ElementBoost, 3);
 }
 
+TEST(DexIterators, BoostAll) {
+  Corpus C{10};
+  const PostingList L0({1, 3, 5, 7, 9});
+  const PostingList L1({2, 5, 8});
+  const PostingList L2({5, 9});
+  // Boosts of items skipped by the intersection don't matter.
+  auto Root = C.intersect(
+      L0.iterator(), C.unionOf(C.boost(L1.iterator(), 2U), C.all(),
+                               C.boost(L2.iterator(), 3U)));
+  EXPECT_THAT(consume(*Root),
+              ElementsAre(Pair(1, 1), Pair(3, 1), Pair(5, 3), Pair(7, 1),
+                          Pair(9, 3)));
+
+  // A boosted TRUE is recognized too, e.g. the fallback of AnyScope queries.
+  Root = C.intersect(L0.iterator(), C.unionOf(C.boost(L2.iterator(), 3U),
+                                              C.boost(C.all(), 0.5)));
+  EXPECT_EQ(llvm::to_string(*Root),
+            "(& [1 3 5 7 9] (| (* 3 [5 9]) (* 0.5 true)))");
+  EXPECT_THAT(consume(*Root),
+              ElementsAre(Pair(1, 1), Pair(3, 1), Pair(5, 3), Pair(7, 1),
+                          Pair(9, 3)));
+}
+
 TEST(DexIterators, Optimizations) {
   Corpus C{5};
   const PostingList L1{1};
@@ -636,6 +661,40 @@ TEST(DexTest, WildcardScope) {
               UnorderedElementsAre("a::y1", "a::b::y2", "c::y3"));
 }
 
+TEST(DexTest, ApproximateScope) {
+  auto I = Dex::build(generateSymbols({"a::y1", "a::b::y2", "x::a::c::y3",
+                                       "c::a::y4", "a::a::y5", "ab::y6"}),
+                      RefSlab(), RelationSlab());
+  FuzzyFindRequest Req;
+  Req.AnyScope = true;
+  Req.Query = "y";
+  Req.ApproximateScope = "a::";
+  EXPECT_THAT(match(*I, Req),
+              UnorderedElementsAre("a::y1", "a::b::y2", "x::a::c::y3",
+                                   "c::a::y4", "a::a::y5"));
+  Req.ApproximateScope = "a::c::";
+  EXPECT_THAT(match(*I, Req), UnorderedElementsAre("x::a::c::y3"));
+}
+
+TEST(DexTest, ApproximateScopeOrderBeforeLimit) {
+  SymbolSlab::Builder B;
+  // Enough popular symbols with the components in the wrong order to fill
+  // the retrieval limit, if they counted against it.
+  for (int I = 0; I < 200; ++I) {
+    Symbol Sym = symbol("c::a::y" + std::to_string(I));
+    Sym.References = 100;
+    B.insert(Sym);
+  }
+  B.insert(symbol("a::c::y"));
+  auto I = Dex::build(std::move(B).build(), RefSlab(), RelationSlab());
+  FuzzyFindRequest Req;
+  Req.AnyScope = true;
+  Req.Query = "y";
+  Req.ApproximateScope = "a::c::";
+  Req.Limit = 1;
+  EXPECT_THAT(match(*I, Req), UnorderedElementsAre("a::c::y"));
+}
+
 TEST(DexTest, IgnoreCases) {
   auto I = Dex::build(generateSymbols({"ns::ABC", "ns::abc"}), RefSlab(),
                       RelationSlab());
@@ -665,6 +724,45 @@ TEST(DexTest, Lookup) {
   EXPECT_THAT(lookup(*I, SymbolID("ns::nonono")), UnorderedElementsAre());
 }
 
+TEST(DexTest, CompressDocumentation) {
+  if (!DocumentationStore::isAvailable())
+    GTEST_SKIP() << "Documentation is compressed with zlib";
+  SymbolSlab::Builder B;
+  DocumentationStore::Builder DocsBuilder;
+  for (unsigned I = 0; I < 200; ++I) {
+    Symbol Sym = symbol("ns::sym" + std::to_string(I));
+    if (I % 3)
+      DocsBuilder.add(Sym.ID, "Documentation of sym" + std::to_string(I));
+    B.insert(Sym);
+  }
+  auto I = Dex::build(std::move(B).build(), RefSlab(), RelationSlab(),
+                      std::move(DocsBuilder).build());
+
+  using NameAndDocs = std::pair<std::string, std::string>;
+  auto Docs = [&](const Symbol &Sym) {
+    return NameAndDocs(Sym.Name, Sym.Documentation);
+  };
+  LookupRequest Lookup;
+  Lookup.IDs = {SymbolID("ns::sym1"), SymbolID("ns::sym3"),
+                SymbolID("ns::sym199")};
+  std::vector<NameAndDocs> Found;
+  I->lookup(Lookup, [&](const Symbol &Sym) { Found.push_back(Docs(Sym)); });
+  EXPECT_THAT(Found,
+              UnorderedElementsAre(NameAndDocs("sym1", "Documentation of sym1"),
+                                   NameAndDocs("sym3", ""),
+                                   NameAndDocs("sym199",
+                                               "Documentation of sym199")));
+
+  FuzzyFindRequest Req;
+  Req.Query = "sym42";
+  Req.AnyScope = true;
+  Req.Limit = 1;
+  Found.clear();
+  I->fuzzyFind(Req, [&](const Symbol &Sym) { Found.push_back(Docs(Sym)); });
+  EXPECT_THAT(Found,
+              ElementsAre(NameAndDocs("sym42", "Documentation of sym42")));
+}
+
 TEST(DexTest, SymbolIndexOptionsFilter) {
   auto CodeCompletionSymbol = symbol("Completion");
   auto NonCodeCompletionSymbol = symbol("NoCompletion");
@@ -680,6 +778,33 @@ TEST(DexTest, SymbolIndexOptionsFilter) {
   EXPECT_THAT(match(I, Req), ElementsAre("Completion"));
 }
 
+TEST(DexTest, CodeCompletionPartition) {
+  std::vector<Symbol> Symbols;
+  for (int I = 0; I < 4; ++I) {
+    Symbols.push_back(symbol("ns::abc" + std::to_string(I)));
+    Symbols.back().References = 10 + 10 * I;
+    if (I % 2)
+      Symbols.back().Flags = Symbol::SymbolFlag::IndexedForCodeCompletion;
+  }
+  Dex I(Symbols, RefSlab(), RelationSlab());
+  FuzzyFindRequest Req;
+  Req.Query = "abc";
+  Req.Scopes = {"ns::"};
+  Req.RestrictForCodeCompletion = true;
+  EXPECT_THAT(match(I, Req), ElementsAre("ns::abc3", "ns::abc1"));
+  Req.Limit = 1;
+  EXPECT_THAT(match(I, Req), ElementsAre("ns::abc3"));
+  Req.RestrictForCodeCompletion = false;
+  Req.Limit = std::nullopt;
+  EXPECT_THAT(match(I, Req),
+              ElementsAre("ns::abc3", "ns::abc2", "ns::abc1", "ns::abc0"));
+  // The limit applies to the merged results of both partitions.
+  Req.Limit = 2;
+  bool Incomplete = false;
+  EXPECT_THAT(match(I, Req, &Incomplete), ElementsAre("ns::abc3", "ns::abc2"));
+  EXPECT_TRUE(Incomplete);
+}
+
 TEST(DexTest, ProximityPathsBoosting) {
   auto RootSymbol = symbol("root::abc");
   RootSymbol.CanonicalDeclaration.FileURI = "unittest:///file.h";
@@ -763,6 +888,66 @@ TEST(DexTests, Relations) {
   EXPECT_THAT(Results, UnorderedElementsAre(Child1.ID, Child2.ID));
 }
 
+TEST(DexTests, RelationsOfSeveralSubjectsAndKinds) {
+  auto A = symbol("A");
+  auto B = symbol("B");
+  auto C = symbol("C");
+  auto D = symbol("D");
+  std::vector<Symbol> Symbols{A, B, C, D};
+  // Unsorted, with a duplicate.
+  std::vector<Relation> Relations{{C.ID, RelationKind::BaseOf, D.ID},
+                                  {A.ID, RelationKind::OverriddenBy, D.ID},
+                                  {A.ID, RelationKind::BaseOf, C.ID},
+                                  {A.ID, RelationKind::BaseOf, B.ID},
+                                  {C.ID, RelationKind::BaseOf, D.ID}};
+  Dex I{Symbols, RefSlab(), Relations};
+
+  auto Query = [&](std::vector<SymbolID> Subjects, RelationKind Kind,
+                   std::optional<uint32_t> Limit = std::nullopt) {
+    RelationsRequest Req;
+    Req.Subjects.insert(Subjects.begin(), Subjects.end());
+    Req.Predicate = Kind;
+    Req.Limit = Limit;
+    std::vector<std::pair<SymbolID, SymbolID>> Results;
+    I.relations(Req, [&](const SymbolID &Subject, const Symbol &Object) {
+      Results.emplace_back(Subject, Object.ID);
+    });
+    return Results;
+  };
+  EXPECT_THAT(Query({A.ID, B.ID, C.ID}, RelationKind::BaseOf),
+              UnorderedElementsAre(Pair(A.ID, B.ID), Pair(A.ID, C.ID),
+                                   Pair(C.ID, D.ID)));
+  EXPECT_THAT(Query({A.ID, C.ID}, RelationKind::OverriddenBy),
+              ElementsAre(Pair(A.ID, D.ID)));
+  EXPECT_THAT(Query({D.ID}, RelationKind::BaseOf), IsEmpty());
+  EXPECT_THAT(Query({A.ID, C.ID}, RelationKind::BaseOf, 2), SizeIs(2));
+}
+
+TEST(DexTests, RelationsOfManySubjects) {
+  // Enough subjects to spread over many buckets.
+  SymbolSlab Slab = generateNumSymbols(0, 1000);
+  std::vector<Symbol> Symbols(Slab.begin(), Slab.end());
+  std::vector<Relation> Relations;
+  for (size_t I = 0; I + 1 < Symbols.size(); I += 2)
+    Relations.push_back(
+        {Symbols[I].ID, RelationKind::BaseOf, Symbols[I + 1].ID});
+  Dex Index{Symbols, RefSlab(), Relations};
+
+  for (size_t I = 0; I < Symbols.size(); ++I) {
+    RelationsRequest Req;
+    Req.Subjects.insert(Symbols[I].ID);
+    Req.Predicate = RelationKind::BaseOf;
+    std::vector<SymbolID> Results;
+    Index.relations(Req, [&](const SymbolID &, const Symbol &Object) {
+      Results.push_back(Object.ID);
+    });
+    if (I % 2 == 0)
+      EXPECT_THAT(Results, ElementsAre(Symbols[I + 1].ID)) << I;
+    else
+      EXPECT_THAT(Results, IsEmpty()) << I;
+  }
+}
+
 TEST(DexIndex, IndexedFiles) {
   SymbolSlab Symbols;
   RefSlab Refs;
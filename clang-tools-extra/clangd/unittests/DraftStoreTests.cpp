@@ -36,6 +36,53 @@ TEST(DraftStore, Versions) {
   EXPECT_EQ("y", *DS.getDraft(File)->Contents);
 }
 
+TEST(DraftStore, Mapping) {
+  DraftStore DS;
+  Path File = "foo.cpp";
+  auto Pos = [](int Line, int Character) {
+    Position P;
+    P.line = Line;
+    P.character = Character;
+    return P;
+  };
+
+  DS.addDraft(File, "1", "a\nb\nc\nd\n");
+  // Edit line 1, and split it in two.
+  DS.addDraft(File, "2", "a\nbb\nb\nc\nd\n");
+  // No-op change.
+  DS.addDraft(File, "3", "a\nbb\nb\nc\nd\n");
+  // Remove line "c".
+  DS.addDraft(File, "4", "a\nbb\nb\nd\n");
+
+  auto Mapping = DS.getMapping(File, "1", "4");
+  ASSERT_TRUE(Mapping);
+  EXPECT_FALSE(Mapping->empty());
+  EXPECT_EQ(Mapping->toCurrent(Pos(0, 1)), Pos(0, 1));
+  EXPECT_EQ(Mapping->toCurrent(Pos(1, 0)), std::nullopt);
+  EXPECT_EQ(Mapping->toCurrent(Pos(2, 0)), std::nullopt);
+  EXPECT_EQ(Mapping->toCurrent(Pos(3, 1)), Pos(3, 1));
+  EXPECT_EQ(Mapping->toOld(Pos(3, 1)), Pos(3, 1));
+  EXPECT_EQ(Mapping->toOld(Pos(2, 0)), std::nullopt);
+  EXPECT_EQ(Mapping->toCurrent(Range{Pos(0, 0), Pos(3, 0)}),
+            (Range{Pos(0, 0), Pos(3, 0)}));
+  EXPECT_EQ(Mapping->toCurrent(Range{Pos(0, 0), Pos(2, 0)}), std::nullopt);
+
+  Mapping = DS.getMapping(File, "2", "3");
+  ASSERT_TRUE(Mapping);
+  EXPECT_TRUE(Mapping->empty());
+  EXPECT_EQ(Mapping->toOld(Pos(1, 1)), Pos(1, 1));
+
+  Mapping = DS.getMapping(File, "2", "4");
+  ASSERT_TRUE(Mapping);
+  EXPECT_EQ(Mapping->toOld(Pos(2, 0)), Pos(2, 0));
+  EXPECT_EQ(Mapping->toOld(Pos(3, 0)), Pos(4, 0));
+  EXPECT_EQ(Mapping->toCurrent(Pos(3, 0)), std::nullopt);
+
+  EXPECT_FALSE(DS.getMapping(File, "4", "1")) << "backwards";
+  EXPECT_FALSE(DS.getMapping(File, "0", "4")) << "unknown version";
+  EXPECT_FALSE(DS.getMapping("bar.cpp", "1", "1")) << "untracked file";
+}
+
 } // namespace
 } // namespace clangd
 } // namespace clang
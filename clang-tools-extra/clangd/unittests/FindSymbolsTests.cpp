@@ -9,6 +9,7 @@
 #include "FindSymbols.h"
 #include "TestFS.h"
 #include "TestTU.h"
+#include "index/Index.h"
 #include "llvm/ADT/StringRef.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
@@ -164,6 +165,59 @@ TEST(WorkspaceSymbols, Namespaces) {
               UnorderedElementsAre(qName("ans1::ans2::ans3::ai3")));
 }
 
+// Ignores FuzzyFindRequest::ApproximateScope, like remote servers that predate
+// it.
+class NoApproximateScopeIndex : public SymbolIndex {
+public:
+  NoApproximateScopeIndex(const SymbolIndex &Base) : Base(Base) {}
+
+  bool fuzzyFind(const FuzzyFindRequest &Req,
+                 llvm::function_ref<void(const Symbol &)> CB) const override {
+    FuzzyFindRequest Copy = Req;
+    Copy.ApproximateScope.clear();
+    return Base.fuzzyFind(Copy, CB);
+  }
+  void lookup(const LookupRequest &Req,
+              llvm::function_ref<void(const Symbol &)> CB) const override {
+    Base.lookup(Req, CB);
+  }
+  bool refs(const RefsRequest &Req,
+            llvm::function_ref<void(const Ref &)> CB) const override {
+    return Base.refs(Req, CB);
+  }
+  void relations(const RelationsRequest &Req,
+                 llvm::function_ref<void(const SymbolID &, const Symbol &)> CB)
+      const override {
+    Base.relations(Req, CB);
+  }
+  llvm::unique_function<IndexContents(llvm::StringRef) const>
+  indexedFiles() const override {
+    return Base.indexedFiles();
+  }
+  size_t estimateMemoryUsage() const override { return 0; }
+
+private:
+  const SymbolIndex &Base;
+};
+
+TEST(WorkspaceSymbols, IndexIgnoresApproximateScope) {
+  TestTU TU;
+  TU.Code = R"cpp(
+      namespace ans1 {
+        int ai1;
+      }
+      namespace other {
+        int ai2;
+      }
+      )cpp";
+  auto Index = TU.index();
+  NoApproximateScopeIndex Old(*Index);
+  auto SymbolInfos =
+      getWorkspaceSymbols("ans1::ai", 0, &Old, testPath(TU.Filename));
+  ASSERT_TRUE(bool(SymbolInfos));
+  EXPECT_THAT(*SymbolInfos, ElementsAre(qName("ans1::ai1")));
+}
+
 TEST(WorkspaceSymbols, AnonymousNamespace) {
   TestTU TU;
   TU.Code = R"cpp(
@@ -0,0 +1,115 @@
+//===-- HeaderCostTests.cpp -------------------------------------*- C++ -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#include "HeaderCost.h"
+#include "FeatureModule.h"
+#include "TestFS.h"
+#include "TestTU.h"
+#include "llvm/ADT/STLExtras.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace clang {
+namespace clangd {
+namespace {
+
+using ::testing::UnorderedElementsAre;
+
+MATCHER_P(path, P, "") { return arg.Path == P; }
+
+std::vector<HeaderCost> measure(TestTU &TU) {
+  struct CollectModule final : public FeatureModule {
+    struct Listener : ASTListener {
+      Listener(HeaderCostCollector &C) : C(C) {}
+      void beforeExecute(CompilerInstance &CI) override { C.collect(CI); }
+      HeaderCostCollector &C;
+    };
+    CollectModule(HeaderCostCollector &C) : C(C) {}
+    std::unique_ptr<ASTListener> astListeners() override {
+      return std::make_unique<Listener>(C);
+    }
+    HeaderCostCollector &C;
+  };
+  HeaderCostCollector Collector;
+  FeatureModuleSet FMS;
+  FMS.add(std::make_unique<CollectModule>(Collector));
+  TU.FeatureModules = &FMS;
+  auto Preamble = TU.preamble(
+      [&](ASTContext &Ctx, Preprocessor &, const CanonicalIncludes &) {
+        Collector.countDecls(Ctx);
+      });
+  EXPECT_TRUE(Preamble);
+  TU.FeatureModules = nullptr;
+  return Collector.takeCosts();
+}
+
+TEST(HeaderCost, Attribution) {
+  TestTU TU = TestTU::withCode(R"cpp(
+    #include "a.h"
+    #include "c.h"
+    #include "c.h"
+    int main();
+  )cpp");
+  TU.AdditionalFiles["a.h"] = R"cpp(
+    #pragma once
+    #include "b.h"
+    struct A { int X; };
+  )cpp";
+  TU.AdditionalFiles["b.h"] = R"cpp(
+    #pragma once
+    #define DECLARE(Name) int Name;
+    namespace ns { void f(); DECLARE(g) }
+  )cpp";
+  // Not guarded, entered twice.
+  TU.AdditionalFiles["c.h"] = "extern int c;";
+
+  auto Costs = measure(TU);
+  ASSERT_THAT(Costs, UnorderedElementsAre(path(testPath("a.h")),
+                                          path(testPath("b.h")),
+                                          path(testPath("c.h"))));
+  auto Get = [&](llvm::StringRef Name) -> const HeaderCost & {
+    return *llvm::find_if(Costs, [&](const HeaderCost &C) {
+      return C.Path == testPath(Name);
+    });
+  };
+  const HeaderCost &A = Get("a.h"), &B = Get("b.h"), &C = Get("c.h");
+
+  EXPECT_TRUE(A.IncludedByMainFile);
+  EXPECT_FALSE(B.IncludedByMainFile);
+  EXPECT_TRUE(C.IncludedByMainFile);
+  EXPECT_EQ(A.Entries, 1u);
+  EXPECT_EQ(C.Entries, 2u);
+  EXPECT_EQ(C.SourceBytes, TU.AdditionalFiles["c.h"].size());
+
+  // struct A, field X.
+  EXPECT_EQ(A.Exclusive.Decls, 2u);
+  // namespace ns, f, g (from a macro expansion).
+  EXPECT_EQ(B.Exclusive.Decls, 3u);
+  EXPECT_EQ(A.Inclusive.Decls, 5u);
+  EXPECT_EQ(B.Inclusive.Decls, 3u);
+  EXPECT_EQ(C.Exclusive.Decls, 2u);
+
+  // "extern int c ;" twice.
+  EXPECT_EQ(C.Exclusive.Tokens, 8u);
+  EXPECT_GT(B.Exclusive.Tokens, 0u);
+  EXPECT_EQ(A.Inclusive.Tokens, A.Exclusive.Tokens + B.Exclusive.Tokens);
+  EXPECT_GE(A.Inclusive.TimeMs, B.Inclusive.TimeMs);
+
+  // Most expensive first.
+  for (unsigned I = 1; I < Costs.size(); ++I)
+    EXPECT_GE(Costs[I - 1].Inclusive.TimeMs, Costs[I].Inclusive.TimeMs);
+}
+
+TEST(HeaderCost, NothingCollected) {
+  HeaderCostCollector Collector;
+  EXPECT_TRUE(Collector.takeCosts().empty());
+}
+
+} // namespace
+} // namespace clangd
+} // namespace clang
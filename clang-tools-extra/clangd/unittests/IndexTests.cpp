@@ -10,14 +10,17 @@
 #include "SyncAPI.h"
 #include "TestIndex.h"
 #include "TestTU.h"
+#include "index/Cache.h"
 #include "index/FileIndex.h"
 #include "index/Index.h"
 #include "index/MemIndex.h"
 #include "index/Merge.h"
+#include "index/Sharded.h"
 #include "index/Symbol.h"
 #include "clang/Index/IndexSymbol.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
+#include <optional>
 #include <utility>
 
 using ::testing::_;
@@ -26,6 +29,7 @@ using ::testing::ElementsAre;
 using ::testing::IsEmpty;
 using ::testing::Pair;
 using ::testing::Pointee;
+using ::testing::SizeIs;
 using ::testing::UnorderedElementsAre;
 
 namespace clang {
@@ -205,6 +209,17 @@ TEST(MemIndexTest, NoMatchNestedScopes) {
   EXPECT_THAT(match(*I, Req), UnorderedElementsAre("a::y1"));
 }
 
+TEST(MemIndexTest, ApproximateScope) {
+  auto I = MemIndex::build(
+      generateSymbols({"a::y1", "a::b::y2", "x::a::c::y3", "c::a::y4"}),
+      RefSlab(), RelationSlab());
+  FuzzyFindRequest Req;
+  Req.AnyScope = true;
+  Req.Query = "y";
+  Req.ApproximateScope = "a::c::";
+  EXPECT_THAT(match(*I, Req), UnorderedElementsAre("x::a::c::y3"));
+}
+
 TEST(MemIndexTest, IgnoreCases) {
   auto I = MemIndex::build(generateSymbols({"ns::ABC", "ns::abc"}), RefSlab(),
                            RelationSlab());
@@ -541,6 +556,278 @@ TEST(MergeIndexTest, IndexedFiles) {
   EXPECT_EQ(ContainsFile("unittest:///foobar.cc"), IndexContents::None);
 }
 
+TEST(ShardedIndexTest, Lookup) {
+  ShardedIndex Sharded(/*Threads=*/2);
+  Sharded.addShard(testPath("a"),
+                   MemIndex::build(generateSymbols({"ns::A", "ns::B"}),
+                                   RefSlab(), RelationSlab()));
+  Sharded.addShard(testPath("b"),
+                   MemIndex::build(generateSymbols({"ns::B", "ns::C"}),
+                                   RefSlab(), RelationSlab()));
+  EXPECT_THAT(lookup(Sharded, {SymbolID("ns::A"), SymbolID("ns::B"),
+                               SymbolID("ns::C"), SymbolID("ns::D")}),
+              UnorderedElementsAre("ns::A", "ns::B", "ns::C"));
+}
+
+TEST(ShardedIndexTest, FuzzyFind) {
+  ShardedIndex Sharded(/*Threads=*/2);
+  Sharded.addShard(testPath("a"),
+                   MemIndex::build(generateSymbols({"ns::ABC", "ns::AB"}),
+                                   RefSlab(), RelationSlab()));
+  SwapIndex &B = Sharded.addShard(
+      testPath("b"), MemIndex::build(generateSymbols({"ns::AB", "ns::A"}),
+                                     RefSlab(), RelationSlab()));
+  FuzzyFindRequest Req;
+  Req.Query = "AB";
+  Req.Scopes = {"ns::"};
+  // Symbols in several shards are reported once.
+  EXPECT_THAT(match(Sharded, Req),
+              UnorderedElementsAre("ns::ABC", "ns::AB"));
+
+  // The limit applies to the merged results, best first.
+  Req.Limit = 1;
+  bool Incomplete = false;
+  EXPECT_THAT(match(Sharded, Req, &Incomplete), ElementsAre("ns::AB"));
+  EXPECT_TRUE(Incomplete);
+
+  // Shards are reloaded independently.
+  B.reset(MemIndex::build(generateSymbols({"ns::ABCD"}), RefSlab(),
+                          RelationSlab()));
+  Req.Limit = std::nullopt;
+  EXPECT_THAT(match(Sharded, Req),
+              UnorderedElementsAre("ns::ABC", "ns::AB", "ns::ABCD"));
+}
+
+// Reports the results of the wrapped index in reverse order, with
+// documentation that only lives during the callback.
+class ReversedIndex : public SwapIndex {
+public:
+  using SwapIndex::SwapIndex;
+
+  bool fuzzyFind(const FuzzyFindRequest &Req,
+                 llvm::function_ref<void(const Symbol &)> CB) const override {
+    std::vector<Symbol> Results;
+    bool More = SwapIndex::fuzzyFind(
+        Req, [&](const Symbol &S) { Results.push_back(S); });
+    for (Symbol S : llvm::reverse(Results)) {
+      std::string Doc = ("Doc of " + S.Name).str();
+      S.Documentation = Doc;
+      CB(S);
+    }
+    return More;
+  }
+};
+
+TEST(ShardedIndexTest, FuzzyFindKeepsShardOrder) {
+  ShardedIndex Sharded(/*Threads=*/2);
+  Sharded.addShard(testPath("a"),
+                   std::make_unique<ReversedIndex>(MemIndex::build(
+                       generateSymbols({"ns::ABC", "ns::AB"}), RefSlab(),
+                       RelationSlab())));
+  Sharded.addShard(testPath("b"),
+                   MemIndex::build(generateSymbols({"ns::ABD"}), RefSlab(),
+                                   RelationSlab()));
+  FuzzyFindRequest Req;
+  Req.Query = "AB";
+  Req.Scopes = {"ns::"};
+  std::vector<std::string> Docs;
+  Sharded.fuzzyFind(
+      Req, [&](const Symbol &S) { Docs.push_back(S.Documentation.str()); });
+  // The first result of each shard comes first, the order of the shard wins
+  // over the score.
+  EXPECT_THAT(Docs, ElementsAre("Doc of ABC", "", "Doc of AB"));
+}
+
+TEST(ShardedIndexTest, Refs) {
+  SymbolID Foo("Foo");
+  auto MakeRefs = [&](std::vector<const char *> Files) {
+    RefSlab::Builder Builder;
+    for (const char *File : Files) {
+      Ref R;
+      R.Location.FileURI = File;
+      R.Kind = RefKind::Reference;
+      Builder.insert(Foo, R);
+    }
+    return std::move(Builder).build();
+  };
+  ShardedIndex Sharded(/*Threads=*/2);
+  Sharded.addShard(testPath("a"),
+                   MemIndex::build(SymbolSlab(),
+                                   MakeRefs({"file:///a.cc", "file:///h.h"}),
+                                   RelationSlab()));
+  Sharded.addShard(testPath("b"),
+                   MemIndex::build(SymbolSlab(),
+                                   MakeRefs({"file:///b.cc", "file:///h.h"}),
+                                   RelationSlab()));
+  RefsRequest Req;
+  Req.IDs = {Foo};
+  std::vector<std::string> Files;
+  EXPECT_FALSE(Sharded.refs(
+      Req, [&](const Ref &R) { Files.push_back(R.Location.FileURI); }));
+  // Refs in the shared header are reported once.
+  EXPECT_THAT(Files, UnorderedElementsAre("file:///a.cc", "file:///b.cc",
+                                          "file:///h.h"));
+
+  Req.Limit = 2;
+  Files.clear();
+  EXPECT_TRUE(Sharded.refs(
+      Req, [&](const Ref &R) { Files.push_back(R.Location.FileURI); }));
+  EXPECT_EQ(Files.size(), 2u);
+}
+
+TEST(ShardedIndexTest, IndexedFiles) {
+  auto MakeIndex = [](llvm::StringRef File, IndexContents Contents) {
+    llvm::StringSet<> Files = {URI::createFile(testPath(File)).toString()};
+    return std::make_unique<MemIndex>(SymbolSlab(), RefSlab(), RelationSlab(),
+                                      std::move(Files), Contents, nullptr,
+                                      /*BackingDataSize=*/0);
+  };
+  ShardedIndex Sharded;
+  Sharded.addShard(testPath("project"),
+                   MakeIndex("project/sub/x.cc", IndexContents::References));
+  Sharded.addShard(testPath("project/sub"),
+                   MakeIndex("project/sub/x.cc", IndexContents::All));
+  auto ContainsFile = Sharded.indexedFiles();
+  // The innermost project owns the file.
+  EXPECT_EQ(ContainsFile(URI::createFile(testPath("project/sub/x.cc"))
+                             .toString()),
+            IndexContents::All);
+  EXPECT_EQ(ContainsFile(URI::createFile(testPath("project/y.cc")).toString()),
+            IndexContents::None);
+  EXPECT_EQ(ContainsFile(URI::createFile(testPath("other/x.cc")).toString()),
+            IndexContents::None);
+}
+
+TEST(CachingIndexTest, RepeatedQueries) {
+  CountingIndex Base(MemIndex::build(generateSymbols({"ns::A", "ns::AB"}),
+                                     RefSlab(), RelationSlab()));
+  CachingIndex Cache(Base, /*MaxBytes=*/1 << 20);
+
+  EXPECT_THAT(lookup(Cache, {SymbolID("ns::A"), SymbolID("ns::AB")}),
+              UnorderedElementsAre("ns::A", "ns::AB"));
+  EXPECT_THAT(lookup(Cache, {SymbolID("ns::AB"), SymbolID("ns::A")}),
+              UnorderedElementsAre("ns::A", "ns::AB"));
+  EXPECT_EQ(Base.Queries, 1);
+
+  FuzzyFindRequest Req;
+  Req.Query = "A";
+  Req.Scopes = {"ns::", "other::"};
+  EXPECT_THAT(match(Cache, Req), UnorderedElementsAre("ns::A", "ns::AB"));
+  Req.Scopes = {"other::", "ns::"};
+  EXPECT_THAT(match(Cache, Req), UnorderedElementsAre("ns::A", "ns::AB"));
+  EXPECT_EQ(Base.Queries, 2);
+  Req.Limit = 1;
+  bool Incomplete = false;
+  EXPECT_THAT(match(Cache, Req, &Incomplete), SizeIs(1));
+  EXPECT_TRUE(Incomplete);
+  EXPECT_THAT(match(Cache, Req, &Incomplete), SizeIs(1));
+  EXPECT_TRUE(Incomplete);
+  EXPECT_EQ(Base.Queries, 3);
+}
+
+TEST(CachingIndexTest, RepeatedRelations) {
+  SymbolSlab Symbols = generateSymbols({"A", "B", "C", "D"});
+  SymbolID A("A"), B("B"), C("C"), D("D");
+  RelationSlab::Builder Relations;
+  Relations.insert(Relation{A, RelationKind::BaseOf, B});
+  Relations.insert(Relation{C, RelationKind::BaseOf, D});
+  Relations.insert(Relation{A, RelationKind::OverriddenBy, D});
+  CountingIndex Base(MemIndex::build(std::move(Symbols), RefSlab(),
+                                     std::move(Relations).build()));
+  CachingIndex Cache(Base, /*MaxBytes=*/1 << 20);
+
+  auto Query = [&](std::vector<SymbolID> Subjects, RelationKind Predicate,
+                   std::optional<uint32_t> Limit = std::nullopt) {
+    RelationsRequest Req;
+    Req.Subjects.insert(Subjects.begin(), Subjects.end());
+    Req.Predicate = Predicate;
+    Req.Limit = Limit;
+    std::vector<std::pair<SymbolID, std::string>> Results;
+    Cache.relations(Req, [&](const SymbolID &Subject, const Symbol &Object) {
+      Results.emplace_back(Subject, getQualifiedName(Object));
+    });
+    return Results;
+  };
+  // The order of the subjects doesn't matter.
+  EXPECT_THAT(Query({A, C}, RelationKind::BaseOf),
+              UnorderedElementsAre(Pair(A, "B"), Pair(C, "D")));
+  EXPECT_THAT(Query({C, A}, RelationKind::BaseOf),
+              UnorderedElementsAre(Pair(A, "B"), Pair(C, "D")));
+  EXPECT_EQ(Base.Queries, 1);
+  // The predicate and the limit do.
+  EXPECT_THAT(Query({A, C}, RelationKind::OverriddenBy),
+              ElementsAre(Pair(A, "D")));
+  EXPECT_EQ(Base.Queries, 2);
+  EXPECT_THAT(Query({A, C}, RelationKind::BaseOf, 1), SizeIs(1));
+  EXPECT_THAT(Query({A, C}, RelationKind::BaseOf, 1), SizeIs(1));
+  EXPECT_EQ(Base.Queries, 3);
+}
+
+TEST(CachingIndexTest, DroppedWhenIndexSwapped) {
+  SymbolID Foo("Foo");
+  auto MakeRefs = [&](const char *File) {
+    RefSlab::Builder Builder;
+    Ref R;
+    R.Location.FileURI = File;
+    R.Kind = RefKind::Reference;
+    Builder.insert(Foo, R);
+    return std::move(Builder).build();
+  };
+  CountingIndex Base(
+      MemIndex::build(SymbolSlab(), MakeRefs("file:///a.cc"), RelationSlab()));
+  CachingIndex Cache(Base, /*MaxBytes=*/1 << 20);
+  RefsRequest Req;
+  Req.IDs = {Foo};
+  auto Files = [&] {
+    std::vector<std::string> Files;
+    Cache.refs(Req,
+               [&](const Ref &R) { Files.push_back(R.Location.FileURI); });
+    return Files;
+  };
+  EXPECT_THAT(Files(), ElementsAre("file:///a.cc"));
+  EXPECT_THAT(Files(), ElementsAre("file:///a.cc"));
+  EXPECT_EQ(Base.Queries, 1);
+
+  // The cached results own their strings, and are dropped with the index.
+  Base.reset(
+      MemIndex::build(SymbolSlab(), MakeRefs("file:///b.cc"), RelationSlab()));
+  EXPECT_THAT(Files(), ElementsAre("file:///b.cc"));
+  EXPECT_EQ(Base.Queries, 2);
+}
+
+TEST(CachingIndexTest, KeptWhenOtherIndexSwapped) {
+  CountingIndex Base(MemIndex::build(generateSymbols({"ns::A"}), RefSlab(),
+                                     RelationSlab()));
+  CachingIndex Cache(Base, /*MaxBytes=*/1 << 20);
+  SwapIndex Other(std::make_unique<MemIndex>());
+  EXPECT_THAT(lookup(Cache, SymbolID("ns::A")), ElementsAre("ns::A"));
+  Other.reset(std::make_unique<MemIndex>());
+  EXPECT_THAT(lookup(Cache, SymbolID("ns::A")), ElementsAre("ns::A"));
+  EXPECT_EQ(Base.Queries, 1);
+
+  // A merged index changes with any of its parts.
+  SwapIndex Dynamic(std::make_unique<MemIndex>());
+  MergedIndex Merged(&Dynamic, &Base);
+  CachingIndex MergedCache(Merged, /*MaxBytes=*/1 << 20);
+  EXPECT_THAT(lookup(MergedCache, SymbolID("ns::A")), ElementsAre("ns::A"));
+  EXPECT_THAT(lookup(MergedCache, SymbolID("ns::A")), ElementsAre("ns::A"));
+  EXPECT_EQ(Base.Queries, 2);
+  Dynamic.reset(std::make_unique<MemIndex>());
+  EXPECT_THAT(lookup(MergedCache, SymbolID("ns::A")), ElementsAre("ns::A"));
+  EXPECT_EQ(Base.Queries, 3);
+}
+
+TEST(CachingIndexTest, BoundedMemory) {
+  CountingIndex Base(MemIndex::build(generateSymbols({"ns::A", "ns::B"}),
+                                     RefSlab(), RelationSlab()));
+  // Too small for any results.
+  CachingIndex Cache(Base, /*MaxBytes=*/1);
+  EXPECT_THAT(lookup(Cache, SymbolID("ns::A")), ElementsAre("ns::A"));
+  EXPECT_THAT(lookup(Cache, SymbolID("ns::A")), ElementsAre("ns::A"));
+  EXPECT_EQ(Base.Queries, 2);
+  EXPECT_EQ(Cache.estimateMemoryUsage(), Base.estimateMemoryUsage());
+}
+
 TEST(MergeIndexTest, NonDocumentation) {
   using index::SymbolKind;
   Symbol L, R;
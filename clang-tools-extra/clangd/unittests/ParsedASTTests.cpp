@@ -25,6 +25,8 @@
 #include "TestFS.h"
 #include "TestTU.h"
 #include "TidyProvider.h"
+#include "support/Cancellation.h"
+#include "support/Context.h"
 #include "clang/AST/DeclTemplate.h"
 #include "clang/Basic/SourceLocation.h"
 #include "clang/Basic/SourceManager.h"
@@ -268,6 +270,58 @@ TEST(ParsedASTTest, NoCrashOnTokensWithTidyCheck) {
   EXPECT_EQ(T.expandedTokens().drop_back().back().text(SM), "}");
 }
 
+TEST(ParsedASTTest, LazyTokens) {
+  TestTU TU;
+  TU.AdditionalFiles["systemc.h"] = R"cpp(
+    #define SC_MODULE(Name) struct Name : ::sc_module
+    #define SC_CTOR(Name) Name(const char *n)
+    #define SC_METHOD(F) declare_method(#F, &SC_CURRENT_USER_MODULE::F)
+    struct sc_module { void declare_method(const char *, ...); };
+  )cpp";
+  TU.Code = R"cpp(
+    #include "systemc.h"
+    #define SC_CURRENT_USER_MODULE Counter
+    #define CAT(A, B) A ## B
+    SC_MODULE(Counter) {
+      SC_CTOR(Counter) { SC_METHOD(tick); }
+      void CAT(ti, ck)();
+      int line = __LINE__;
+    };
+  )cpp";
+  // The tidy check runs the preprocessor after the log is recorded.
+  TU.ClangTidyProvider = addTidyChecks("modernize-use-trailing-return-type");
+  auto Eager = TU.build();
+  TU.ParseOpts.LazyTokens = true;
+  auto Lazy = TU.build();
+
+  EXPECT_EQ(Eager.getTokens().dumpForTests(), Lazy.getTokens().dumpForTests());
+}
+
+TEST(ParsedASTTest, AbortsWhenCancelled) {
+  TestTU TU = TestTU::withCode(R"cpp(
+    #include "foo.h"
+    int x = foo();
+  )cpp");
+  TU.AdditionalFiles["foo.h"] = "int foo();";
+  MockFS FS;
+  auto Inputs = TU.inputs(FS);
+  IgnoreDiagnostics Diags;
+  auto CI = buildCompilerInvocation(Inputs, Diags);
+  ASSERT_TRUE(CI);
+  auto Preamble = buildPreamble(testPath(TU.Filename), *CI, Inputs,
+                                /*StoreInMemory=*/true, nullptr);
+  ASSERT_TRUE(Preamble);
+
+  auto Task = cancelableTask();
+  WithContext Cancelable(std::move(Task.first));
+  Task.second();
+  EXPECT_EQ(buildPreamble(testPath(TU.Filename), *CI, Inputs,
+                          /*StoreInMemory=*/true, nullptr),
+            nullptr);
+  EXPECT_FALSE(ParsedAST::build(testPath(TU.Filename), Inputs, std::move(CI),
+                                {}, Preamble));
+}
+
 TEST(ParsedASTTest, CanBuildInvocationWithUnknownArgs) {
   MockFS FS;
   FS.Files = {{testPath("foo.cpp"), "void test() {}"}};
@@ -252,6 +252,26 @@ TEST(SerializationTest, BinaryConversions) {
               UnorderedElementsAreArray(yamlFromRelations(*In->Relations)));
 }
 
+TEST(SerializationTest, CompressDocumentation) {
+  if (!DocumentationStore::isAvailable())
+    GTEST_SKIP() << "Documentation is compressed with zlib";
+  auto In = readIndexFile(YAML);
+  ASSERT_TRUE(bool(In)) << In.takeError();
+  IndexFileOut Out(*In);
+  Out.Format = IndexFileFormat::RIFF;
+  std::string Serialized = llvm::to_string(Out);
+
+  auto In2 = readIndexFile(Serialized, SymbolOrigin::Static,
+                           /*CompressDocumentation=*/true);
+  ASSERT_TRUE(bool(In2)) << In2.takeError();
+  ASSERT_TRUE(In2->Symbols);
+  ASSERT_TRUE(In2->Documentation);
+  auto Sym1 = *In2->Symbols->find(
+      cantFail(SymbolID::fromStr("057557CEBF6E6B2D")));
+  EXPECT_EQ(Sym1.Documentation, "");
+  EXPECT_EQ(In2->Documentation->get(Sym1.ID), "Foo doc");
+}
+
 TEST(SerializationTest, SrcsTest) {
   auto In = readIndexFile(YAML);
   EXPECT_TRUE(bool(In)) << In.takeError();
@@ -322,6 +342,23 @@ TEST(SerializationTest, CmdlTest) {
   }
 }
 
+TEST(SerializationTest, IndexingMemory) {
+  auto In = readIndexFile(YAML);
+  ASSERT_TRUE(bool(In)) << In.takeError();
+  IndexFileOut Out(*In);
+  Out.Format = IndexFileFormat::RIFF;
+  Out.IndexingMemory = 3 << 20;
+
+  auto Serialized = readIndexFile(llvm::to_string(Out));
+  ASSERT_TRUE(bool(Serialized)) << Serialized.takeError();
+  EXPECT_EQ(Serialized->IndexingMemory, size_t(3 << 20));
+  // Files written before it was stored have no estimate.
+  Out.IndexingMemory = 0;
+  Serialized = readIndexFile(llvm::to_string(Out));
+  ASSERT_TRUE(bool(Serialized)) << Serialized.takeError();
+  EXPECT_EQ(Serialized->IndexingMemory, 0u);
+}
+
 // rlimit is part of POSIX. RLIMIT_AS does not exist in OpenBSD.
 // Sanitizers use a lot of address space, so we can't apply strict limits.
 #if LLVM_ON_UNIX && defined(RLIMIT_AS) && !LLVM_ADDRESS_SANITIZER_BUILD &&     \
@@ -0,0 +1,187 @@
+//===-- SystemIncludeExtractorTests.cpp -------------------------*- C++ -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#include "GlobalCompilationDatabase.h"
+#include "support/TestTracer.h"
+#include "clang/Tooling/CompilationDatabase.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Config/llvm-config.h"
+#include "llvm/Support/Chrono.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/Process.h"
+#include "llvm/Support/raw_ostream.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include <string>
+#include <vector>
+
+namespace clang {
+namespace clangd {
+namespace {
+using ::testing::ElementsAre;
+using ::testing::IsEmpty;
+
+// The fake drivers are shell scripts.
+#ifdef LLVM_ON_UNIX
+class QueryDriverStoreTest : public ::testing::Test {
+protected:
+  void SetUp() override {
+    ASSERT_FALSE(llvm::sys::fs::createUniqueDirectory("QueryDriver", Dir));
+    // /var/tmp is a symlink on Mac, and drivers are matched by resolved path.
+    ASSERT_FALSE(llvm::sys::fs::real_path(Dir.str(), Dir));
+    Driver = path("fake-cc");
+    CacheDir = path("cache");
+  }
+
+  void TearDown() override { llvm::sys::fs::remove_directories(Dir); }
+
+  std::string path(llvm::StringRef Name) {
+    llvm::SmallString<256> Path(Dir);
+    llvm::sys::path::append(Path, Name);
+    return Path.str().str();
+  }
+
+  // Writes a driver that reports \p Include as its only system include, and
+  // records each time it runs.
+  void writeDriver(llvm::StringRef Include) {
+    {
+      std::error_code EC;
+      llvm::raw_fd_ostream OS(Driver, EC);
+      ASSERT_FALSE(EC);
+      OS << "#!/bin/sh\n"
+         << "echo run >> '" << path("runs") << "'\n"
+         << "echo '#include <...> search starts here:' >&2\n"
+         << "echo ' " << Include << "' >&2\n"
+         << "echo 'End of search list.' >&2\n";
+    }
+    ASSERT_FALSE(
+        llvm::sys::fs::setPermissions(Driver, llvm::sys::fs::all_all));
+  }
+
+  // Extracts the includes like a new clangd process would, with nothing
+  // cached in memory.
+  std::vector<std::string> extract(llvm::StringRef StoreDir,
+                                   llvm::StringRef Sysroot = "") {
+    auto Extractor =
+        getSystemIncludeExtractor(std::vector<std::string>{Driver}, StoreDir);
+    tooling::CompileCommand Cmd;
+    Cmd.Directory = Dir.str().str();
+    Cmd.CommandLine = {Driver};
+    if (!Sysroot.empty())
+      Cmd.CommandLine.push_back(("--sysroot=" + Sysroot).str());
+    Extractor(Cmd, "foo.cc");
+    Cmd.CommandLine.erase(Cmd.CommandLine.begin());
+    return Cmd.CommandLine;
+  }
+
+  // Returns how many times the driver was run.
+  size_t runs() {
+    auto Buf = llvm::MemoryBuffer::getFile(path("runs"));
+    return Buf ? Buf->get()->getBuffer().count('\n') : 0;
+  }
+
+  llvm::SmallString<256> Dir;
+  std::string Driver;
+  std::string CacheDir;
+};
+
+TEST_F(QueryDriverStoreTest, RoundTrip) {
+  trace::TestTracer Tracer;
+  writeDriver("/first");
+  EXPECT_THAT(extract(CacheDir), ElementsAre("-isystem", "/first"));
+  EXPECT_THAT(Tracer.takeMetric("query_driver_cache", "miss"),
+              ElementsAre(1));
+  EXPECT_EQ(runs(), 1u);
+
+  EXPECT_THAT(extract(CacheDir), ElementsAre("-isystem", "/first"));
+  EXPECT_THAT(Tracer.takeMetric("query_driver_cache", "hit"), ElementsAre(1));
+  EXPECT_EQ(runs(), 1u);
+}
+
+TEST_F(QueryDriverStoreTest, StaleStamp) {
+  trace::TestTracer Tracer;
+  writeDriver("/first");
+  EXPECT_THAT(extract(CacheDir), ElementsAre("-isystem", "/first"));
+  writeDriver("/second/include");
+  EXPECT_THAT(extract(CacheDir), ElementsAre("-isystem", "/second/include"));
+  EXPECT_THAT(Tracer.takeMetric("query_driver_cache", "stale"),
+              ElementsAre(1));
+  EXPECT_EQ(runs(), 2u);
+
+  EXPECT_THAT(extract(CacheDir), ElementsAre("-isystem", "/second/include"));
+  EXPECT_THAT(Tracer.takeMetric("query_driver_cache", "hit"), ElementsAre(1));
+  EXPECT_EQ(runs(), 2u);
+}
+
+TEST_F(QueryDriverStoreTest, TouchedButUnchanged) {
+  trace::TestTracer Tracer;
+  writeDriver("/first");
+  EXPECT_THAT(extract(CacheDir), ElementsAre("-isystem", "/first"));
+
+  int FD;
+  ASSERT_FALSE(llvm::sys::fs::openFileForWrite(
+      Driver, FD, llvm::sys::fs::CD_OpenExisting, llvm::sys::fs::OF_Append));
+  ASSERT_FALSE(llvm::sys::fs::setLastAccessAndModificationTime(
+      FD, llvm::sys::toTimePoint(1000000000)));
+  ASSERT_FALSE(llvm::sys::Process::SafelyCloseFileDescriptor(FD));
+
+  // The contents are compared, and still match.
+  EXPECT_THAT(extract(CacheDir), ElementsAre("-isystem", "/first"));
+  EXPECT_THAT(Tracer.takeMetric("query_driver_cache", "hit"), ElementsAre(1));
+  EXPECT_EQ(runs(), 1u);
+}
+
+TEST_F(QueryDriverStoreTest, RefreshedAtStartup) {
+  trace::TestTracer Tracer;
+  writeDriver("/first");
+  EXPECT_THAT(extract(CacheDir), ElementsAre("-isystem", "/first"));
+  writeDriver("/second/include");
+  // The stale query is answered again as soon as the extractor is created,
+  // before any command asks for it. Destroying the extractor waits for it.
+  getSystemIncludeExtractor(std::vector<std::string>{Driver}, CacheDir);
+  EXPECT_THAT(Tracer.takeMetric("query_driver_cache", "stale"),
+              ElementsAre(1));
+  EXPECT_EQ(runs(), 2u);
+
+  EXPECT_THAT(extract(CacheDir), ElementsAre("-isystem", "/second/include"));
+  EXPECT_THAT(Tracer.takeMetric("query_driver_cache", "hit"), ElementsAre(1));
+  EXPECT_EQ(runs(), 2u);
+}
+
+TEST_F(QueryDriverStoreTest, EvictsOldEntries) {
+  writeDriver("/first");
+  // Each sysroot is a separate query.
+  for (unsigned I = 0; I < 100; ++I)
+    extract(CacheDir, "/sysroot" + std::to_string(I));
+  size_t Entries = 0;
+  std::error_code EC;
+  for (llvm::sys::fs::directory_iterator It(CacheDir, EC), End;
+       !EC && It != End; It.increment(EC))
+    ++Entries;
+  EXPECT_FALSE(EC);
+  EXPECT_GT(Entries, 0u);
+  EXPECT_LT(Entries, 100u);
+}
+
+TEST_F(QueryDriverStoreTest, Disabled) {
+  trace::TestTracer Tracer;
+  writeDriver("/first");
+  EXPECT_THAT(extract(""), ElementsAre("-isystem", "/first"));
+  EXPECT_THAT(extract(""), ElementsAre("-isystem", "/first"));
+  EXPECT_EQ(runs(), 2u);
+  EXPECT_THAT(Tracer.takeMetric("query_driver_cache"), IsEmpty());
+  EXPECT_FALSE(llvm::sys::fs::exists(CacheDir));
+}
+#endif
+
+} // namespace
+} // namespace clangd
+} // namespace clang
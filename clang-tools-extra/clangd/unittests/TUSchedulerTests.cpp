@@ -30,6 +30,8 @@
 #include "llvm/ADT/StringExtras.h"
 #include "llvm/ADT/StringMap.h"
 #include "llvm/ADT/StringRef.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/VirtualFileSystem.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 #include <atomic>
@@ -41,6 +43,7 @@
 #include <mutex>
 #include <optional>
 #include <string>
+#include <thread>
 #include <utility>
 #include <vector>
 
@@ -252,6 +255,29 @@ TEST_F(TUSchedulerTests, WantDiagnostics) {
   EXPECT_EQ(2, CallbackCount);
 }
 
+TEST_F(TUSchedulerTests, AutoDiagnosticsNotAbortedByNoDiagnostics) {
+  std::atomic<int> CallbackCount(0);
+  {
+    Notification Ready;
+    TUScheduler S(CDB, optsForTest(), captureDiags());
+    auto Path = testPath("foo.cpp");
+    updateWithDiags(S, Path, "", WantDiagnostics::Yes,
+                    [&](std::vector<Diag>) { Ready.wait(); });
+    // The build for these diagnostics starts with the next update queued, and
+    // must not be aborted as that update doesn't want diagnostics.
+    updateWithDiags(S, Path, "auto (produces)", WantDiagnostics::Auto,
+                    [&](std::vector<Diag>) { ++CallbackCount; });
+    updateWithDiags(S, Path, "request no diags", WantDiagnostics::No,
+                    [&](std::vector<Diag>) {
+                      ADD_FAILURE() << "no diags should not be called back";
+                    });
+    Ready.notify();
+
+    ASSERT_TRUE(S.blockUntilIdle(timeoutSeconds(10)));
+  }
+  EXPECT_EQ(1, CallbackCount);
+}
+
 TEST_F(TUSchedulerTests, Debounce) {
   auto Opts = optsForTest();
   Opts.UpdateDebounce = DebouncePolicy::fixed(std::chrono::milliseconds(500));
@@ -1173,6 +1199,86 @@ TEST_F(TUSchedulerTests, AsyncPreambleThread) {
   Ready.notify();
 }
 
+TEST_F(TUSchedulerTests, AbortsObsoletePreambleBuild) {
+  // Holds the preamble build that reads block.h until it is cancelled.
+  class BlockingFS : public ThreadsafeFS {
+  public:
+    BlockingFS(const llvm::StringMap<std::string> &Files, Notification &Blocked)
+        : Files(Files), Blocked(Blocked) {}
+
+  private:
+    IntrusiveRefCntPtr<llvm::vfs::FileSystem> viewImpl() const override {
+      class BlockingVFS : public llvm::vfs::ProxyFileSystem {
+      public:
+        BlockingVFS(IntrusiveRefCntPtr<llvm::vfs::FileSystem> FS,
+                    Notification &Blocked)
+            : ProxyFileSystem(std::move(FS)), Blocked(Blocked) {}
+
+        llvm::ErrorOr<std::unique_ptr<llvm::vfs::File>>
+        openFileForRead(const Twine &Path) override {
+          if (llvm::sys::path::filename(Path.str()) == "block.h") {
+            Blocked.notify();
+            Deadline Timeout = timeoutSeconds(10);
+            while (!isCancelled() && !Timeout.expired())
+              std::this_thread::sleep_for(std::chrono::milliseconds(10));
+          }
+          return ProxyFileSystem::openFileForRead(Path);
+        }
+
+      private:
+        Notification &Blocked;
+      };
+      return IntrusiveRefCntPtr<BlockingVFS>(
+          new BlockingVFS(buildTestFS(Files), Blocked));
+    }
+
+    const llvm::StringMap<std::string> &Files;
+    Notification &Blocked;
+  };
+  class RecordPreambles : public ParsingCallbacks {
+  public:
+    RecordPreambles(std::mutex &Mu, std::vector<std::string> &Versions)
+        : Mu(Mu), Versions(Versions) {}
+    void onPreambleAST(PathRef Path, llvm::StringRef Version,
+                       const CompilerInvocation &, ASTContext &Ctx,
+                       Preprocessor &, const CanonicalIncludes &) override {
+      std::lock_guard<std::mutex> Lock(Mu);
+      Versions.push_back(Version.str());
+    }
+
+  private:
+    std::mutex &Mu;
+    std::vector<std::string> &Versions;
+  };
+
+  FS.Files[testPath("block.h")] = "int x;";
+  FS.Files[testPath("other.h")] = "int y;";
+  Notification Blocked;
+  BlockingFS BlockFS(FS.Files, Blocked);
+  std::mutex Mu;
+  std::vector<std::string> Versions;
+  TUScheduler S(CDB, optsForTest(),
+                std::make_unique<RecordPreambles>(Mu, Versions));
+  Path File = testPath("foo.cpp");
+  auto Update = [&](llvm::StringRef Version, llvm::StringRef Contents) {
+    auto PI = getInputs(File, Contents.str());
+    PI.TFS = &BlockFS;
+    PI.Version = Version.str();
+    S.update(File, PI, WantDiagnostics::Auto);
+  };
+
+  Update("v0", "#include \"other.h\"\nint a;");
+  ASSERT_TRUE(S.blockUntilIdle(timeoutSeconds(10)));
+  // The preamble of v1 is being built when v2 changes the preamble, so it is
+  // aborted and v0's preamble is kept until v2's is built.
+  Update("v1", "#include \"block.h\"\nint a;");
+  Blocked.wait();
+  Update("v2", "#define V2\n#include \"other.h\"\nint a;");
+  ASSERT_TRUE(S.blockUntilIdle(timeoutSeconds(10)));
+  std::lock_guard<std::mutex> Lock(Mu);
+  EXPECT_THAT(Versions, ElementsAre("v0", "v2"));
+}
+
 TEST_F(TUSchedulerTests, OnlyPublishWhenPreambleIsBuilt) {
   struct PreamblePublishCounter : public ParsingCallbacks {
     PreamblePublishCounter(int &PreamblePublishCount)
@@ -1644,6 +1750,86 @@ TEST_F(TUSchedulerTests, PreambleThrottle) {
   EXPECT_THAT(Throttler.Releases, UnorderedElementsAre(1, 0));
 }
 
+TEST_F(TUSchedulerTests, StaleAST) {
+  // Blocks the worker after building the AST of version 2.
+  class BlockMainAST : public ParsingCallbacks {
+  public:
+    BlockMainAST(Notification &Unblock) : Unblock(Unblock) {}
+    void onMainAST(PathRef File, ParsedAST &AST, PublishFn) override {
+      if (AST.version() == "2")
+        Unblock.wait();
+    }
+
+  private:
+    Notification &Unblock;
+  };
+  Notification Unblock;
+  auto Opts = optsForTest();
+  Opts.KeepStaleASTs = true;
+  TUScheduler S(CDB, Opts, std::make_unique<BlockMainAST>(Unblock));
+
+  Path File = testPath("foo.cpp");
+  auto Inputs = getInputs(File, "int x;");
+  Inputs.Version = "1";
+  S.update(File, Inputs, WantDiagnostics::Yes);
+  ASSERT_TRUE(S.blockUntilIdle(timeoutSeconds(60)));
+  // Queued before the update, so it reads version 1, whether before or after
+  // the stale read below.
+  S.runWithAST("Before", File, [&](llvm::Expected<InputsAndAST> AST) {
+    ASSERT_TRUE(bool(AST));
+    EXPECT_EQ(AST->Inputs.Version, "1");
+  });
+  Inputs = getInputs(File, "int x;\nint y;");
+  Inputs.Version = "2";
+  S.update(File, Inputs, WantDiagnostics::Yes);
+
+  // Reads don't wait for version 2.
+  std::vector<std::pair<std::string, bool>> Seen;
+  auto Record = [&](llvm::Expected<InputsAndAST> AST, bool Stale) {
+    EXPECT_TRUE(bool(AST));
+    if (AST)
+      Seen.emplace_back(AST->Inputs.Version, Stale);
+    else
+      llvm::consumeError(AST.takeError());
+  };
+  Notification Accepted;
+  S.runWithStaleAST("Accept", File,
+                    [&](llvm::Expected<InputsAndAST> AST, bool Stale) {
+                      Record(std::move(AST), Stale);
+                      Accepted.notify();
+                      return true;
+                    });
+  Accepted.wait();
+  EXPECT_THAT(Seen, ElementsAre(Pair("1", true)));
+
+  // Declining the stale AST waits for the up-to-date one.
+  Seen.clear();
+  Notification Declined;
+  S.runWithStaleAST("Decline", File,
+                    [&](llvm::Expected<InputsAndAST> AST, bool Stale) {
+                      Record(std::move(AST), Stale);
+                      if (Stale)
+                        Declined.notify();
+                      return false;
+                    });
+  Declined.wait();
+  Unblock.notify();
+  ASSERT_TRUE(S.blockUntilIdle(timeoutSeconds(60)));
+  EXPECT_THAT(Seen, ElementsAre(Pair("1", true), Pair("2", false)));
+
+  // Once version 2 is built, the stale AST is gone.
+  Seen.clear();
+  S.runWithStaleAST("Fresh", File,
+                    [&](llvm::Expected<InputsAndAST> AST, bool Stale) {
+                      Record(std::move(AST), Stale);
+                      return true;
+                    });
+  ASSERT_TRUE(S.blockUntilIdle(timeoutSeconds(60)));
+  EXPECT_THAT(Seen, ElementsAre(Pair("2", false)));
+  // Stale reads only lease the cached AST, no read had to rebuild it.
+  EXPECT_EQ(S.fileStats().lookup(File).ASTBuilds, 2u);
+}
+
 } // namespace
 } // namespace clangd
 } // namespace clang
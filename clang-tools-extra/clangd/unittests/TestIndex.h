@@ -66,6 +66,36 @@ std::vector<std::string> match(const SymbolIndex &I,
 std::vector<std::string> lookup(const SymbolIndex &I,
                                 llvm::ArrayRef<SymbolID> IDs);
 
+// Counts the queries that reach the wrapped index.
+class CountingIndex : public SwapIndex {
+public:
+  using SwapIndex::SwapIndex;
+
+  bool fuzzyFind(const FuzzyFindRequest &Req,
+                 llvm::function_ref<void(const Symbol &)> CB) const override {
+    ++Queries;
+    return SwapIndex::fuzzyFind(Req, CB);
+  }
+  void lookup(const LookupRequest &Req,
+              llvm::function_ref<void(const Symbol &)> CB) const override {
+    ++Queries;
+    SwapIndex::lookup(Req, CB);
+  }
+  bool refs(const RefsRequest &Req,
+            llvm::function_ref<void(const Ref &)> CB) const override {
+    ++Queries;
+    return SwapIndex::refs(Req, CB);
+  }
+  void relations(const RelationsRequest &Req,
+                 llvm::function_ref<void(const SymbolID &, const Symbol &)> CB)
+      const override {
+    ++Queries;
+    SwapIndex::relations(Req, CB);
+  }
+
+  mutable int Queries = 0;
+};
+
 } // namespace clangd
 } // namespace clang
 
@@ -0,0 +1,130 @@
+//===-- TimeTraceTests.cpp --------------------------------------*- C++ -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#include "TestTU.h"
+#include "TimeTrace.h"
+#include "llvm/Support/FormatVariadic.h"
+#include "llvm/Support/JSON.h"
+#include "llvm/Support/TimeProfiler.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace clang {
+namespace clangd {
+namespace {
+
+using ::testing::ElementsAre;
+using ::testing::IsEmpty;
+
+MATCHER_P4(hotspot, Event, Detail, TotalMs, Count, "") {
+  return arg.Event == Event && arg.Detail == Detail &&
+         arg.TotalMs == TotalMs && arg.Count == Count;
+}
+
+TEST(TimeTraceRecorder, RecordsBuild) {
+  TestTU TU = TestTU::withCode("#include \"foo.h\"\nint x = y;");
+  TU.AdditionalFiles["foo.h"] = "int y = 0;";
+
+  TimeTraceRecorder Recorder(/*Enabled=*/true);
+  EXPECT_TRUE(llvm::timeTraceProfilerEnabled());
+  TU.build();
+  auto Trace = Recorder.take(BuildTimeTrace::AST, "42");
+  EXPECT_FALSE(llvm::timeTraceProfilerEnabled());
+  ASSERT_TRUE(Trace);
+  EXPECT_EQ(Trace->K, BuildTimeTrace::AST);
+  EXPECT_EQ(Trace->Version, "42");
+  EXPECT_GE(Trace->TotalMs, 0);
+
+  auto Parsed = llvm::json::parse(Trace->JSON);
+  ASSERT_TRUE(bool(Parsed)) << llvm::toString(Parsed.takeError());
+  ASSERT_TRUE(Parsed->getAsObject());
+  EXPECT_TRUE(Parsed->getAsObject()->getArray("traceEvents"));
+
+  // Only one trace is produced.
+  EXPECT_FALSE(Recorder.take(BuildTimeTrace::AST, "42"));
+}
+
+TEST(TimeTraceRecorder, Inert) {
+  TimeTraceRecorder Disabled(/*Enabled=*/false);
+  EXPECT_FALSE(llvm::timeTraceProfilerEnabled());
+  EXPECT_FALSE(Disabled.take(BuildTimeTrace::Preamble, "1"));
+
+  // An enclosing profile of the thread must not be disturbed.
+  TimeTraceRecorder Outer(/*Enabled=*/true);
+  {
+    TimeTraceRecorder Inner(/*Enabled=*/true);
+    EXPECT_FALSE(Inner.take(BuildTimeTrace::Preamble, "1"));
+  }
+  EXPECT_TRUE(llvm::timeTraceProfilerEnabled());
+  EXPECT_TRUE(Outer.take(BuildTimeTrace::Preamble, "1"));
+}
+
+TEST(TimeTrace, Summarize) {
+  auto Trace = [](llvm::json::Array Events) {
+    llvm::json::Object Root{{"traceEvents", std::move(Events)}};
+    return llvm::formatv("{0}", llvm::json::Value(std::move(Root))).str();
+  };
+  auto Event = [](llvm::StringRef Name, llvm::StringRef Detail, double Dur) {
+    llvm::json::Object E{{"ph", "X"}, {"name", Name}, {"dur", Dur}};
+    if (!Detail.empty())
+      E["args"] = llvm::json::Object{{"detail", Detail}};
+    return E;
+  };
+  std::vector<std::string> Traces = {
+      Trace({Event("Source", "/a.h", 3000), Event("Source", "/b.h", 1000),
+             Event("InstantiateClass", "std::vector<int>", 2000),
+             Event("Total Source", "", 4000), Event("Frontend", "", 9000)}),
+      Trace({Event("Source", "/a.h", 2000),
+             llvm::json::Object{{"ph", "i"}, {"name", "Source"}}}),
+      "not json",
+  };
+
+  EXPECT_THAT(summarizeTimeTraces(Traces, /*Limit=*/0),
+              ElementsAre(hotspot("Source", "/a.h", 5.0, 2u),
+                          hotspot("InstantiateClass", "std::vector<int>",
+                                  2.0, 1u),
+                          hotspot("Source", "/b.h", 1.0, 1u)));
+  EXPECT_THAT(summarizeTimeTraces(Traces, /*Limit=*/1),
+              ElementsAre(hotspot("Source", "/a.h", 5.0, 2u)));
+  EXPECT_THAT(summarizeTimeTraces({}, /*Limit=*/1), IsEmpty());
+}
+
+TEST(TimeTraceStore, Lifecycle) {
+  TimeTraceStore Store;
+  BuildTimeTrace Preamble;
+  Preamble.K = BuildTimeTrace::Preamble;
+  Preamble.Version = "1";
+  BuildTimeTrace AST;
+  AST.K = BuildTimeTrace::AST;
+  AST.Version = "2";
+
+  // Traces for files that weren't selected are dropped.
+  Store.record("/foo.cc", AST);
+  EXPECT_FALSE(Store.enabled("/foo.cc"));
+  EXPECT_THAT(Store.traces("/foo.cc"), IsEmpty());
+
+  Store.enable("/foo.cc");
+  EXPECT_TRUE(Store.enabled("/foo.cc"));
+  Store.record("/foo.cc", AST);
+  Store.record("/foo.cc", Preamble);
+  AST.Version = "3";
+  Store.record("/foo.cc", AST);
+  auto Traces = Store.traces("/foo.cc");
+  ASSERT_EQ(Traces.size(), 2u);
+  EXPECT_EQ(Traces[0].K, BuildTimeTrace::Preamble);
+  EXPECT_EQ(Traces[1].Version, "3");
+  EXPECT_EQ(Store.allTraces().size(), 2u);
+
+  Store.remove("/foo.cc");
+  EXPECT_FALSE(Store.enabled("/foo.cc"));
+  EXPECT_THAT(Store.allTraces(), IsEmpty());
+}
+
+} // namespace
+} // namespace clangd
+} // namespace clang
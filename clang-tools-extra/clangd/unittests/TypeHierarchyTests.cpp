@@ -10,8 +10,10 @@
 #include "Matchers.h"
 #include "ParsedAST.h"
 #include "TestFS.h"
+#include "TestIndex.h"
 #include "TestTU.h"
 #include "XRefs.h"
+#include "index/Index.h"
 #include "clang/AST/DeclCXX.h"
 #include "clang/AST/DeclTemplate.h"
 #include "llvm/Support/Path.h"
@@ -755,6 +757,35 @@ struct Child2b : Child1 {};
                            parentsNotResolved(), childrenNotResolved()))));
 }
 
+TEST(Subtypes, OneQueryPerLevel) {
+  Annotations Source(R"cpp(
+struct P^arent {};
+struct A : Parent {};
+struct B : Parent {};
+struct D : A, B {};
+struct E : D {};
+)cpp");
+
+  TestTU TU = TestTU::withCode(Source.code());
+  auto AST = TU.build();
+  CountingIndex Index(TU.index());
+
+  auto Result = getTypeHierarchy(AST, Source.point(), /*ResolveLevels=*/3,
+                                 TypeHierarchyDirection::Children, &Index,
+                                 testPath(TU.Filename));
+  EXPECT_EQ(Index.Queries, 3);
+  ASSERT_THAT(Result, SizeIs(1));
+  // D is reachable through A and B, and appears under both.
+  auto DUnder = [](const char *Base) {
+    return AllOf(withName(Base),
+                 children(AllOf(withName("D"),
+                                children(AllOf(withName("E"),
+                                               childrenNotResolved())))));
+  };
+  EXPECT_THAT(Result.front(),
+              AllOf(withName("Parent"), children(DUnder("A"), DUnder("B"))));
+}
+
 TEST(Standard, SubTypes) {
   Annotations Source(R"cpp(
 struct Pare^nt1 {};
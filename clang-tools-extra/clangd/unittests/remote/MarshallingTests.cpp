@@ -25,6 +25,7 @@
 #include "llvm/Support/Error.h"
 #include "llvm/Support/Path.h"
 #include "llvm/Support/StringSaver.h"
+#include "llvm/Testing/Support/Error.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 #include <cstring>
@@ -234,6 +235,82 @@ TEST(RemoteMarshallingTest, RefSerialization) {
   EXPECT_EQ(toYAML(Ref), toYAML(*Deserialized));
 }
 
+TEST(RemoteMarshallingTest, RefsBatchSerialization) {
+  llvm::BumpPtrAllocator Arena;
+  llvm::UniqueStringSaver Strings(Arena);
+  Marshaller ProtobufMarshaller(testPath("remote/llvm-project/"),
+                                testPath("home/llvm-project/"));
+
+  auto MakeRef = [&](llvm::StringRef File, uint32_t Line, uint32_t Column,
+                     uint32_t EndLine) {
+    clangd::Ref R;
+    R.Kind = clangd::RefKind::Reference;
+    R.Location.FileURI = testPathURI(("remote/llvm-project/" + File).str(),
+                                     Strings);
+    R.Location.Start.setLine(Line);
+    R.Location.Start.setColumn(Column);
+    R.Location.End.setLine(EndLine);
+    R.Location.End.setColumn(Column + 3);
+    R.Container = SymbolID::fromRaw(
+        std::string(SymbolID::RawSize, static_cast<char>(Line)));
+    return R;
+  };
+  std::vector<clangd::Ref> Refs = {MakeRef("a.h", 10, 4, 10),
+                                   MakeRef("b.h", 2, 0, 3),
+                                   MakeRef("a.h", 500, 100, 502)};
+  Refs[1].Kind = clangd::RefKind::Definition;
+
+  RefsBatchBuilder Builder(ProtobufMarshaller, /*WantContainer=*/true);
+  for (const auto &R : Refs)
+    ASSERT_THAT_ERROR(Builder.add(R), llvm::Succeeded());
+  EXPECT_EQ(Builder.size(), 3u);
+  RefsBatch Batch = Builder.take();
+  EXPECT_EQ(Builder.size(), 0u);
+  // Each file path is sent once.
+  EXPECT_THAT(Batch.file_paths(), testing::ElementsAre("a.h", "b.h"));
+  EXPECT_EQ(Batch.containers().size(), 3 * SymbolID::RawSize);
+
+  auto Deserialized = ProtobufMarshaller.fromProtobuf(Batch);
+  ASSERT_TRUE(bool(Deserialized));
+  ASSERT_EQ(Deserialized->size(), Refs.size());
+  for (size_t I = 0; I < Refs.size(); ++I) {
+    clangd::Ref Expected = Refs[I];
+    Expected.Location.FileURI = testPathURI(
+        ("home/llvm-project/" +
+         llvm::StringRef(Refs[I].Location.FileURI).rsplit('/').second)
+            .str(),
+        Strings);
+    EXPECT_EQ(toYAML(Expected), toYAML((*Deserialized)[I]));
+  }
+
+  // The next batch starts over.
+  ASSERT_THAT_ERROR(Builder.add(Refs[1]), llvm::Succeeded());
+  Batch = Builder.take();
+  EXPECT_THAT(Batch.file_paths(), testing::ElementsAre("b.h"));
+
+  // Containers are only sent when wanted.
+  RefsBatchBuilder NoContainers(ProtobufMarshaller, /*WantContainer=*/false);
+  ASSERT_THAT_ERROR(NoContainers.add(Refs[0]), llvm::Succeeded());
+  Batch = NoContainers.take();
+  EXPECT_FALSE(Batch.has_containers());
+  Deserialized = ProtobufMarshaller.fromProtobuf(Batch);
+  ASSERT_TRUE(bool(Deserialized));
+  ASSERT_EQ(Deserialized->size(), 1u);
+  EXPECT_FALSE(Deserialized->front().Container);
+
+  // Malformed batches are rejected.
+  Batch.add_files(0);
+  Deserialized = ProtobufMarshaller.fromProtobuf(Batch);
+  EXPECT_FALSE(bool(Deserialized));
+  llvm::consumeError(Deserialized.takeError());
+
+  // Refs outside of the index root can't be sent.
+  clangd::Ref Outside = MakeRef("a.h", 1, 1, 1);
+  Outside.Location.FileURI = testPathURI("elsewhere/a.h", Strings);
+  EXPECT_THAT_ERROR(NoContainers.add(Outside), llvm::Failed());
+  EXPECT_EQ(NoContainers.size(), 0u);
+}
+
 TEST(RemoteMarshallingTest, IncludeHeaderURIs) {
   llvm::BumpPtrAllocator Arena;
   llvm::UniqueStringSaver Strings(Arena);
@@ -324,11 +401,13 @@ TEST(RemoteMarshallingTest, FuzzyFindRequestSerialization) {
   Request.ProximityPaths = {testPath("local/Header.h"),
                             testPath("local/subdir/OtherHeader.h"),
                             testPath("remote/File.h"), "Not a Path."};
+  Request.ApproximateScope = "a::b::";
   Marshaller ProtobufMarshaller(testPath("remote/"), testPath("local/"));
   auto Serialized = ProtobufMarshaller.toProtobuf(Request);
   EXPECT_EQ(Serialized.proximity_paths_size(), 2);
   auto Deserialized = ProtobufMarshaller.fromProtobuf(&Serialized);
   ASSERT_TRUE(bool(Deserialized));
+  EXPECT_EQ(Deserialized->ApproximateScope, "a::b::");
   EXPECT_THAT(Deserialized->ProximityPaths,
               testing::ElementsAre(testPath("remote/Header.h"),
                                    testPath("remote/subdir/OtherHeader.h")));
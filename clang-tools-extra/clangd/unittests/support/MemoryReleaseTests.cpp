@@ -0,0 +1,82 @@
+//===-- MemoryReleaseTests.cpp ----------------------------------*- C++ -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#include "support/MemoryRelease.h"
+#include "support/TestTracer.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Process.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include <climits>
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+namespace clang {
+namespace clangd {
+namespace {
+using testing::IsEmpty;
+using testing::SizeIs;
+
+TEST(MemoryRelease, RecordsRetainedMemory) {
+  trace::TestTracer Tracer;
+  recordRetainedMemory();
+#ifdef __GLIBC__
+  EXPECT_THAT(Tracer.takeMetric("retained_memory"), SizeIs(1));
+#else
+  EXPECT_THAT(Tracer.takeMetric("retained_memory"), IsEmpty());
+#endif
+}
+
+TEST(MemoryRelease, MapLargeAllocationsTooLarge) {
+  EXPECT_FALSE(mapLargeAllocations(static_cast<size_t>(INT_MAX) + 1));
+}
+
+#if defined(__GLIBC__) && defined(__linux__)
+// Returns the resident set size of the process, or 0 if it can't be read.
+size_t residentMemory() {
+  auto Statm = llvm::MemoryBuffer::getFileAsStream("/proc/self/statm");
+  if (!Statm)
+    return 0;
+  size_t Pages = 0;
+  llvm::StringRef Resident =
+      (*Statm)->getBuffer().split(' ').second.split(' ').first;
+  if (Resident.getAsInteger(10, Pages))
+    return 0;
+  return Pages * llvm::sys::Process::getPageSizeEstimate();
+}
+
+TEST(MemoryRelease, MapLargeAllocations) {
+  ASSERT_TRUE(mapLargeAllocations(128 * 1024));
+
+  // Blocks larger than the free chunks earlier tests may have left in the
+  // heap, which would otherwise be reused.
+  constexpr size_t BlockSize = 16 << 20, Blocks = 4;
+  size_t Before = residentMemory();
+  ASSERT_NE(Before, 0u);
+  std::vector<std::unique_ptr<char[]>> Allocated;
+  for (size_t I = 0; I < Blocks; ++I) {
+    Allocated.emplace_back(new char[BlockSize]);
+    std::memset(Allocated.back().get(), 1, BlockSize);
+  }
+  // Keeps the top of the heap in use, so that heap blocks couldn't be
+  // released by trimming its top either.
+  Allocated.emplace_back(new char[64]);
+  size_t Peak = residentMemory();
+  ASSERT_GE(Peak, Before + Blocks * BlockSize * 3 / 4);
+  Allocated.erase(Allocated.begin(), Allocated.begin() + Blocks);
+  // Mapped blocks are returned to the OS right away.
+  EXPECT_LE(residentMemory(), Peak - Blocks * BlockSize * 3 / 4);
+}
+#endif
+
+} // namespace
+} // namespace clangd
+} // namespace clang
@@ -6,7 +6,11 @@
 //
 //===----------------------------------------------------------------------===//
 
+#include "Annotations.h"
+#include "Config.h"
 #include "TestFS.h"
+#include "SourceCode.h"
+#include "TestTU.h"
 #include "refactor/Tweak.h"
 #include "clang/Basic/Diagnostic.h"
 #include "clang/Basic/DiagnosticIDs.h"
@@ -56,6 +60,97 @@ TEST(FileEdits, AbsolutePath) {
   }
 }
 
+TEST(PrepareTweaks, Cached) {
+  Annotations Code(R"cpp(
+    void f(int x) {
+      [[if (x) { x = 1 + 2; } else { x = 3; }]]
+      auto y = "$point^foo\n";
+    }
+  )cpp");
+  auto AST = TestTU::withCode(Code.code()).build();
+  auto Tweaks = [&](unsigned Begin, unsigned End) {
+    unsigned Built = 0;
+    auto Selections = [&] {
+      ++Built;
+      std::vector<std::unique_ptr<Tweak::Selection>> Result;
+      SelectionTree::createEach(
+          AST.getASTContext(), AST.getTokens(), Begin, End,
+          [&](SelectionTree T) {
+            Result.push_back(std::make_unique<Tweak::Selection>(
+                nullptr, AST, Begin, End, std::move(T), nullptr));
+            return false;
+          });
+      return Result;
+    };
+    auto All = [](const Tweak &) { return true; };
+    // The uncached results, as enumerated on each selection.
+    std::vector<std::string> Expected;
+    for (const auto &S : Selections())
+      for (const auto &T : prepareTweaks(*S, All, nullptr))
+        if (!llvm::is_contained(Expected, T->id()))
+          Expected.push_back(T->id());
+
+    std::vector<std::string> First, Second;
+    for (const auto &T : prepareTweaks(AST, Begin, End, Selections, All,
+                                       nullptr))
+      First.push_back(T.ID);
+    EXPECT_EQ(Built, 2u);
+    for (const auto &T : prepareTweaks(AST, Begin, End, Selections, All,
+                                       nullptr))
+      Second.push_back(T.ID);
+    EXPECT_EQ(Built, 2u) << "Selections rebuilt for a cached range";
+    EXPECT_EQ(First, Expected);
+    EXPECT_EQ(Second, Expected);
+    return First;
+  };
+
+  auto Range = Code.range();
+  auto Begin = cantFail(positionToOffset(Code.code(), Range.start));
+  auto End = cantFail(positionToOffset(Code.code(), Range.end));
+  auto OnIf = Tweaks(Begin, End);
+  EXPECT_THAT(OnIf, ::testing::Contains("SwapIfBranches"));
+  EXPECT_THAT(OnIf, ::testing::Not(::testing::Contains("RawStringLiteral")));
+  unsigned Point = Code.point("point");
+  EXPECT_THAT(Tweaks(Point, Point), ::testing::Contains("RawStringLiteral"));
+}
+
+TEST(PrepareTweaks, CachedDroppedOnConfigChange) {
+  Annotations Code(R"cpp(
+    namespace ban { void foo(); }
+    void f() { ban::f^oo(); }
+  )cpp");
+  auto AST = TestTU::withCode(Code.code()).build();
+  unsigned Point = Code.point();
+  auto Tweaks = [&] {
+    auto Selections = [&] {
+      std::vector<std::unique_ptr<Tweak::Selection>> Result;
+      SelectionTree::createEach(
+          AST.getASTContext(), AST.getTokens(), Point, Point,
+          [&](SelectionTree T) {
+            Result.push_back(std::make_unique<Tweak::Selection>(
+                nullptr, AST, Point, Point, std::move(T), nullptr));
+            return false;
+          });
+      return Result;
+    };
+    std::vector<std::string> IDs;
+    for (const auto &T :
+         prepareTweaks(AST, Point, Point, Selections,
+                       [](const Tweak &) { return true; }, nullptr))
+      IDs.push_back(T.ID);
+    return IDs;
+  };
+
+  EXPECT_THAT(Tweaks(), ::testing::Contains("AddUsing"));
+  {
+    Config Cfg;
+    Cfg.Style.FullyQualifiedNamespaces.push_back("ban");
+    WithContextValue WithConfig(Config::Key, std::move(Cfg));
+    EXPECT_THAT(Tweaks(), ::testing::Not(::testing::Contains("AddUsing")));
+  }
+  EXPECT_THAT(Tweaks(), ::testing::Contains("AddUsing"));
+}
+
 } // namespace
 } // namespace clangd
 } // namespace clang
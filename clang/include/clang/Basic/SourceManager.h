@@ -701,6 +701,18 @@ class SourceManager : public RefCountedBase<SourceManager> {
   /// use (-ID - 2).
   SmallVector<SrcMgr::SLocEntry, 0> LoadedSLocEntryTable;
 
+  /// The starting offsets of the entries in LocalSLocEntryTable.
+  ///
+  /// This mirrors LocalSLocEntryTable so that the searches in getFileIDLocal
+  /// walk a dense array of offsets instead of the much larger SLocEntries.
+  SmallVector<SourceLocation::UIntTy, 0> LocalSLocOffsetTable;
+
+  /// The starting offsets of the entries in LoadedSLocEntryTable.
+  ///
+  /// Same indexing as LoadedSLocEntryTable. An offset is only meaningful once
+  /// the corresponding bit in SLocEntryLoaded is set.
+  SmallVector<SourceLocation::UIntTy, 0> LoadedSLocOffsetTable;
+
   /// The starting offset of the next local SLocEntry.
   ///
   /// This is LocalSLocEntryTable.back().Offset + the size of that entry.
@@ -732,6 +744,24 @@ class SourceManager : public RefCountedBase<SourceManager> {
   /// is very common to look up many tokens from the same file.
   mutable FileID LastFileIDLookup;
 
+  /// A small round-robin cache of FileIDs found by getFileIDSlow.
+  ///
+  /// Clients often alternate between a handful of files and macro expansions
+  /// (e.g. the main file and a few headers), which defeats the one-entry
+  /// cache above. This is consulted before searching the SLocEntry tables.
+  ///
+  /// Each slot keeps the [Begin, End) offsets of its entry, so that scanning
+  /// the cache doesn't touch the SLocEntry tables (nor load entries). Empty
+  /// slots have an empty range.
+  struct FileIDLookupCacheEntry {
+    FileID FID;
+    SourceLocation::UIntTy Begin = 0;
+    SourceLocation::UIntTy End = 0;
+  };
+  static constexpr unsigned FileIDLookupCacheSize = 8;
+  mutable FileIDLookupCacheEntry FileIDLookupCache[FileIDLookupCacheSize];
+  mutable unsigned NextFileIDLookupCacheSlot = 0;
+
   /// Holds information for \#line directives.
   ///
   /// This is referenced by indices from SLocEntryTable.
@@ -753,6 +783,7 @@ class SourceManager : public RefCountedBase<SourceManager> {
   // Statistics for -print-stats.
   mutable unsigned NumLinearScans = 0;
   mutable unsigned NumBinaryProbes = 0;
+  mutable unsigned NumFileIDCacheHits = 0;
 
   /// Associates a FileID with its "included/expanded in" decomposed
   /// location.
@@ -1896,6 +1927,15 @@ private:
   FileID getFileIDLocal(SourceLocation::UIntTy SLocOffset) const;
   FileID getFileIDLoaded(SourceLocation::UIntTy SLocOffset) const;
 
+  /// Get the starting offset of the loaded SLocEntry at \p Index, loading the
+  /// entry from the external source if needed.
+  SourceLocation::UIntTy getLoadedSLocOffset(unsigned Index,
+                                             bool *Invalid = nullptr) const {
+    if (SLocEntryLoaded[Index])
+      return LoadedSLocOffsetTable[Index];
+    return loadSLocEntry(Index, Invalid).getOffset();
+  }
+
   SourceLocation getExpansionLocSlowCase(SourceLocation Loc) const;
   SourceLocation getSpellingLocSlowCase(SourceLocation Loc) const;
   SourceLocation getFileLocSlowCase(SourceLocation Loc) const;
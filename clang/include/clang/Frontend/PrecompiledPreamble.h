@@ -237,6 +237,12 @@ public:
   /// Only used if FrontendOpts::SkipFunctionBodies is true.
   /// See ASTConsumer::shouldSkipFunctionBody.
   virtual bool shouldSkipFunctionBody(Decl *D) { return true; }
+  /// Returning true stops the build, which fails with
+  /// BuildPreambleError::Aborted. Can be used to give up on preambles that are
+  /// no longer needed. Only polled after each top-level declaration and once
+  /// before the ASTWriter runs, so neither a long declaration nor the
+  /// serialization is interrupted.
+  virtual bool shouldAbort() { return false; }
 };
 
 enum class BuildPreambleError {
@@ -244,7 +250,8 @@ enum class BuildPreambleError {
   CouldntCreateTargetInfo,
   BeginSourceFileFailed,
   CouldntEmitPCH,
-  BadInputs
+  BadInputs,
+  Aborted
 };
 
 class BuildPreambleErrorCategory final : public std::error_category {
@@ -38,7 +38,9 @@
 #include "llvm/Support/Compiler.h"
 #include "llvm/Support/raw_ostream.h"
 #include <cstdint>
+#include <optional>
 #include <tuple>
+#include <vector>
 
 namespace clang {
 class Preprocessor;
@@ -195,6 +197,9 @@ public:
   /// Creates an index only once. Further calls to it will be no-op.
   void indexExpandedTokens();
 
+  /// Estimated memory used by the buffer, in bytes.
+  size_t getMemoryUsage() const;
+
   /// Returns the subrange of expandedTokens() corresponding to the closed
   /// token range R.
   /// Consider calling indexExpandedTokens() before for faster lookups.
@@ -411,6 +416,36 @@ std::vector<syntax::Token> tokenize(FileID FID, const SourceManager &SM,
 std::vector<syntax::Token>
 tokenize(const FileRange &FR, const SourceManager &SM, const LangOptions &LO);
 
+/// A compact record of a preprocessor run, from which the TokenBuffer can be
+/// built later, or not at all if it's never needed.
+///
+/// Only the location and kind of each expanded token are stored. Token lengths
+/// are recovered by re-lexing the token spellings, and the spelled tokens and
+/// mappings are computed by build(). The SourceManager must be kept alive until
+/// then, as the log refers to its macro expansions.
+class TokenLog {
+public:
+  TokenLog() = default;
+
+  /// Builds the same TokenBuffer that TokenCollector::consume() would have.
+  /// \p SM and \p LangOpts must be the ones the log was recorded with.
+  [[nodiscard]] TokenBuffer build(const SourceManager &SM,
+                                  const LangOptions &LangOpts) &&;
+
+  /// Number of expanded tokens in the log, including the final 'eof'.
+  size_t size() const { return Locations.size(); }
+  /// Estimated memory used by the log, in bytes.
+  size_t getMemoryUsage() const;
+
+private:
+  friend class TokenCollector;
+
+  std::vector<SourceLocation> Locations;
+  std::vector<tok::TokenKind> Kinds;
+  /// Top-level macro expansions, see TokenCollector::PPExpansions.
+  llvm::DenseMap<SourceLocation, SourceLocation> Expansions;
+};
+
 /// Collects tokens for the main file while running the frontend action. An
 /// instance of this object should be created on
 /// FrontendAction::BeginSourceFile() and the results should be consumed after
@@ -420,11 +455,16 @@ public:
   /// Adds the hooks to collect the tokens. Should be called before the
   /// preprocessing starts, i.e. as a part of BeginSourceFile() or
   /// CreateASTConsumer().
-  TokenCollector(Preprocessor &P);
+  /// If \p RecordLog is true, only a TokenLog is recorded while preprocessing,
+  /// which is cheaper if the TokenBuffer is built lazily, see consumeLog().
+  TokenCollector(Preprocessor &P, bool RecordLog = false);
 
   /// Finalizes token collection. Should be called after preprocessing is
   /// finished, i.e. after running Execute().
   [[nodiscard]] TokenBuffer consume() &&;
+  /// Like consume(), but defers building the TokenBuffer to TokenLog::build().
+  /// EXPECTS: the collector was created with RecordLog.
+  [[nodiscard]] TokenLog consumeLog() &&;
 
 private:
   /// Maps from a start to an end spelling location of transformations
@@ -447,8 +487,11 @@ private:
   using PPExpansions = llvm::DenseMap<SourceLocation, SourceLocation>;
   class Builder;
   class CollectPPExpansions;
+  friend class TokenLog;
 
   std::vector<syntax::Token> Expanded;
+  /// Used instead of Expanded if the collector records a log.
+  std::optional<TokenLog> Log;
   // FIXME: we only store macro expansions, also add directives(#pragma, etc.)
   PPExpansions Expansions;
   Preprocessor &PP;
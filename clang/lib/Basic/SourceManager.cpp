@@ -337,10 +337,15 @@ void SourceManager::clearIDTables() {
   MainFileID = FileID();
   LocalSLocEntryTable.clear();
   LoadedSLocEntryTable.clear();
+  LocalSLocOffsetTable.clear();
+  LoadedSLocOffsetTable.clear();
   SLocEntryLoaded.clear();
   LastLineNoFileIDQuery = FileID();
   LastLineNoContentCache = nullptr;
   LastFileIDLookup = FileID();
+  std::fill(std::begin(FileIDLookupCache), std::end(FileIDLookupCache),
+            FileIDLookupCacheEntry());
+  NextFileIDLookupCacheSlot = 0;
 
   if (LineTable)
     LineTable->clear();
@@ -459,6 +464,7 @@ SourceManager::AllocateLoadedSLocEntries(unsigned NumSLocEntries,
     return std::make_pair(0, 0);
   }
   LoadedSLocEntryTable.resize(LoadedSLocEntryTable.size() + NumSLocEntries);
+  LoadedSLocOffsetTable.resize(LoadedSLocEntryTable.size());
   SLocEntryLoaded.resize(LoadedSLocEntryTable.size());
   CurrentLoadedOffset -= TotalSize;
   int ID = LoadedSLocEntryTable.size();
@@ -608,6 +614,7 @@ FileID SourceManager::createFileIDImpl(ContentCache &File, StringRef Filename,
     assert(!SLocEntryLoaded[Index] && "FileID already loaded");
     LoadedSLocEntryTable[Index] = SLocEntry::get(
         LoadedOffset, FileInfo::get(IncludePos, File, FileCharacter, Filename));
+    LoadedSLocOffsetTable[Index] = LoadedOffset;
     SLocEntryLoaded[Index] = true;
     return FileID::get(LoadedID);
   }
@@ -621,6 +628,7 @@ FileID SourceManager::createFileIDImpl(ContentCache &File, StringRef Filename,
   LocalSLocEntryTable.push_back(
       SLocEntry::get(NextLocalOffset,
                      FileInfo::get(IncludePos, File, FileCharacter, Filename)));
+  LocalSLocOffsetTable.push_back(NextLocalOffset);
   // We do a +1 here because we want a SourceLocation that means "the end of the
   // file", e.g. for the "no newline at the end of the file" diagnostic.
   NextLocalOffset += FileSize + 1;
@@ -668,10 +676,12 @@ SourceManager::createExpansionLocImpl(const ExpansionInfo &Info,
     assert(Index < LoadedSLocEntryTable.size() && "FileID out of range");
     assert(!SLocEntryLoaded[Index] && "FileID already loaded");
     LoadedSLocEntryTable[Index] = SLocEntry::get(LoadedOffset, Info);
+    LoadedSLocOffsetTable[Index] = LoadedOffset;
     SLocEntryLoaded[Index] = true;
     return SourceLocation::getMacroLoc(LoadedOffset);
   }
   LocalSLocEntryTable.push_back(SLocEntry::get(NextLocalOffset, Info));
+  LocalSLocOffsetTable.push_back(NextLocalOffset);
   // FIXME: Produce a proper diagnostic for this case.
   assert(NextLocalOffset + Length + 1 > NextLocalOffset &&
          NextLocalOffset + Length + 1 <= CurrentLoadedOffset &&
@@ -772,11 +782,46 @@ FileID SourceManager::getFileIDSlow(SourceLocation::UIntTy SLocOffset) const {
   if (!SLocOffset)
     return FileID::get(0);
 
+  // Before searching the tables, see whether one of the recently found FileIDs
+  // contains the offset.
+  for (const FileIDLookupCacheEntry &Entry : FileIDLookupCache) {
+    if (Entry.Begin <= SLocOffset && SLocOffset < Entry.End) {
+      ++NumFileIDCacheHits;
+      return LastFileIDLookup = Entry.FID;
+    }
+  }
+
   // Now it is time to search for the correct file. See where the SLocOffset
   // sits in the global view and consult local or loaded buffers for it.
-  if (SLocOffset < NextLocalOffset)
-    return getFileIDLocal(SLocOffset);
-  return getFileIDLoaded(SLocOffset);
+  FileID Res = SLocOffset < NextLocalOffset ? getFileIDLocal(SLocOffset)
+                                            : getFileIDLoaded(SLocOffset);
+  if (!Res.isValid())
+    return Res;
+
+  // The range of an entry ends where the next one in offset order starts. The
+  // last local entry ends at NextLocalOffset, which is also where the next
+  // local entry will start, so the range stays valid as entries are added.
+  FileIDLookupCacheEntry Entry;
+  Entry.FID = Res;
+  bool Invalid = false;
+  if (Res.ID >= 0) {
+    unsigned Index = Res.ID;
+    Entry.Begin = LocalSLocOffsetTable[Index];
+    Entry.End = Index + 1 < LocalSLocOffsetTable.size()
+                    ? LocalSLocOffsetTable[Index + 1]
+                    : NextLocalOffset;
+  } else {
+    unsigned Index = -Res.ID - 2;
+    Entry.Begin = LoadedSLocOffsetTable[Index];
+    Entry.End =
+        Index == 0 ? MaxLoadedOffset : getLoadedSLocOffset(Index - 1, &Invalid);
+  }
+  if (!Invalid) {
+    FileIDLookupCache[NextFileIDLookupCacheSlot] = Entry;
+    NextFileIDLookupCacheSlot =
+        (NextFileIDLookupCacheSlot + 1) % FileIDLookupCacheSize;
+  }
+  return Res;
 }
 
 /// Return the FileID for a SourceLocation with a low offset.
@@ -803,10 +848,10 @@ FileID SourceManager::getFileIDLocal(SourceLocation::UIntTy SLocOffset) const {
   // SLocOffset.
   unsigned LessIndex = 0;
   // upper bound of the search range.
-  unsigned GreaterIndex = LocalSLocEntryTable.size();
+  unsigned GreaterIndex = LocalSLocOffsetTable.size();
   if (LastFileIDLookup.ID >= 0) {
     // Use the LastFileIDLookup to prune the search space.
-    if (LocalSLocEntryTable[LastFileIDLookup.ID].getOffset() < SLocOffset)
+    if (LocalSLocOffsetTable[LastFileIDLookup.ID] < SLocOffset)
       LessIndex = LastFileIDLookup.ID;
     else
       GreaterIndex = LastFileIDLookup.ID;
@@ -816,8 +861,8 @@ FileID SourceManager::getFileIDLocal(SourceLocation::UIntTy SLocOffset) const {
   unsigned NumProbes = 0;
   while (true) {
     --GreaterIndex;
-    assert(GreaterIndex < LocalSLocEntryTable.size());
-    if (LocalSLocEntryTable[GreaterIndex].getOffset() <= SLocOffset) {
+    assert(GreaterIndex < LocalSLocOffsetTable.size());
+    if (LocalSLocOffsetTable[GreaterIndex] <= SLocOffset) {
       FileID Res = FileID::get(int(GreaterIndex));
       // Remember it.  We have good locality across FileID lookups.
       LastFileIDLookup = Res;
@@ -831,8 +876,7 @@ FileID SourceManager::getFileIDLocal(SourceLocation::UIntTy SLocOffset) const {
   NumProbes = 0;
   while (true) {
     unsigned MiddleIndex = (GreaterIndex-LessIndex)/2+LessIndex;
-    SourceLocation::UIntTy MidOffset =
-        getLocalSLocEntry(MiddleIndex).getOffset();
+    SourceLocation::UIntTy MidOffset = LocalSLocOffsetTable[MiddleIndex];
 
     ++NumProbes;
 
@@ -844,8 +888,8 @@ FileID SourceManager::getFileIDLocal(SourceLocation::UIntTy SLocOffset) const {
     }
 
     // If the middle index contains the value, succeed and return.
-    if (MiddleIndex + 1 == LocalSLocEntryTable.size() ||
-        SLocOffset < getLocalSLocEntry(MiddleIndex + 1).getOffset()) {
+    if (MiddleIndex + 1 == LocalSLocOffsetTable.size() ||
+        SLocOffset < LocalSLocOffsetTable[MiddleIndex + 1]) {
       FileID Res = FileID::get(MiddleIndex);
 
       // Remember it.  We have good locality across FileID lookups.
@@ -878,7 +922,7 @@ FileID SourceManager::getFileIDLoaded(SourceLocation::UIntTy SLocOffset) const {
   if (LastFileIDLookup.ID < 0) {
     // Prune the search space.
     int LastID = LastFileIDLookup.ID;
-    if (getLoadedSLocEntryByID(LastID).getOffset() > SLocOffset)
+    if (getLoadedSLocOffset(-LastID - 2) > SLocOffset)
       GreaterIndex =
           (-LastID - 2) + 1; // Exclude LastID, else we would have hit the cache
     else
@@ -890,10 +934,10 @@ FileID SourceManager::getFileIDLoaded(SourceLocation::UIntTy SLocOffset) const {
   bool Invalid = false;
   for (NumProbes = 0; NumProbes < 8; ++NumProbes, ++GreaterIndex) {
     // Make sure the entry is loaded!
-    const SrcMgr::SLocEntry &E = getLoadedSLocEntry(GreaterIndex, &Invalid);
+    SourceLocation::UIntTy Offset = getLoadedSLocOffset(GreaterIndex, &Invalid);
     if (Invalid)
       return FileID(); // invalid entry.
-    if (E.getOffset() <= SLocOffset) {
+    if (Offset <= SLocOffset) {
       FileID Res = FileID::get(-int(GreaterIndex) - 2);
       LastFileIDLookup = Res;
       NumLinearScans += NumProbes + 1;
@@ -906,11 +950,12 @@ FileID SourceManager::getFileIDLoaded(SourceLocation::UIntTy SLocOffset) const {
   while (true) {
     ++NumProbes;
     unsigned MiddleIndex = (LessIndex - GreaterIndex) / 2 + GreaterIndex;
-    const SrcMgr::SLocEntry &E = getLoadedSLocEntry(MiddleIndex, &Invalid);
+    SourceLocation::UIntTy MidOffset =
+        getLoadedSLocOffset(MiddleIndex, &Invalid);
     if (Invalid)
       return FileID(); // invalid entry.
 
-    if (E.getOffset() > SLocOffset) {
+    if (MidOffset > SLocOffset) {
       if (GreaterIndex == MiddleIndex) {
         assert(0 && "binary search missed the entry");
         return FileID();
@@ -2174,7 +2219,8 @@ void SourceManager::PrintStats() const {
                << NumLineNumsComputed << " files with line #'s computed, "
                << NumMacroArgsComputed << " files with macro args computed.\n";
   llvm::errs() << "FileID scans: " << NumLinearScans << " linear, "
-               << NumBinaryProbes << " binary.\n";
+               << NumBinaryProbes << " binary, " << NumFileIDCacheHits
+               << " cache hits.\n";
 }
 
 LLVM_DUMP_METHOD void SourceManager::dump() const {
@@ -2347,6 +2393,8 @@ size_t SourceManager::getDataStructureSizes() const {
   size_t size = llvm::capacity_in_bytes(MemBufferInfos)
     + llvm::capacity_in_bytes(LocalSLocEntryTable)
     + llvm::capacity_in_bytes(LoadedSLocEntryTable)
+    + llvm::capacity_in_bytes(LocalSLocOffsetTable)
+    + llvm::capacity_in_bytes(LoadedSLocOffsetTable)
     + llvm::capacity_in_bytes(SLocEntryLoaded)
     + llvm::capacity_in_bytes(FileInfos);
 
@@ -1409,6 +1409,7 @@ ASTUnit::getMainBufferWithPrecompiledPreamble(
     } else {
       switch (static_cast<BuildPreambleError>(NewPreamble.getError().value())) {
       case BuildPreambleError::CouldntCreateTempFile:
+      case BuildPreambleError::Aborted:
         // Try again next time.
         PreambleRebuildCountdown = 1;
         return nullptr;
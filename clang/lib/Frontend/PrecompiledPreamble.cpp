@@ -256,6 +256,14 @@ public:
 
   bool hasEmittedPreamblePCH() const { return HasEmittedPreamblePCH; }
 
+  /// Polls PreambleCallbacks::shouldAbort(). Once it returned true, the build
+  /// stays aborted.
+  bool shouldAbort() {
+    Aborted = Aborted || Callbacks.shouldAbort();
+    return Aborted;
+  }
+  bool wasAborted() const { return Aborted; }
+
   void setEmittedPreamblePCH(ASTWriter &Writer) {
     if (FileOS) {
       *FileOS << Buffer->Data;
@@ -281,6 +289,7 @@ private:
   friend class PrecompilePreambleConsumer;
 
   bool HasEmittedPreamblePCH = false;
+  bool Aborted = false;
   std::shared_ptr<PCHBuffer> Buffer;
   bool WritePCHFile; // otherwise the PCH is written into the PCHBuffer only.
   std::unique_ptr<llvm::raw_pwrite_stream> FileOS; // null if in-memory
@@ -301,10 +310,13 @@ public:
 
   bool HandleTopLevelDecl(DeclGroupRef DG) override {
     Action.Callbacks.HandleTopLevelDecl(DG);
-    return true;
+    // Returning false stops the parser.
+    return !Action.shouldAbort();
   }
 
   void HandleTranslationUnit(ASTContext &Ctx) override {
+    if (Action.shouldAbort())
+      return;
     PCHGenerator::HandleTranslationUnit(Ctx);
     if (!hasEmittedPCH())
       return;
@@ -535,6 +547,12 @@ llvm::ErrorOr<PrecompiledPreamble> PrecompiledPreamble::Build(
   if (llvm::Error Err = Act->Execute())
     return errorToErrorCode(std::move(Err));
 
+  // The AST is incomplete, don't show it to the callbacks.
+  if (Act->wasAborted()) {
+    Act->EndSourceFile();
+    return BuildPreambleError::Aborted;
+  }
+
   // Run the callbacks.
   Callbacks.AfterExecute(*Clang);
 
@@ -852,6 +870,8 @@ std::string BuildPreambleErrorCategory::message(int condition) const {
     return "Could not emit PCH";
   case BuildPreambleError::BadInputs:
     return "Command line arguments must contain exactly one source file";
+  case BuildPreambleError::Aborted:
+    return "Preamble build was aborted";
   }
   llvm_unreachable("unexpected BuildPreambleError");
 }
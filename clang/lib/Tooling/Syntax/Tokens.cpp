@@ -14,6 +14,7 @@
 #include "clang/Basic/SourceLocation.h"
 #include "clang/Basic/SourceManager.h"
 #include "clang/Basic/TokenKinds.h"
+#include "clang/Lex/Lexer.h"
 #include "clang/Lex/PPCallbacks.h"
 #include "clang/Lex/Preprocessor.h"
 #include "clang/Lex/Token.h"
@@ -725,11 +726,18 @@ private:
 ///          - skipped pp regions,
 ///          - ...
 
-TokenCollector::TokenCollector(Preprocessor &PP) : PP(PP) {
+TokenCollector::TokenCollector(Preprocessor &PP, bool RecordLog) : PP(PP) {
+  if (RecordLog)
+    Log.emplace();
   // Collect the expanded token stream during preprocessing.
   PP.setTokenWatcher([this](const clang::Token &T) {
     if (T.isAnnotation())
       return;
+    if (Log) {
+      Log->Locations.push_back(T.getLocation());
+      Log->Kinds.push_back(T.getKind());
+      return;
+    }
     DEBUG_WITH_TYPE("collect-tokens", llvm::dbgs()
                                           << "Token: "
                                           << syntax::Token(T).dumpForTests(
@@ -938,6 +946,9 @@ private:
 };
 
 TokenBuffer TokenCollector::consume() && {
+  if (Log)
+    return std::move(*this).consumeLog().build(PP.getSourceManager(),
+                                               PP.getLangOpts());
   PP.setTokenWatcher(nullptr);
   Collector->disable();
   return Builder(std::move(Expanded), std::move(Expansions),
@@ -945,6 +956,51 @@ TokenBuffer TokenCollector::consume() && {
       .build();
 }
 
+TokenLog TokenCollector::consumeLog() && {
+  assert(Log && "TokenCollector doesn't record a log");
+  PP.setTokenWatcher(nullptr);
+  Collector->disable();
+  TokenLog Result = std::move(*Log);
+  Result.Expansions = std::move(Expansions);
+  return Result;
+}
+
+TokenBuffer TokenLog::build(const SourceManager &SM,
+                            const LangOptions &LangOpts) && {
+  std::vector<syntax::Token> Expanded;
+  Expanded.reserve(Locations.size());
+  for (unsigned I = 0; I < Locations.size(); ++I) {
+    // The preprocessor lexed each token from its spelling, so lexing it again
+    // from there yields the same length. Tokens formed by the preprocessor
+    // (pasting, stringizing, builtin macros) are spelled in the scratch buffer.
+    unsigned Length = Kinds[I] == tok::eof
+                          ? 0
+                          : Lexer::MeasureTokenLength(
+                                SM.getSpellingLoc(Locations[I]), SM, LangOpts);
+    Expanded.emplace_back(Locations[I], Length, Kinds[I]);
+  }
+  Locations.clear();
+  Kinds.clear();
+  return TokenCollector::Builder(std::move(Expanded), std::move(Expansions), SM,
+                                 LangOpts)
+      .build();
+}
+
+size_t TokenBuffer::getMemoryUsage() const {
+  size_t Total = ExpandedTokens.capacity() * sizeof(syntax::Token) +
+                 ExpandedTokIndex.getMemorySize() + Files.getMemorySize();
+  for (const auto &F : Files)
+    Total += F.second.SpelledTokens.capacity() * sizeof(syntax::Token) +
+             F.second.Mappings.capacity() * sizeof(Mapping);
+  return Total;
+}
+
+size_t TokenLog::getMemoryUsage() const {
+  return Locations.capacity() * sizeof(SourceLocation) +
+         Kinds.capacity() * sizeof(tok::TokenKind) +
+         Expansions.getMemorySize();
+}
+
 std::string syntax::Token::str() const {
   return std::string(llvm::formatv("Token({0}, length = {1})",
                                    tok::getTokenName(kind()), length()));
@@ -409,6 +409,89 @@ TEST_F(SourceManagerTest, getLineNumber) {
   ASSERT_NO_FATAL_FAILURE(SourceMgr.getLineNumber(mainFileID, 1, nullptr));
 }
 
+TEST_F(SourceManagerTest, getFileIDManyEntries) {
+  // Create enough local entries that lookups in a scrambled order miss the
+  // lookup caches and go through the linear and binary searches.
+  const unsigned NumFiles = 300;
+  std::vector<FileID> Files;
+  for (unsigned I = 0; I != NumFiles; ++I) {
+    std::string Contents(I % 17 + 1, 'x');
+    FileID FID = SourceMgr.createFileID(
+        llvm::MemoryBuffer::getMemBufferCopy(Contents));
+    ASSERT_TRUE(FID.isValid());
+    Files.push_back(FID);
+    // Interleave macro expansions, which also occupy local entries.
+    SourceLocation Start = SourceMgr.getLocForStartOfFile(FID);
+    SourceMgr.createExpansionLoc(Start, Start, Start, 1);
+  }
+
+  for (unsigned Round = 0; Round != 3; ++Round) {
+    for (unsigned I = 0; I != NumFiles; ++I) {
+      FileID FID = Files[(I * 37 + Round * 101) % NumFiles];
+      SourceLocation Start = SourceMgr.getLocForStartOfFile(FID);
+      unsigned Size = SourceMgr.getFileIDSize(FID);
+      for (unsigned Offset = 0; Offset <= Size; ++Offset)
+        EXPECT_EQ(FID, SourceMgr.getFileID(Start.getLocWithOffset(Offset)));
+    }
+  }
+}
+
+TEST_F(SourceManagerTest, getFileIDManyLoadedEntries) {
+  FileID MainFID = SourceMgr.createFileID(
+      llvm::MemoryBuffer::getMemBufferCopy("int x;\n"));
+  SourceMgr.setMainFileID(MainFID);
+  SourceLocation MainLoc = SourceMgr.getLocForStartOfFile(MainFID);
+
+  // Two blocks of loaded files, each followed by a macro expansion. The first
+  // block holds the entry with the highest offset (FileID -2).
+  const unsigned NumBlocks = 2, FilesPerBlock = 150;
+  std::vector<FileID> Files;
+  std::vector<SourceLocation> Expansions;
+  for (unsigned Block = 0; Block != NumBlocks; ++Block) {
+    SourceLocation::UIntTy TotalSize = 0;
+    for (unsigned I = 0; I != FilesPerBlock; ++I)
+      TotalSize += (I % 17 + 1) + 1 + /*expansion=*/2;
+    auto [FirstID, Offset] =
+        SourceMgr.AllocateLoadedSLocEntries(2 * FilesPerBlock, TotalSize);
+    ASSERT_NE(FirstID, 0);
+    // Entries with higher IDs have higher offsets.
+    int ID = FirstID;
+    for (unsigned I = 0; I != FilesPerBlock; ++I) {
+      std::string Contents(I % 17 + 1, 'x');
+      FileID FID = SourceMgr.createFileID(
+          llvm::MemoryBuffer::getMemBufferCopy(Contents), SrcMgr::C_User, ID++,
+          Offset);
+      ASSERT_TRUE(FID.isValid());
+      Files.push_back(FID);
+      Offset += Contents.size() + 1;
+      Expansions.push_back(SourceMgr.createExpansionLoc(
+          MainLoc, MainLoc, MainLoc, 1, true, ID++, Offset));
+      Offset += 2;
+    }
+  }
+
+  // Alternate between loaded entries in a scrambled order and the main file,
+  // so that lookups both hit and miss the lookup caches.
+  for (unsigned Round = 0; Round != 3; ++Round) {
+    for (unsigned I = 0; I != Files.size(); ++I) {
+      unsigned Index = (I * 37 + Round * 101) % Files.size();
+      FileID FID = Files[Index];
+      SourceLocation Start = SourceMgr.getLocForStartOfFile(FID);
+      unsigned Size = SourceMgr.getFileIDSize(FID);
+      for (unsigned Offset = 0; Offset <= Size; ++Offset)
+        EXPECT_EQ(FID, SourceMgr.getFileID(Start.getLocWithOffset(Offset)));
+      EXPECT_EQ(MainFID, SourceMgr.getFileID(MainLoc.getLocWithOffset(I % 7)));
+
+      SourceLocation Expansion = Expansions[Index];
+      FileID ExpansionFID = SourceMgr.getFileID(Expansion);
+      EXPECT_TRUE(SourceMgr.getSLocEntry(ExpansionFID).isExpansion());
+      EXPECT_EQ(ExpansionFID,
+                SourceMgr.getFileID(Expansion.getLocWithOffset(1)));
+      EXPECT_NE(FID, ExpansionFID);
+    }
+  }
+}
+
 #if defined(LLVM_ON_UNIX)
 
 TEST_F(SourceManagerTest, getMacroArgExpandedLocation) {
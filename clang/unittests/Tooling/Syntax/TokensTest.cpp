@@ -94,11 +94,12 @@ public:
   void recordTokens(llvm::StringRef Code) {
     class RecordTokens : public ASTFrontendAction {
     public:
-      explicit RecordTokens(TokenBuffer &Result) : Result(Result) {}
+      RecordTokens(TokenBuffer &Result, bool RecordLog)
+          : Result(Result), RecordLog(RecordLog) {}
 
       bool BeginSourceFileAction(CompilerInstance &CI) override {
         assert(!Collector && "expected only a single call to BeginSourceFile");
-        Collector.emplace(CI.getPreprocessor());
+        Collector.emplace(CI.getPreprocessor(), RecordLog);
         return true;
       }
       void EndSourceFileAction() override {
@@ -114,6 +115,7 @@ public:
 
     private:
       TokenBuffer &Result;
+      bool RecordLog;
       std::optional<TokenCollector> Collector;
     };
 
@@ -139,7 +141,7 @@ public:
     Compiler.setSourceManager(SourceMgr.get());
 
     this->Buffer = TokenBuffer(*SourceMgr);
-    RecordTokens Recorder(this->Buffer);
+    RecordTokens Recorder(this->Buffer, RecordLog);
     ASSERT_TRUE(Compiler.ExecuteAction(Recorder))
         << "failed to run the frontend";
   }
@@ -259,6 +261,8 @@ public:
       new SourceManager(*Diags, *FileMgr);
   /// Contains last result of calling recordTokens().
   TokenBuffer Buffer = TokenBuffer(*SourceMgr);
+  /// Whether recordTokens() builds the buffer from a TokenLog.
+  bool RecordLog = false;
 };
 
 TEST_F(TokenCollectorTest, RawMode) {
@@ -626,6 +630,44 @@ file './bar.h'
       << "input: " << Code << "\nresults: " << collectAndDump(Code);
 }
 
+TEST_F(TokenCollectorTest, Log) {
+  addFile("./module.h", R"cpp(
+    #define SC_MODULE(Name) struct Name : ::sc_module
+    #define SC_CTOR(Name) Name(const char *n)
+    #define SC_METHOD(F) declare_method(#F, &SC_CURRENT::F)
+    #define SC_LINE __LINE__
+    #define CAT(A, B) A ## B
+    #define EMPTY
+    #define ID(X) X
+    struct sc_module { void declare_method(const char *, ...); };
+  )cpp");
+  llvm::StringLiteral Cases[] = {
+      R"cpp(
+    #include "module.h"
+    #define SC_CURRENT Counter
+    SC_MODULE(Counter) {
+      SC_CTOR(Counter) { SC_METHOD(tick); EMPTY }
+      void tick();
+      int CAT(li, ne) = SC_LINE;
+      const char *s = ID(ID("a\
+b"));
+    };
+  )cpp",
+      "#include \"module.h\"\nin\\\nt a = ID(i\\\nnt(1)) EMPTY;",
+      // The file ends in a macro expansion.
+      "#include \"module.h\"\nint CAT(a, b) ID(;)",
+      // An empty file.
+      "",
+  };
+
+  for (llvm::StringRef Code : Cases) {
+    RecordLog = false;
+    std::string Expected = collectAndDump(Code);
+    RecordLog = true;
+    EXPECT_EQ(Expected, collectAndDump(Code)) << "input: " << Code;
+  }
+}
+
 class TokenBufferTest : public TokenCollectorTest {};
 
 TEST_F(TokenBufferTest, SpelledByExpanded) {